@@ -0,0 +1,7 @@
+/* this file is autogenerated by make autover.h
+ * DO NOT EDIT IT
+ */
+
+#define REPO_VER "16cb70-dirty"
+#define REPO_HASH "16cb70"
+#define REPO_STATE "-dirty"
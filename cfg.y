@@ -204,6 +204,24 @@
 	#define IF_RAW_SOCKS(x) warn("raw socket support not compiled in")
 #endif
 
+#ifdef SO_REUSEPORT
+	#define IF_REUSEPORT(x) x
+#else
+	#define IF_REUSEPORT(x) warn("SO_REUSEPORT not supported")
+#endif
+
+#ifdef HAVE_RECVMMSG
+	#define IF_RECVMMSG(x) x
+#else
+	#define IF_RECVMMSG(x) warn("recvmmsg support not compiled in")
+#endif
+
+#ifdef HAVE_SENDMMSG
+	#define IF_SENDMMSG(x) x
+#else
+	#define IF_SENDMMSG(x) warn("sendmmsg support not compiled in")
+#endif
+
 
 extern int yylex();
 /* safer then using yytext which can be array or pointer */
@@ -337,6 +355,9 @@ extern char *default_routename;
 %token UDP4_RAW
 %token UDP4_RAW_MTU
 %token UDP4_RAW_TTL
+%token UDP_RCV_BATCH
+%token UDP_SND_BATCH
+%token UDP_REUSE_PORT
 %token IF
 %token ELSE
 %token SET_ADV_ADDRESS
@@ -455,6 +476,8 @@ extern char *default_routename;
 %token MEMJOIN
 %token CORELOG
 %token SIP_WARNING
+%token SIP_HDR_INDEX
+%token FWD_ZERO_COPY
 %token SERVER_SIGNATURE
 %token SERVER_HEADER
 %token USER_AGENT_HEADER
@@ -499,6 +522,7 @@ extern char *default_routename;
 %token TCP_OPT_CRLF_PING
 %token TCP_OPT_ACCEPT_NO_CL
 %token TCP_CLONE_RCVBUF
+%token TCP_REUSE_PORT
 %token DISABLE_TLS
 %token ENABLE_TLS
 %token TLSLOG
@@ -524,6 +548,7 @@ extern char *default_routename;
 %token OPEN_FD_LIMIT
 %token SHM_MEM_SZ
 %token SHM_FORCE_ALLOC
+%token SHM_CACHE
 %token MLOCK_PAGES
 %token REAL_TIME
 %token RT_PRIO
@@ -532,6 +557,7 @@ extern char *default_routename;
 %token RT_TIMER1_POLICY
 %token RT_TIMER2_PRIO
 %token RT_TIMER2_POLICY
+%token TIMER_SHARDS
 %token MCAST_LOOPBACK
 %token MCAST_TTL
 %token TOS
@@ -972,6 +998,10 @@ assign_stm:
 	| CORELOG EQUAL error { yyerror("int value expected"); }
 	| SIP_WARNING EQUAL NUMBER { sip_warning=$3; }
 	| SIP_WARNING EQUAL error { yyerror("boolean value expected"); }
+	| SIP_HDR_INDEX EQUAL NUMBER { sip_hdr_index=$3; }
+	| SIP_HDR_INDEX EQUAL error { yyerror("boolean value expected"); }
+	| FWD_ZERO_COPY EQUAL NUMBER { fwd_zero_copy=$3; }
+	| FWD_ZERO_COPY EQUAL error { yyerror("boolean value expected"); }
 	| VERSION_TABLE_CFG EQUAL STRING { version_table.s=$3;
 			version_table.len=strlen(version_table.s);
 	}
@@ -1265,6 +1295,14 @@ assign_stm:
 		#endif
 	}
 	| TCP_CLONE_RCVBUF EQUAL error { yyerror("number expected"); }
+	| TCP_REUSE_PORT EQUAL NUMBER {
+		#if defined(USE_TCP) && defined(TCP_ASYNC)
+			IF_REUSEPORT(tcp_reuse_port=$3);
+		#else
+			warn("tcp or tcp async support not compiled in");
+		#endif
+	}
+	| TCP_REUSE_PORT EQUAL error { yyerror("boolean value expected"); }
 	| DISABLE_TLS EQUAL NUMBER {
 		#ifdef USE_TLS
 			tls_disable=$3;
@@ -1505,6 +1543,17 @@ assign_stm:
 			shm_force_alloc=$3;
 	}
 	| SHM_FORCE_ALLOC EQUAL error { yyerror("boolean value expected"); }
+	| SHM_CACHE EQUAL NUMBER {
+		#ifndef SHM_SAFE_MALLOC
+			if ($3<0 || $3>SHM_CACHE_MAX)
+				yyerror("invalid shm_cache value (0 - 256)");
+			else
+				shm_cache_size=$3;
+		#else
+			warn("shm_cache not supported by the shm allocator");
+		#endif
+	}
+	| SHM_CACHE EQUAL error { yyerror("number expected"); }
 	| MLOCK_PAGES EQUAL NUMBER { mlock_pages=$3; }
 	| MLOCK_PAGES EQUAL error { yyerror("boolean value expected"); }
 	| REAL_TIME EQUAL NUMBER { real_time=$3; }
@@ -1521,6 +1570,8 @@ assign_stm:
 	| RT_TIMER2_PRIO EQUAL error { yyerror("boolean value expected"); }
 	| RT_TIMER2_POLICY EQUAL NUMBER { rt_timer2_policy=$3; }
 	| RT_TIMER2_POLICY EQUAL error { yyerror("boolean value expected"); }
+	| TIMER_SHARDS EQUAL NUMBER { timer_shards=$3; }
+	| TIMER_SHARDS EQUAL error { yyerror("number expected"); }
 	| MCAST_LOOPBACK EQUAL NUMBER {
 		#ifdef USE_MCAST
 			mcast_loopback=$3;
@@ -1610,6 +1661,12 @@ assign_stm:
 		IF_RAW_SOCKS(default_core_cfg.udp4_raw_ttl=$3);
 	}
 	| UDP4_RAW_TTL EQUAL error { yyerror("number expected"); }
+	| UDP_RCV_BATCH EQUAL NUMBER { IF_RECVMMSG(udp_rcv_batch=$3); }
+	| UDP_RCV_BATCH EQUAL error { yyerror("number expected"); }
+	| UDP_SND_BATCH EQUAL NUMBER { IF_SENDMMSG(udp_snd_batch=$3); }
+	| UDP_SND_BATCH EQUAL error { yyerror("number expected"); }
+	| UDP_REUSE_PORT EQUAL NUMBER { IF_REUSEPORT(udp_reuse_port=$3); }
+	| UDP_REUSE_PORT EQUAL error { yyerror("number expected"); }
 	| cfg_var
 	| error EQUAL { yyerror("unknown config variable"); }
 	;
@@ -496,6 +496,12 @@ static void core_shmmem(rpc_t* rpc, void* c)
 	void *handle;
 	char* param;
 	long rs;
+#ifndef SHM_SAFE_MALLOC
+	struct shm_cache_stats st;
+	void *ah;
+	void *ph;
+	int i;
+#endif
 
 	rs=0;
 	/* look for optional size/divisor parameter */
@@ -536,12 +542,38 @@ static void core_shmmem(rpc_t* rpc, void* c)
 		"max_used", (unsigned int)(mi.max_used>>rs),
 		"fragments", (unsigned int)mi.total_frags
 	);
+#ifndef SHM_SAFE_MALLOC
+	/* per process fragment caches */
+	if (shm_cache_size==0)
+		return;
+	if (rpc->struct_add(handle, "[", "cache", &ah)<0)
+		return;
+	for (i=0; i<get_proc_no(); i++){
+		if (shm_cache_get_stats(i, &st)<0)
+			break;
+		if (rpc->array_add(ah, "{", &ph)<0)
+			return;
+		rpc->struct_add(ph, "dsdddddd",
+			"pid", pt[i].pid,
+			"desc", pt[i].desc,
+			"hits", (unsigned int)st.hits,
+			"misses", (unsigned int)st.misses,
+			"hit_rate", (st.hits+st.misses)?
+							(int)(st.hits*100/(st.hits+st.misses)):0,
+			"frees", (unsigned int)st.frees,
+			"flushes", (unsigned int)st.flushes,
+			"drains", (unsigned int)st.drains
+		);
+	}
+#endif
 }
 
 static const char* core_shmmem_doc[] = {
 	"Returns shared memory info. It has an optional parameter that specifies"
 	" the measuring unit: b - bytes (default), k or kb, m or mb, g or gb. "
-	"Note: when using something different from bytes, the value is truncated.",
+	"Note: when using something different from bytes, the value is truncated."
+	" With shm_cache enabled, it returns also the fragment cache stats of"
+	" each process (hit_rate in percents).",
 	0                               /* Method signature(s) */
 };
 
@@ -682,6 +714,13 @@ static void core_tcpinfo(rpc_t* rpc, void* c)
 			"opened_tls_connections", ti.tls_connections_no,
 			"write_queued_bytes", ti.tcp_write_queued
 		);
+		if (ti.owned_readers>0)
+			/* tcp readers owning their connections (tcp_reuse_port) */
+			rpc->struct_add(handle, "ddd",
+				"owned_connections", ti.owned_connections,
+				"owned_accepted", (int)ti.owned_accepted,
+				"owned_handoffs", (int)ti.owned_handoffs
+			);
 	}else{
 		rpc->fault(c, 500, "tcp support disabled");
 	}
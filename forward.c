@@ -462,6 +462,8 @@ int forward_request(struct sip_msg* msg, str* dst, unsigned short port,
 	struct ip_addr ip; /* debugging only */
 	char proto;
 	struct onsend_info onsnd_info = {0};
+	struct msg_sg sg;
+	int use_sg;
 #ifdef USE_DNS_FAILOVER
 	struct socket_info* prev_send_sock;
 	int err;
@@ -476,6 +478,10 @@ int forward_request(struct sip_msg* msg, str* dst, unsigned short port,
 	orig_send_sock=send_info->send_sock;
 	proto=send_info->proto;
 	ret=0;
+	msg_sg_init(&sg);
+	/* onsend_route and the onsend info need the message in one buffer */
+	use_sg=fwd_zero_copy && !onsend_route_enabled(SIP_REQUEST) &&
+			!_forward_set_send_info;
 
 	if(dst){
 #ifdef USE_DNS_FAILOVER
@@ -543,17 +549,29 @@ int forward_request(struct sip_msg* msg, str* dst, unsigned short port,
 #endif
 			if (buf) pkg_free(buf);
 			send_info->proto=proto;
-			buf = build_req_buf_from_sip_req(msg, &len, send_info, 0);
-			if (!buf){
-				LM_ERR("building failed\n");
-				ret=E_OUT_OF_MEM; /* most probable */
-				goto error;
+			if (use_sg){
+				msg_sg_free(&sg);
+				buf=0;
+				if (build_req_sg_from_sip_req(msg, &sg, send_info, 0)<0){
+					LM_ERR("building failed\n");
+					ret=E_OUT_OF_MEM; /* most probable */
+					goto error;
+				}
+				len=sg.len;
+			}else{
+				buf = build_req_buf_from_sip_req(msg, &len, send_info, 0);
+				if (!buf){
+					LM_ERR("building failed\n");
+					ret=E_OUT_OF_MEM; /* most probable */
+					goto error;
+				}
 			}
 #ifdef USE_DNS_FAILOVER
 		}
 #endif
 		 /* send it! */
-		LM_DBG("Sending:\n%.*s.\n", (int)len, buf);
+		if (buf)
+			LM_DBG("Sending:\n%.*s.\n", (int)len, buf);
 		LM_DBG("orig. len=%d, new_len=%d, proto=%d\n",
 				msg->len, len, send_info->proto );
 	
@@ -594,7 +612,8 @@ int forward_request(struct sip_msg* msg, str* dst, unsigned short port,
 			p_onsend=&onsnd_info;
 		}
 
-		if (msg_send(send_info, buf, len)<0){
+		if ((use_sg?msg_send_sg(send_info, &sg):msg_send(send_info, buf, len))
+				<0){
 			p_onsend=0;
 			ret=ser_error=E_SEND;
 #ifdef USE_DST_BLACKLIST
@@ -636,6 +655,7 @@ end:
 	}
 #endif
 	if (buf) pkg_free(buf);
+	msg_sg_free(&sg);
 	/* received_buf & line_buf will be freed in receive_msg by free_lump_list*/
 #if defined STATS_REQ_FWD_OK || defined STATS_REQ_FWD_DROP
 	if(ret==0)
@@ -723,12 +743,15 @@ static int do_forward_reply(struct sip_msg* msg, int mode)
 	unsigned int new_len;
 	int r;
 	struct ip_addr ip;
+	struct msg_sg sg;
+	int use_sg;
 #ifdef USE_TCP
 	char* s;
 	int len;
 #endif
 	init_dest_info(&dst);
 	new_buf=0;
+	msg_sg_init(&sg);
 	/*check if first via host = us */
 	if (check_via){
 		if (check_self(&msg->via1->host,
@@ -755,10 +778,20 @@ static int do_forward_reply(struct sip_msg* msg, int mode)
 		goto error;
 	}
 
-	new_buf = build_res_buf_from_sip_res( msg, &new_len);
-	if (!new_buf){
-		LM_ERR("building failed\n");
-		goto error;
+	/* onsend_route needs the reply in one buffer */
+	use_sg=fwd_zero_copy && !onsend_route_enabled(SIP_REPLY);
+	if (use_sg){
+		if (build_res_sg_from_sip_res(msg, &sg)<0){
+			LM_ERR("building failed\n");
+			goto error;
+		}
+		new_len=sg.len;
+	}else{
+		new_buf = build_res_buf_from_sip_res( msg, &new_len);
+		if (!new_buf){
+			LM_ERR("building failed\n");
+			goto error;
+		}
 	}
 
 	dst.proto=msg->via2->proto;
@@ -819,7 +852,7 @@ static int do_forward_reply(struct sip_msg* msg, int mode)
 		}
 	}
 
-	if (msg_send(&dst, new_buf, new_len)<0)
+	if ((use_sg?msg_send_sg(&dst, &sg):msg_send(&dst, new_buf, new_len))<0)
 	{
 		STATS_RPL_FWD_DROP();
 		goto error;
@@ -835,11 +868,13 @@ static int do_forward_reply(struct sip_msg* msg, int mode)
 			(unsigned short) msg->via2->port);
 
 	STATS_RPL_FWD_OK();
-	pkg_free(new_buf);
+	if (new_buf) pkg_free(new_buf);
+	msg_sg_free(&sg);
 skip:
 	return 0;
 error:
 	if (new_buf) pkg_free(new_buf);
+	msg_sg_free(&sg);
 	return -1;
 }
 
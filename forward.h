@@ -33,6 +33,7 @@
 #include "route.h"
 #include "proxy.h"
 #include "ip_addr.h"
+#include "msg_translator.h"
 
 #include "stats.h"
 #include "udp_server.h"
@@ -274,4 +275,40 @@ error:
 	return -1;
 }
 
+
+/* same as msg_send(), but for a message built as a scatter/gather list
+ * (see build_req_sg_from_sip_req()): over udp the chunks are sent directly
+ * with sendmsg(), for the other protocols or if the outgoing buffer can be
+ * changed by event callbacks they are copied first in one buffer
+ * returns: 0 if ok, -1 on error */
+static inline int msg_send_sg(struct dest_info* dst, struct msg_sg* sg)
+{
+	struct dest_info new_dst;
+	char* buf;
+
+	if (likely(dst->proto==PROTO_UDP && sg->buf==0 &&
+				!sr_event_enabled(SREV_NET_DATA_OUT))){
+		if (unlikely((dst->send_sock==0) ||
+					(dst->send_sock->flags & SI_IS_MCAST))){
+			new_dst=*dst;
+			new_dst.send_sock=get_send_socket(0, &dst->to, dst->proto);
+			if (unlikely(new_dst.send_sock==0)){
+				LM_ERR("no sending socket found\n");
+				return -1;
+			}
+			dst=&new_dst;
+		}
+		if (unlikely(udp_send_iov(dst, sg->iov, sg->iov_no, sg->len)==-1)){
+			STATS_TX_DROPS;
+			LOG(cfg_get(core, core_cfg, corelog), "udp_send_iov failed\n");
+			return -1;
+		}
+		return 0;
+	}
+	buf=msg_sg_flatten(sg);
+	if (unlikely(buf==0))
+		return -1;
+	return msg_send(dst, buf, sg->len);
+}
+
 #endif
@@ -91,6 +91,10 @@ extern unsigned int maxbuffer;
 extern unsigned int sql_buffer_size;
 extern int children_no;
 extern int socket_workers;
+extern int udp_rcv_batch;
+extern int udp_snd_batch;
+extern int udp_reuse_port;
+extern int tcp_reuse_port;
 #ifdef USE_TCP
 extern int tcp_main_pid;
 extern int tcp_cfg_children_no;
@@ -116,6 +120,8 @@ extern int received_dns;
 /* extern int process_no; */
 extern int child_rank;
 extern int sip_warning;
+extern int sip_hdr_index;
+extern int fwd_zero_copy;
 extern int server_signature;
 extern str server_hdr;
 extern str user_agent_hdr;
@@ -211,6 +217,7 @@ extern int rt_timer1_prio;  /* "fast" timer */
 extern int rt_timer2_prio;  /* "slow" timer */
 extern int rt_timer1_policy; /* "fast" timer, SCHED_OTHER */
 extern int rt_timer2_policy; /* "slow" timer, SCHED_OTHER */
+extern int timer_shards; /* timer lists, each with its own lock */
 
 extern int http_reply_parse;
 
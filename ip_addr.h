@@ -116,6 +116,10 @@ struct socket_info{
 	int workers; /* number of worker processes for this socket */
 	int workers_tcpidx; /* index of workers in tcp children array */
 	struct advertise_info useinfo; /* details to be used in SIP msg */
+	int* rp_socket; /* SO_REUSEPORT sockets, one per udp worker
+					   (udp_reuse_port) or per tcp reader accepting
+					   on this socket (tcp_reuse_port) */
+	int rp_socket_no; /* size of rp_socket, 0 if not sharded */
 };
 
 
@@ -130,6 +130,10 @@ int db_check_api(db_func_t* dbf, char *mname)
 		dbf->cap |= DB_CAP_INSERT_UPDATE;
 	}
 
+	if (dbf->insert_update_bulk) {
+		dbf->cap |= DB_CAP_INSERT_UPDATE_BULK;
+	}
+
 	if (dbf->insert_delayed) {
 		dbf->cap |= DB_CAP_INSERT_DELAYED;
 	}
@@ -233,6 +237,8 @@ int db_bind_mod(const str* mod, db_func_t* mydbf)
 			"db_affected_rows", 1, 0);
 		dbf.insert_update = (db_insert_update_f)find_mod_export(tmp,
 			"db_insert_update", 2, 0);
+		dbf.insert_update_bulk = (db_insert_update_bulk_f)find_mod_export(tmp,
+			"db_insert_update_bulk", 2, 0);
 		dbf.insert_delayed = (db_insert_delayed_f)find_mod_export(tmp,
 			"db_insert_delayed", 2, 0);
 		dbf.start_transaction = (db_start_transaction_f)find_mod_export(tmp,
@@ -327,6 +327,26 @@ typedef int (*db_insert_update_f) (const db1_con_t* _h, const db_key_t* _k,
 				const db_val_t* _v, const int _n);
 
 
+/**
+ * \brief Insert many rows into a specified table, update on duplicate key.
+ *
+ * The function implements the INSERT ON DUPLICATE KEY UPDATE SQL directive
+ * for several rows at once, with a single statement. All the rows have the
+ * same columns, the values are stored row after row in the _v array.
+ * \param _h structure representing database connection
+ * \param _k key names
+ * \param _v values of the keys, _n*_nr elements
+ * \param _n number of key=value pairs in a row
+ * \param _nr number of rows
+ * \param _uk keys updated on duplicate key, all the _k keys if 0
+ * \param _un number of keys in _uk
+ * \return returns 0 if everything is OK, otherwise returns value < 0
+ */
+typedef int (*db_insert_update_bulk_f) (const db1_con_t* _h, const db_key_t* _k,
+				const db_val_t* _v, const int _n, const int _nr,
+				const db_key_t* _uk, const int _un);
+
+
 /**
  * \brief Insert delayed a row into the specified table.
  *
@@ -417,6 +437,7 @@ typedef struct db_func {
 	db_last_inserted_id_f  last_inserted_id;  /* Retrieve the last inserted ID
 	                                            in a table */
 	db_insert_update_f insert_update; /* Insert into table, update on duplicate key */ 
+	db_insert_update_bulk_f insert_update_bulk; /* Insert many rows, update on duplicate key */
 	db_insert_delayed_f insert_delayed;           /* Insert delayed into table */
 	db_insert_async_f insert_async;               /* Insert async into table */
 	db_affected_rows_f affected_rows; /* Numer of affected rows for last query */
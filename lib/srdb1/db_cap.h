@@ -47,7 +47,8 @@ typedef enum db_cap {
 	DB_CAP_LAST_INSERTED_ID = 1 << 7,  /*!< driver can return the ID of the last insert operation   */
 	DB_CAP_INSERT_UPDATE = 1 << 8, /*!< driver can insert data into database & update on duplicate  */
 	DB_CAP_INSERT_DELAYED = 1 << 9, /*!< driver can do insert delayed                                */
-	DB_CAP_AFFECTED_ROWS = 1 << 10 /*!< driver can return number of rows affected by the last query  */
+	DB_CAP_AFFECTED_ROWS = 1 << 10, /*!< driver can return number of rows affected by the last query  */
+	DB_CAP_INSERT_UPDATE_BULK = 1 << 11 /*!< driver can insert & update on duplicate many rows at once */
 } db_cap_t;
 
 
@@ -0,0 +1,165 @@
+/*
+ * snapfile - writing of snapshot files
+ *
+ * Copyright (C) 2015 kamailio.org
+ *
+ * This file is part of Kamailio, a free SIP server.
+ *
+ * Kamailio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * Kamailio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+/*!
+* \file
+* \brief srutils :: Snapshot files
+* \ingroup srutils
+* Module: \ref srutils
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "../../dprint.h"
+#include "../../mem/mem.h"
+
+#include "snapfile.h"
+
+/*!
+ * \brief Start writing a snapshot file
+ * \param sf snapshot file
+ * \param name zero terminated name of the snapshot
+ * \param head header, written again by snapfile_close()
+ * \param hsize size of the header
+ * \return 0 on success, -1 on failure
+ */
+int snapfile_open(snapfile_t *sf, str *name, void *head, int hsize)
+{
+	memset(sf, 0, sizeof(snapfile_t));
+	sf->tmpname = (char*)pkg_malloc(name->len + 5);
+	if(sf->tmpname==NULL) {
+		LM_ERR("no more pkg memory\n");
+		return -1;
+	}
+	memcpy(sf->tmpname, name->s, name->len);
+	memcpy(sf->tmpname + name->len, ".tmp", 5);
+	sf->name = name->s;
+
+	sf->f = fopen(sf->tmpname, "w");
+	if(sf->f==NULL) {
+		LM_ERR("cannot open file %s: %s\n", sf->tmpname, strerror(errno));
+		pkg_free(sf->tmpname);
+		sf->tmpname = NULL;
+		return -1;
+	}
+	if(fwrite(head, hsize, 1, sf->f)!=1) {
+		snapfile_abort(sf);
+		return -1;
+	}
+	return 0;
+}
+
+/*!
+ * \brief Add a record to the buffer of the snapshot
+ * \param sf snapshot file
+ * \param size size of the record, the space returned is SNAPFILE_ALIGN(size)
+ * with the padding zeroed
+ * \return the space of the record, NULL when out of memory
+ */
+char* snapfile_rec(snapfile_t *sf, int size)
+{
+	char *p;
+
+	size = SNAPFILE_ALIGN(size);
+	if(sf->len + size > sf->size) {
+		p = (char*)pkg_realloc(sf->buf, 2*(sf->len + size));
+		if(p==NULL) {
+			LM_ERR("no more pkg memory\n");
+			return NULL;
+		}
+		sf->buf = p;
+		sf->size = 2*(sf->len + size);
+	}
+	p = sf->buf + sf->len;
+	memset(p, 0, size);
+	sf->len += size;
+	sf->records++;
+	return p;
+}
+
+/*!
+ * \brief Write the buffered records to the file
+ * \return 0 on success, -1 on failure (then snapfile_abort() the file)
+ */
+int snapfile_flush(snapfile_t *sf)
+{
+	if(sf->len<=0)
+		return 0;
+	if(fwrite(sf->buf, sf->len, 1, sf->f)!=1)
+		return -1;
+	sf->len = 0;
+	return 0;
+}
+
+/*!
+ * \brief Finish the snapshot: writes the rest of the records and the
+ * final header, syncs the file and renames it over the old snapshot
+ * \return 0 on success, -1 on failure (the old snapshot is kept)
+ */
+int snapfile_close(snapfile_t *sf, void *head, int hsize)
+{
+	if(snapfile_flush(sf)<0)
+		goto error;
+	if(fseek(sf->f, 0, SEEK_SET)!=0
+			|| fwrite(head, hsize, 1, sf->f)!=1
+			|| fflush(sf->f)!=0 || fsync(fileno(sf->f))!=0)
+		goto error;
+	if(fclose(sf->f)!=0) {
+		sf->f = NULL;
+		goto error;
+	}
+	sf->f = NULL;
+	if(rename(sf->tmpname, sf->name)<0) {
+		LM_ERR("cannot rename %s to %s: %s\n", sf->tmpname, sf->name,
+				strerror(errno));
+		goto error;
+	}
+	if(sf->buf)
+		pkg_free(sf->buf);
+	pkg_free(sf->tmpname);
+	memset(sf, 0, sizeof(snapfile_t));
+	return 0;
+
+error:
+	snapfile_abort(sf);
+	return -1;
+}
+
+/*!
+ * \brief Drop the snapshot being written, the old one is kept
+ */
+void snapfile_abort(snapfile_t *sf)
+{
+	if(sf->tmpname==NULL)
+		return;
+	LM_ERR("failed to write snapshot %s (%s)\n", sf->tmpname,
+			strerror(errno));
+	if(sf->f)
+		fclose(sf->f);
+	unlink(sf->tmpname);
+	if(sf->buf)
+		pkg_free(sf->buf);
+	pkg_free(sf->tmpname);
+	memset(sf, 0, sizeof(snapfile_t));
+}
@@ -0,0 +1,59 @@
+/*
+ * snapfile - writing of snapshot files
+ *
+ * Copyright (C) 2015 kamailio.org
+ *
+ * This file is part of Kamailio, a free SIP server.
+ *
+ * Kamailio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * Kamailio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+/*!
+* \file
+* \brief srutils :: Snapshot files
+* \ingroup srutils
+* Module: \ref srutils
+*
+* A snapshot file is a header followed by records aligned to 8 bytes. It
+* is written to name.tmp and renamed over the old file once complete and
+* synced, so a crash while writing keeps the previous snapshot. The
+* records are collected in a pkg buffer, to be added under a lock and
+* written with snapfile_flush() once the lock is released.
+*/
+
+#ifndef _SR_SNAPFILE_H_
+#define _SR_SNAPFILE_H_
+
+#include <stdio.h>
+#include "../../str.h"
+
+#define SNAPFILE_ALIGN(_s) (((_s) + 7) & ~7)
+
+typedef struct snapfile {
+	char *name;            /* zero terminated name of the snapshot */
+	char *tmpname;         /* file written before the rename */
+	FILE *f;
+	char *buf;             /* records not written yet */
+	int len;
+	int size;
+	unsigned int records;  /* records added since open */
+} snapfile_t;
+
+int snapfile_open(snapfile_t *sf, str *name, void *head, int hsize);
+char* snapfile_rec(snapfile_t *sf, int size);
+int snapfile_flush(snapfile_t *sf);
+int snapfile_close(snapfile_t *sf, void *head, int hsize);
+void snapfile_abort(snapfile_t *sf);
+
+#endif
@@ -290,6 +290,14 @@ unsigned int sql_buffer_size = 65535; /* Size for the SQL buffer. Defaults to 64
 int socket_workers = 0;		/* number of workers processing requests for a socket
 							   - it's reset everytime with a new listen socket */
 int children_no = 0;		/* number of children processing requests */
+int udp_rcv_batch = 0;		/* max datagrams read with one recvmmsg()
+							   by an udp receiver, 0 or 1 - recvfrom() */
+int udp_snd_batch = 0;		/* 1 if udp replies generated while processing
+							   a received batch are sent with sendmmsg() */
+int udp_reuse_port = 0;		/* 1 - one SO_REUSEPORT socket per udp worker,
+							   2 - same plus cpu based steering (cbpf) */
+int tcp_reuse_port = 0;		/* 1 - the tcp readers accept on their own
+							   SO_REUSEPORT sockets and keep the connections */
 #ifdef USE_TCP
 int tcp_cfg_children_no = 0; /* set via config or command line option */
 int tcp_children_no = 0; /* based on socket_workers and tcp_cfg_children_no */
@@ -335,6 +343,11 @@ int timerlog = L_WARN;
    good for trouble-shooting
 */
 int sip_warning = 0;
+/* if 1, index the header field types of the received messages */
+int sip_hdr_index = 0;
+/* if 1, stateless forwarded messages are sent as scatter/gather lists
+ * pointing into the received message, without building a copy */
+int fwd_zero_copy = 0;
 /* should localy-generated messages include server's signature?
    be default yes, good for trouble-shooting
 */
@@ -394,6 +407,7 @@ int rt_timer1_prio=0;  /* "fast" timer */
 int rt_timer2_prio=0;  /* "slow" timer */
 int rt_timer1_policy=0; /* "fast" timer, SCHED_OTHER */
 int rt_timer2_policy=0; /* "slow" timer, SCHED_OTHER */
+int timer_shards=1; /* timer lists, each with its own lock */
 
 
 /* a hint to reply modules whether they should send reply
@@ -1396,6 +1410,10 @@ int main_loop(void)
 			/* create the listening socket (for each address)*/
 			/* udp */
 			if (udp_init(si)==-1) goto error;
+			/* one socket per worker for SO_REUSEPORT sharding */
+			if (udp_reuse_port && udp_init_reuse_port(si,
+						(si->workers>0)?si->workers:children_no)==-1)
+				goto error;
 			/* get first ipv4/ipv6 socket*/
 			if ((si->address.af==AF_INET)&&
 					((sendipv4==0)||(sendipv4->flags&(SI_IS_LO|SI_IS_MCAST))))
@@ -1495,6 +1513,9 @@ int main_loop(void)
 			}
 		}
 #endif /* USE_TLS */
+		/* listen sockets of the tcp readers accepting directly */
+		if (!tcp_disable && tcp_reuse_port && tcp_reuse_port_init()<0)
+			goto error;
 #endif /* USE_TCP */
 
 			/* all processes should have access to all the sockets (for 
@@ -1567,6 +1588,8 @@ int main_loop(void)
 				}else if (pid==0){
 					/* child */
 					bind_address=si; /* shortcut */
+					if (si->rp_socket_no>0)
+						udp_reuse_port_child_init(si, i);
 #ifdef STATS
 					setstats( i+r*children_no );
 #endif
@@ -2480,6 +2503,10 @@ try_again:
 	 * processes registered from the modules*/
 	if (init_pt(calc_proc_no())==-1)
 		goto error;
+#ifndef SHM_SAFE_MALLOC
+	if (shm_cache_init(get_max_procs())<0)
+		goto error;
+#endif
 #ifdef USE_TCP
 #ifdef USE_TLS
 	if (!tls_disable){
@@ -30,6 +30,7 @@
 #include "shm_mem.h"
 #include "../config.h"
 #include "../globals.h"
+#include "../compiler_opt.h"
 #include "memdbg.h"
 
 #ifdef  SHM_MMAP
@@ -71,6 +72,287 @@ static void* shm_mempool=(void*)-1;
 #endif
 
 
+#ifndef SHM_SAFE_MALLOC
+
+int shm_cache_size=0;
+
+/* magazine of free fragments of the same size class */
+struct shm_cache_mag{
+	unsigned int no;
+	void* frags[SHM_CACHE_MAX];
+};
+
+/* per process, class c holds fragments of at least c*SHM_CACHE_CLASS_SIZE
+ * bytes (class 0 is not used) */
+static struct shm_cache_mag shm_cache[SHM_CACHE_CLASSES+1];
+/* per process stats, in shm after shm_cache_init(), indexed by process_no */
+static struct shm_cache_stats shm_cache_init_stats;
+static struct shm_cache_stats* shm_cache_stats_lst=0;
+static int shm_cache_stats_no=0;
+static struct shm_cache_stats* shm_cache_crt=&shm_cache_init_stats;
+/* flush requests, in shm: a process which runs out of shared memory bumps
+ * the generation and every process gives back its cached fragments on its
+ * next shm_malloc()/shm_free() after seeing a new one */
+static volatile unsigned int* shm_cache_flush_gen=0;
+static unsigned int shm_cache_gen=0; /* last generation seen */
+
+
+/* allocs the per process stats, must be called before forking,
+ * with the max. number of processes */
+int shm_cache_init(int procs)
+{
+	if (shm_cache_size<0 || shm_cache_size>SHM_CACHE_MAX){
+		LM_ERR("invalid shm_cache value %d (0 - %d)\n",
+				shm_cache_size, SHM_CACHE_MAX);
+		return -1;
+	}
+	if (shm_cache_size==0)
+		return 0;
+	shm_cache_stats_lst=shm_malloc(procs*sizeof(struct shm_cache_stats));
+	if (shm_cache_stats_lst==0){
+		LM_ERR("out of shared memory\n");
+		return -1;
+	}
+	memset(shm_cache_stats_lst, 0, procs*sizeof(struct shm_cache_stats));
+	shm_cache_flush_gen=shm_malloc(sizeof(*shm_cache_flush_gen));
+	if (shm_cache_flush_gen==0){
+		LM_ERR("out of shared memory\n");
+		shm_free(shm_cache_stats_lst);
+		shm_cache_stats_lst=0;
+		return -1;
+	}
+	*shm_cache_flush_gen=0;
+	shm_cache_stats_no=procs;
+	shm_cache_crt=&shm_cache_stats_lst[0];
+	*shm_cache_crt=shm_cache_init_stats;
+	return 0;
+}
+
+
+
+/* the fragments cached by the parent are not ours, forget them */
+void shm_cache_on_fork(void)
+{
+	int c;
+
+	for (c=0; c<=SHM_CACHE_CLASSES; c++)
+		shm_cache[c].no=0;
+	if (shm_cache_flush_gen)
+		shm_cache_gen=*shm_cache_flush_gen;
+	if (shm_cache_stats_lst && process_no<shm_cache_stats_no){
+		shm_cache_crt=&shm_cache_stats_lst[process_no];
+		memset(shm_cache_crt, 0, sizeof(*shm_cache_crt));
+	}else{
+		shm_cache_crt=&shm_cache_init_stats;
+	}
+}
+
+
+
+/* returns 0 and fills st with the cache stats of process proc
+ * or -1 if not available */
+int shm_cache_get_stats(int proc, struct shm_cache_stats* st)
+{
+	if (shm_cache_stats_lst==0 || proc<0 || proc>=shm_cache_stats_no)
+		return -1;
+	*st=shm_cache_stats_lst[proc];
+	return 0;
+}
+
+
+
+/* gives back all the fragments cached by this process,
+ * the shm lock must be held */
+#ifdef DBG_QM_MALLOC
+static void shm_cache_drain_unsafe(const char* file, const char* func,
+									int line)
+#else
+static void shm_cache_drain_unsafe(void)
+#endif
+{
+	int c;
+
+	for (c=1; c<=SHM_CACHE_CLASSES; c++){
+		while(shm_cache[c].no){
+			shm_cache[c].no--;
+#ifdef DBG_QM_MALLOC
+			MY_FREE(shm_block, shm_cache[c].frags[shm_cache[c].no],
+						file, func, line);
+#else
+			MY_FREE(shm_block, shm_cache[c].frags[shm_cache[c].no]);
+#endif
+		}
+	}
+	shm_cache_crt->drains++;
+	if (shm_cache_flush_gen)
+		shm_cache_gen=*shm_cache_flush_gen;
+}
+
+
+
+/* drains the cache if another process asked for it */
+#ifdef DBG_QM_MALLOC
+#define shm_cache_check_flush() \
+	do{ \
+		if (unlikely(shm_cache_flush_gen && \
+					*shm_cache_flush_gen!=shm_cache_gen)){ \
+			shm_lock(); \
+			shm_cache_drain_unsafe(file, func, line); \
+			shm_unlock(); \
+		} \
+	}while(0)
+#else
+#define shm_cache_check_flush() \
+	do{ \
+		if (unlikely(shm_cache_flush_gen && \
+					*shm_cache_flush_gen!=shm_cache_gen)){ \
+			shm_lock(); \
+			shm_cache_drain_unsafe(); \
+			shm_unlock(); \
+		} \
+	}while(0)
+#endif
+
+
+
+/* out of shared memory: gives back the fragments cached by this process,
+ * asks the other processes to do the same and retries once,
+ * the shm lock must be held */
+#ifdef DBG_QM_MALLOC
+static void* shm_cache_oom_unsafe(unsigned int size,
+			const char* file, const char* func, int line)
+#else
+static void* shm_cache_oom_unsafe(unsigned int size)
+#endif
+{
+	if (shm_cache_flush_gen)
+		(*shm_cache_flush_gen)++;
+#ifdef DBG_QM_MALLOC
+	shm_cache_drain_unsafe(file, func, line);
+	return MY_MALLOC(shm_block, size, file, func, line);
+#else
+	shm_cache_drain_unsafe();
+	return MY_MALLOC(shm_block, size);
+#endif
+}
+
+
+
+/* retries a failed allocation of a size which is not cached */
+#ifdef DBG_QM_MALLOC
+void* shm_cache_oom_malloc(unsigned int size,
+			const char* file, const char* func, int line)
+#else
+void* shm_cache_oom_malloc(unsigned int size)
+#endif
+{
+	void* p;
+
+	shm_lock();
+#ifdef DBG_QM_MALLOC
+	p=shm_cache_oom_unsafe(size, file, func, line);
+#else
+	p=shm_cache_oom_unsafe(size);
+#endif
+	shm_unlock();
+	return p;
+}
+
+
+
+#ifdef DBG_QM_MALLOC
+void* shm_cache_malloc(unsigned int size,
+			const char* file, const char* func, int line)
+#else
+void* shm_cache_malloc(unsigned int size)
+#endif
+{
+	struct shm_cache_mag* m;
+	unsigned int c;
+	unsigned int n;
+	void* p;
+
+	shm_cache_check_flush();
+	c=(size+SHM_CACHE_CLASS_SIZE-1)/SHM_CACHE_CLASS_SIZE;
+	if (unlikely(c==0))
+		c=1;
+	m=&shm_cache[c];
+	if (likely(m->no)){
+		shm_cache_crt->hits++;
+		return m->frags[--m->no];
+	}
+	/* empty, refill half of it with one lock */
+	shm_cache_crt->misses++;
+	n=(shm_cache_size+1)/2;
+	shm_lock();
+	for (; m->no<n; m->no++){
+#ifdef DBG_QM_MALLOC
+		p=MY_MALLOC(shm_block, c*SHM_CACHE_CLASS_SIZE, file, func, line);
+#else
+		p=MY_MALLOC(shm_block, c*SHM_CACHE_CLASS_SIZE);
+#endif
+		if (unlikely(p==0))
+			break;
+		m->frags[m->no]=p;
+	}
+	if (unlikely(m->no==0)){
+#ifdef DBG_QM_MALLOC
+		p=shm_cache_oom_unsafe(c*SHM_CACHE_CLASS_SIZE, file, func, line);
+#else
+		p=shm_cache_oom_unsafe(c*SHM_CACHE_CLASS_SIZE);
+#endif
+		shm_unlock();
+		return p;
+	}
+	shm_unlock();
+	return m->frags[--m->no];
+}
+
+
+
+/* returns 0 if p was added to the cache, -1 if it must be freed
+ * by the caller */
+#ifdef DBG_QM_MALLOC
+int shm_cache_free(void* p, const char* file, const char* func, int line)
+#else
+int shm_cache_free(void* p)
+#endif
+{
+	struct shm_cache_mag* m;
+	unsigned long size;
+	unsigned int n;
+
+	if (unlikely(p==0))
+		return -1;
+	shm_cache_check_flush();
+	size=MY_FRAG_SIZE(p);
+	if (size>SHM_CACHE_MAX_SIZE || size<SHM_CACHE_CLASS_SIZE)
+		return -1;
+	m=&shm_cache[size/SHM_CACHE_CLASS_SIZE];
+	if (unlikely(m->no>=shm_cache_size)){
+		/* full, flush half of it with one lock */
+		shm_cache_crt->flushes++;
+		n=shm_cache_size/2;
+		shm_lock();
+		while(m->no>n){
+			m->no--;
+#ifdef DBG_QM_MALLOC
+			MY_FREE(shm_block, m->frags[m->no], file, func, line);
+#else
+			MY_FREE(shm_block, m->frags[m->no]);
+#endif
+		}
+		shm_unlock();
+	}
+	shm_cache_crt->frees++;
+	m->frags[m->no++]=p;
+	return 0;
+}
+
+#endif /* SHM_SAFE_MALLOC */
+
+
+
 inline static void* sh_realloc(void* p, unsigned int size)
 {
 	void *r;
@@ -135,10 +135,12 @@
 #	define MY_STATUS fm_status
 #	define MY_MEMINFO	fm_info
 #	define MY_SUMS	fm_sums
+#	define MY_FRAG_SIZE(p) \
+		(((struct fm_frag*)((char*)(p)-sizeof(struct fm_frag)))->size)
 #	define  shm_malloc_init fm_malloc_init
 #	define shm_malloc_destroy(b) do{}while(0)
 #	define shm_available() fm_available(shm_block)
-#	define shm_malloc_on_fork() do{}while(0)
+#	define shm_malloc_on_fork() shm_cache_on_fork()
 #elif defined DL_MALLOC
 #	include "dl_malloc.h"
 	extern mspace shm_block;
@@ -148,9 +150,10 @@
 #	define MY_STATUS(...) 0
 #	define MY_SUMS do{}while(0)
 #	define MY_MEMINFO	mspace_info
+#	define MY_FRAG_SIZE(p) dlmalloc_usable_size(p)
 #	define  shm_malloc_init(buf, len, type) create_mspace_with_base(buf, len, 0)
 #	define shm_malloc_destroy(b) do{}while(0)
-#	define shm_malloc_on_fork() do{}while(0)
+#	define shm_malloc_on_fork() shm_cache_on_fork()
 #elif defined TLSF_MALLOC
 #	include "tlsf.h"
 	extern pool_t shm_block;
@@ -160,10 +163,11 @@
 #	define MY_STATUS tlsf_status
 #	define MY_MEMINFO	tlsf_meminfo
 #	define MY_SUMS tlsf_sums
+#	define MY_FRAG_SIZE(p) tlsf_block_size(p)
 #	define shm_malloc_init(mem, bytes, type) tlsf_create_with_pool((void*) mem, bytes)
 #	define shm_malloc_destroy(b) do{}while(0)
 #	define shm_available() tlsf_available(shm_block)
-#	define shm_malloc_on_fork() do{}while(0)
+#	define shm_malloc_on_fork() shm_cache_on_fork()
 #else
 #	include "q_malloc.h"
 	extern struct qm_block* shm_block;
@@ -173,15 +177,51 @@
 #	define MY_STATUS qm_status
 #	define MY_MEMINFO	qm_info
 #	define MY_SUMS	qm_sums
+#	define MY_FRAG_SIZE(p) \
+		(((struct qm_frag*)((char*)(p)-sizeof(struct qm_frag)))->size)
 #	define  shm_malloc_init qm_malloc_init
 #	define shm_malloc_destroy(b) do{}while(0)
 #	define shm_available() qm_available(shm_block)
-#	define shm_malloc_on_fork() do{}while(0)
+#	define shm_malloc_on_fork() shm_cache_on_fork()
 #endif
 
 #ifndef SHM_SAFE_MALLOC
 	extern gen_lock_t* mem_lock;
-#endif
+
+/* per process caches of free fragments, one for each size class, in front
+ * of the shm allocator: they are refilled from and flushed to the allocator
+ * in batches, so most of shm_malloc()/shm_free() calls for small sizes
+ * don't need the shm lock (enabled with the shm_cache core parameter) */
+#define SHM_CACHE_CLASS_SIZE	16U /* size class granularity */
+#define SHM_CACHE_MAX_SIZE	1024U /* bigger fragments are not cached */
+#define SHM_CACHE_CLASSES	(SHM_CACHE_MAX_SIZE/SHM_CACHE_CLASS_SIZE)
+#define SHM_CACHE_MAX	256 /* max. cached fragments per size class */
+
+struct shm_cache_stats{
+	unsigned long hits; /* allocations served from the cache */
+	unsigned long misses; /* allocations which refilled the cache */
+	unsigned long frees; /* fragments returned to the cache */
+	unsigned long flushes; /* frees which flushed the cache */
+	unsigned long drains; /* whole cache given back (out of memory) */
+};
+
+extern int shm_cache_size; /* cached fragments per size class, 0 - off */
+
+int shm_cache_init(int procs);
+void shm_cache_on_fork(void);
+int shm_cache_get_stats(int proc, struct shm_cache_stats* st);
+#ifdef DBG_QM_MALLOC
+void* shm_cache_malloc(unsigned int size,
+			const char* file, const char* func, int line);
+int shm_cache_free(void* p, const char* file, const char* func, int line);
+void* shm_cache_oom_malloc(unsigned int size,
+			const char* file, const char* func, int line);
+#else
+void* shm_cache_malloc(unsigned int size);
+int shm_cache_free(void* p);
+void* shm_cache_oom_malloc(unsigned int size);
+#endif /* DBG_QM_MALLOC */
+#endif /* SHM_SAFE_MALLOC */
 
 
 int shm_mem_init(int); /* calls shm_getmem & shm_mem_init_mallocs */
@@ -215,9 +255,13 @@ inline static void* _shm_malloc(unsigned int size,
 {
 	void *p;
 	
+	if (shm_cache_size && size<=SHM_CACHE_MAX_SIZE)
+		return shm_cache_malloc(size, file, function, line);
 	shm_lock();
 	p=MY_MALLOC(shm_block, size, file, function, line );
 	shm_unlock();
+	if (unlikely(p==0) && shm_cache_size)
+		p=shm_cache_oom_malloc(size, file, function, line);
 	return p; 
 }
 
@@ -243,12 +287,18 @@ inline static void* _shm_realloc(void *ptr, unsigned int size,
 #define shm_free_unsafe( _p  ) \
 	MY_FREE( shm_block, (_p), _SRC_LOC_, _SRC_FUNCTION_, _SRC_LINE_ )
 
-#define shm_free(_p) \
-do { \
-		shm_lock(); \
-		shm_free_unsafe( (_p)); \
-		shm_unlock(); \
-}while(0)
+inline static void _shm_free(void *p,
+		const char* file, const char* function, int line)
+{
+	if (shm_cache_size && shm_cache_free(p, file, function, line)==0)
+		return;
+	shm_lock();
+	MY_FREE(shm_block, p, file, function, line);
+	shm_unlock();
+}
+
+#define shm_free(_p) _shm_free((_p), \
+	_SRC_LOC_, _SRC_FUNCTION_, _SRC_LINE_ )
 
 
 
@@ -269,9 +319,13 @@ inline static void* shm_malloc(unsigned int size)
 {
 	void *p;
 	
+	if (shm_cache_size && size<=SHM_CACHE_MAX_SIZE)
+		return shm_cache_malloc(size);
 	shm_lock();
 	p=shm_malloc_unsafe(size);
 	shm_unlock();
+	if (unlikely(p==0) && shm_cache_size)
+		p=shm_cache_oom_malloc(size);
 	 return p; 
 }
 
@@ -289,12 +343,14 @@ inline static void* shm_realloc(void *ptr, unsigned int size)
 
 #define shm_free_unsafe( _p ) MY_FREE(shm_block, (_p))
 
-#define shm_free(_p) \
-do { \
-		shm_lock(); \
-		shm_free_unsafe( _p ); \
-		shm_unlock(); \
-}while(0)
+inline static void shm_free(void *p)
+{
+	if (shm_cache_size && shm_cache_free(p)==0)
+		return;
+	shm_lock();
+	shm_free_unsafe(p);
+	shm_unlock();
+}
 
 
 
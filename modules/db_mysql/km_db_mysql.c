@@ -107,6 +107,7 @@ int db_mysql_bind_api(db_func_t *dbb)
 	dbb->replace          = db_mysql_replace;
 	dbb->last_inserted_id = db_mysql_last_inserted_id;
 	dbb->insert_update    = db_mysql_insert_update;
+	dbb->insert_update_bulk = db_mysql_insert_update_bulk;
 	dbb->insert_delayed   = db_mysql_insert_delayed;
 	dbb->affected_rows    = db_mysql_affected_rows;
 	dbb->start_transaction= db_mysql_start_transaction;
@@ -826,6 +826,90 @@ error:
 }
 
 
+/**
+ * Insert many rows into a specified table with a single statement, update
+ * on duplicate key. The updated columns take the values of the inserted row.
+ * \param _h structure representing database connection
+ * \param _k key names
+ * \param _v values of the keys, row after row
+ * \param _n number of key=value pairs in a row
+ * \param _nr number of rows
+ * \param _uk keys updated on duplicate key, all the _k keys if 0
+ * \param _un number of keys in _uk
+ * \return zero on success, negative value on failure
+ */
+int db_mysql_insert_update_bulk(const db1_con_t* _h, const db_key_t* _k,
+	const db_val_t* _v, const int _n, const int _nr, const db_key_t* _uk,
+	const int _un)
+{
+	int off, ret, i, un;
+	static str  sql_str;
+
+	if ((!_h) || (!_k) || (!_v) || (_n<=0) || (_nr<=0) || (_uk && _un<=0)) {
+		LM_ERR("invalid parameter value\n");
+		return -1;
+	}
+	if (!_uk) {
+		_uk = _k;
+		un = _n;
+	} else {
+		un = _un;
+	}
+
+	ret = snprintf(mysql_sql_buf, sql_buffer_size, "insert into %s%.*s%s (",
+			CON_TQUOTESZ(_h), CON_TABLE(_h)->len, CON_TABLE(_h)->s, CON_TQUOTESZ(_h));
+	if (ret < 0 || ret >= sql_buffer_size) goto error;
+	off = ret;
+
+	ret = db_print_columns(mysql_sql_buf + off, sql_buffer_size - off, _k, _n, CON_TQUOTESZ(_h));
+	if (ret < 0) return -1;
+	off += ret;
+
+	ret = snprintf(mysql_sql_buf + off, sql_buffer_size - off, ") values ");
+	if (ret < 0 || ret >= (sql_buffer_size - off)) goto error;
+	off += ret;
+
+	for (i = 0; i < _nr; i++) {
+		if (off + 3 > sql_buffer_size) goto error;
+		if (i > 0)
+			*(mysql_sql_buf + off++) = ',';
+		*(mysql_sql_buf + off++) = '(';
+		ret = db_print_values(_h, mysql_sql_buf + off, sql_buffer_size - off,
+				_v + i * _n, _n, db_mysql_val2str);
+		if (ret < 0) return -1;
+		off += ret;
+		if (off + 1 > sql_buffer_size) goto error;
+		*(mysql_sql_buf + off++) = ')';
+	}
+
+	ret = snprintf(mysql_sql_buf + off, sql_buffer_size - off, " on duplicate key update ");
+	if (ret < 0 || ret >= (sql_buffer_size - off)) goto error;
+	off += ret;
+
+	for (i = 0; i < un; i++) {
+		ret = snprintf(mysql_sql_buf + off, sql_buffer_size - off,
+				"%s%s%.*s%s=values(%s%.*s%s)", (i > 0) ? "," : "",
+				CON_TQUOTESZ(_h), _uk[i]->len, _uk[i]->s, CON_TQUOTESZ(_h),
+				CON_TQUOTESZ(_h), _uk[i]->len, _uk[i]->s, CON_TQUOTESZ(_h));
+		if (ret < 0 || ret >= (sql_buffer_size - off)) goto error;
+		off += ret;
+	}
+
+	sql_str.s = mysql_sql_buf;
+	sql_str.len = off;
+
+	if (db_mysql_submit_query(_h, &sql_str) < 0) {
+		LM_ERR("error while submitting query\n");
+		return -2;
+	}
+	return 0;
+
+error:
+	LM_ERR("error while preparing insert_update_bulk operation\n");
+	return -1;
+}
+
+
 /**
  * Insert delayed a row into a specified table.
  * \param _h structure representing database connection
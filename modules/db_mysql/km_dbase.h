@@ -146,6 +146,14 @@ int db_mysql_insert_update(const db1_con_t* _h, const db_key_t* _k, const db_val
 	const int _n);
 
 
+/*! \brief
+ * Insert many rows into table, update on duplicate key
+ */
+int db_mysql_insert_update_bulk(const db1_con_t* _h, const db_key_t* _k,
+	const db_val_t* _v, const int _n, const int _nr, const db_key_t* _uk,
+	const int _un);
+
+
 /*! \brief
  * Insert a row into table
  */
@@ -73,6 +73,7 @@
 #include "dlg_load.h"
 #include "dlg_cb.h"
 #include "dlg_db_handler.h"
+#include "dlg_db_queue.h"
 #include "dlg_req_within.h"
 #include "dlg_profile.h"
 #include "dlg_var.h"
@@ -277,6 +278,7 @@ static param_export_t mod_params[]={
 	{ "db_update_period",      INT_PARAM, &db_update_period         },
 	{ "db_fetch_rows",         INT_PARAM, &db_fetch_rows            },
 	{ "profiles_with_value",   PARAM_STRING, &profiles_wv_s            },
+	{ "profiles_hash_size",    INT_PARAM, &dlg_profiles_hash_size      },
 	{ "profiles_no_value",     PARAM_STRING, &profiles_nv_s            },
 	{ "bridge_controller",     PARAM_STR, &dlg_bridge_controller  },
 	{ "bridge_contact",        PARAM_STR, &dlg_bridge_contact       },
@@ -289,6 +291,12 @@ static param_export_t mod_params[]={
 	{ "ka_interval",           INT_PARAM, &dlg_ka_interval          },
 	{ "timeout_noreset",       INT_PARAM, &dlg_timeout_noreset      },
 	{ "timer_procs",           PARAM_INT, &dlg_timer_procs          },
+	{ "lockfree_lookup",       PARAM_INT, &dlg_lockfree_lookup      },
+	{ "timer_wheel_size",      PARAM_INT, &dlg_timer_wheel_size     },
+	{ "db_async_procs",        PARAM_INT, &dlg_db_async_procs       },
+	{ "db_async_queue_size",   PARAM_INT, &dlg_db_async_queue_size  },
+	{ "db_async_batch",        PARAM_INT, &dlg_db_async_batch       },
+	{ "db_async_interval",     PARAM_INT, &dlg_db_async_interval    },
 	{ "track_cseq_updates",    PARAM_INT, &_dlg_track_cseq_updates  },
 	{ "lreq_callee_headers",   PARAM_STR, &dlg_lreq_callee_headers  },
 	{ 0,0,0 }
@@ -301,6 +309,12 @@ static stat_export_t mod_stats[] = {
 	{"processed_dialogs" ,  0,              &processed_dlgs    },
 	{"expired_dialogs" ,    0,              &expired_dlgs      },
 	{"failed_dialogs",      0,              &failed_dlgs       },
+	{"db_queue_depth",      STAT_IS_FUNC, (stat_var**)dlg_dbq_get_depth },
+	{"db_flush_time",       STAT_IS_FUNC, (stat_var**)dlg_dbq_get_flush_time },
+	{"db_flush_max_time",   STAT_IS_FUNC,
+		(stat_var**)dlg_dbq_get_flush_max_time },
+	{"db_flushed_rows",     STAT_IS_FUNC, (stat_var**)dlg_dbq_get_rows },
+	{"db_queue_overflows",  STAT_IS_FUNC, (stat_var**)dlg_dbq_get_overflows },
 	{0,0,0}
 };
 
@@ -563,6 +577,25 @@ static int mod_init(void)
 	if (dlg_enable_stats==0)
 		exports.stats = 0;
 
+	/* sanitize dlg_profiles_hash_size */
+	if (dlg_profiles_hash_size < 1){
+		LM_WARN("profiles_hash_size is smaller "
+				"then 1  -> rounding from %d to 1\n",
+				dlg_profiles_hash_size);
+		dlg_profiles_hash_size = 1;
+	}
+	for( n=0 ; n<(8*sizeof(n)) ; n++) {
+		if (dlg_profiles_hash_size==(1<<n))
+			break;
+		if (n && dlg_profiles_hash_size<(1<<n)) {
+			LM_WARN("profiles_hash_size is not a power "
+				"of 2 as it should be -> rounding from %d to %d\n",
+				dlg_profiles_hash_size, 1<<(n-1));
+			dlg_profiles_hash_size = 1<<(n-1);
+			break;
+		}
+	}
+
 	/* create profile hashes */
 	if (add_profile_definitions( profiles_nv_s, 0)!=0 ) {
 		LM_ERR("failed to add profiles without value\n");
@@ -677,6 +710,7 @@ static int mod_init(void)
 	dlg_db_mode = dlg_db_mode_param;
 	if (dlg_db_mode==DB_MODE_NONE) {
 		db_url.s = 0; db_url.len = 0;
+		dlg_db_async_procs = 0;
 	} else {
 		if (dlg_db_mode!=DB_MODE_REALTIME &&
 		dlg_db_mode!=DB_MODE_DELAYED && dlg_db_mode!=DB_MODE_SHUTDOWN ) {
@@ -687,6 +721,12 @@ static int mod_init(void)
 			LM_ERR("db_url not configured for db_mode %d\n", dlg_db_mode);
 			return -1;
 		}
+		if (dlg_db_mode==DB_MODE_SHUTDOWN)
+			dlg_db_async_procs = 0;
+		if (dlg_db_async_procs>0 && dlg_dbq_init()!=0) {
+			LM_ERR("failed to initialize the DB writers queue\n");
+			return -1;
+		}
 		if (init_dlg_db(&db_url, dlg_hash_size, db_update_period,db_fetch_rows)!=0) {
 			LM_ERR("failed to initialize the DB support\n");
 			return -1;
@@ -714,6 +754,13 @@ static int child_init(int rank)
 {
 	dlg_db_mode = dlg_db_mode_param;
 
+	if(rank==PROC_INIT) {
+		if(dlg_gc_init()<0) {
+			LM_ERR("failed to init the deferred free of dialogs\n");
+			return -1;
+		}
+	}
+
 	if(rank==PROC_MAIN) {
 		if(dlg_timer_procs>0) {
 			if(fork_sync_timer(PROC_TIMER, "Dialog Main Timer", 1 /*socks flag*/,
@@ -736,6 +783,9 @@ static int child_init(int rank)
 			LM_ERR("failed to start clean timer routine as process\n");
 			return -1; /* error */
 		}
+
+		if(dlg_db_async_procs>0 && dlg_dbq_fork_writers()<0)
+			return -1; /* error */
 	}
 
 	if (rank==1) {
@@ -771,6 +821,8 @@ static void mod_destroy(void)
 		dialog_update_db(0, 0);
 		destroy_dlg_db();
 	}
+	if(dlg_db_async_procs>0)
+		dlg_dbq_destroy(&db_url);
 	dlg_bridge_destroy_hdrs();
 	/* no DB interaction from now on */
 	dlg_db_mode = DB_MODE_NONE;
@@ -1659,8 +1711,8 @@ static void internal_rpc_profile_print_dlgs(rpc_t *rpc, void *c, str *profile_na
 	if (profile->has_value==0)
 		value=NULL;
 
-	lock_get( &profile->lock );
 	for ( i=0 ; i< profile->size ; i++ ) {
+		lock_get( &profile->entries[i].lock );
 		ph = profile->entries[i].first;
 		if(ph) {
 			do {
@@ -1672,7 +1724,7 @@ static void internal_rpc_profile_print_dlgs(rpc_t *rpc, void *c, str *profile_na
 				ph=ph->next;
 			}while(ph!=profile->entries[i].first);
 		}
-		lock_release(&profile->lock);
+		lock_release( &profile->entries[i].lock );
 	}
 }
 
@@ -41,6 +41,7 @@
 #include "dlg_var.h"
 #include "dlg_profile.h"
 #include "dlg_db_handler.h"
+#include "dlg_db_queue.h"
 
 
 str call_id_column			=	str_init(CALL_ID_COL);
@@ -75,8 +76,24 @@ str vars_key_column		=	str_init(VARS_KEY_COL);
 str vars_value_column		=	str_init(VARS_VALUE_COL);
 str dialog_vars_table_name	=	str_init(DIALOG_VARS_TABLE_NAME);
 
-static db1_con_t* dialog_db_handle    = 0; /* database connection handle */
-static db_func_t dialog_dbf;
+db1_con_t* dialog_db_handle    = 0; /* database connection handle */
+db_func_t dialog_dbf;
+
+/* columns of a dialog row, in the order of dlg_db_fill_row() */
+db_key_t dialog_row_keys[DIALOG_TABLE_COL_NO] = { &h_entry_column,
+		&h_id_column,        &call_id_column,     &from_uri_column,
+		&from_tag_column,    &to_uri_column,      &to_tag_column,
+		&from_sock_column,   &to_sock_column,
+		&start_time_column,  &state_column,       &timeout_column,
+		&from_cseq_column,   &to_cseq_column,     &from_route_column,
+		&to_route_column,    &from_contact_column,&to_contact_column,
+		&sflags_column,      &toroute_name_column,     &req_uri_column,
+		&xdata_column, &iflags_column };
+
+/* columns of a dialog variable row */
+db_key_t dialog_vars_row_keys[DIALOG_VARS_TABLE_COL_NO] = {
+		&vars_h_entry_column, &vars_h_id_column, &vars_key_column,
+		&vars_value_column };
 
 extern int dlg_enable_stats;
 extern int active_dlgs_cnt;
@@ -159,7 +176,8 @@ int init_dlg_db(const str *db_url, int dlg_hash_size , int db_update_period, int
 	}
 
 	if( (dlg_db_mode==DB_MODE_DELAYED) && 
-	(register_timer( dialog_update_db, 0, db_update_period)<0 )) {
+	(register_timer( (dlg_db_async_procs>0)?dlg_dbq_update_timer
+			:dialog_update_db, 0, db_update_period)<0 )) {
 		LM_ERR("failed to register update db\n");
 		return -1;
 	}
@@ -192,7 +210,7 @@ void destroy_dlg_db(void)
 
 
 
-static int use_dialog_table(void)
+int use_dialog_table(void)
 {
 	if(!dialog_db_handle){
 		LM_ERR("invalid database handle\n");
@@ -207,7 +225,7 @@ static int use_dialog_table(void)
 	return 0;
 }
 
-static int use_dialog_vars_table(void)
+int use_dialog_vars_table(void)
 {
 	if(!dialog_db_handle){
 		LM_ERR("invalid database handle\n");
@@ -607,6 +625,11 @@ int remove_dialog_from_db(struct dlg_cell * cell)
 	if (cell->dflags & DLG_FLAG_NEW) 
 		return 0;
 
+	/* the writer process of the entry does the delete, unless its queue
+	 * is full (the writer then checks the dialogs it is inserting) */
+	if (dlg_db_async_procs>0 && dlg_dbq_push(cell, DLG_DBQ_DELETE)==0)
+		return 0;
+
 	if (use_dialog_table()!=0)
 		return -1;
 
@@ -693,23 +716,96 @@ error:
 }
 
 
-int update_dialog_dbinfo_unsafe(struct dlg_cell * cell)
+/*!
+ * \brief Fill the values of a dialog row, in the order of dialog_row_keys
+ *
+ * The string values point to the dialog and to the json document of the
+ * profiles. If jdoc is NULL, the profiles are not printed and the xdata
+ * value is null.
+ */
+void dlg_db_fill_row(struct dlg_cell *cell, db_val_t *values,
+		srjson_doc_t *jdoc)
 {
 	int i;
+
+	VAL_TYPE(values) = VAL_TYPE(values+1) = VAL_TYPE(values+9) = 
+	VAL_TYPE(values+10) = VAL_TYPE(values+11) = DB1_INT;
+
+	VAL_TYPE(values+2) = VAL_TYPE(values+3) = VAL_TYPE(values+4) = 
+	VAL_TYPE(values+5) = VAL_TYPE(values+6) = VAL_TYPE(values+7) = 
+	VAL_TYPE(values+8) = VAL_TYPE(values+12) = VAL_TYPE(values+13) = 
+	VAL_TYPE(values+14) = VAL_TYPE(values+15) = VAL_TYPE(values+16)=
+	VAL_TYPE(values+17) = VAL_TYPE(values+20) = DB1_STR;
+
+	SET_NULL_FLAG(values, i, DIALOG_TABLE_COL_NO-6, 0);
+	VAL_TYPE(values+18) = DB1_INT;
+	VAL_TYPE(values+19) = DB1_STR;
+	VAL_TYPE(values+21) = DB1_STR;
+	VAL_TYPE(values+22) = DB1_INT;
+
+	VAL_INT(values)			= cell->h_entry;
+	VAL_INT(values+1)		= cell->h_id;
+	VAL_INT(values+9)		= cell->start_ts;
+	VAL_INT(values+10)		= cell->state;
+	VAL_INT(values+11)		= (unsigned int)( (unsigned int)time(0) +
+			 cell->tl.timeout - get_ticks() );
+
+	SET_STR_VALUE(values+2, cell->callid);
+	SET_STR_VALUE(values+3, cell->from_uri);
+	SET_STR_VALUE(values+4, cell->tag[DLG_CALLER_LEG]);
+	SET_STR_VALUE(values+5, cell->to_uri);
+	SET_STR_VALUE(values+6, cell->tag[DLG_CALLEE_LEG]);
+	SET_PROPER_NULL_FLAG(cell->tag[DLG_CALLEE_LEG], values, 6);
+
+	LM_DBG("sock_info is %.*s\n", 
+		cell->bind_addr[DLG_CALLER_LEG]->sock_str.len,
+		cell->bind_addr[DLG_CALLEE_LEG]->sock_str.s);
+
+	SET_STR_VALUE(values+7, cell->bind_addr[DLG_CALLER_LEG]->sock_str);
+	SET_STR_VALUE(values+8, cell->bind_addr[DLG_CALLEE_LEG]->sock_str);
+
+	SET_STR_VALUE(values+12, cell->cseq[DLG_CALLER_LEG]);
+	SET_STR_VALUE(values+13, cell->cseq[DLG_CALLEE_LEG]);
+	SET_STR_VALUE(values+14, cell->route_set[DLG_CALLER_LEG]);
+	SET_STR_VALUE(values+15, cell->route_set[DLG_CALLEE_LEG]);
+	SET_STR_VALUE(values+16, cell->contact[DLG_CALLER_LEG]);
+	SET_STR_VALUE(values+17, cell->contact[DLG_CALLEE_LEG]);
+
+	SET_PROPER_NULL_FLAG(cell->route_set[DLG_CALLER_LEG], 	values, 14);
+	SET_PROPER_NULL_FLAG(cell->route_set[DLG_CALLEE_LEG], 	values, 15);
+	SET_PROPER_NULL_FLAG(cell->contact[DLG_CALLER_LEG], 	values, 16);
+	SET_PROPER_NULL_FLAG(cell->contact[DLG_CALLEE_LEG], 	values, 17);
+
+	VAL_NULL(values+18) = 0;
+	VAL_INT(values+18)  = cell->sflags;
+
+	SET_STR_VALUE(values+19, cell->toroute_name);
+	SET_PROPER_NULL_FLAG(cell->toroute_name, values, 19);
+	SET_STR_VALUE(values+20, cell->req_uri);
+	SET_PROPER_NULL_FLAG(cell->req_uri, 	values, 20);
+
+	VAL_NULL(values+21) = 1;
+	if(jdoc!=NULL) {
+		dlg_profiles_to_json(cell, jdoc);
+		if(jdoc->buf.s!=NULL)
+		{
+			SET_STR_VALUE(values+21, jdoc->buf);
+			SET_PROPER_NULL_FLAG(jdoc->buf, values, 21);
+		}
+	}
+
+	VAL_NULL(values+22) = 0;
+	VAL_INT(values+22)  = cell->iflags;
+}
+
+int update_dialog_dbinfo_unsafe(struct dlg_cell * cell)
+{
 	struct dlg_var *var;
 	srjson_doc_t jdoc;
 
 	db_val_t values[DIALOG_TABLE_COL_NO];
 
-	db_key_t insert_keys[DIALOG_TABLE_COL_NO] = { &h_entry_column,
-			&h_id_column,        &call_id_column,     &from_uri_column,
-			&from_tag_column,    &to_uri_column,      &to_tag_column,
-			&from_sock_column,   &to_sock_column,
-			&start_time_column,  &state_column,       &timeout_column,
-			&from_cseq_column,   &to_cseq_column,     &from_route_column,
-			&to_route_column,    &from_contact_column,&to_contact_column,
-			&sflags_column,      &toroute_name_column,     &req_uri_column,
-			&xdata_column, &iflags_column };
+	db_key_t *insert_keys = dialog_row_keys;
 
 	if( (cell->dflags & DLG_FLAG_NEW) != 0 
 	|| (cell->dflags & DLG_FLAG_CHANGED_VARS) != 0) {
@@ -729,73 +825,7 @@ int update_dialog_dbinfo_unsafe(struct dlg_cell * cell)
 
 	if((cell->dflags & DLG_FLAG_NEW) != 0){
 		/* save all the current dialogs information*/
-		VAL_TYPE(values) = VAL_TYPE(values+1) = VAL_TYPE(values+9) = 
-		VAL_TYPE(values+10) = VAL_TYPE(values+11) = DB1_INT;
-
-		VAL_TYPE(values+2) = VAL_TYPE(values+3) = VAL_TYPE(values+4) = 
-		VAL_TYPE(values+5) = VAL_TYPE(values+6) = VAL_TYPE(values+7) = 
-		VAL_TYPE(values+8) = VAL_TYPE(values+12) = VAL_TYPE(values+13) = 
-		VAL_TYPE(values+14) = VAL_TYPE(values+15) = VAL_TYPE(values+16)=
-		VAL_TYPE(values+17) = VAL_TYPE(values+20) = DB1_STR;
-
-		SET_NULL_FLAG(values, i, DIALOG_TABLE_COL_NO-6, 0);
-		VAL_TYPE(values+18) = DB1_INT;
-		VAL_TYPE(values+19) = DB1_STR;
-		VAL_TYPE(values+21) = DB1_STR;
-		VAL_TYPE(values+22) = DB1_INT;
-
-		VAL_INT(values)			= cell->h_entry;
-		VAL_INT(values+1)		= cell->h_id;
-		VAL_INT(values+9)		= cell->start_ts;
-		VAL_INT(values+10)		= cell->state;
-		VAL_INT(values+11)		= (unsigned int)( (unsigned int)time(0) +
-				 cell->tl.timeout - get_ticks() );
-
-		SET_STR_VALUE(values+2, cell->callid);
-		SET_STR_VALUE(values+3, cell->from_uri);
-		SET_STR_VALUE(values+4, cell->tag[DLG_CALLER_LEG]);
-		SET_STR_VALUE(values+5, cell->to_uri);
-		SET_STR_VALUE(values+6, cell->tag[DLG_CALLEE_LEG]);
-		SET_PROPER_NULL_FLAG(cell->tag[DLG_CALLEE_LEG], values, 6);
-
-		LM_DBG("sock_info is %.*s\n", 
-			cell->bind_addr[DLG_CALLER_LEG]->sock_str.len,
-			cell->bind_addr[DLG_CALLEE_LEG]->sock_str.s);
-
-		SET_STR_VALUE(values+7, cell->bind_addr[DLG_CALLER_LEG]->sock_str);
-		SET_STR_VALUE(values+8, cell->bind_addr[DLG_CALLEE_LEG]->sock_str);
-
-		SET_STR_VALUE(values+12, cell->cseq[DLG_CALLER_LEG]);
-		SET_STR_VALUE(values+13, cell->cseq[DLG_CALLEE_LEG]);
-		SET_STR_VALUE(values+14, cell->route_set[DLG_CALLER_LEG]);
-		SET_STR_VALUE(values+15, cell->route_set[DLG_CALLEE_LEG]);
-		SET_STR_VALUE(values+16, cell->contact[DLG_CALLER_LEG]);
-		SET_STR_VALUE(values+17, cell->contact[DLG_CALLEE_LEG]);
-
-		SET_PROPER_NULL_FLAG(cell->route_set[DLG_CALLER_LEG], 	values, 14);
-		SET_PROPER_NULL_FLAG(cell->route_set[DLG_CALLEE_LEG], 	values, 15);
-		SET_PROPER_NULL_FLAG(cell->contact[DLG_CALLER_LEG], 	values, 16);
-		SET_PROPER_NULL_FLAG(cell->contact[DLG_CALLEE_LEG], 	values, 17);
-
-		VAL_NULL(values+18) = 0;
-		VAL_INT(values+18)  = cell->sflags;
-
-		SET_STR_VALUE(values+19, cell->toroute_name);
-		SET_PROPER_NULL_FLAG(cell->toroute_name, values, 19);
-		SET_STR_VALUE(values+20, cell->req_uri);
-		SET_PROPER_NULL_FLAG(cell->req_uri, 	values, 20);
-
-		dlg_profiles_to_json(cell, &jdoc);
-		if(jdoc.buf.s!=NULL)
-		{
-			SET_STR_VALUE(values+21, jdoc.buf);
-			SET_PROPER_NULL_FLAG(jdoc.buf, values, 21);
-		} else {
-			VAL_NULL(values+21) = 1;
-		}
-
-		VAL_NULL(values+22) = 0;
-		VAL_INT(values+22)  = cell->iflags;
+		dlg_db_fill_row(cell, values, &jdoc);
 
 		if((dialog_dbf.insert(dialog_db_handle, insert_keys, values, 
 								DIALOG_TABLE_COL_NO)) !=0){
@@ -854,43 +884,49 @@ error:
 
 int update_dialog_dbinfo(struct dlg_cell * cell)
 {
-	struct dlg_entry entry;
+	struct dlg_entry *entry;
 	/* lock the entry */
-	entry = (d_table->entries)[cell->h_entry];
-	dlg_lock( d_table, &entry);
+	entry = &(d_table->entries)[cell->h_entry];
+	dlg_lock( d_table, entry);
+	if (dlg_db_async_procs>0) {
+		/* the writer process of the entry does the update, unless its
+		 * queue is full: then it is written now, not to lose it */
+		if (!(cell->dflags & (DLG_FLAG_NEW|DLG_FLAG_CHANGED
+						|DLG_FLAG_CHANGED_VARS))
+				|| (cell->dflags & DLG_FLAG_DBQUEUED)
+				|| dlg_dbq_push(cell, DLG_DBQ_UPDATE)==0) {
+			dlg_unlock( d_table, entry);
+			return 0;
+		}
+	}
 	if (update_dialog_dbinfo_unsafe(cell) != 0) {
-		dlg_unlock( d_table, &entry);
+		dlg_unlock( d_table, entry);
 		return -1;
 	} 
-	dlg_unlock( d_table, &entry);
+	dlg_unlock( d_table, entry);
 	return 0;
 }
 
 void dialog_update_db(unsigned int ticks, void * param)
 {
 	int index;
-	struct dlg_entry entry;
+	struct dlg_entry *entry;
 	struct dlg_cell  * cell; 
 
 	LM_DBG("saving current_info \n");
 	
 	for(index = 0; index< d_table->size; index++){
 		/* lock the whole entry */
-		entry = (d_table->entries)[index];
-		dlg_lock( d_table, &entry);
+		entry = &(d_table->entries)[index];
+		dlg_lock( d_table, entry);
 
-		for(cell = entry.first; cell != NULL; cell = cell->next){
+		for(cell = entry->first; cell != NULL; cell = cell->next){
 			if (update_dialog_dbinfo_unsafe(cell) != 0) {
-				dlg_unlock( d_table, &entry);
-				goto error;
+				dlg_unlock( d_table, entry);
+				return;
 			}
 		}
-		dlg_unlock( d_table, &entry);
+		dlg_unlock( d_table, entry);
 
 	}
-
-	return;
-
-error:
-	dlg_unlock( d_table, &entry);
 }
@@ -32,6 +32,7 @@
 
 #include "../../str.h"
 #include "../../lib/srdb1/db.h"
+#include "../../lib/srutils/srjson.h"
 
 #define CALL_ID_COL				"callid"
 #define FROM_URI_COL			"from_uri"
@@ -101,6 +102,8 @@ extern str from_sock_column;
 extern str iflags_column;
 extern str sflags_column;
 extern str toroute_name_column;
+extern str req_uri_column;
+extern str xdata_column;
 extern str dialog_table_name;
 extern int dlg_db_mode;
 
@@ -111,11 +114,21 @@ extern str vars_key_column;
 extern str vars_value_column;
 extern str dialog_vars_table_name;
 
+extern db1_con_t* dialog_db_handle;
+extern db_func_t dialog_dbf;
+extern db_key_t dialog_row_keys[DIALOG_TABLE_COL_NO];
+extern db_key_t dialog_vars_row_keys[DIALOG_VARS_TABLE_COL_NO];
+
 
 int init_dlg_db(const str *db_url, int dlg_hash_size, int db_update_period, int fetch_num_rows);
 int dlg_connect_db(const str *db_url);
 void destroy_dlg_db(void);
 
+int use_dialog_table(void);
+int use_dialog_vars_table(void);
+void dlg_db_fill_row(struct dlg_cell *cell, db_val_t *values,
+		srjson_doc_t *jdoc);
+
 int remove_dialog_from_db(struct dlg_cell * cell);
 int update_dialog_dbinfo(struct dlg_cell * cell);
 void dialog_update_db(unsigned int ticks, void * param);
@@ -0,0 +1,790 @@
+/*
+ * Copyright (C) 2015 kamailio.org
+ *
+ * This file is part of Kamailio, a free SIP server.
+ *
+ * Kamailio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * Kamailio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*!
+ * \file
+ * \brief Queue of the dialog changes written by the DB writer processes
+ *
+ * The SIP workers and the timers queue the id of a changed or deleted
+ * dialog in the ring of the writer process owning its hash entry, instead
+ * of writing to the database. A dialog is queued once for an update, until
+ * its writer takes it. The writer reads the queued ids in batches, merges
+ * the ones of the same dialog, takes a copy of the changed dialogs with the
+ * entry locked and writes them without holding any lock: the new dialogs
+ * and variables with multi-row inserts, the deletes with one statement per
+ * batch, the updates one by one (the tables have no unique key on the
+ * hash_entry and hash_id columns). When the ring is full, the delete of a
+ * dialog is run by the worker: the writer then deletes again the new
+ * dialogs it has just inserted and which are gone meanwhile. In db_mode 1
+ * the worker also writes the update that does not fit, in db_mode 2 the
+ * timer queues it on its next run.
+ * \ingroup dialog
+ * Module: \ref dialog
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+#include "../../dprint.h"
+#include "../../mem/mem.h"
+#include "../../mem/shm_mem.h"
+#include "../../sr_module.h"
+#include "../../timer_proc.h"
+#include "../../lib/srdb1/db.h"
+#include "dlg_hash.h"
+#include "dlg_var.h"
+#include "dlg_db_handler.h"
+#include "dlg_db_queue.h"
+
+int dlg_db_async_procs = 0;
+int dlg_db_async_queue_size = 8192;
+int dlg_db_async_batch = 100;
+int dlg_db_async_interval = 100;
+
+static dlg_dbq_t *_dlg_dbq = NULL;
+
+#define DLG_DBQ_DIRTY	(DLG_FLAG_NEW|DLG_FLAG_CHANGED|DLG_FLAG_CHANGED_VARS)
+
+/*! copy of a changed dialog taken by the writer, in one pkg block */
+typedef struct dlg_dbq_row {
+	unsigned int h_entry;
+	unsigned int h_id;
+	unsigned int dflags;	/*!< DLG_DBQ_DIRTY flags taken from the dialog */
+	int nvars;
+	db_val_t values[DIALOG_TABLE_COL_NO];
+	db_val_t *vvalues;		/*!< nvars rows of the vars table */
+	unsigned int *vflags;	/*!< flags taken from each variable */
+} dlg_dbq_row_t;
+
+/*! buffers of a writer process, in one pkg block */
+static db_val_t *_dlg_dbq_bulk = NULL;
+static dlg_dbq_row_t **_dlg_dbq_rows = NULL;
+static dlg_dbq_item_t *_dlg_dbq_items = NULL;
+
+
+/*!
+ * \brief Allocate the rings, one per writer process
+ * \return 0 on success, -1 on failure
+ */
+int dlg_dbq_init(void)
+{
+	dlg_dbq_item_t *items;
+	unsigned int size;
+	int i;
+
+	if(dlg_db_async_batch<1)
+		dlg_db_async_batch = 1;
+	if(dlg_db_async_interval<1)
+		dlg_db_async_interval = 1;
+	for(size=1; size<(unsigned int)dlg_db_async_queue_size; size<<=1);
+
+	_dlg_dbq = (dlg_dbq_t*)shm_malloc(dlg_db_async_procs
+			* (sizeof(dlg_dbq_t) + size*sizeof(dlg_dbq_item_t)));
+	if(_dlg_dbq==NULL) {
+		LM_ERR("no more shm\n");
+		return -1;
+	}
+	items = (dlg_dbq_item_t*)(_dlg_dbq + dlg_db_async_procs);
+	for(i=0; i<dlg_db_async_procs; i++) {
+		memset(&_dlg_dbq[i], 0, sizeof(dlg_dbq_t));
+		if(lock_init(&_dlg_dbq[i].lock)==0) {
+			LM_ERR("cannot init the lock of queue %d\n", i);
+			shm_free(_dlg_dbq);
+			_dlg_dbq = NULL;
+			return -1;
+		}
+		_dlg_dbq[i].size = size;
+		_dlg_dbq[i].items = items + i*size;
+	}
+
+	if(register_basic_timers(dlg_db_async_procs)<0) {
+		LM_ERR("cannot register the db writer processes\n");
+		shm_free(_dlg_dbq);
+		_dlg_dbq = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+
+/*!
+ * \brief Queue a change of a dialog for its writer process
+ */
+int dlg_dbq_push(struct dlg_cell *dlg, int op)
+{
+	dlg_dbq_t *q;
+	dlg_dbq_item_t *it;
+
+	if(_dlg_dbq==NULL)
+		return -1;
+	q = &_dlg_dbq[dlg->h_entry % dlg_db_async_procs];
+	lock_get(&q->lock);
+	/* the last quarter of the ring is kept for the deletes */
+	if(q->tail - q->head >= ((op==DLG_DBQ_DELETE)?q->size
+				:q->size - q->size/4)) {
+		q->overflows++;
+		/* the caller deletes the dialog at once, maybe before the writer
+		 * inserts it */
+		if(op==DLG_DBQ_DELETE)
+			q->bypassed++;
+		lock_release(&q->lock);
+		LM_DBG("queue full - dialog [%u:%u] not queued\n",
+				dlg->h_entry, dlg->h_id);
+		return -1;
+	}
+	it = &q->items[q->tail & (q->size-1)];
+	it->h_entry = dlg->h_entry;
+	it->h_id = dlg->h_id;
+	it->op = op;
+	q->tail++;
+	lock_release(&q->lock);
+
+	if(op==DLG_DBQ_UPDATE)
+		dlg->dflags |= DLG_FLAG_DBQUEUED;
+	return 0;
+}
+
+
+/*!
+ * \brief Queue the changed dialogs, timer for db_mode 2 (delayed)
+ */
+void dlg_dbq_update_timer(unsigned int ticks, void *param)
+{
+	struct dlg_entry *entry;
+	struct dlg_cell *cell;
+	unsigned int index;
+	int ring;
+
+	/* the dialogs of an entry go to the ring index % dlg_db_async_procs,
+	 * so a full ring stops only the entries of its writer */
+	for(ring=0; ring<dlg_db_async_procs; ring++) {
+		for(index=ring; index<d_table->size; index+=dlg_db_async_procs) {
+			entry = &d_table->entries[index];
+			dlg_lock(d_table, entry);
+			for(cell=entry->first; cell!=NULL; cell=cell->next) {
+				if((cell->dflags & DLG_DBQ_DIRTY)==0
+						|| (cell->dflags & DLG_FLAG_DBQUEUED))
+					continue;
+				if(dlg_dbq_push(cell, DLG_DBQ_UPDATE)<0)
+					break;
+			}
+			dlg_unlock(d_table, entry);
+			/* full, the next run takes the rest */
+			if(cell!=NULL)
+				break;
+		}
+	}
+}
+
+
+static int dlg_dbq_pop(dlg_dbq_t *q, dlg_dbq_item_t *items, int max)
+{
+	int n;
+
+	lock_get(&q->lock);
+	for(n=0; n<max && q->head!=q->tail; n++, q->head++)
+		items[n] = q->items[q->head & (q->size-1)];
+	lock_release(&q->lock);
+	return n;
+}
+
+
+static int dlg_dbq_item_cmp(const void *a, const void *b)
+{
+	const dlg_dbq_item_t *ia = (const dlg_dbq_item_t*)a;
+	const dlg_dbq_item_t *ib = (const dlg_dbq_item_t*)b;
+
+	if(ia->h_entry!=ib->h_entry)
+		return (ia->h_entry<ib->h_entry)?-1:1;
+	if(ia->h_id!=ib->h_id)
+		return (ia->h_id<ib->h_id)?-1:1;
+	return (int)ia->op - (int)ib->op;
+}
+
+
+static inline void dlg_dbq_copy_str(char **p, str *s)
+{
+	memcpy(*p, s->s, s->len);
+	s->s = *p;
+	*p += s->len;
+}
+
+
+/*!
+ * \brief Take a copy of a changed dialog and clear its change flags
+ * \return the copy, NULL if the dialog is gone or not changed
+ */
+static dlg_dbq_row_t* dlg_dbq_take_row(unsigned int h_entry,
+		unsigned int h_id)
+{
+	struct dlg_entry *entry;
+	struct dlg_cell *cell;
+	struct dlg_var *var;
+	dlg_dbq_row_t *row = NULL;
+	db_val_t values[DIALOG_TABLE_COL_NO];
+	db_val_t *v;
+	srjson_doc_t jdoc;
+	unsigned int dflags;
+	int nvars, len, i, k;
+	char *p;
+
+	if(h_entry>=d_table->size)
+		return NULL;
+	entry = &d_table->entries[h_entry];
+	srjson_InitDoc(&jdoc, NULL);
+
+	dlg_lock(d_table, entry);
+	for(cell=entry->first; cell!=NULL && cell->h_id!=h_id; cell=cell->next);
+	if(cell==NULL)
+		goto done;
+	cell->dflags &= ~DLG_FLAG_DBQUEUED;
+	dflags = cell->dflags & DLG_DBQ_DIRTY;
+	if(dflags==0)
+		goto done;
+
+	/* the profiles are only written with a new dialog */
+	dlg_db_fill_row(cell, values, (dflags&DLG_FLAG_NEW)?&jdoc:NULL);
+	len = 0;
+	for(i=0; i<DIALOG_TABLE_COL_NO; i++)
+		if(VAL_TYPE(values+i)==DB1_STR && !VAL_NULL(values+i))
+			len += VAL_STR(values+i).len;
+	/* the variables are written with a new dialog or when changed */
+	nvars = 0;
+	if(dflags & (DLG_FLAG_NEW|DLG_FLAG_CHANGED_VARS)) {
+		for(var=cell->vars; var!=NULL; var=var->next) {
+			if(var->vflags & (DLG_FLAG_NEW|DLG_FLAG_CHANGED)) {
+				nvars++;
+				len += var->key.len + var->value.len;
+			}
+		}
+	}
+
+	row = (dlg_dbq_row_t*)pkg_malloc(sizeof(dlg_dbq_row_t)
+			+ nvars*(DIALOG_VARS_TABLE_COL_NO*sizeof(db_val_t)
+				+ sizeof(unsigned int)) + len);
+	if(row==NULL) {
+		/* the flags are kept, the dialog is written later */
+		LM_ERR("no more pkg\n");
+		goto done;
+	}
+	row->h_entry = h_entry;
+	row->h_id = h_id;
+	row->dflags = dflags;
+	row->nvars = nvars;
+	row->vvalues = (db_val_t*)(row+1);
+	row->vflags = (unsigned int*)(row->vvalues
+			+ nvars*DIALOG_VARS_TABLE_COL_NO);
+	p = (char*)(row->vflags + nvars);
+	memcpy(row->values, values, sizeof(values));
+	for(i=0; i<DIALOG_TABLE_COL_NO; i++)
+		if(VAL_TYPE(row->values+i)==DB1_STR && !VAL_NULL(row->values+i))
+			dlg_dbq_copy_str(&p, &VAL_STR(row->values+i));
+
+	for(var=cell->vars, k=0; var!=NULL && k<nvars; var=var->next) {
+		if((var->vflags & (DLG_FLAG_NEW|DLG_FLAG_CHANGED))==0)
+			continue;
+		v = row->vvalues + k*DIALOG_VARS_TABLE_COL_NO;
+		VAL_TYPE(v) = VAL_TYPE(v+1) = DB1_INT;
+		VAL_TYPE(v+2) = VAL_TYPE(v+3) = DB1_STR;
+		VAL_NULL(v) = VAL_NULL(v+1) = VAL_NULL(v+2) = VAL_NULL(v+3) = 0;
+		VAL_INT(v) = h_entry;
+		VAL_INT(v+1) = h_id;
+		VAL_STR(v+2) = var->key;
+		VAL_STR(v+3) = var->value;
+		dlg_dbq_copy_str(&p, &VAL_STR(v+2));
+		dlg_dbq_copy_str(&p, &VAL_STR(v+3));
+		row->vflags[k] = var->vflags & (DLG_FLAG_NEW|DLG_FLAG_CHANGED);
+		var->vflags &= ~(DLG_FLAG_NEW|DLG_FLAG_CHANGED);
+		k++;
+	}
+	cell->dflags &= ~dflags;
+
+done:
+	dlg_unlock(d_table, entry);
+	if(jdoc.buf.s!=NULL) {
+		jdoc.free_fn(jdoc.buf.s);
+		jdoc.buf.s = NULL;
+	}
+	srjson_DestroyDoc(&jdoc);
+	return row;
+}
+
+
+/*!
+ * \brief Set back the flags of a dialog (and of a variable, if v>=0)
+ * whose write failed, so it is written again later
+ */
+static void dlg_dbq_restore(dlg_dbq_row_t *row, unsigned int dflags, int v)
+{
+	struct dlg_entry *entry;
+	struct dlg_cell *cell;
+	struct dlg_var *var;
+	str *key;
+
+	entry = &d_table->entries[row->h_entry];
+	dlg_lock(d_table, entry);
+	for(cell=entry->first; cell!=NULL && cell->h_id!=row->h_id;
+			cell=cell->next);
+	if(cell!=NULL) {
+		cell->dflags |= dflags;
+		if(v>=0) {
+			key = &VAL_STR(row->vvalues + v*DIALOG_VARS_TABLE_COL_NO + 2);
+			for(var=cell->vars; var!=NULL; var=var->next) {
+				if(var->key.len==key->len
+						&& memcmp(var->key.s, key->s, key->len)==0) {
+					var->vflags |= row->vflags[v];
+					cell->dflags |= DLG_FLAG_CHANGED_VARS;
+					break;
+				}
+			}
+		}
+	}
+	dlg_unlock(d_table, entry);
+}
+
+
+static int dlg_dbq_delete_one(unsigned int h_entry, unsigned int h_id);
+
+/*!
+ * \brief Delete again the new dialogs just inserted which were deleted
+ * meanwhile by a worker, without the ring
+ */
+static void dlg_dbq_undo_inserts(dlg_dbq_row_t **rows, int nrows)
+{
+	struct dlg_entry *entry;
+	struct dlg_cell *cell;
+	int i, gone;
+
+	for(i=0; i<nrows; i++) {
+		if((rows[i]->dflags & DLG_FLAG_NEW)==0)
+			continue;
+		entry = &d_table->entries[rows[i]->h_entry];
+		dlg_lock(d_table, entry);
+		for(cell=entry->first; cell!=NULL && cell->h_id!=rows[i]->h_id;
+				cell=cell->next);
+		gone = (cell==NULL || cell->state==DLG_STATE_DELETED);
+		dlg_unlock(d_table, entry);
+		if(gone) {
+			LM_DBG("dialog [%u:%u] deleted while inserted\n",
+					rows[i]->h_entry, rows[i]->h_id);
+			if(dlg_dbq_delete_one(rows[i]->h_entry, rows[i]->h_id)<0)
+				LM_ERR("failed to delete dialog [%u:%u] from db\n",
+						rows[i]->h_entry, rows[i]->h_id);
+		}
+	}
+}
+
+
+static int dlg_dbq_delete_one(unsigned int h_entry, unsigned int h_id)
+{
+	db_val_t values[2];
+	db_key_t match_keys[2] = { &h_entry_column, &h_id_column};
+	db_key_t vars_match_keys[2] = { &vars_h_entry_column, &vars_h_id_column};
+
+	VAL_TYPE(values) = VAL_TYPE(values+1) = DB1_INT;
+	VAL_NULL(values) = VAL_NULL(values+1) = 0;
+	VAL_INT(values) = h_entry;
+	VAL_INT(values+1) = h_id;
+
+	if(use_dialog_table()!=0
+			|| dialog_dbf.delete(dialog_db_handle, match_keys, 0, values, 2)<0)
+		return -1;
+	if(use_dialog_vars_table()!=0
+			|| dialog_dbf.delete(dialog_db_handle, vars_match_keys, 0,
+				values, 2)<0)
+		return -1;
+	return 0;
+}
+
+
+/*!
+ * \brief Delete the rows of many dialogs from a table, with one statement
+ */
+static int dlg_dbq_delete_bulk(str *table, str *ecol, str *icol,
+		dlg_dbq_item_t *items, int n)
+{
+	str sql;
+	int len, ret, i;
+
+	len = 32 + table->len + n*(ecol->len + icol->len + 40);
+	sql.s = (char*)pkg_malloc(len);
+	if(sql.s==NULL) {
+		LM_ERR("no more pkg\n");
+		return -1;
+	}
+	sql.len = snprintf(sql.s, len, "delete from %.*s where ",
+			table->len, table->s);
+	for(i=0; i<n; i++) {
+		sql.len += snprintf(sql.s + sql.len, len - sql.len,
+				"%s(%.*s=%u and %.*s=%u)", (i>0)?" or ":"",
+				ecol->len, ecol->s, items[i].h_entry,
+				icol->len, icol->s, items[i].h_id);
+	}
+	ret = dialog_dbf.raw_query(dialog_db_handle, &sql, NULL);
+	pkg_free(sql.s);
+	return ret;
+}
+
+
+/*!
+ * \brief Write the new dialogs or variables of a batch, many rows with
+ * one statement if the database can do it, else one by one
+ * \param vars 0 for the dialogs, 1 for the variables
+ */
+static void dlg_dbq_insert_rows(dlg_dbq_row_t **rows, int nrows, int vars)
+{
+	typedef struct dlg_dbq_ref {
+		dlg_dbq_row_t *row;
+		int v;
+	} dlg_dbq_ref_t;
+	dlg_dbq_ref_t *refs;
+	db_key_t *keys;
+	db_val_t *v;
+	int ncols, max, n, m, i, j, k;
+
+	n = 0;
+	for(i=0; i<nrows; i++) {
+		if(!vars) {
+			n += (rows[i]->dflags & DLG_FLAG_NEW)?1:0;
+			continue;
+		}
+		for(j=0; j<rows[i]->nvars; j++)
+			n += (rows[i]->vflags[j] & DLG_FLAG_NEW)?1:0;
+	}
+	if(n==0)
+		return;
+	refs = (dlg_dbq_ref_t*)pkg_malloc(n*sizeof(dlg_dbq_ref_t));
+	if(refs==NULL) {
+		LM_ERR("no more pkg\n");
+		for(i=0; i<nrows; i++)
+			dlg_dbq_restore(rows[i], vars?DLG_FLAG_CHANGED_VARS
+					:(rows[i]->dflags & (DLG_FLAG_NEW|DLG_FLAG_CHANGED)), -1);
+		return;
+	}
+	for(i=0, k=0; i<nrows; i++) {
+		if(!vars) {
+			if(rows[i]->dflags & DLG_FLAG_NEW) {
+				refs[k].row = rows[i];
+				refs[k++].v = -1;
+			}
+			continue;
+		}
+		for(j=0; j<rows[i]->nvars; j++) {
+			if(rows[i]->vflags[j] & DLG_FLAG_NEW) {
+				refs[k].row = rows[i];
+				refs[k++].v = j;
+			}
+		}
+	}
+
+	ncols = vars?DIALOG_VARS_TABLE_COL_NO:DIALOG_TABLE_COL_NO;
+	keys = vars?dialog_vars_row_keys:dialog_row_keys;
+	/* the bulk buffer holds a batch of dialog rows */
+	max = dlg_db_async_batch*DIALOG_TABLE_COL_NO/ncols;
+	for(i=0; i<n; i+=m) {
+		m = (n-i<max)?n-i:max;
+		if(m>1 && DB_CAPABILITY(dialog_dbf, DB_CAP_INSERT_UPDATE_BULK)) {
+			for(k=0; k<m; k++) {
+				v = vars?refs[i+k].row->vvalues + refs[i+k].v*ncols
+					:refs[i+k].row->values;
+				memcpy(_dlg_dbq_bulk + k*ncols, v, ncols*sizeof(db_val_t));
+			}
+			if((vars?use_dialog_vars_table():use_dialog_table())==0
+					&& dialog_dbf.insert_update_bulk(dialog_db_handle, keys,
+						_dlg_dbq_bulk, ncols, m, 0, 0)==0)
+				continue;
+			LM_WARN("bulk insert of %d %s failed, writing them one by one\n",
+					m, vars?"dialog variables":"dialogs");
+		}
+		/* one by one, the flags of the failed rows are set back */
+		for(k=i; k<i+m; k++) {
+			v = vars?refs[k].row->vvalues + refs[k].v*ncols:refs[k].row->values;
+			if((vars?use_dialog_vars_table():use_dialog_table())==0
+					&& dialog_dbf.insert(dialog_db_handle, keys, v, ncols)==0)
+				continue;
+			LM_ERR("could not add dialog [%u:%u]%s to db\n",
+					refs[k].row->h_entry, refs[k].row->h_id,
+					vars?" variable":"");
+			dlg_dbq_restore(refs[k].row, vars?0
+					:(refs[k].row->dflags & (DLG_FLAG_NEW|DLG_FLAG_CHANGED)),
+					refs[k].v);
+		}
+	}
+	pkg_free(refs);
+}
+
+
+/*!
+ * \brief Merge and write a batch of queued changes
+ * \return number of dialogs written or deleted
+ */
+static int dlg_dbq_flush(dlg_dbq_t *q, dlg_dbq_item_t *items, int n)
+{
+	dlg_dbq_row_t *row;
+	db_val_t *v;
+	unsigned int bypassed;
+	int i, j, k, nrows, ndel, max;
+
+	/* deletes run by the workers from now on might be before the inserts */
+	lock_get(&q->lock);
+	bypassed = q->bypassed;
+	lock_release(&q->lock);
+
+	/* the changes of a dialog are next to each other, the delete last */
+	qsort(items, n, sizeof(dlg_dbq_item_t), dlg_dbq_item_cmp);
+	nrows = ndel = 0;
+	for(i=0; i<n; i=j) {
+		for(j=i+1; j<n && items[j].h_entry==items[i].h_entry
+				&& items[j].h_id==items[i].h_id; j++);
+		if(items[j-1].op==DLG_DBQ_DELETE) {
+			/* a deleted dialog is not written, ndel<=i */
+			items[ndel++] = items[j-1];
+			continue;
+		}
+		row = dlg_dbq_take_row(items[i].h_entry, items[i].h_id);
+		if(row!=NULL)
+			_dlg_dbq_rows[nrows++] = row;
+	}
+
+	/* new dialogs and variables */
+	dlg_dbq_insert_rows(_dlg_dbq_rows, nrows, 0);
+	dlg_dbq_insert_rows(_dlg_dbq_rows, nrows, 1);
+	lock_get(&q->lock);
+	bypassed = q->bypassed - bypassed;
+	lock_release(&q->lock);
+	if(bypassed)
+		dlg_dbq_undo_inserts(_dlg_dbq_rows, nrows);
+
+	/* changed dialogs and variables */
+	for(i=0; i<nrows; i++) {
+		row = _dlg_dbq_rows[i];
+		if((row->dflags & (DLG_FLAG_NEW|DLG_FLAG_CHANGED))==DLG_FLAG_CHANGED) {
+			if(use_dialog_table()!=0
+					|| dialog_dbf.update(dialog_db_handle, dialog_row_keys, 0,
+						row->values, dialog_row_keys+10, row->values+10,
+						2, 4)!=0) {
+				LM_ERR("could not update dialog [%u:%u] in db\n",
+						row->h_entry, row->h_id);
+				dlg_dbq_restore(row, DLG_FLAG_CHANGED, -1);
+			}
+		}
+		for(k=0; k<row->nvars; k++) {
+			if(row->vflags[k]!=DLG_FLAG_CHANGED)
+				continue;
+			v = row->vvalues + k*DIALOG_VARS_TABLE_COL_NO;
+			if(use_dialog_vars_table()!=0
+					|| dialog_dbf.update(dialog_db_handle, dialog_vars_row_keys,
+						0, v, dialog_vars_row_keys+3, v+3, 3, 1)!=0) {
+				LM_ERR("could not update dialog [%u:%u] variable in db\n",
+						row->h_entry, row->h_id);
+				dlg_dbq_restore(row, 0, k);
+			}
+		}
+		pkg_free(row);
+	}
+
+	/* deleted dialogs, from both tables */
+	max = dlg_db_async_batch;
+	for(i=0; i<ndel; i+=max) {
+		k = (ndel-i<max)?ndel-i:max;
+		if(DB_CAPABILITY(dialog_dbf, DB_CAP_RAW_QUERY) && k>1
+				&& dlg_dbq_delete_bulk(&dialog_table_name, &h_entry_column,
+					&h_id_column, items+i, k)==0
+				&& dlg_dbq_delete_bulk(&dialog_vars_table_name,
+					&vars_h_entry_column, &vars_h_id_column, items+i, k)==0)
+			continue;
+		for(j=i; j<i+k; j++) {
+			if(dlg_dbq_delete_one(items[j].h_entry, items[j].h_id)<0)
+				LM_ERR("failed to delete dialog [%u:%u] from db\n",
+						items[j].h_entry, items[j].h_id);
+		}
+	}
+
+	return nrows + ndel;
+}
+
+
+/*!
+ * \brief Write the queued changes of a ring, at most one ring full
+ */
+static void dlg_dbq_run(dlg_dbq_t *q)
+{
+	struct timeval tv_start, tv_end;
+	unsigned int us, rounds;
+	int n;
+
+	if(_dlg_dbq_bulk==NULL) {
+		_dlg_dbq_bulk = (db_val_t*)pkg_malloc(dlg_db_async_batch
+				* (DIALOG_TABLE_COL_NO*sizeof(db_val_t)
+					+ sizeof(dlg_dbq_row_t*) + sizeof(dlg_dbq_item_t)));
+		if(_dlg_dbq_bulk==NULL) {
+			LM_ERR("no more pkg\n");
+			return;
+		}
+		_dlg_dbq_rows = (dlg_dbq_row_t**)(_dlg_dbq_bulk
+				+ dlg_db_async_batch*DIALOG_TABLE_COL_NO);
+		_dlg_dbq_items = (dlg_dbq_item_t*)(_dlg_dbq_rows
+				+ dlg_db_async_batch);
+	}
+
+	/* what is queued meanwhile waits for the next run */
+	for(rounds=q->size/dlg_db_async_batch+1; rounds>0; rounds--) {
+		n = dlg_dbq_pop(q, _dlg_dbq_items, dlg_db_async_batch);
+		if(n==0)
+			break;
+		gettimeofday(&tv_start, NULL);
+		n = dlg_dbq_flush(q, _dlg_dbq_items, n);
+		gettimeofday(&tv_end, NULL);
+		us = (tv_end.tv_sec - tv_start.tv_sec)*1000000
+			+ (tv_end.tv_usec - tv_start.tv_usec);
+		q->flush_us = us;
+		if(us>q->flush_max_us)
+			q->flush_max_us = us;
+		q->rows += n;
+	}
+}
+
+
+static void dlg_dbq_timer(unsigned int ticks, void *param)
+{
+	dlg_dbq_run(&_dlg_dbq[(int)(long)param]);
+}
+
+
+/*!
+ * \brief Start the writer processes, from PROC_MAIN
+ */
+int dlg_dbq_fork_writers(void)
+{
+	int i;
+
+	for(i=0; i<dlg_db_async_procs; i++) {
+		if(fork_basic_utimer(PROC_TIMER, "Dialog DB Writer", 1 /*socks flag*/,
+					dlg_dbq_timer, (void*)(long)i,
+					dlg_db_async_interval*1000 /*usec*/)<0) {
+			LM_ERR("failed to start the db writer %d\n", i);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+/*!
+ * \brief Write what is left in the rings and free them
+ */
+void dlg_dbq_destroy(const str *db_url)
+{
+	int i, connected;
+
+	if(_dlg_dbq==NULL)
+		return;
+	connected = 0;
+	if(dialog_db_handle==NULL && dlg_dbq_get_depth()>0 && db_url!=NULL
+			&& db_url->s!=NULL && dlg_connect_db(db_url)==0)
+		connected = 1;
+	if(dialog_db_handle!=NULL) {
+		for(i=0; i<dlg_db_async_procs; i++)
+			dlg_dbq_run(&_dlg_dbq[i]);
+	}
+	if(connected)
+		destroy_dlg_db();
+	if(_dlg_dbq_bulk!=NULL) {
+		pkg_free(_dlg_dbq_bulk);
+		_dlg_dbq_bulk = NULL;
+	}
+	shm_free(_dlg_dbq);
+	_dlg_dbq = NULL;
+}
+
+
+/*!
+ * \brief Changes waiting in the rings of all writers
+ */
+unsigned long dlg_dbq_get_depth(void)
+{
+	unsigned long depth = 0;
+	int i;
+
+	for(i=0; _dlg_dbq!=NULL && i<dlg_db_async_procs; i++)
+		depth += _dlg_dbq[i].tail - _dlg_dbq[i].head;
+	return depth;
+}
+
+
+/*!
+ * \brief Longest duration of the last flush of the writers, in usec
+ */
+unsigned long dlg_dbq_get_flush_time(void)
+{
+	unsigned long us = 0;
+	int i;
+
+	for(i=0; _dlg_dbq!=NULL && i<dlg_db_async_procs; i++)
+		if(_dlg_dbq[i].flush_us>us)
+			us = _dlg_dbq[i].flush_us;
+	return us;
+}
+
+
+/*!
+ * \brief Longest flush of the writers since start, in usec
+ */
+unsigned long dlg_dbq_get_flush_max_time(void)
+{
+	unsigned long us = 0;
+	int i;
+
+	for(i=0; _dlg_dbq!=NULL && i<dlg_db_async_procs; i++)
+		if(_dlg_dbq[i].flush_max_us>us)
+			us = _dlg_dbq[i].flush_max_us;
+	return us;
+}
+
+
+/*!
+ * \brief Dialogs written or deleted by the writers
+ */
+unsigned long dlg_dbq_get_rows(void)
+{
+	unsigned long rows = 0;
+	int i;
+
+	for(i=0; _dlg_dbq!=NULL && i<dlg_db_async_procs; i++)
+		rows += _dlg_dbq[i].rows;
+	return rows;
+}
+
+
+/*!
+ * \brief Changes not queued because a ring was full
+ */
+unsigned long dlg_dbq_get_overflows(void)
+{
+	unsigned long n = 0;
+	int i;
+
+	for(i=0; _dlg_dbq!=NULL && i<dlg_db_async_procs; i++)
+		n += _dlg_dbq[i].overflows;
+	return n;
+}
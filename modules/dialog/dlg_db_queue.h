@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2015 kamailio.org
+ *
+ * This file is part of Kamailio, a free SIP server.
+ *
+ * Kamailio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * Kamailio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*!
+ * \file
+ * \brief Queue of the dialog changes written by the DB writer processes
+ * \ingroup dialog
+ * Module: \ref dialog
+ */
+
+#ifndef _DLG_DB_QUEUE_H_
+#define _DLG_DB_QUEUE_H_
+
+#include "../../locking.h"
+#include "dlg_hash.h"
+
+#define DLG_DBQ_UPDATE	1	/*!< insert or update the dialog */
+#define DLG_DBQ_DELETE	2	/*!< delete the dialog */
+
+/*! change queued for a dialog */
+typedef struct dlg_dbq_item {
+	unsigned int h_entry;
+	unsigned int h_id;
+	unsigned int op;
+} dlg_dbq_item_t;
+
+/*! ring of one writer process, with the gauges of its flushes */
+typedef struct dlg_dbq {
+	gen_lock_t lock;
+	unsigned int size;			/*!< number of items, power of 2 */
+	unsigned int head;			/*!< next item to read */
+	unsigned int tail;			/*!< next item to write */
+	unsigned int overflows;		/*!< changes not queued, the ring was full */
+	unsigned int bypassed;		/*!< deletes run by the workers, ring full */
+	unsigned int flush_us;		/*!< duration of the last flush */
+	unsigned int flush_max_us;	/*!< longest flush */
+	unsigned long rows;			/*!< dialogs written or deleted */
+	dlg_dbq_item_t *items;
+} dlg_dbq_t;
+
+extern int dlg_db_async_procs;
+extern int dlg_db_async_queue_size;
+extern int dlg_db_async_batch;
+extern int dlg_db_async_interval;
+
+/*!
+ * \brief Allocate the rings, one per writer process
+ * \return 0 on success, -1 on failure
+ */
+int dlg_dbq_init(void);
+
+/*!
+ * \brief Start the writer processes, from PROC_MAIN
+ * \return 0 on success, -1 on failure
+ */
+int dlg_dbq_fork_writers(void);
+
+/*!
+ * \brief Write what is left in the rings and free them
+ * \param db_url database to connect to, if not yet connected
+ */
+void dlg_dbq_destroy(const str *db_url);
+
+/*!
+ * \brief Queue a change of a dialog for its writer process
+ *
+ * For an update the dialog is marked as queued, it is not queued again
+ * until its writer takes it. The updates leave a quarter of the ring to
+ * the deletes. A delete that doesn't fit is counted, so the writer undoes
+ * an insert of the dialog it might be running meanwhile. Must be called
+ * with the dialog entry locked.
+ * \param dlg dialog
+ * \param op DLG_DBQ_UPDATE or DLG_DBQ_DELETE
+ * \return 0 on success, -1 if the ring is full
+ */
+int dlg_dbq_push(struct dlg_cell *dlg, int op);
+
+/*!
+ * \brief Queue the changed dialogs, timer for db_mode 2 (delayed)
+ */
+void dlg_dbq_update_timer(unsigned int ticks, void *param);
+
+/* statistics */
+unsigned long dlg_dbq_get_depth(void);
+unsigned long dlg_dbq_get_flush_time(void);
+unsigned long dlg_dbq_get_flush_max_time(void);
+unsigned long dlg_dbq_get_rows(void);
+unsigned long dlg_dbq_get_overflows(void);
+
+#endif
@@ -34,6 +34,7 @@
 #include "../../dprint.h"
 #include "../../ut.h"
 #include "../../hashes.h"
+#include "../../pt.h"
 #include "../../lib/kmi/mi.h"
 #include "dlg_timer.h"
 #include "dlg_var.h"
@@ -51,6 +52,36 @@ dlg_ka_t **dlg_ka_list_head = NULL;
 dlg_ka_t **dlg_ka_list_tail = NULL;
 gen_lock_t *dlg_ka_list_lock = NULL;
 
+/*! lookup of dialogs without locking the hash table slot */
+int dlg_lockfree_lookup = 0;
+
+/*!
+ * Deferred free of dialogs, for the lookups that walk a slot without
+ * locking it. Each process increments its epoch when it starts and when
+ * it ends walking a slot, so the epoch is odd while walking. The unlinked
+ * dialogs are first added to the pending list. When the waiting list is
+ * empty, the pending list becomes the waiting list and the epochs are
+ * saved. The waiting dialogs are freed once every process that was
+ * walking a slot at that moment has finished. The tag buffers replaced in
+ * dialogs still linked are freed the same way, chained by their first
+ * word.
+ */
+typedef struct dlg_gc {
+	gen_lock_t lock;
+	dlg_cell_t *pending;	/*!< unlinked since the epochs were saved */
+	dlg_cell_t *waiting;	/*!< unlinked before the epochs were saved */
+	void *pbufs;			/*!< tag buffers replaced since the epochs were saved */
+	void *wbufs;			/*!< tag buffers replaced before the epochs were saved */
+	int nprocs;
+	volatile unsigned int *epochs;	/*!< epoch per process, odd while walking */
+	unsigned int *snap;		/*!< epochs saved for the waiting list */
+} dlg_gc_t;
+
+static dlg_gc_t *dlg_gc = NULL;
+
+/*! nesting of the walks within this process */
+static int dlg_gc_walking = 0;
+
 /*!
  * \brief Reference a dialog without locking
  * \param _dlg dialog
@@ -58,9 +89,10 @@ gen_lock_t *dlg_ka_list_lock = NULL;
  */
 #define ref_dlg_unsafe(_dlg,_cnt)     \
 	do { \
-		(_dlg)->ref += (_cnt); \
+		int _r; \
+		_r = atomic_add_int(&(_dlg)->ref, (_cnt)); \
 		LM_DBG("ref dlg %p with %d -> %d\n", \
-			(_dlg),(_cnt),(_dlg)->ref); \
+			(_dlg),(_cnt),_r); \
 	}while(0)
 
 
@@ -72,15 +104,16 @@ gen_lock_t *dlg_ka_list_lock = NULL;
  */
 #define unref_dlg_unsafe(_dlg,_cnt,_d_entry)   \
 	do { \
+		int _r; \
 		if((_dlg)->ref <= 0 ) { \
 			LM_WARN("invalid unref'ing dlg %p with ref %d by %d\n",\
 					(_dlg),(_dlg)->ref,(_cnt));\
 			break; \
 		} \
-		(_dlg)->ref -= (_cnt); \
+		_r = atomic_add_int(&(_dlg)->ref, -(_cnt)); \
 		LM_DBG("unref dlg %p with %d -> %d\n",\
-			(_dlg),(_cnt),(_dlg)->ref);\
-		if ((_dlg)->ref<0) {\
+			(_dlg),(_cnt),_r);\
+		if (_r<0) {\
 			LM_CRIT("bogus ref %d with cnt %d for dlg %p [%u:%u] "\
 				"with clid '%.*s' and tags '%.*s' '%.*s'\n",\
 				(_dlg)->ref, _cnt, _dlg,\
@@ -91,13 +124,192 @@ gen_lock_t *dlg_ka_list_lock = NULL;
 				(_dlg)->tag[DLG_CALLEE_LEG].len,\
 				(_dlg)->tag[DLG_CALLEE_LEG].s); \
 		}\
-		if ((_dlg)->ref<=0) { \
+		if (_r<=0) { \
 			unlink_unsafe_dlg( _d_entry, _dlg);\
 			LM_DBG("ref <=0 for dialog %p\n",_dlg);\
 			destroy_dlg(_dlg);\
 		}\
 	}while(0)
 
+/*!
+ * \brief Reference a dialog found without locking its slot, unless it is
+ * being destroyed
+ * \param dlg dialog
+ * \return 1 if referenced, 0 if the reference counter is already 0
+ */
+static inline int dlg_tryref(dlg_cell_t *dlg)
+{
+	int r;
+
+	do {
+		r = dlg->ref;
+		if (r<=0)
+			return 0;
+	} while (atomic_cmpxchg_int(&dlg->ref, r, r+1)!=r);
+	LM_DBG("ref dlg %p with 1 -> %d\n", dlg, r+1);
+	return 1;
+}
+
+
+/*!
+ * \brief Start walking a slot without locking it
+ */
+static inline void dlg_gc_enter(void)
+{
+	if (dlg_gc_walking++ == 0) {
+		dlg_gc->epochs[process_no]++;
+		membar();
+	}
+}
+
+
+/*!
+ * \brief Stop walking a slot without locking it
+ */
+static inline void dlg_gc_leave(void)
+{
+	if (--dlg_gc_walking == 0) {
+		membar();
+		dlg_gc->epochs[process_no]++;
+	}
+}
+
+
+/*!
+ * \brief Free a dialog structure, later if lookups can still walk over it
+ * \param dlg dialog
+ */
+static void dlg_gc_free(dlg_cell_t *dlg)
+{
+	if (dlg_gc==NULL) {
+		shm_free(dlg);
+		return;
+	}
+	lock_get(&dlg_gc->lock);
+	dlg->gc_next = dlg_gc->pending;
+	dlg_gc->pending = dlg;
+	lock_release(&dlg_gc->lock);
+}
+
+
+/*!
+ * \brief Free a tag buffer of a dialog, later if lookups can still read it
+ * \param buf buffer, of at least the size of a pointer
+ */
+static void dlg_gc_free_buf(void *buf)
+{
+	if (dlg_gc==NULL) {
+		shm_free(buf);
+		return;
+	}
+	lock_get(&dlg_gc->lock);
+	*(void**)buf = dlg_gc->pbufs;
+	dlg_gc->pbufs = buf;
+	lock_release(&dlg_gc->lock);
+}
+
+
+/*!
+ * \brief Free a list of tag buffers
+ */
+static void dlg_gc_free_bufs(void **list)
+{
+	void *buf;
+
+	while (*list) {
+		buf = *list;
+		*list = *(void**)buf;
+		shm_free(buf);
+	}
+}
+
+
+/*!
+ * \brief Initialize the deferred free of dialogs, once the number of
+ * processes is known
+ * \return 0 on success, -1 on failure
+ */
+int dlg_gc_init(void)
+{
+	int n;
+
+	if (dlg_lockfree_lookup==0 || dlg_gc!=NULL)
+		return 0;
+	n = get_max_procs();
+	if (n<=0) {
+		LM_ERR("invalid number of processes %d\n", n);
+		return -1;
+	}
+	dlg_gc = (dlg_gc_t*)shm_malloc(sizeof(dlg_gc_t)
+			+ 2*n*sizeof(unsigned int));
+	if (dlg_gc==NULL) {
+		LM_ERR("no more shm mem\n");
+		return -1;
+	}
+	memset(dlg_gc, 0, sizeof(dlg_gc_t) + 2*n*sizeof(unsigned int));
+	if (lock_init(&dlg_gc->lock)==NULL) {
+		LM_ERR("failed to init lock\n");
+		shm_free(dlg_gc);
+		dlg_gc = NULL;
+		return -1;
+	}
+	dlg_gc->nprocs = n;
+	dlg_gc->epochs = (unsigned int*)(dlg_gc+1);
+	dlg_gc->snap = (unsigned int*)(dlg_gc->epochs + n);
+	return 0;
+}
+
+
+/*!
+ * \brief Free the unlinked dialogs that no lookup can still walk over
+ */
+void dlg_gc_run(void)
+{
+	dlg_cell_t *dlg;
+	dlg_cell_t *fdlg;
+	void *fbuf;
+	int i;
+
+	if (dlg_gc==NULL)
+		return;
+
+	lock_get(&dlg_gc->lock);
+	fdlg = NULL;
+	fbuf = NULL;
+	if (dlg_gc->waiting!=NULL || dlg_gc->wbufs!=NULL) {
+		membar();
+		for (i=0; i<dlg_gc->nprocs; i++) {
+			if ((dlg_gc->snap[i]&1) && dlg_gc->epochs[i]==dlg_gc->snap[i])
+				break;
+		}
+		if (i==dlg_gc->nprocs) {
+			fdlg = dlg_gc->waiting;
+			dlg_gc->waiting = NULL;
+			fbuf = dlg_gc->wbufs;
+			dlg_gc->wbufs = NULL;
+		}
+	}
+	if (dlg_gc->waiting==NULL && dlg_gc->wbufs==NULL
+			&& (dlg_gc->pending!=NULL || dlg_gc->pbufs!=NULL)) {
+		dlg_gc->waiting = dlg_gc->pending;
+		dlg_gc->pending = NULL;
+		dlg_gc->wbufs = dlg_gc->pbufs;
+		dlg_gc->pbufs = NULL;
+		membar();
+		for (i=0; i<dlg_gc->nprocs; i++)
+			dlg_gc->snap[i] = dlg_gc->epochs[i];
+	}
+	lock_release(&dlg_gc->lock);
+
+	while (fdlg) {
+		dlg = fdlg;
+		fdlg = fdlg->gc_next;
+		shm_free(dlg);
+	}
+	dlg_gc_free_bufs(&fbuf);
+}
+
+
 /**
  * add item to keep-alive list
  *
@@ -229,8 +441,11 @@ int dlg_clean_run(ticks_t ti)
 				/* dialog in early state older than 5min */
 				LM_NOTICE("dialog in early state is too old (%p ref %d)\n",
 						tdlg, tdlg->ref);
+				/* no new references by the lookups */
+				atomic_set_int(&tdlg->ref, 0);
 				unlink_unsafe_dlg(&d_table->entries[i], tdlg);
 				destroy_dlg(tdlg);
+				continue;
 			}
 			if(tdlg->state==DLG_STATE_CONFIRMED_NA && tdlg->start_ts<tm-60) {
 				if(update_dlg_timer(&tdlg->tl, 10)<0) {
@@ -374,7 +589,7 @@ void destroy_dlg(struct dlg_cell *dlg)
 	}
 
 
-	shm_free(dlg);
+	dlg_gc_free(dlg);
 	dlg = 0;
 }
 
@@ -403,6 +618,24 @@ void destroy_dlg_table(void)
 	shm_free(d_table);
 	d_table = 0;
 
+	if (dlg_gc!=NULL) {
+		while (dlg_gc->pending) {
+			dlg = dlg_gc->pending;
+			dlg_gc->pending = dlg->gc_next;
+			shm_free(dlg);
+		}
+		while (dlg_gc->waiting) {
+			dlg = dlg_gc->waiting;
+			dlg_gc->waiting = dlg->gc_next;
+			shm_free(dlg);
+		}
+		dlg_gc_free_bufs(&dlg_gc->pbufs);
+		dlg_gc_free_bufs(&dlg_gc->wbufs);
+		lock_destroy(&dlg_gc->lock);
+		shm_free(dlg_gc);
+		dlg_gc = NULL;
+	}
+
 	return;
 }
 
@@ -420,6 +653,7 @@ struct dlg_cell* build_new_dlg( str *callid, str *from_uri, str *to_uri,
 		str *from_tag, str *req_uri)
 {
 	struct dlg_cell *dlg;
+	unsigned int chash;
 	int len;
 	char *p;
 
@@ -435,7 +669,9 @@ struct dlg_cell* build_new_dlg( str *callid, str *from_uri, str *to_uri,
 	dlg->state = DLG_STATE_UNCONFIRMED;
 	dlg->init_ts = (unsigned int)time(NULL);
 
-	dlg->h_entry = core_hash( callid, 0, d_table->size);
+	chash = core_hash( callid, 0, 0);
+	dlg->h_entry = chash & (d_table->size-1);
+	dlg->fp = (unsigned long long)chash<<32;
 	LM_DBG("new dialog on hash %u\n",dlg->h_entry);
 
 	p = (char*)(dlg+1);
@@ -484,6 +720,9 @@ int dlg_set_leg_info(struct dlg_cell *dlg, str* tag, str *rr, str *contact,
 					str *cseq, unsigned int leg)
 {
 	char *p;
+	char *buf;
+	char *old;
+	int size;
 	str cs = {"0", 1};
 
 	/* if we don't have cseq, set it to 0 */
@@ -491,9 +730,16 @@ int dlg_set_leg_info(struct dlg_cell *dlg, str* tag, str *rr, str *contact,
 		cs = *cseq;
 	}
 
-	if(dlg->tag[leg].s)
-		shm_free(dlg->tag[leg].s);
-	dlg->tag[leg].s = (char*)shm_malloc( tag->len + rr->len + contact->len );
+	/* the lookups without lock can still read the old tag: the new buffer
+	 * is published once complete, it is not shorter than the old tag in
+	 * case a lookup reads the old length with it, and the old buffer is
+	 * freed later, chained by its first word */
+	size = tag->len + rr->len + contact->len;
+	if (size < dlg->tag[leg].len)
+		size = dlg->tag[leg].len;
+	if (size < (int)sizeof(void*))
+		size = (int)sizeof(void*);
+	buf = (char*)shm_malloc(size);
 
 	if(dlg->cseq[leg].s) {
 		if (dlg->cseq[leg].len < cs.len) {
@@ -504,13 +750,10 @@ int dlg_set_leg_info(struct dlg_cell *dlg, str* tag, str *rr, str *contact,
 		dlg->cseq[leg].s = (char*)shm_malloc( cs.len );
 	}
 
-	if ( dlg->tag[leg].s==NULL || dlg->cseq[leg].s==NULL) {
+	if ( buf==NULL || dlg->cseq[leg].s==NULL) {
 		LM_ERR("no more shm mem\n");
-		if (dlg->tag[leg].s)
-		{
-			shm_free(dlg->tag[leg].s);
-			dlg->tag[leg].s = NULL;
-		}
+		if (buf)
+			shm_free(buf);
 		if (dlg->cseq[leg].s)
 		{
 			shm_free(dlg->cseq[leg].s);
@@ -518,10 +761,9 @@ int dlg_set_leg_info(struct dlg_cell *dlg, str* tag, str *rr, str *contact,
 		}
 		return -1;
 	}
-	p = dlg->tag[leg].s;
+	p = buf;
 
 	/* tag */
-	dlg->tag[leg].len = tag->len;
 	memcpy( p, tag->s, tag->len);
 	p += tag->len;
 	/* contact */
@@ -535,6 +777,15 @@ int dlg_set_leg_info(struct dlg_cell *dlg, str* tag, str *rr, str *contact,
 		dlg->route_set[leg].len = rr->len;
 		memcpy( p, rr->s, rr->len);
 	}
+	old = dlg->tag[leg].s;
+	membar();
+	dlg->tag[leg].s = buf;
+	membar();
+	dlg->tag[leg].len = tag->len;
+	if (leg==DLG_CALLER_LEG)
+		dlg->fp = dlg_fingerprint(dlg->fp>>32, tag);
+	if (old)
+		dlg_gc_free_buf(old);
 
 	/* cseq */
 	dlg->cseq[leg].len = cs.len;
@@ -607,6 +858,19 @@ dlg_cell_t *dlg_lookup( unsigned int h_entry, unsigned int h_id)
 
 	d_entry = &(d_table->entries[h_entry]);
 
+	if (likely(dlg_gc!=NULL)) {
+		dlg_gc_enter();
+		for( dlg=d_entry->first ; dlg ; dlg=dlg->next ) {
+			if (dlg->h_id == h_id && dlg_tryref(dlg)) {
+				dlg_gc_leave();
+				LM_DBG("dialog id=%u found on entry %u\n", h_id, h_entry);
+				return dlg;
+			}
+		}
+		dlg_gc_leave();
+		goto not_found;
+	}
+
 	dlg_lock( d_table, d_entry);
 
 	for( dlg=d_entry->first ; dlg ; dlg=dlg->next ) {
@@ -643,10 +907,60 @@ dlg_cell_t* dlg_get_by_iuid(dlg_iuid_t *diuid)
 	return dlg_lookup(diuid->h_entry, diuid->h_id);
 }
 
+/*!
+ * \brief Check the fingerprint of a dialog before comparing the strings
+ *
+ * The caller tag of a matching dialog is the from tag downstream and the
+ * to tag upstream.
+ * \param dlg dialog
+ * \param fpf fingerprint of the callid and from tag
+ * \param fpt fingerprint of the callid and to tag
+ * \param dir direction of the message
+ * \return 1 if the dialog can match, 0 otherwise
+ */
+static inline int dlg_fp_match(dlg_cell_t *dlg, unsigned long long fpf,
+		unsigned long long fpt, unsigned int dir)
+{
+	if (dir==DLG_DIR_DOWNSTREAM)
+		return dlg->fp==fpf;
+	if (dir==DLG_DIR_UPSTREAM)
+		return dlg->fp==fpt;
+	return dlg->fp==fpf || dlg->fp==fpt;
+}
+
+
+/*!
+ * \brief Helper function to get a dialog corresponding to a SIP message,
+ * walking the hash table slot without locking it
+ * \see internal_get_dlg
+ * \return dialog structure on success, NULL on failure
+ */
+static inline struct dlg_cell* internal_get_dlg_lockfree(dlg_entry_t *d_entry,
+						unsigned long long fpf, unsigned long long fpt,
+						str *callid, str *ftag, str *ttag, unsigned int *dir)
+{
+	struct dlg_cell *dlg;
+
+	dlg_gc_enter();
+	for( dlg = d_entry->first ; dlg ; dlg = dlg->next ) {
+		if (!dlg_fp_match(dlg, fpf, fpt, *dir) || !dlg_tryref(dlg))
+			continue;
+		/* referenced, the tags can be compared */
+		if (match_dialog( dlg, callid, ftag, ttag, dir)==1) {
+			dlg_gc_leave();
+			return dlg;
+		}
+		dlg_unref(dlg, 1);
+	}
+	dlg_gc_leave();
+	return 0;
+}
+
+
 /*!
  * \brief Helper function to get a dialog corresponding to a SIP message
  * \see get_dlg
- * \param h_entry hash index in the directory list
+ * \param chash hash of the callid
  * \param callid callid
  * \param ftag from tag
  * \param ttag to tag
@@ -654,18 +968,38 @@ dlg_cell_t* dlg_get_by_iuid(dlg_iuid_t *diuid)
  * \param mode let hash table slot locked if dialog is not found
  * \return dialog structure on success, NULL on failure
  */
-static inline struct dlg_cell* internal_get_dlg(unsigned int h_entry,
+static inline struct dlg_cell* internal_get_dlg(unsigned int chash,
 						str *callid, str *ftag, str *ttag,
 						unsigned int *dir, int mode)
 {
 	struct dlg_cell *dlg;
 	struct dlg_entry *d_entry;
+	unsigned long long fpf;
+	unsigned long long fpt;
+	unsigned int h_entry;
 
+	h_entry = chash & (d_table->size-1);
 	d_entry = &(d_table->entries[h_entry]);
+	fpf = dlg_fingerprint(chash, ftag);
+	fpt = dlg_fingerprint(chash, ttag);
+
+	if (likely(mode==0 && dlg_gc!=NULL)) {
+		dlg = internal_get_dlg_lockfree(d_entry, fpf, fpt, callid, ftag, ttag,
+				dir);
+		if (dlg) {
+			LM_DBG("dialog callid='%.*s' found on entry %u, dir=%d\n",
+				callid->len, callid->s,h_entry,*dir);
+		} else {
+			LM_DBG("no dialog callid='%.*s' found\n", callid->len, callid->s);
+		}
+		return dlg;
+	}
 
 	dlg_lock( d_table, d_entry);
 
 	for( dlg = d_entry->first ; dlg ; dlg = dlg->next ) {
+		if (!dlg_fp_match(dlg, fpf, fpt, *dir))
+			continue;
 		/* Check callid / fromtag / totag */
 		if (match_dialog( dlg, callid, ftag, ttag, dir)==1) {
 			ref_dlg_unsafe(dlg, 1);
@@ -704,7 +1038,7 @@ struct dlg_cell* get_dlg( str *callid, str *ftag, str *ttag, unsigned int *dir)
 	struct dlg_cell *dlg;
 	unsigned int he;
 
-	he = core_hash(callid, 0, d_table->size);
+	he = core_hash(callid, 0, 0);
 	dlg = internal_get_dlg(he, callid, ftag, ttag, dir, 0);
 
 	if (dlg == 0) {
@@ -738,7 +1072,7 @@ dlg_cell_t* search_dlg( str *callid, str *ftag, str *ttag, unsigned int *dir)
 	struct dlg_cell *dlg;
 	unsigned int he;
 
-	he = core_hash(callid, 0, d_table->size);
+	he = core_hash(callid, 0, 0);
 	dlg = internal_get_dlg(he, callid, ftag, ttag, dir, 1);
 
 	if (dlg == 0) {
@@ -783,6 +1117,10 @@ void link_dlg(struct dlg_cell *dlg, int n, int mode)
 	dlg->h_id = 1 + d_entry->next_id++;
 	if(dlg->h_id == 0) dlg->h_id = 1;
 	LM_DBG("linking dialog [%u:%u]\n", dlg->h_entry, dlg->h_id);
+	ref_dlg_unsafe(dlg, 1+n);
+	/* the dialog is complete before the lookups without lock can see it */
+	dlg->next = 0;
+	membar_write();
 	if (d_entry->first==0) {
 		d_entry->first = d_entry->last = dlg;
 	} else {
@@ -791,28 +1129,23 @@ void link_dlg(struct dlg_cell *dlg, int n, int mode)
 		d_entry->last = dlg;
 	}
 
-	ref_dlg_unsafe(dlg, 1+n);
-
 	if(unlikely(mode==0)) dlg_unlock( d_table, d_entry);
 	return;
 }
 
 
 /*!
- * \brief Refefence a dialog with locking
+ * \brief Refefence a dialog
+ *
+ * The reference counter is atomic, the caller already holds a reference,
+ * so the slot is not locked.
  * \see ref_dlg_unsafe
  * \param dlg dialog
  * \param cnt increment for the reference counter
  */
 void dlg_ref(dlg_cell_t *dlg, unsigned int cnt)
 {
-	dlg_entry_t *d_entry;
-
-	d_entry = &(d_table->entries[dlg->h_entry]);
-
-	dlg_lock( d_table, d_entry);
 	ref_dlg_unsafe( dlg, cnt);
-	dlg_unlock( d_table, d_entry);
 }
 
 
@@ -34,6 +34,7 @@
 #include "../../lib/kmi/mi.h"
 #include "../../timer.h"
 #include "../../atomic_ops.h"
+#include "../../hashes.h"
 #include "dlg_timer.h"
 #include "dlg_cb.h"
 
@@ -69,6 +70,7 @@
 
 #define DLG_FLAG_TM            (1<<9) /*!< dialog is set in transaction */
 #define DLG_FLAG_EXPIRED       (1<<10)/*!< dialog is expired */
+#define DLG_FLAG_DBQUEUED      (1<<11)/*!< update queued for the db writer */
 
 /* internal flags stored in db */
 #define DLG_IFLAG_TIMEOUTBYE        (1<<0) /*!< send bye on time-out */
@@ -103,6 +105,7 @@ typedef struct dlg_cell
 	struct dlg_cell      *prev;		/*!< previous entry in the list */
 	unsigned int         h_id;		/*!< id in the hash table entry (seq nr in slot) */
 	unsigned int         h_entry;	/*!< index of hash table entry (the slot number) */
+	unsigned long long   fp;		/*!< fingerprint: callid and caller tag hashes */
 	unsigned int         state;		/*!< dialog state */
 	unsigned int         lifetime;		/*!< dialog lifetime */
 	unsigned int         init_ts;		/*!< init (creation) time (absolute UNIX ts)*/
@@ -126,6 +129,7 @@ typedef struct dlg_cell
 	struct dlg_head_cbl  cbs;		/*!< dialog callbacks */
 	struct dlg_profile_link *profile_links; /*!< dialog profiles */
 	struct dlg_var       *vars;		/*!< dialog variables */
+	struct dlg_cell      *gc_next;	/*!< next in the list of dialogs to be freed */
 } dlg_cell_t;
 
 
@@ -159,6 +163,17 @@ typedef struct dlg_ka {
 /*! global dialog table */
 extern dlg_table_t *d_table;
 
+/*! lookup of dialogs without locking the hash table slot */
+extern int dlg_lockfree_lookup;
+
+/*!
+ * \brief Fingerprint of a dialog, the hash of the callid in the high 32 bits
+ * and the hash of the caller tag in the low 32 bits
+ */
+#define dlg_fingerprint(_chash, _tag) \
+	(((unsigned long long)(_chash)<<32) \
+		| (unsigned long long)core_hash((_tag), 0, 0))
+
 
 /*!
  * \brief Set a dialog lock (re-entrant)
@@ -197,6 +212,9 @@ extern dlg_table_t *d_table;
 
 /*!
  * \brief Unlink a dialog from the list without locking
+ *
+ * The next pointer of the dialog is kept, lookups that do not lock the
+ * slot can still be walking over it.
  * \see unref_dlg_unsafe
  * \param d_entry unlinked entry
  * \param dlg unlinked dialog
@@ -212,7 +230,7 @@ static inline void unlink_unsafe_dlg(dlg_entry_t *d_entry, dlg_cell_t *dlg)
 	else
 		d_entry->first = dlg->next;
 
-	dlg->next = dlg->prev = 0;
+	dlg->prev = 0;
 
 	return;
 }
@@ -233,6 +251,20 @@ void destroy_dlg(dlg_cell_t *dlg);
 int init_dlg_table(unsigned int size);
 
 
+/*!
+ * \brief Initialize the deferred free of dialogs, once the number of
+ * processes is known
+ * \return 0 on success, -1 on failure
+ */
+int dlg_gc_init(void);
+
+
+/*!
+ * \brief Free the unlinked dialogs that no lookup can still walk over
+ */
+void dlg_gc_run(void);
+
+
 /*!
  * \brief Destroy the global dialog table
  */
@@ -43,7 +43,7 @@
 
 
 /*! size of dialog profile hash */
-#define PROFILE_HASH_SIZE 16
+int dlg_profiles_hash_size = 1024;
 
 /*! tm bindings */
 extern struct tm_binds d_tmb;
@@ -115,7 +115,7 @@ int add_profile_definitions( char* profiles, unsigned int has_value)
 		/* name ok -> create the profile */
 		LM_DBG("creating profile <%.*s>\n",name.len,name.s);
 
-		if (new_dlg_profile( &name, PROFILE_HASH_SIZE, has_value)==NULL) {
+		if (new_dlg_profile( &name, dlg_profiles_hash_size, has_value)==NULL) {
 			LM_ERR("failed to create new profile <%.*s>\n",name.len,name.s);
 			return -1;
 		}
@@ -193,16 +193,20 @@ static struct dlg_profile_table* new_dlg_profile( str *name, unsigned int size,
 	memset( profile , 0 , len);
 	profile->size = size;
 	profile->has_value = (has_value==0)?0:1;
-
-	/* init lock */
-	if (lock_init( &profile->lock )==NULL) {
-		LM_ERR("failed to init lock\n");
-		shm_free(profile);
-		return NULL;
-	}
+	atomic_set(&profile->count, 0);
 
 	/* set inner pointers */
 	profile->entries = (struct dlg_profile_entry*)(profile + 1);
+
+	/* init locks */
+	for( i=0 ; i<size ; i++ ) {
+		if (lock_init( &profile->entries[i].lock )==NULL) {
+			LM_ERR("failed to init lock\n");
+			shm_free(profile);
+			return NULL;
+		}
+	}
+
 	profile->name.s = ((char*)profile->entries) + 
 		size*sizeof(struct dlg_profile_entry);
 
@@ -230,10 +234,20 @@ static struct dlg_profile_table* new_dlg_profile( str *name, unsigned int size,
  */
 static void destroy_dlg_profile(struct dlg_profile_table *profile)
 {
+	struct dlg_profile_value *pv;
+	unsigned int i;
+
 	if (profile==NULL)
 		return;
 
-	lock_destroy( &profile->lock );
+	for( i=0 ; i<profile->size ; i++ ) {
+		lock_destroy( &profile->entries[i].lock );
+		while(profile->entries[i].values) {
+			pv = profile->entries[i].values;
+			profile->entries[i].values = pv->next;
+			shm_free(pv);
+		}
+	}
 	shm_free( profile );
 	return;
 }
@@ -255,6 +269,72 @@ void destroy_dlg_profiles(void)
 }
 
 
+/*!
+ * \brief Search the counter of a value in a profile hash entry
+ * \note The entry must be locked
+ * \param p_entry profile hash entry
+ * \param value profile value
+ * \param vhash hash of the value
+ * \return pointer to the counter if found, NULL otherwise
+ */
+static inline dlg_profile_value_t* search_profile_value(
+		dlg_profile_entry_t *p_entry, str *value, unsigned int vhash)
+{
+	dlg_profile_value_t *pv;
+
+	for( pv=p_entry->values ; pv ; pv=pv->next ) {
+		if (pv->vhash==vhash && pv->value.len==value->len
+				&& memcmp(pv->value.s, value->s, value->len)==0)
+			return pv;
+	}
+	return NULL;
+}
+
+
+/*!
+ * \brief Unlink an item from a profile hash entry and update the counters
+ * \note The entry must be locked
+ * \param profile dialog profile table
+ * \param p_entry profile hash entry
+ * \param lh unlinked item
+ */
+static void unlink_profile_hash(dlg_profile_table_t *profile,
+		dlg_profile_entry_t *p_entry, dlg_profile_hash_t *lh)
+{
+	dlg_profile_value_t *pv;
+	dlg_profile_value_t **ppv;
+
+	/* last element on the list? */
+	if (lh==lh->next) {
+		p_entry->first = NULL;
+	} else {
+		if (p_entry->first==lh)
+			p_entry->first = lh->next;
+		lh->next->prev = lh->prev;
+		lh->prev->next = lh->next;
+	}
+	lh->next = lh->prev = NULL;
+	p_entry->content --;
+	atomic_dec(&profile->count);
+
+	pv = lh->vcount;
+	lh->vcount = NULL;
+	if (pv==NULL)
+		return;
+	pv->count--;
+	if (pv->count==0) {
+		/* no more dialogs with the value */
+		for( ppv=&p_entry->values ; *ppv ; ppv=&(*ppv)->next ) {
+			if (*ppv==pv) {
+				*ppv = pv->next;
+				break;
+			}
+		}
+		shm_free(pv);
+	}
+}
+
+
 /*!
  * \brief Destroy dialog linkers
  * \param linker dialog linker
@@ -263,7 +343,6 @@ void destroy_linkers(struct dlg_profile_link *linker)
 {
 	struct dlg_profile_entry *p_entry;
 	struct dlg_profile_link *l;
-	struct dlg_profile_hash *lh;
 
 	while(linker) {
 		l = linker;
@@ -271,20 +350,10 @@ void destroy_linkers(struct dlg_profile_link *linker)
 		/* unlink from profile table */
 		if (l->hash_linker.next) {
 			p_entry = &l->profile->entries[l->hash_linker.hash];
-			lock_get( &l->profile->lock );
-			lh = &l->hash_linker;
-			/* last element on the list? */
-			if (lh==lh->next) {
-				p_entry->first = NULL;
-			} else {
-				if (p_entry->first==lh)
-					p_entry->first = lh->next;
-				lh->next->prev = lh->prev;
-				lh->prev->next = lh->next;
-			}
-			lh->next = lh->prev = NULL;
-			p_entry->content --;
-			lock_release( &l->profile->lock );
+			lock_get( &p_entry->lock );
+			if (l->hash_linker.next)
+				unlink_profile_hash(l->profile, p_entry, &l->hash_linker);
+			lock_release( &p_entry->lock );
 		}
 		/* free memory */
 		shm_free(l);
@@ -325,36 +394,27 @@ void remove_expired_remote_profiles(time_t te)
 	struct dlg_profile_entry *p_entry;
 	struct dlg_profile_hash *lh;
 	struct dlg_profile_hash *kh;
+	unsigned int n;
 	int i;
 
 	for( profile=profiles ; profile ; profile=profile->next ) {
 		if(profile->flags&FLAG_PROFILE_REMOTE) {
 			for(i=0; i<profile->size; i++) {
-				/* space for optimization */
-				lock_get(&profile->lock);
 				p_entry = &profile->entries[i];
+				lock_get(&p_entry->lock);
 				lh = p_entry->first;
-				while(lh) {
+				n = p_entry->content;
+				/* walk the circular list once */
+				while(lh && n>0) {
 					kh = lh->next;
+					n--;
 					if(lh->dlg==NULL && lh->expires>0 && lh->expires<te) {
-						/* last element on the list? */
-						if (lh==lh->next) {
-							p_entry->first = NULL;
-						} else {
-							if (p_entry->first==lh)
-								p_entry->first = lh->next;
-							lh->next->prev = lh->prev;
-							lh->prev->next = lh->next;
-						}
-						lh->next = lh->prev = NULL;
+						unlink_profile_hash(profile, p_entry, lh);
 						if(lh->linker) shm_free(lh->linker);
-						p_entry->content--;
-						lock_release(&profile->lock);
-						return;
 					}
-					lh = kh;
+					lh = (p_entry->first)?kh:NULL;
 				}
-				lock_release(&profile->lock);
+				lock_release(&p_entry->lock);
 			}
 		}
 	}
@@ -373,33 +433,25 @@ int remove_profile(dlg_profile_table_t *profile, str *value, str *puid)
 	struct dlg_profile_hash *lh;
 
 	hash = calc_hash_profile(value, puid, profile);
-	lock_get(&profile->lock );
 	p_entry = &profile->entries[hash];
+	lock_get(&p_entry->lock);
 	lh = p_entry->first;
 	if(lh) {
 		do {
 			if(lh->dlg==NULL && lh->puid_len==puid->len
-					&& lh->value.len==value->len
 					&& strncmp(lh->puid, puid->s, puid->len)==0
-					&& strncmp(lh->value.s, value->s, value->len)==0) {
-				/* last element on the list? */
-				if (lh==lh->next) {
-					p_entry->first = NULL;
-				} else {
-					if (p_entry->first==lh)
-						p_entry->first = lh->next;
-					lh->next->prev = lh->prev;
-					lh->prev->next = lh->next;
-				}
-				lh->next = lh->prev = NULL;
+					&& (profile->has_value==0
+						|| (lh->value.len==value->len
+							&& strncmp(lh->value.s, value->s, value->len)==0))) {
+				unlink_profile_hash(profile, p_entry, lh);
+				lock_release(&p_entry->lock);
 				if(lh->linker) shm_free(lh->linker);
-				p_entry->content--;
 				return 1;
 			}
 			lh = lh->next;
 		} while(lh != p_entry->first);
 	}
-	lock_release(&profile->lock );
+	lock_release(&p_entry->lock);
 	return 0;
 }
 
@@ -465,15 +517,53 @@ int profile_cleanup( struct sip_msg *msg, unsigned int flags, void *param )
 static void link_profile(struct dlg_profile_link *linker, str *vkey)
 {
 	unsigned int hash;
+	unsigned int vhash = 0;
 	struct dlg_profile_entry *p_entry;
+	dlg_profile_value_t *pv = NULL;
+	dlg_profile_value_t *npv = NULL;
+	str *value;
 
 	/* calculate the hash position */
-	hash = calc_hash_profile(&linker->hash_linker.value, vkey, linker->profile);
+	value = &linker->hash_linker.value;
+	if (linker->profile->has_value) {
+		vhash = core_hash(value, NULL, 0);
+		hash = vhash & (linker->profile->size-1);
+	} else {
+		hash = calc_hash_profile(value, vkey, linker->profile);
+	}
 	linker->hash_linker.hash = hash;
 
 	/* insert into profile hash table */
 	p_entry = &linker->profile->entries[hash];
-	lock_get( &linker->profile->lock );
+	lock_get( &p_entry->lock );
+	if (linker->profile->has_value) {
+		/* counter of the value, allocated out of the lock if new */
+		pv = search_profile_value(p_entry, value, vhash);
+		if (pv==NULL) {
+			lock_release( &p_entry->lock );
+			npv = (dlg_profile_value_t*)shm_malloc(sizeof(dlg_profile_value_t)
+					+ value->len);
+			lock_get( &p_entry->lock );
+			pv = search_profile_value(p_entry, value, vhash);
+			if (pv==NULL && npv!=NULL) {
+				memset(npv, 0, sizeof(dlg_profile_value_t));
+				npv->value.s = (char*)(npv+1);
+				memcpy(npv->value.s, value->s, value->len);
+				npv->value.len = value->len;
+				npv->vhash = vhash;
+				npv->next = p_entry->values;
+				p_entry->values = npv;
+				pv = npv;
+				npv = NULL;
+			}
+		}
+		if (pv!=NULL) {
+			pv->count++;
+		} else {
+			LM_ERR("no more shm - profile value not counted\n");
+		}
+		linker->hash_linker.vcount = pv;
+	}
 	if (p_entry->first) {
 		linker->hash_linker.prev = p_entry->first->prev;
 		linker->hash_linker.next = p_entry->first;
@@ -484,7 +574,10 @@ static void link_profile(struct dlg_profile_link *linker, str *vkey)
 			= linker->hash_linker.prev = &linker->hash_linker;
 	}
 	p_entry->content ++;
-	lock_release( &linker->profile->lock );
+	atomic_inc(&linker->profile->count);
+	lock_release( &p_entry->lock );
+	if (npv!=NULL)
+		shm_free(npv);
 }
 
 /*!
@@ -803,36 +896,21 @@ done:
  */
 unsigned int get_profile_size(struct dlg_profile_table *profile, str *value)
 {
-	unsigned int n,i;
-	struct dlg_profile_hash *ph;
+	unsigned int n, vhash;
+	struct dlg_profile_entry *p_entry;
+	dlg_profile_value_t *pv;
 
 	if (profile->has_value==0 || value==NULL) {
-		/* iterate through the hash and count all records */
-		lock_get( &profile->lock );
-		for( i=0,n=0 ; i<profile->size ; i++ )
-			n += profile->entries[i].content;
-		lock_release( &profile->lock );
-		return n;
+		/* all records */
+		return (unsigned int)atomic_get(&profile->count);
 	} else {
-		/* iterate through the hash entry and count only matching */
-		/* calculate the hash position */
-		i = calc_hash_profile( value, NULL, profile);
-		n = 0;
-		lock_get( &profile->lock );
-		ph = profile->entries[i].first;
-		if(ph) {
-			do {
-				/* compare */
-				if ( value->len==ph->value.len &&
-				memcmp(value->s,ph->value.s,value->len)==0 ) {
-					/* found */
-					n++;
-				}
-				/* next */
-				ph=ph->next;
-			}while( ph!=profile->entries[i].first );
-		}
-		lock_release( &profile->lock );
+		/* counter of the value, in its hash entry */
+		vhash = core_hash(value, NULL, 0);
+		p_entry = &profile->entries[vhash & (profile->size-1)];
+		lock_get( &p_entry->lock );
+		pv = search_profile_value(p_entry, value, vhash);
+		n = (pv)?pv->count:0;
+		lock_release( &p_entry->lock );
 		return n;
 	}
 }
@@ -885,18 +963,31 @@ int	dlg_set_timeout_by_profile(struct dlg_profile_table *profile,
 	 */
 
 	if(profile->has_value == 0 || value == NULL) {
-		lock_get(&profile->lock);
-
 		for(i = 0; i < profile->size; i ++) {
+			lock_get(&profile->entries[i].lock);
+
 			ph = profile->entries[i].first;
 
-			if(!ph) continue;
+			if(!ph) {
+				lock_release(&profile->entries[i].lock);
+				continue;
+			}
 			
 			do { 
-				struct dlg_map_list *d = malloc(sizeof(struct dlg_map_list));
+				struct dlg_map_list *d;
 
-				if(!d)
+				if(!ph->dlg) {
+					/* remote profile item */
+					ph = ph->next;
+					continue;
+				}
+
+				d = malloc(sizeof(struct dlg_map_list));
+
+				if(!d) {
+					lock_release(&profile->entries[i].lock);
 					return -1;
+				}
 
 				memset(d, 0, sizeof(struct dlg_map_list));
 
@@ -912,26 +1003,28 @@ int	dlg_set_timeout_by_profile(struct dlg_profile_table *profile,
 	
 				ph = ph->next;
 			} while(ph != profile->entries[i].first);
-		} 
 
-		lock_release(&profile->lock);
+			lock_release(&profile->entries[i].lock);
+		} 
 	}
 
 	else {
 		i = calc_hash_profile(value, NULL, profile);
 
-		lock_get(&profile->lock);
+		lock_get(&profile->entries[i].lock);
 
 		ph = profile->entries[i].first;
 
 		if(ph) {
 			do {
-				if(ph && value->len == ph->value.len &&
+				if(ph && ph->dlg && value->len == ph->value.len &&
 				   memcmp(value->s, ph->value.s, value->len) == 0) {
 					struct dlg_map_list *d = malloc(sizeof(struct dlg_map_list));
 
-					if(!d)
+					if(!d) {
+						lock_release(&profile->entries[i].lock);
 						return -1;
+					}
 
 					memset(d, 0, sizeof(struct dlg_map_list));
 
@@ -950,7 +1043,7 @@ int	dlg_set_timeout_by_profile(struct dlg_profile_table *profile,
 			} while(ph && ph != profile->entries[i].first);
 		}
 
-		lock_release(&profile->lock);
+		lock_release(&profile->entries[i].lock);
 	}
 
 	/* Walk the list and bulk-set the timeout */
@@ -1106,43 +1199,43 @@ struct mi_root * mi_profile_list(struct mi_root *cmd_tree, void *param )
 	/* go through the hash and print the dialogs */
 	if (profile->has_value==0 || value==NULL) {
 		/* no value */
-		lock_get( &profile->lock );
 		for ( i=0 ; i< profile->size ; i++ ) {
+			lock_get( &profile->entries[i].lock );
 			ph = profile->entries[i].first;
 			if(ph) {
 				do {
 					/* print dialog */
-					if ( mi_print_dlg( rpl, ph->dlg, 0)!=0 )
+					if ( ph->dlg && mi_print_dlg( rpl, ph->dlg, 0)!=0 )
 						goto error;
 					/* next */
 					ph=ph->next;
 				}while( ph!=profile->entries[i].first );
 			}
+			lock_release( &profile->entries[i].lock );
 		}
-		lock_release( &profile->lock );
 	} else {
-		/* check for value also */
-		lock_get( &profile->lock );
-		for ( i=0 ; i< profile->size ; i++ ) {
-			ph = profile->entries[i].first;
-			if(ph) {
-				do {
-					if ( value->len==ph->value.len &&
-					memcmp(value->s,ph->value.s,value->len)==0 ) {
-						/* print dialog */
-						if ( mi_print_dlg( rpl, ph->dlg, 0)!=0 )
-							goto error;
-					}
-					/* next */
-					ph=ph->next;
-				}while( ph!=profile->entries[i].first );
-			}
+		/* check for value also - all dialogs with it are in one entry */
+		i = calc_hash_profile( value, NULL, profile);
+		lock_get( &profile->entries[i].lock );
+		ph = profile->entries[i].first;
+		if(ph) {
+			do {
+				if ( ph->dlg && value->len==ph->value.len &&
+				memcmp(value->s,ph->value.s,value->len)==0 ) {
+					/* print dialog */
+					if ( mi_print_dlg( rpl, ph->dlg, 0)!=0 )
+						goto error;
+				}
+				/* next */
+				ph=ph->next;
+			}while( ph!=profile->entries[i].first );
 		}
-		lock_release( &profile->lock );
+		lock_release( &profile->entries[i].lock );
 	}
 
 	return rpl_tree;
 error:
+	lock_release( &profile->entries[i].lock );
 	free_mi_tree(rpl_tree);
 	return NULL;
 }
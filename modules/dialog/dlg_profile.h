@@ -37,6 +37,7 @@
 #include "../../lib/srutils/srjson.h"
 #include "../../lib/srutils/sruid.h"
 #include "../../locking.h"
+#include "../../atomic_ops.h"
 #include "../../str.h"
 #include "../../modules/tm/h_table.h"
 
@@ -50,6 +51,15 @@
  */
 
 
+/*! number of dialogs in a profile with a value */
+typedef struct dlg_profile_value {
+	str value; /*!< profile value */
+	unsigned int vhash; /*!< hash of the value */
+	unsigned int count; /*!< number of linked dialogs */
+	struct dlg_profile_value *next;
+} dlg_profile_value_t;
+
+
 /*! dialog profile hash list */
 typedef struct dlg_profile_hash {
 	str value; /*!< hash value */
@@ -59,6 +69,7 @@ typedef struct dlg_profile_hash {
 	time_t expires;
 	int flags;
 	struct dlg_profile_link *linker;
+	struct dlg_profile_value *vcount; /*!< counter of the value */
 	struct dlg_profile_hash *next;
 	struct dlg_profile_hash *prev;
 	unsigned int hash; /*!< position in the hash table */
@@ -77,17 +88,22 @@ typedef struct dlg_profile_link {
 typedef struct dlg_profile_entry {
 	struct dlg_profile_hash *first;
 	unsigned int content; /*!< content of the entry */
+	struct dlg_profile_value *values; /*!< counters of the values */
+	gen_lock_t lock; /*!< lock for concurrent access to the entry */
 } dlg_profile_entry_t;
 
 #define FLAG_PROFILE_REMOTE	1
 
+/*! size of the hash table of each profile */
+extern int dlg_profiles_hash_size;
+
 /*! dialog profile table */
 typedef struct dlg_profile_table {
 	str name; /*!< name of the dialog profile */
 	unsigned int size; /*!< size of the dialog profile */
 	unsigned int has_value; /*!< 0 for profiles without value, otherwise it has a value */
 	int flags; /*!< flags related to the profile */
-	gen_lock_t lock; /*! lock for concurrent access */
+	atomic_t count; /*!< number of linked dialogs */
 	struct dlg_profile_entry *entries;
 	struct dlg_profile_table *next;
 } dlg_profile_table_t;
@@ -188,6 +204,7 @@ int is_dlg_in_profile(sip_msg_t *msg, dlg_profile_table_t *profile,
 
 /*!
  * \brief Get the size of a profile
+ * \note Constant time, from the counters kept when linking dialogs
  * \param profile evaluated profile
  * \param value value
  * \return the profile size
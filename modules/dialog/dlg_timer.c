@@ -29,47 +29,56 @@
 #include "../../mem/shm_mem.h"
 #include "../../timer.h"
 #include "dlg_timer.h"
+#include "dlg_hash.h"
 
 /*! global dialog timer */
 struct dlg_timer *d_timer = 0;
 /*! global dialog timer handler */
 dlg_timer_handler timer_hdl = 0;
+/*! number of slots of the dialog timer wheel */
+int dlg_timer_wheel_size = 4096;
 
 
 /*!
  * \brief Initialize the dialog timer handler
- * Initialize the dialog timer handler, allocate the lock and a global
- * timer in shared memory. The global timer handler will be set on success.
+ * Initialize the dialog timer handler, allocate the timer wheel with
+ * the locks of its slots in shared memory. The global timer handler will
+ * be set on success.
  * \param hdl dialog timer handler
  * \return 0 on success, -1 on failure
  */
 int init_dlg_timer(dlg_timer_handler hdl)
 {
-	d_timer = (struct dlg_timer*)shm_malloc(sizeof(struct dlg_timer));
+	unsigned int i;
+	unsigned int size;
+
+	for( size=1 ; size<(unsigned int)dlg_timer_wheel_size && size<(1<<20);
+			size<<=1 );
+
+	d_timer = (struct dlg_timer*)shm_malloc(sizeof(struct dlg_timer)
+			+ size*sizeof(struct dlg_timer_slot));
 	if (d_timer==0) {
 		LM_ERR("no more shm mem\n");
 		return -1;
 	}
-	memset( d_timer, 0, sizeof(struct dlg_timer) );
-
-	d_timer->first.next = d_timer->first.prev = &(d_timer->first);
-
-	d_timer->lock = lock_alloc();
-	if (d_timer->lock==0) {
-		LM_ERR("failed to alloc lock\n");
-		goto error0;
-	}
-
-	if (lock_init(d_timer->lock)==0) {
-		LM_ERR("failed to init lock\n");
-		goto error1;
+	memset( d_timer, 0, sizeof(struct dlg_timer)
+			+ size*sizeof(struct dlg_timer_slot));
+
+	d_timer->size = size;
+	d_timer->last = get_ticks();
+	d_timer->slots = (struct dlg_timer_slot*)(d_timer+1);
+	for( i=0 ; i<size ; i++ ) {
+		d_timer->slots[i].first.next = d_timer->slots[i].first.prev
+			= &(d_timer->slots[i].first);
+		if (lock_init(&d_timer->slots[i].lock)==0) {
+			LM_ERR("failed to init lock\n");
+			goto error;
+		}
 	}
 
 	timer_hdl = hdl;
 	return 0;
-error1:
-	lock_dealloc(d_timer->lock);
-error0:
+error:
 	shm_free(d_timer);
 	d_timer = 0;
 	return -1;
@@ -81,35 +90,85 @@ error0:
  */
 void destroy_dlg_timer(void)
 {
+	unsigned int i;
+
 	if (d_timer==0)
 		return;
 
-	lock_destroy(d_timer->lock);
-	lock_dealloc(d_timer->lock);
+	for( i=0 ; i<d_timer->size ; i++ )
+		lock_destroy(&d_timer->slots[i].lock);
 
 	shm_free(d_timer);
 	d_timer = 0;
 }
 
 
+/*!
+ * \brief Get and lock the slot of the wheel for a new timeout
+ *
+ * The slot is the one of the timeout second, or of the next second to be
+ * checked if the timeout is not after the last checked one. The last
+ * checked second is set with the lock of its slot, so it cannot go past
+ * the one of the returned slot while it is locked.
+ * \param timeout timeout in ticks
+ * \return locked slot index
+ */
+static inline unsigned int dlg_timer_lock_new_slot(unsigned int timeout)
+{
+	unsigned int tick;
+	unsigned int slot;
+
+	while(1) {
+		tick = d_timer->last + 1;
+		if ((int)(timeout - tick) > 0)
+			tick = timeout;
+		slot = tick & (d_timer->size-1);
+		lock_get( &d_timer->slots[slot].lock);
+		if ((int)(tick - d_timer->last) > 0)
+			return slot;
+		lock_release( &d_timer->slots[slot].lock);
+	}
+}
+
+
+/*!
+ * \brief Lock the slot of the wheel of a dialog timer
+ *
+ * The slot of a timer is changed only with the lock of the slot held, so
+ * it is checked again after locking.
+ * \param tl dialog timer list
+ * \return locked slot index
+ */
+static inline unsigned int dlg_timer_lock_slot(struct dlg_tl *tl)
+{
+	unsigned int slot;
+
+	while(1) {
+		slot = tl->slot;
+		lock_get( &d_timer->slots[slot].lock);
+		if (slot==tl->slot)
+			return slot;
+		lock_release( &d_timer->slots[slot].lock);
+	}
+}
+
+
 /*!
  * \brief Helper function for insert_dialog_timer
  * \see insert_dialog_timer
  * \param tl dialog timer list
+ * \param slot locked slot of the wheel
  */
-static inline void insert_dialog_timer_unsafe(struct dlg_tl *tl)
+static inline void insert_dialog_timer_unsafe(struct dlg_tl *tl,
+		unsigned int slot)
 {
 	struct dlg_tl* ptr;
 
-	/* insert in sorted order */
-	for(ptr = d_timer->first.prev; ptr != &d_timer->first ; ptr = ptr->prev) {
-		if ( ptr->timeout <= tl->timeout )
-			break;
-	}
-
-	LM_DBG("inserting %p for %d\n", tl,tl->timeout);
-	tl->prev = ptr;
-	tl->next = ptr->next;
+	LM_DBG("inserting %p for %d in slot %u\n", tl, tl->timeout, slot);
+	ptr = &d_timer->slots[slot].first;
+	tl->slot = slot;
+	tl->prev = ptr->prev;
+	tl->next = ptr;
 	tl->prev->next = tl;
 	tl->next->prev = tl;
 }
@@ -123,18 +182,19 @@ static inline void insert_dialog_timer_unsafe(struct dlg_tl *tl)
  */
 int insert_dlg_timer(struct dlg_tl *tl, int interval)
 {
-	lock_get( d_timer->lock);
+	unsigned int timeout;
+	unsigned int slot;
 
 	if (tl->next!=0 || tl->prev!=0) {
 		LM_CRIT("Trying to insert a bogus dlg tl=%p tl->next=%p tl->prev=%p\n",
 			tl, tl->next, tl->prev);
-		lock_release( d_timer->lock);
 		return -1;
 	}
-	tl->timeout = get_ticks()+interval;
-	insert_dialog_timer_unsafe( tl );
-
-	lock_release( d_timer->lock);
+	timeout = get_ticks()+interval;
+	slot = dlg_timer_lock_new_slot(timeout);
+	tl->timeout = timeout;
+	insert_dialog_timer_unsafe( tl, slot );
+	lock_release( &d_timer->slots[slot].lock);
 
 	return 0;
 }
@@ -160,17 +220,19 @@ static inline void remove_dialog_timer_unsafe(struct dlg_tl *tl)
  */
 int remove_dialog_timer(struct dlg_tl *tl)
 {
-	lock_get( d_timer->lock);
+	unsigned int slot;
+
+	slot = dlg_timer_lock_slot(tl);
 
 	if (tl->prev==NULL && tl->timeout==0) {
-		lock_release( d_timer->lock);
+		lock_release( &d_timer->slots[slot].lock);
 		return 1;
 	}
 
 	if (tl->prev==NULL || tl->next==NULL) {
 		LM_CRIT("bogus tl=%p tl->prev=%p tl->next=%p\n",
 			tl, tl->prev, tl->next);
-		lock_release( d_timer->lock);
+		lock_release( &d_timer->slots[slot].lock);
 		return -1;
 	}
 
@@ -179,13 +241,16 @@ int remove_dialog_timer(struct dlg_tl *tl)
 	tl->prev = NULL;
 	tl->timeout = 0;
 
-	lock_release( d_timer->lock);
+	lock_release( &d_timer->slots[slot].lock);
 	return 0;
 }
 
 
 /*!
  * \brief Update a dialog timer on the list
+ *
+ * The timer is moved with the locks of the old and of the new slot held,
+ * taken in the order of the slot indexes.
  * \param tl dialog timer
  * \param timeout new timeout value in seconds
  * \return 0 on success, -1 when the input list is invalid
@@ -193,67 +258,103 @@ int remove_dialog_timer(struct dlg_tl *tl)
  */
 int update_dlg_timer(struct dlg_tl *tl, int timeout)
 {
-	lock_get( d_timer->lock);
-
-	if (tl->next==0 || tl->prev==0) {
-		LM_CRIT("Trying to update a bogus dlg tl=%p tl->next=%p tl->prev=%p\n",
-			tl, tl->next, tl->prev);
-		lock_release( d_timer->lock);
-		return -1;
+	unsigned int oslot;
+	unsigned int nslot;
+	unsigned int tick;
+	unsigned int ntimeout;
+
+	ntimeout = get_ticks()+timeout;
+	while(1) {
+		oslot = dlg_timer_lock_slot(tl);
+		if (tl->next==0 || tl->prev==0) {
+			LM_CRIT("Trying to update a bogus dlg tl=%p tl->next=%p tl->prev=%p\n",
+				tl, tl->next, tl->prev);
+			lock_release( &d_timer->slots[oslot].lock);
+			return -1;
+		}
+		tick = d_timer->last + 1;
+		if ((int)(ntimeout - tick) > 0)
+			tick = ntimeout;
+		nslot = tick & (d_timer->size-1);
+		if (nslot==oslot)
+			break;
+		if (nslot<oslot) {
+			/* keep the order of the locks */
+			lock_release( &d_timer->slots[oslot].lock);
+			lock_get( &d_timer->slots[nslot].lock);
+			lock_get( &d_timer->slots[oslot].lock);
+			if (tl->slot!=oslot) {
+				lock_release( &d_timer->slots[oslot].lock);
+				lock_release( &d_timer->slots[nslot].lock);
+				continue;
+			}
+		} else {
+			lock_get( &d_timer->slots[nslot].lock);
+		}
+		if ((int)(tick - d_timer->last) > 0 && tl->next!=0 && tl->prev!=0)
+			break;
+		lock_release( &d_timer->slots[nslot].lock);
+		lock_release( &d_timer->slots[oslot].lock);
 	}
+
 	remove_dialog_timer_unsafe( tl );
-	tl->timeout = get_ticks()+timeout;
-	insert_dialog_timer_unsafe( tl );
+	tl->timeout = ntimeout;
+	insert_dialog_timer_unsafe( tl, nslot );
 
-	lock_release( d_timer->lock);
+	if (nslot!=oslot)
+		lock_release( &d_timer->slots[nslot].lock);
+	lock_release( &d_timer->slots[oslot].lock);
 	return 0;
 }
 
 
 /*!
  * \brief Helper function for dlg_timer_routine
+ *
+ * Checks the slots of the seconds since the last check, each slot only
+ * once when more seconds than slots have passed. The timers of a slot
+ * that are not yet expired wait for the next round of the wheel.
  * \param time time for expiration check
  * \return list of expired dialogs on success, 0 on failure
  */
 static inline struct dlg_tl* get_expired_dlgs(unsigned int time)
 {
-	struct dlg_tl *tl , *end, *ret;
+	struct dlg_tl *tl, *ntl, *end, *ret, *last;
+	struct dlg_timer_slot *ts;
+	unsigned int tick;
 
-	lock_get( d_timer->lock);
-
-	if (d_timer->first.next==&(d_timer->first)
-	|| d_timer->first.next->timeout > time ) {
-		lock_release( d_timer->lock);
+	if ((int)(time - d_timer->last) <= 0)
 		return 0;
-	}
 
-	end = &d_timer->first;
-	tl = d_timer->first.next;
-	LM_DBG("start with tl=%p tl->prev=%p tl->next=%p (%d) at %d "
-		"and end with end=%p end->prev=%p end->next=%p\n",
-		tl,tl->prev,tl->next,tl->timeout,time,
-		end,end->prev,end->next);
-	while( tl!=end && tl->timeout <= time) {
-		LM_DBG("getting tl=%p tl->prev=%p tl->next=%p with %d\n",
-			tl,tl->prev,tl->next,tl->timeout);
-		tl->prev = 0;
-		tl->timeout = 0;
-		tl=tl->next;
-	}
-	LM_DBG("end with tl=%p tl->prev=%p tl->next=%p and d_timer->first.next->prev=%p\n",
-		tl,tl->prev,tl->next,d_timer->first.next->prev);
-
-	if (tl==end && d_timer->first.next->prev) {
-		ret = 0;
-	} else {
-		ret = d_timer->first.next;
-		tl->prev->next = 0;
-		d_timer->first.next = tl;
-		tl->prev = &d_timer->first;
+	tick = d_timer->last + 1;
+	if (time - d_timer->last > d_timer->size)
+		tick = time - d_timer->size + 1;
+
+	ret = last = 0;
+	for( ; (int)(time - tick) >= 0 ; tick++ ) {
+		ts = &d_timer->slots[tick & (d_timer->size-1)];
+		lock_get( &ts->lock);
+		end = &ts->first;
+		for( tl=end->next ; tl!=end ; tl=ntl ) {
+			ntl = tl->next;
+			if ((int)(tl->timeout - time) > 0)
+				continue;
+			LM_DBG("getting tl=%p tl->prev=%p tl->next=%p with %d\n",
+				tl,tl->prev,tl->next,tl->timeout);
+			remove_dialog_timer_unsafe(tl);
+			tl->prev = 0;
+			tl->timeout = 0;
+			tl->next = 0;
+			if (last)
+				last->next = tl;
+			else
+				ret = tl;
+			last = tl;
+		}
+		d_timer->last = tick;
+		lock_release( &ts->lock);
 	}
 
-	lock_release( d_timer->lock);
-
 	return ret;
 }
 
@@ -277,4 +378,7 @@ void dlg_timer_routine(unsigned int ticks , void * attr)
 		LM_DBG("tl=%p next=%p\n", ctl, tl);
 		timer_hdl( ctl );
 	}
+
+	/* free the dialogs unlinked from the hash table */
+	dlg_gc_run();
 }
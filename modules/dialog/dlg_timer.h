@@ -39,25 +39,40 @@ typedef struct dlg_tl
 	struct dlg_tl     *next;
 	struct dlg_tl     *prev;
 	volatile unsigned int  timeout; /*!< timeout in seconds */
+	volatile unsigned int  slot; /*!< slot of the timer wheel */
 } dlg_tl_t;
 
 
-/*! dialog timer */
+/*! slot of the dialog timer wheel */
+typedef struct dlg_timer_slot
+{
+	struct dlg_tl   first; /*!< dialog timeout list, not sorted */
+	gen_lock_t      lock; /*!< lock for the list */
+} dlg_timer_slot_t;
+
+
+/*! dialog timer, a wheel with a slot per second */
 typedef struct dlg_timer
 {
-	struct dlg_tl   first; /*!< dialog timeout list */
-	gen_lock_t      *lock; /*!< lock for the list */
+	unsigned int    size; /*!< number of slots, power of 2 */
+	volatile unsigned int last; /*!< last second checked for expiration */
+	struct dlg_timer_slot *slots; /*!< slots of the wheel */
 } dlg_timer_t;
 
 
+/*! number of slots of the dialog timer wheel */
+extern int dlg_timer_wheel_size;
+
+
 /*! dialog timer handler */
 typedef void (*dlg_timer_handler)(struct dlg_tl *);
 
 
 /*!
  * \brief Initialize the dialog timer handler
- * Initialize the dialog timer handler, allocate the lock and a global
- * timer in shared memory. The global timer handler will be set on success.
+ * Initialize the dialog timer handler, allocate the timer wheel with
+ * the locks of its slots in shared memory. The global timer handler will
+ * be set on success.
  * \param hdl dialog timer handler
  * \return 0 on success, -1 on failure
  */
@@ -31,6 +31,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
+#include <sys/time.h>
 
 #include "../../ut.h"
 #include "../../trim.h"
@@ -39,6 +40,7 @@
 #include "../../route.h"
 #include "../../dset.h"
 #include "../../mem/shm_mem.h"
+#include "../../locking.h"
 #include "../../parser/parse_uri.h"
 #include "../../parser/parse_from.h"
 #include "../../parser/parse_param.h"
@@ -55,6 +57,8 @@
 #include "../../lib/kcore/faked_msg.h"
 
 #include "ds_ht.h"
+#include "ds_index.h"
+#include "ds_ring.h"
 #include "api.h"
 #include "dispatch.h"
 
@@ -65,11 +69,24 @@
 
 #define DS_ALG_RROBIN	4
 #define DS_ALG_LOAD		10
+#define DS_ALG_RING		12
+#define DS_ALG_HRW		13
+#define DS_ALG_LATENCY	14
 
 static int _ds_table_version = DS_TABLE_VERSION;
 
 static ds_ht_t *_dsht_load = NULL;
 
+/* serializes the updates of the probing latency stats */
+static gen_lock_t *_ds_latency_lock = NULL;
+
+/* probe in progress, the parameter of the reply callback */
+typedef struct _ds_probe
+{
+	int group;
+	long long sent;		/* time the probe was sent (usec) */
+} ds_probe_t;
+
 
 extern int ds_force_dst;
 
@@ -77,12 +94,14 @@ static db_func_t ds_dbf;
 static db1_con_t* ds_db_handle=NULL;
 
 ds_set_t **ds_lists=NULL;
+ds_index_t **ds_indexes=NULL;
 
 int *ds_list_nr = NULL;
 int *crt_idx    = NULL;
 int *next_idx   = NULL;
 
 #define _ds_list 	(ds_lists[*crt_idx])
+#define _ds_index 	(ds_indexes[*crt_idx])
 #define _ds_list_nr (*ds_list_nr)
 
 static void ds_run_route(struct sip_msg *msg, str *uri, char *route);
@@ -162,6 +181,13 @@ int init_data(void)
 	}
 	ds_lists[0] = ds_lists[1] = 0;
 
+	ds_indexes = (ds_index_t**)shm_malloc(2*sizeof(ds_index_t*));
+	if(!ds_indexes)
+	{
+		LM_ERR("Out of memory\n");
+		return -1;
+	}
+	ds_indexes[0] = ds_indexes[1] = 0;
 
 	p = (int*)shm_malloc(3*sizeof(int));
 	if(!p)
@@ -175,6 +201,13 @@ int init_data(void)
 	ds_list_nr = p+2;
 	*crt_idx= *next_idx = 0;
 
+	_ds_latency_lock = lock_alloc();
+	if(_ds_latency_lock==NULL || lock_init(_ds_latency_lock)==NULL)
+	{
+		LM_ERR("cannot init the latency lock\n");
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -573,6 +606,8 @@ int reindex_dests(int list_idx, int setn)
 		sp->dlist = dp0;
 		dp_init_weights(sp);
 		dp_init_relative_weights(sp);
+		if(ds_ring_init(sp)<0)
+			goto err1;
 	}
 
 	LM_DBG("found [%d] dest sets\n", setn);
@@ -703,6 +738,11 @@ next_line:
 		LM_ERR("error on reindex\n");
 		goto error;
 	}
+	ds_indexes[*next_idx] = ds_index_build(ds_lists[*next_idx]);
+	if(ds_indexes[*next_idx]==NULL){
+		LM_ERR("error on building the index\n");
+		goto error;
+	}
 
 	fclose(f);
 	f = NULL;
@@ -912,6 +952,12 @@ int ds_load_db(void)
 		LM_ERR("error on reindex\n");
 		goto err2;
 	}
+	ds_indexes[*next_idx] = ds_index_build(ds_lists[*next_idx]);
+	if(ds_indexes[*next_idx]==NULL)
+	{
+		LM_ERR("error on building the index\n");
+		goto err2;
+	}
 
 	ds_dbf.free_result(ds_db_handle, res);
 
@@ -942,10 +988,18 @@ int ds_destroy_list(void)
 		destroy_list(1);
 		shm_free(ds_lists);
 	}
+	if (ds_indexes)
+		shm_free(ds_indexes);
 
 	if (crt_idx)
 		shm_free(crt_idx);
 
+	if (_ds_latency_lock) {
+		lock_destroy(_ds_latency_lock);
+		lock_dealloc(_ds_latency_lock);
+		_ds_latency_lock = NULL;
+	}
+
 	return 0;
 }
 
@@ -973,11 +1027,17 @@ void destroy_list(int list_id)
 		}
 		if (sp->dlist != NULL)
 			shm_free(sp->dlist);
+		ds_ring_free(sp);
 		shm_free(sp);
 		sp = sp1;
 	}
 
 	ds_lists[list_id]  = NULL;
+	if(ds_indexes)
+	{
+		ds_index_free(ds_indexes[list_id]);
+		ds_indexes[list_id] = NULL;
+	}
 }
 
 /**
@@ -1335,16 +1395,9 @@ static inline int ds_get_index(int group, ds_set_t **index)
 		return -1;
 
 	/* get the index of the set */
-	si = _ds_list;
-	while(si)
-	{
-		if(si->id == group)
-		{
-			*index = si;
-			break;
-		}
-		si = si->next;
-	}
+	si = ds_index_get_set(_ds_index, group);
+	if(si!=NULL)
+		*index = si;
 
 	if(si==NULL)
 	{
@@ -1364,15 +1417,7 @@ int ds_list_exist(int set)
 	LM_DBG("-- Looking for set %d\n", set);
 
 	/* get the index of the set */
-	si = _ds_list;
-	while(si)
-	{
-		if(si->id == set)
-		{
-			break;
-		}
-		si = si->next;
-	}
+	si = ds_index_get_set(_ds_index, set);
 
 	if(si==NULL)
 	{
@@ -1409,6 +1454,55 @@ int ds_get_leastloaded(ds_set_t *dset)
 	return k;
 }
 
+/**
+ * get the active destination with the lowest probing latency
+ * - with load set, the latency is multiplied by the number of active
+ *   calls plus one, and the destinations over maxload are skipped
+ * - the destinations not replied yet count with the average latency of
+ *   the set
+ */
+int ds_get_fastest(ds_set_t *dset, int load)
+{
+	long long score, best_score, sum;
+	int j, m, n, lat, best;
+
+	m = (ds_use_default!=0 && dset->nr>1)?dset->nr-1:dset->nr;
+	sum = 0;
+	n = 0;
+	for(j=0; j<m; j++)
+	{
+		if(dset->dlist[j].latency_stats.replies>0)
+		{
+			sum += dset->dlist[j].latency_stats.avg;
+			n++;
+		}
+	}
+
+	best = -1;
+	best_score = 0;
+	for(j=0; j<m; j++)
+	{
+		if(ds_skip_dst(dset->dlist[j].flags))
+			continue;
+		if(load && dset->dlist[j].attrs.maxload>0
+				&& dset->dlist[j].dload>=dset->dlist[j].attrs.maxload)
+			continue;
+		if(dset->dlist[j].latency_stats.replies>0)
+			lat = dset->dlist[j].latency_stats.avg;
+		else
+			lat = (n>0)?(int)(sum/n):1;
+		if(lat<1)
+			lat = 1;
+		score = (long long)lat * ((load)?dset->dlist[j].dload+1:1);
+		if(best<0 || score<best_score)
+		{
+			best = j;
+			best_score = score;
+		}
+	}
+	return best;
+}
+
 /**
  *
  */
@@ -1731,6 +1825,144 @@ int ds_select_dst(struct sip_msg *msg, int set, int alg, int mode)
 	return ds_select_dst_limit(msg, set, alg, 0, mode);
 }
 
+/**
+ * add the address of a destination, with its attributes and socket,
+ * to the failover avps
+ */
+static int ds_add_dst_avps(ds_dest_t *dp)
+{
+	int_str avp_val;
+	char buf[2+16+1];
+
+	avp_val.s = dp->uri;
+	if(add_avp(AVP_VAL_STR|dst_avp_type, dst_avp_name, avp_val)!=0)
+		return -1;
+
+	if(attrs_avp_name.n!=0 && dp->attrs.body.len>0)
+	{
+		avp_val.s = dp->attrs.body;
+		if(add_avp(AVP_VAL_STR|attrs_avp_type, attrs_avp_name, avp_val)!=0)
+			return -1;
+	}
+
+	if(sock_avp_name.n!=0 && dp->sock)
+	{
+		avp_val.s.len = 1 + sprintf(buf, "%p", dp->sock);
+		avp_val.s.s = buf;
+		if(add_avp(AVP_VAL_STR|sock_avp_type, sock_avp_name, avp_val)!=0)
+			return -1;
+	}
+	return 0;
+}
+
+/**
+ * Select with the hash ring or rendezvous hashing (alg 12 and 13)
+ * - the failover avps are added in the order of the ring (or of the
+ *   score), so that ds_next_dst() takes the destination that would get
+ *   the key if the current one was inactive
+ */
+static int ds_select_dst_hashed(sip_msg_t *msg, ds_set_t *idx, int set,
+		int alg, unsigned int hash, unsigned int limit, int mode)
+{
+	int_str avp_val;
+	double *score;
+	int *order;
+	char *mark;
+	int m, n, nd, i, cnt, sel, dflt, ret;
+
+	m = ds_ring_members(idx);
+	dflt = (ds_use_default!=0 && idx->nr!=1)?1:0;
+	/* how many from the ring: the selected one and the failovers */
+	n = 1;
+	if((ds_flags&DS_FAILOVER_ON) && dst_avp_name.n!=0 && m>1
+			&& limit>(unsigned int)dflt)
+		n = (limit-dflt<(unsigned int)m-1)?(int)(limit-dflt)+1:m;
+
+	/* scratch space: scores, order, marks */
+	score = (double*)pkg_malloc(idx->nr*(sizeof(double)+sizeof(int)+1));
+	if(score==NULL)
+	{
+		LM_ERR("no more pkg\n");
+		return -1;
+	}
+	order = (int*)(score + idx->nr);
+	mark = (char*)(order + idx->nr);
+
+	if(alg==DS_ALG_RING)
+		nd = ds_ring_select(idx, hash, order, n, mark);
+	else
+		nd = ds_hrw_select(idx, hash, order, n, score);
+
+	ret = -1;
+	if(nd>0)
+	{
+		sel = order[0];
+	} else {
+		/* no active dst hashed - only the default one is left */
+		if(dflt==0 || ds_skip_dst(idx->dlist[idx->nr-1].flags))
+			goto done;
+		sel = idx->nr-1;
+	}
+
+	if(ds_update_dst(msg, &idx->dlist[sel].uri, idx->dlist[sel].sock, mode)!=0)
+	{
+		LM_ERR("cannot set dst addr\n");
+		goto done;
+	}
+
+	LM_DBG("selected [%d-%d/%d] <%.*s>\n", alg, set, sel,
+			idx->dlist[sel].uri.len, idx->dlist[sel].uri.s);
+
+	ret = 1;
+	if(!(ds_flags&DS_FAILOVER_ON))
+		goto done;
+
+	ret = -1;
+	cnt = 0;
+	if(dst_avp_name.n!=0)
+	{
+		/* avps are taken last added first: default dst, then the rest
+		 * of the ring backwards, then the selected one */
+		if(dflt!=0 && sel!=idx->nr-1 && limit>0)
+		{
+			if(ds_add_dst_avps(&idx->dlist[idx->nr-1])<0)
+				goto done;
+			cnt++;
+		}
+		for(i=nd-1; i>0; i--)
+		{
+			LM_DBG("using entry [%d/%d]\n", set, order[i]);
+			if(ds_add_dst_avps(&idx->dlist[order[i]])<0)
+				goto done;
+			cnt++;
+		}
+		if(ds_add_dst_avps(&idx->dlist[sel])<0)
+			goto done;
+		cnt++;
+	}
+
+	if(grp_avp_name.n!=0)
+	{
+		/* add to avp the group id */
+		avp_val.n = set;
+		if(add_avp(grp_avp_type, grp_avp_name, avp_val)!=0)
+			goto done;
+	}
+
+	if(cnt_avp_name.n!=0)
+	{
+		/* add to avp the number of dst */
+		avp_val.n = cnt;
+		if(add_avp(cnt_avp_type, cnt_avp_name, avp_val)!=0)
+			goto done;
+	}
+	ret = 1;
+
+done:
+	pkg_free(score);
+	return ret;
+}
+
 /**
  * Set destination address from group 'set' selected with alogorithm 'alg'
  * - the rest of addresses in group are added as next destination in avps,
@@ -1888,6 +2120,38 @@ int ds_select_dst_limit(sip_msg_t *msg, int set, int alg, unsigned int limit, in
 			hash = idx->rwlist[idx->rwlast];
 			idx->rwlast = (idx->rwlast+1) % 100;
 			break;
+		case DS_ALG_LATENCY: /* lowest latency, with the call load */
+			/* the call load is tracked like for alg 10, if it is set */
+			cnt = (dstid_avp_name.n!=0
+					&& msg->first_line.u.request.method_value==METHOD_INVITE);
+			i = ds_get_fastest(idx, cnt);
+			if(i<0)
+			{
+				/* no address selected */
+				return -1;
+			}
+			hash = i;
+			if(cnt)
+			{
+				if(ds_load_add(msg, idx, set, hash)<0)
+					LM_ERR("unable to update destination load\n");
+				else
+					alg = DS_ALG_LOAD;
+			}
+			break;
+		case DS_ALG_RING: /* consistent hash ring */
+		case DS_ALG_HRW: /* rendezvous hashing */
+			/* key is the PV value if hash_pvar is set, else the call-id */
+			if(hash_param_model!=NULL)
+				i = ds_hash_pvar(msg, &hash);
+			else
+				i = ds_hash_callid(msg, &hash);
+			if(i!=0)
+			{
+				LM_ERR("can't get the hash key\n");
+				return -1;
+			}
+			return ds_select_dst_hashed(msg, idx, set, alg, hash, limit, mode);
 		default:
 			LM_WARN("algo %d not implemented - using first entry...\n", alg);
 			hash = 0;
@@ -2557,7 +2821,7 @@ int ds_is_addr_from_list(sip_msg_t *_m, int group, str *uri, int mode)
 {
 	pv_value_t val;
 	ds_set_t *list;
-	int j;
+	ds_dest_t *dest;
 	struct ip_addr* pipaddr;
 	struct ip_addr  aipaddr;
 	unsigned short tport;
@@ -2592,48 +2856,33 @@ int ds_is_addr_from_list(sip_msg_t *_m, int group, str *uri, int mode)
 		tproto = puri.proto;
 	}
 
-	for(list = _ds_list; list!= NULL; list= list->next)
+	if(ds_index_match_addr(_ds_index, group, pipaddr, tport, tproto, mode,
+				&list, &dest)==0)
+		return -1;
+
+	if(group==-1 && ds_setid_pvname.s!=0)
 	{
-		// LM_ERR("list id: %d (n: %d)\n", list->id, list->nr);
-		if ((group == -1) || (group == list->id))
+		val.ri = list->id;
+		if(ds_setid_pv.setf(_m, &ds_setid_pv.pvp,
+					(int)EQ_T, &val)<0)
 		{
-			for(j=0; j<list->nr; j++)
-			{
-				// LM_ERR("port no: %d (%d)\n", list->dlist[j].port, j);
-				if (ip_addr_cmp(pipaddr, &list->dlist[j].ip_address)
-						&& ((mode&DS_MATCH_NOPORT) || list->dlist[j].port==0
-							|| tport == list->dlist[j].port)
-						&& ((mode&DS_MATCH_NOPROTO)
-							|| tproto == list->dlist[j].proto))
-				{
-					if(group==-1 && ds_setid_pvname.s!=0)
-					{
-						val.ri = list->id;
-						if(ds_setid_pv.setf(_m, &ds_setid_pv.pvp,
-									(int)EQ_T, &val)<0)
-						{
-							LM_ERR("setting PV failed\n");
-							return -2;
-						}
-					}
-					if(ds_attrs_pvname.s!=0 && list->dlist[j].attrs.body.len>0)
-					{
-						memset(&val, 0, sizeof(pv_value_t));
-						val.flags = PV_VAL_STR;
-						val.rs = list->dlist[j].attrs.body;
-						if(ds_attrs_pv.setf(_m, &ds_attrs_pv.pvp,
-									(int)EQ_T, &val)<0)
-						{
-							LM_ERR("setting attrs pv failed\n");
-							return -3;
-						}
-					}
-					return 1;
-				}
-			}
+			LM_ERR("setting PV failed\n");
+			return -2;
 		}
 	}
-	return -1;
+	if(ds_attrs_pvname.s!=0 && dest->attrs.body.len>0)
+	{
+		memset(&val, 0, sizeof(pv_value_t));
+		val.flags = PV_VAL_STR;
+		val.rs = dest->attrs.body;
+		if(ds_attrs_pv.setf(_m, &ds_attrs_pv.pvp,
+					(int)EQ_T, &val)<0)
+		{
+			LM_ERR("setting attrs pv failed\n");
+			return -3;
+		}
+	}
+	return 1;
 }
 
 int ds_is_from_list(struct sip_msg *_m, int group)
@@ -2712,6 +2961,76 @@ int ds_print_mi_list(struct mi_node* rpl)
 	return 0;
 }
 
+/**
+ * current time in micro-seconds, for the probing latency
+ */
+static long long ds_time_us(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (long long)tv.tv_sec*1000000 + tv.tv_usec;
+}
+
+/**
+ * update the latency stats of a destination with the reply of a probe
+ * - sent is the time the replied probe was sent
+ * - timeout is set when the probe was not replied (local reply)
+ */
+static int ds_update_latency(int group, str *address, long long sent,
+		int timeout)
+{
+	ds_set_t *idx = NULL;
+	ds_latency_stats_t *ls;
+	long long lat;
+	int i;
+
+	if(_ds_list==NULL || _ds_list_nr<=0)
+		return -1;
+
+	if(ds_get_index(group, &idx)!=0)
+		return -1;
+
+	for(i=0; i<idx->nr; i++)
+	{
+		if(idx->dlist[i].uri.len==address->len
+				&& strncasecmp(idx->dlist[i].uri.s, address->s,
+					address->len)==0)
+			break;
+	}
+	if(i==idx->nr)
+		return -1;
+
+	ls = &idx->dlist[i].latency_stats;
+	lat = ds_time_us() - sent;
+	if(lat<0)
+		lat = 0;
+	else if(lat>0x7fffffff)
+		lat = 0x7fffffff;
+	/* the replies of the probes are handled by many processes */
+	lock_get(_ds_latency_lock);
+	if(timeout)
+	{
+		ls->timeouts++;
+		lock_release(_ds_latency_lock);
+		return 0;
+	}
+	ls->last = (int)lat;
+	if(ls->replies==0)
+	{
+		ls->avg = ls->min = ls->max = ls->last;
+	} else {
+		ls->avg += (int)(((long long)ls->last - ls->avg)*ds_latency_ewma/100);
+		if(ls->last<ls->min)
+			ls->min = ls->last;
+		if(ls->last>ls->max)
+			ls->max = ls->last;
+	}
+	ls->replies++;
+	lock_release(_ds_latency_lock);
+	return 0;
+}
+
 /*! \brief
  * Callback-Function for the OPTIONS-Request
  * This Function is called, as soon as the Transaction is finished
@@ -2720,6 +3039,7 @@ int ds_print_mi_list(struct mi_node* rpl)
 static void ds_options_callback( struct cell *t, int type,
 		struct tmcb_params *ps )
 {
+	ds_probe_t *probe;
 	int group = 0;
 	str uri = {0, 0};
 	sip_msg_t *fmsg;
@@ -2727,7 +3047,7 @@ static void ds_options_callback( struct cell *t, int type,
 
 	/* The param contains the group, in which the failed host
 	 * can be found.*/
-	if (ps->param==NULL)
+	if (ps->param==NULL || *ps->param==NULL)
 	{
 		LM_DBG("No parameter provided, OPTIONS-Request was finished"
 				" with code %d\n", ps->code);
@@ -2736,9 +3056,9 @@ static void ds_options_callback( struct cell *t, int type,
 
 	fmsg = NULL;
 
-	/* The param is a (void*) Pointer, so we need to dereference it and
-	 *  cast it to an int. */
-	group = (int)(long)(*ps->param);
+	/* The param is the probe, with the group and the time it was sent */
+	probe = (ds_probe_t*)(*ps->param);
+	group = probe->group;
 	/* The SIP-URI is taken from the Transaction.
 	 * Remove the "To: <" (s+5) and the trailing >+new-line (s - 5 (To: <)
 	 * - 3 (>\r\n)). */
@@ -2746,6 +3066,10 @@ static void ds_options_callback( struct cell *t, int type,
 	uri.len = t->to.len - 8;
 	LM_DBG("OPTIONS-Request was finished with code %d (to %.*s, group %d)\n",
 			ps->code, uri.len, uri.s, group);
+	ds_update_latency(group, &uri, probe->sent,
+			(ps->rpl==FAKED_REPLY)?1:0);
+	shm_free(probe);
+	*ps->param = NULL;
 	/* ps->code contains the result-code of the request.
 	 *
 	 * We accept both a "200 OK" or the configured reply as a valid response */
@@ -2776,6 +3100,58 @@ static void ds_options_callback( struct cell *t, int type,
 	return;
 }
 
+/**
+ * send an OPTIONS probe to a destination of a set
+ */
+static void ds_ping_dst(ds_set_t *list, int j)
+{
+	uac_req_t uac_r;
+	ds_probe_t *probe;
+
+	LM_DBG("probing set #%d, URI %.*s\n", list->id,
+			list->dlist[j].uri.len, list->dlist[j].uri.s);
+
+	/* freed by the reply callback */
+	probe = (ds_probe_t*)shm_malloc(sizeof(ds_probe_t));
+	if (probe==NULL) {
+		LM_ERR("no more shm memory\n");
+		return;
+	}
+	probe->group = list->id;
+
+	/* Send ping using TM-Module.
+	 * int request(str* m, str* ruri, str* to, str* from, str* h,
+	 *		str* b, str *oburi,
+	 *		transaction_cb cb, void* cbp); */
+	set_uac_req(&uac_r, &ds_ping_method, 0, 0, 0,
+			TMCB_LOCAL_COMPLETED, ds_options_callback, (void*)probe);
+	if (list->dlist[j].attrs.socket.s != NULL && list->dlist[j].attrs.socket.len > 0) {
+		uac_r.ssock = &list->dlist[j].attrs.socket;
+	} else if (ds_default_socket.s != NULL && ds_default_socket.len > 0) {
+		uac_r.ssock = &ds_default_socket;
+	}
+	probe->sent = ds_time_us();
+	lock_get(_ds_latency_lock);
+	list->dlist[j].latency_stats.probes++;
+	lock_release(_ds_latency_lock);
+	if (tmb.t_request(&uac_r,
+				&list->dlist[j].uri,
+				&list->dlist[j].uri,
+				&ds_ping_from,
+				&ds_outbound_proxy) < 0) {
+		LM_ERR("unable to ping [%.*s]\n",
+				list->dlist[j].uri.len, list->dlist[j].uri.s);
+		shm_free(probe);
+	}
+}
+
+/**
+ * tell if a destination is to be probed
+ */
+#define ds_probe_dst(_dp) (((_dp)->flags&DS_DISABLED_DST)==0 \
+		&& (ds_probing_mode==DS_PROBE_ALL \
+			|| ((_dp)->flags&DS_PROBING_DST)!=0))
+
 /*! \brief
  * Timer for checking probing destinations
  *
@@ -2785,7 +3161,6 @@ void ds_check_timer(unsigned int ticks, void* param)
 {
 	int j;
 	ds_set_t *list;
-	uac_req_t uac_r;
 
 	/* Check for the list. */
 	if(_ds_list==NULL || _ds_list_nr<=0)
@@ -2799,37 +3174,45 @@ void ds_check_timer(unsigned int ticks, void* param)
 	{
 		for(j=0; j<list->nr; j++)
 		{
-			/* skip addresses set in disabled state by admin */
-			if((list->dlist[j].flags&DS_DISABLED_DST) != 0)
-				continue;
-			/* If the Flag of the entry has "Probing set, send a probe:	*/
-			if (ds_probing_mode==DS_PROBE_ALL ||
-					(list->dlist[j].flags&DS_PROBING_DST) != 0)
-			{
-				LM_DBG("probing set #%d, URI %.*s\n", list->id,
-						list->dlist[j].uri.len, list->dlist[j].uri.s);
-
-				/* Send ping using TM-Module.
-				 * int request(str* m, str* ruri, str* to, str* from, str* h,
-				 *		str* b, str *oburi,
-				 *		transaction_cb cb, void* cbp); */
-				set_uac_req(&uac_r, &ds_ping_method, 0, 0, 0,
-						TMCB_LOCAL_COMPLETED, ds_options_callback,
-						(void*)(long)list->id);
-				if (list->dlist[j].attrs.socket.s != NULL && list->dlist[j].attrs.socket.len > 0) {
-					uac_r.ssock = &list->dlist[j].attrs.socket;
-				} else if (ds_default_socket.s != NULL && ds_default_socket.len > 0) {
-					uac_r.ssock = &ds_default_socket;
-				}
-				if (tmb.t_request(&uac_r,
-							&list->dlist[j].uri,
-							&list->dlist[j].uri,
-							&ds_ping_from,
-							&ds_outbound_proxy) < 0) {
-					LM_ERR("unable to ping [%.*s]\n",
-							list->dlist[j].uri.len, list->dlist[j].uri.s);
-				}
-			}
+			/* skip addresses set in disabled state by admin and send a
+			 * probe if the entry has the probing flag set */
+			if(ds_probe_dst(&list->dlist[j]))
+				ds_ping_dst(list, j);
+		}
+	}
+}
+
+/*! \brief
+ * Timer for checking probing destinations, spread over the ping interval
+ *
+ * The interval is split in steps (the param) and each run probes the
+ * destinations of one step - the destination with position k in the
+ * lists goes in the step k modulo the number of steps, so every
+ * destination is probed once per interval and the probes are not sent
+ * in bursts.
+ */
+void ds_check_utimer(unsigned int ticks, void* param)
+{
+	static unsigned int step = 0;
+	unsigned int steps, k;
+	int j;
+	ds_set_t *list;
+
+	steps = (unsigned int)(long)param;
+	if(steps==0)
+		steps = 1;
+	step = (step+1) % steps;
+
+	if(_ds_list==NULL || _ds_list_nr<=0)
+		return;
+
+	k = 0;
+	for(list = _ds_list; list!= NULL; list= list->next)
+	{
+		for(j=0; j<list->nr; j++, k++)
+		{
+			if(k%steps==step && ds_probe_dst(&list->dlist[j]))
+				ds_ping_dst(list, j);
 		}
 	}
 }
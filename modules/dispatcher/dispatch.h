@@ -63,6 +63,7 @@ extern str ds_dest_attrs_col;
 
 extern int ds_flags; 
 extern int ds_use_default;
+extern int ds_ring_vnodes;
 
 extern int_str dst_avp_name;
 extern unsigned short dst_avp_type;
@@ -96,6 +97,7 @@ extern int ds_probing_mode;
 extern str ds_outbound_proxy;
 extern str ds_default_socket;
 extern struct socket_info * ds_default_sockinfo;
+extern int ds_latency_ewma;
 
 int init_data(void);
 int init_ds_db(void);
@@ -131,6 +133,11 @@ int ds_is_addr_from_list(sip_msg_t *_m, int group, str *uri, int mode);
  */
 void ds_check_timer(unsigned int ticks, void* param);
 
+/*! \brief
+ * Timer for checking destinations, spread over the ping interval
+ */
+void ds_check_utimer(unsigned int ticks, void* param);
+
 
 /*! \brief
  * Timer for checking active calls load
@@ -152,6 +159,17 @@ typedef struct _ds_attrs
 	int rweight;
 } ds_attrs_t;
 
+typedef struct _ds_latency_stats
+{
+	int last;				/*!< latency of the last reply (usec) */
+	int avg;				/*!< moving average of the latency (usec) */
+	int min;
+	int max;
+	unsigned int probes;	/*!< probes sent */
+	unsigned int replies;	/*!< probes replied */
+	unsigned int timeouts;	/*!< probes not replied */
+} ds_latency_stats_t;
+
 typedef struct _ds_dest
 {
 	str uri;
@@ -164,9 +182,17 @@ typedef struct _ds_dest
 	unsigned short int port; 	/*!< Port of the URI */
 	unsigned short int proto; 	/*!< Protocol of the URI */
 	int message_count;
+	ds_latency_stats_t latency_stats;	/*!< probing latency */
+	unsigned int uhash;		/*!< hash of the URI (hash ring, HRW) */
 	struct _ds_dest *next;
 } ds_dest_t;
 
+typedef struct _ds_ring_point
+{
+	unsigned int hash;	/*!< position on the hash ring */
+	int dst;			/*!< index of the destination in dlist */
+} ds_ring_point_t;
+
 typedef struct _ds_set
 {
 	int id;				/*!< id of dst set */
@@ -177,6 +203,8 @@ typedef struct _ds_set
 	ds_dest_t *dlist;
 	unsigned int wlist[100];
 	unsigned int rwlist[100];
+	int rnr;			/*!< number of points on the hash ring */
+	ds_ring_point_t *ring;	/*!< hash ring, sorted by position */
 	struct _ds_set *next;
 } ds_set_t;
 
@@ -51,6 +51,7 @@
 #include "../../mod_fix.h"
 #include "../../rpc.h"
 #include "../../rpc_lookup.h"
+#include "../../timer_proc.h"
 
 #include "ds_ht.h"
 #include "dispatch.h"
@@ -71,6 +72,7 @@ char *dslistfile = CFG_DIR"dispatcher.list";
 int  ds_force_dst   = 1;
 int  ds_flags       = 0;
 int  ds_use_default = 0;
+int  ds_ring_vnodes = 160;
 static str dst_avp_param = {NULL, 0};
 static str grp_avp_param = {NULL, 0};
 static str cnt_avp_param = {NULL, 0};
@@ -101,7 +103,9 @@ int inactive_threshold = 1; /* number of replied requests, before a destination
 str ds_ping_method = str_init("OPTIONS");
 str ds_ping_from   = str_init("sip:dispatcher@localhost");
 static int ds_ping_interval = 0;
+static int ds_ping_spread = 0; /* step of the probing timer (ms), 0 - off */
 int ds_probing_mode  = DS_PROBE_NONE;
+int ds_latency_ewma = 10; /* weight of a new latency sample (percent) */
 
 static str ds_ping_reply_codes_str= {NULL, 0};
 static int** ds_ping_reply_codes = NULL;
@@ -219,6 +223,7 @@ static param_export_t params[]={
 	{"force_dst",       INT_PARAM, &ds_force_dst},
 	{"flags",           INT_PARAM, &ds_flags},
 	{"use_default",     INT_PARAM, &ds_use_default},
+	{"ring_vnodes",     INT_PARAM, &ds_ring_vnodes},
 	{"dst_avp",         PARAM_STR, &dst_avp_param},
 	{"grp_avp",         PARAM_STR, &grp_avp_param},
 	{"cnt_avp",         PARAM_STR, &cnt_avp_param},
@@ -235,6 +240,8 @@ static param_export_t params[]={
 	{"ds_ping_interval",   INT_PARAM, &ds_ping_interval},
 	{"ds_ping_reply_codes", PARAM_STR, &ds_ping_reply_codes_str},
 	{"ds_probing_mode",    INT_PARAM, &ds_probing_mode},
+	{"ds_ping_spread",     INT_PARAM, &ds_ping_spread},
+	{"ds_latency_ewma",    INT_PARAM, &ds_latency_ewma},
 	{"ds_hash_size",       INT_PARAM, &ds_hash_size},
 	{"ds_hash_expire",     INT_PARAM, &ds_hash_expire},
 	{"ds_hash_initexpire", INT_PARAM, &ds_hash_initexpire},
@@ -329,6 +336,12 @@ static int mod_init(void)
 		LM_INFO("default dispatcher socket set to <%.*s>\n", ds_default_socket.len, ds_default_socket.s);
 	}
 
+	if(ds_ring_vnodes<=0)
+	{
+		LM_WARN("invalid ring_vnodes %d - using 160\n", ds_ring_vnodes);
+		ds_ring_vnodes = 160;
+	}
+
 	if(init_data()!= 0)
 		return -1;
 
@@ -532,7 +545,24 @@ static int mod_init(void)
 		/*****************************************************
 		 * Register the PING-Timer
 		 *****************************************************/
-		register_timer(ds_check_timer, NULL, ds_ping_interval);
+		if(ds_ping_spread>0)
+		{
+			/* own timer process, forked in child_init() */
+			if(ds_ping_spread>ds_ping_interval*1000)
+				ds_ping_spread = ds_ping_interval*1000;
+			if(register_basic_timers(1)<0)
+			{
+				LM_ERR("failed to register the probing timer\n");
+				return -1;
+			}
+		} else {
+			register_timer(ds_check_timer, NULL, ds_ping_interval);
+		}
+	}
+	if(ds_latency_ewma<=0 || ds_latency_ewma>100)
+	{
+		LM_WARN("invalid ds_latency_ewma %d - using 10\n", ds_latency_ewma);
+		ds_latency_ewma = 10;
 	}
 
 	return 0;
@@ -545,6 +575,18 @@ static int child_init(int rank)
 {
 	srand((11+rank)*getpid()*7);
 
+	if(rank==PROC_MAIN && ds_ping_interval>0 && ds_ping_spread>0)
+	{
+		/* the interval is split in steps of ds_ping_spread ms */
+		if(fork_basic_utimer(PROC_TIMER, "DS PING TIMER", 1, ds_check_utimer,
+					(void*)(long)(ds_ping_interval*1000/ds_ping_spread),
+					ds_ping_spread*1000 /*usec*/)<0)
+		{
+			LM_ERR("failed to start the probing timer\n");
+			return -1;
+		}
+	}
+
 	return 0;
 }
 
@@ -1303,6 +1345,111 @@ static void dispatcher_rpc_set_state(rpc_t* rpc, void* ctx)
 }
 
 
+static const char* dispatcher_rpc_latency_doc[2] = {
+	"Return the probing latency and the load of the destinations",
+	0
+};
+
+
+/*
+ * RPC command to print the probing latency stats of the destinations
+ */
+static void dispatcher_rpc_latency(rpc_t* rpc, void* ctx)
+{
+	void* th;
+	void* ih;
+	void* rh;
+	void* sh;
+	void* vh;
+	int j;
+	char c[3];
+	ds_set_t *ds_list;
+	int ds_list_nr;
+	ds_set_t *list;
+	ds_latency_stats_t *ls;
+
+	ds_list = ds_get_list();
+	ds_list_nr = ds_get_list_nr();
+
+	if(ds_list==NULL || ds_list_nr<=0)
+	{
+		LM_ERR("no destination sets\n");
+		rpc->fault(ctx, 500, "No Destination Sets");
+		return;
+	}
+
+	if (rpc->add(ctx, "{", &th) < 0)
+	{
+		rpc->fault(ctx, 500, "Internal error root reply");
+		return;
+	}
+	if(rpc->struct_add(th, "d[",
+				"NRSETS", ds_list_nr,
+				"RECORDS",  &ih)<0)
+	{
+		rpc->fault(ctx, 500, "Internal error sets structure");
+		return;
+	}
+
+	for(list = ds_list; list!= NULL; list= list->next)
+	{
+		if (rpc->struct_add(ih, "{", "SET", &sh) < 0)
+		{
+			rpc->fault(ctx, 500, "Internal error set structure");
+			return;
+		}
+		if(rpc->struct_add(sh, "d[",
+					"ID", list->id,
+					"TARGETS", &rh)<0)
+		{
+			rpc->fault(ctx, 500, "Internal error creating set id");
+			return;
+		}
+
+		for(j=0; j<list->nr; j++)
+		{
+			ls = &list->dlist[j].latency_stats;
+			if(rpc->struct_add(rh, "{",
+						"DEST", &vh)<0)
+			{
+				rpc->fault(ctx, 500, "Internal error creating dest");
+				return;
+			}
+			memset(&c, 0, sizeof(c));
+			if (list->dlist[j].flags & DS_INACTIVE_DST)
+				c[0] = 'I';
+			else if (list->dlist[j].flags & DS_DISABLED_DST)
+				c[0] = 'D';
+			else if (list->dlist[j].flags & DS_TRYING_DST)
+				c[0] = 'T';
+			else
+				c[0] = 'A';
+			c[1] = (list->dlist[j].flags & DS_PROBING_DST)?'P':'X';
+
+			/* latency values in micro-seconds */
+			if(rpc->struct_add(vh, "Ssddddddddd",
+						"URI", &list->dlist[j].uri,
+						"FLAGS", c,
+						"AVG", ls->avg,
+						"LAST", ls->last,
+						"MIN", ls->min,
+						"MAX", ls->max,
+						"PROBES", ls->probes,
+						"REPLIES", ls->replies,
+						"TIMEOUTS", ls->timeouts,
+						"LOAD", list->dlist[j].dload,
+						"MAXLOAD", list->dlist[j].attrs.maxload)<0)
+			{
+				rpc->fault(ctx, 500, "Internal error creating dest struct");
+				return;
+			}
+		}
+	}
+
+	return;
+}
+
+
 rpc_export_t dispatcher_rpc_cmds[] = {
 	{"dispatcher.reload", dispatcher_rpc_reload,
 		dispatcher_rpc_reload_doc, 0},
@@ -1310,6 +1457,8 @@ rpc_export_t dispatcher_rpc_cmds[] = {
 		dispatcher_rpc_list_doc,   0},
 	{"dispatcher.set_state",   dispatcher_rpc_set_state,
 		dispatcher_rpc_set_state_doc,   0},
+	{"dispatcher.latency",   dispatcher_rpc_latency,
+		dispatcher_rpc_latency_doc,   0},
 	{0, 0, 0, 0}
 };
 
@@ -0,0 +1,217 @@
+/**
+ * Copyright (C) 2015 kamailio.org
+ *
+ * This file is part of Kamailio, a free SIP server.
+ *
+ * Kamailio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * Kamailio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*! \file
+ * \ingroup dispatcher
+ * \brief Dispatcher :: Index of the destination sets
+ */
+
+#include <string.h>
+
+#include "../../mem/shm_mem.h"
+#include "../../mem/mem.h"
+#include "../../dprint.h"
+#include "../../hashes.h"
+
+#include "ds_index.h"
+
+static inline unsigned int ds_set_hash(int id)
+{
+	unsigned int h;
+
+	h = (unsigned int)id * 2654435761u;
+	return h ^ (h>>16);
+}
+
+#define ds_addr_hash(_ip)	get_hash1_raw((char*)(_ip)->u.addr, (_ip)->len)
+#define ds_group_hash(_h, _id)	((_h) ^ ds_set_hash(_id))
+
+static unsigned int ds_index_size(int n)
+{
+	unsigned int size;
+
+	/* at most half full */
+	for(size=8; size < 2*(unsigned int)n; size<<=1);
+	return size;
+}
+
+/**
+ * build the index of a list of sets, in one shm block
+ */
+ds_index_t* ds_index_build(ds_set_t *list)
+{
+	ds_index_t *dsi;
+	ds_set_t *sp;
+	ds_addr_entry_t *e;
+	int *tails = NULL;
+	int *gtails;
+	unsigned int ssize, asize, h, b;
+	int setn, nentries, i;
+	char *p;
+
+	setn = nentries = 0;
+	for(sp=list; sp!=NULL; sp=sp->next)
+	{
+		setn++;
+		nentries += sp->nr;
+	}
+	ssize = ds_index_size(setn);
+	asize = ds_index_size(nentries);
+
+	dsi = (ds_index_t*)shm_malloc(sizeof(ds_index_t)
+			+ ssize*sizeof(ds_set_t*) + 2*asize*sizeof(int)
+			+ nentries*sizeof(ds_addr_entry_t));
+	if(dsi==NULL)
+	{
+		LM_ERR("no more shm\n");
+		return NULL;
+	}
+	tails = (int*)pkg_malloc(2*asize*sizeof(int));
+	if(tails==NULL)
+	{
+		LM_ERR("no more pkg\n");
+		shm_free(dsi);
+		return NULL;
+	}
+
+	memset(dsi, 0, sizeof(ds_index_t));
+	dsi->list = list;
+	dsi->setn = setn;
+	p = (char*)dsi + sizeof(ds_index_t);
+	dsi->sets = (ds_set_t**)p;
+	p += ssize*sizeof(ds_set_t*);
+	dsi->abuckets = (int*)p;
+	p += asize*sizeof(int);
+	dsi->gbuckets = (int*)p;
+	p += asize*sizeof(int);
+	dsi->aentries = (ds_addr_entry_t*)p;
+	dsi->smask = ssize - 1;
+	dsi->amask = asize - 1;
+	memset(dsi->sets, 0, ssize*sizeof(ds_set_t*));
+	gtails = tails + asize;
+	for(b=0; b<asize; b++)
+		dsi->abuckets[b] = dsi->gbuckets[b] = tails[b] = gtails[b] = -1;
+
+	for(sp=list; sp!=NULL; sp=sp->next)
+	{
+		/* the first set with an id wins, like when walking the list */
+		for(h=ds_set_hash(sp->id)&dsi->smask; dsi->sets[h]!=NULL;
+				h=(h+1)&dsi->smask)
+		{
+			if(dsi->sets[h]->id==sp->id)
+				break;
+		}
+		if(dsi->sets[h]==NULL)
+			dsi->sets[h] = sp;
+
+		/* destinations appended to keep the order of the list */
+		for(i=0; i<sp->nr; i++)
+		{
+			e = &dsi->aentries[dsi->nentries];
+			e->set = sp;
+			e->dest = &sp->dlist[i];
+			e->hash = ds_addr_hash(&sp->dlist[i].ip_address);
+			e->next = -1;
+			e->gnext = -1;
+			b = e->hash & dsi->amask;
+			if(tails[b]<0)
+				dsi->abuckets[b] = dsi->nentries;
+			else
+				dsi->aentries[tails[b]].next = dsi->nentries;
+			tails[b] = dsi->nentries;
+			b = ds_group_hash(e->hash, sp->id) & dsi->amask;
+			if(gtails[b]<0)
+				dsi->gbuckets[b] = dsi->nentries;
+			else
+				dsi->aentries[gtails[b]].gnext = dsi->nentries;
+			gtails[b] = dsi->nentries;
+			dsi->nentries++;
+		}
+	}
+
+	pkg_free(tails);
+	LM_DBG("indexed %d sets and %d destinations\n", setn, dsi->nentries);
+	return dsi;
+}
+
+/**
+ *
+ */
+void ds_index_free(ds_index_t *dsi)
+{
+	if(dsi!=NULL)
+		shm_free(dsi);
+}
+
+/**
+ * get the set with the given id
+ */
+ds_set_t* ds_index_get_set(ds_index_t *dsi, int id)
+{
+	unsigned int h;
+
+	if(dsi==NULL)
+		return NULL;
+	for(h=ds_set_hash(id)&dsi->smask; dsi->sets[h]!=NULL;
+			h=(h+1)&dsi->smask)
+	{
+		if(dsi->sets[h]->id==id)
+			return dsi->sets[h];
+	}
+	return NULL;
+}
+
+/**
+ * get the first destination matching the address, in the given group
+ * (-1 for all groups)
+ * - return 1 if found, with set and dest filled, 0 if not found
+ */
+int ds_index_match_addr(ds_index_t *dsi, int group, struct ip_addr *ip,
+		unsigned short port, unsigned short proto, int mode,
+		ds_set_t **set, ds_dest_t **dest)
+{
+	ds_addr_entry_t *e;
+	unsigned int h;
+	int i;
+
+	if(dsi==NULL || dsi->nentries==0)
+		return 0;
+	h = ds_addr_hash(ip);
+	if(group==-1)
+		i = dsi->abuckets[h&dsi->amask];
+	else
+		i = dsi->gbuckets[ds_group_hash(h, group)&dsi->amask];
+	for(; i>=0; i=(group==-1)?e->next:e->gnext)
+	{
+		e = &dsi->aentries[i];
+		if(e->hash!=h || (group!=-1 && e->set->id!=group))
+			continue;
+		if(ip_addr_cmp(ip, &e->dest->ip_address)
+				&& ((mode&DS_MATCH_NOPORT) || e->dest->port==0
+					|| port==e->dest->port)
+				&& ((mode&DS_MATCH_NOPROTO) || proto==e->dest->proto))
+		{
+			*set = e->set;
+			*dest = e->dest;
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,67 @@
+/**
+ * Copyright (C) 2015 kamailio.org
+ *
+ * This file is part of Kamailio, a free SIP server.
+ *
+ * Kamailio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * Kamailio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*! \file
+ * \ingroup dispatcher
+ * \brief Dispatcher :: Index of the destination sets
+ *
+ * Built for a loaded list of destination sets, before it becomes the
+ * current one, and freed with it. It has a hash table of the sets by id
+ * and hash tables of the destinations by IP address and by IP address and
+ * set id, with the entries kept in the order of the list, so that lookups
+ * return the same destination as walking the list.
+ */
+
+#ifndef _DS_INDEX_H_
+#define _DS_INDEX_H_
+
+#include "../../ip_addr.h"
+#include "dispatch.h"
+
+typedef struct _ds_addr_entry
+{
+	ds_set_t *set;
+	ds_dest_t *dest;
+	unsigned int hash;     /* hash of the IP address */
+	int next;              /* next entry in the address bucket, -1 for none */
+	int gnext;             /* next entry in the address and set bucket */
+} ds_addr_entry_t;
+
+typedef struct _ds_index
+{
+	ds_set_t *list;        /* the indexed list of sets */
+	int setn;              /* number of sets */
+	unsigned int smask;    /* size of the set table - 1 */
+	ds_set_t **sets;       /* sets by id, open addressing */
+	unsigned int amask;    /* number of address buckets - 1 */
+	int *abuckets;         /* first entry of each address bucket */
+	int *gbuckets;         /* first entry of each address and set bucket */
+	int nentries;
+	ds_addr_entry_t *aentries;
+} ds_index_t;
+
+ds_index_t* ds_index_build(ds_set_t *list);
+void ds_index_free(ds_index_t *dsi);
+ds_set_t* ds_index_get_set(ds_index_t *dsi, int id);
+int ds_index_match_addr(ds_index_t *dsi, int group, struct ip_addr *ip,
+		unsigned short port, unsigned short proto, int mode,
+		ds_set_t **set, ds_dest_t **dest);
+
+#endif
@@ -0,0 +1,251 @@
+/**
+ * Copyright (C) 2015 kamailio.org
+ *
+ * This file is part of Kamailio, a free SIP server.
+ *
+ * Kamailio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * Kamailio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*! \file
+ * \ingroup dispatcher
+ * \brief Dispatcher :: Consistent hash ring and rendezvous hashing
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../../mem/shm_mem.h"
+#include "../../mem/mem.h"
+#include "../../dprint.h"
+#include "../../hashes.h"
+
+#include "ds_ring.h"
+
+/**
+ * final mix of murmur3, spreads the bits of the core string hashes
+ */
+static inline unsigned int ds_mix32(unsigned int h)
+{
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+	return h;
+}
+
+#define ds_dst_weight(_dp)	(((_dp)->attrs.weight>0)?(_dp)->attrs.weight:1)
+
+static int ds_ring_cmp(const void *a, const void *b)
+{
+	const ds_ring_point_t *pa = (const ds_ring_point_t*)a;
+	const ds_ring_point_t *pb = (const ds_ring_point_t*)b;
+
+	if(pa->hash!=pb->hash)
+		return (pa->hash<pb->hash)?-1:1;
+	return pa->dst - pb->dst;
+}
+
+/**
+ * number of destinations that are hashed - all but the default one
+ */
+int ds_ring_members(ds_set_t *dset)
+{
+	if(ds_use_default!=0 && dset->nr>1)
+		return dset->nr - 1;
+	return dset->nr;
+}
+
+/**
+ * build the hash ring of a set - each destination gets ds_ring_vnodes
+ * points on average, more or less according to its weight
+ */
+int ds_ring_init(ds_set_t *dset)
+{
+	ds_ring_point_t *ring;
+	int j, k, m, t, npts, wsum;
+	int *pts;
+
+	if(dset==NULL || dset->dlist==NULL)
+		return -1;
+
+	ds_ring_free(dset);
+	m = ds_ring_members(dset);
+	for(j=0; j<dset->nr; j++)
+		dset->dlist[j].uhash = ds_mix32(get_hash1_raw(dset->dlist[j].uri.s,
+					dset->dlist[j].uri.len));
+	if(m<=0)
+		return 0;
+
+	wsum = 0;
+	for(j=0; j<m; j++)
+		wsum += ds_dst_weight(&dset->dlist[j]);
+
+	pts = (int*)pkg_malloc(m*sizeof(int));
+	if(pts==NULL)
+	{
+		LM_ERR("no more pkg\n");
+		return -1;
+	}
+	npts = 0;
+	for(j=0; j<m; j++)
+	{
+		pts[j] = (int)((long long)ds_ring_vnodes * ds_dst_weight(&dset->dlist[j])
+				* m / wsum);
+		if(pts[j]<1)
+			pts[j] = 1;
+		npts += pts[j];
+	}
+
+	ring = (ds_ring_point_t*)shm_malloc(npts*sizeof(ds_ring_point_t));
+	if(ring==NULL)
+	{
+		LM_ERR("no more shm\n");
+		pkg_free(pts);
+		return -1;
+	}
+	t = 0;
+	for(j=0; j<m; j++)
+	{
+		for(k=0; k<pts[j]; k++)
+		{
+			ring[t].hash = ds_mix32(dset->dlist[j].uhash
+					+ (unsigned int)k*0x9e3779b9u);
+			ring[t].dst = j;
+			t++;
+		}
+	}
+	pkg_free(pts);
+	qsort(ring, npts, sizeof(ds_ring_point_t), ds_ring_cmp);
+
+	dset->ring = ring;
+	dset->rnr = npts;
+	LM_DBG("set [%d]: %d points on the hash ring\n", dset->id, npts);
+	return 0;
+}
+
+/**
+ *
+ */
+void ds_ring_free(ds_set_t *dset)
+{
+	if(dset->ring!=NULL)
+		shm_free(dset->ring);
+	dset->ring = NULL;
+	dset->rnr = 0;
+}
+
+/**
+ * fill in order up to n active destinations, walking the ring from the
+ * position of the key
+ * - mark must have space for dset->nr items
+ * - return the number of destinations filled in
+ */
+int ds_ring_select(ds_set_t *dset, unsigned int key, int *order, int n,
+		char *mark)
+{
+	ds_ring_point_t *base;
+	unsigned int h;
+	int lo, len, half, i, d, cnt;
+
+	if(dset->ring==NULL || dset->rnr<=0 || n<=0)
+		return 0;
+
+	/* first point at or after the key, wrapping at the end - binary
+	 * search without branches on the comparison */
+	h = ds_mix32(key);
+	base = dset->ring;
+	for(len=dset->rnr; len>1; len-=half)
+	{
+		half = len/2;
+		base = (base[half].hash<h)?base+half:base;
+	}
+	lo = (int)(base - dset->ring) + (base->hash<h);
+	if(lo==dset->rnr)
+		lo = 0;
+
+	if(n==1)
+	{
+		/* no failover - the first active one is enough */
+		for(i=0; i<dset->rnr; i++)
+		{
+			d = dset->ring[(lo+i)%dset->rnr].dst;
+			if(!ds_skip_dst(dset->dlist[d].flags))
+			{
+				order[0] = d;
+				return 1;
+			}
+		}
+		return 0;
+	}
+
+	memset(mark, 0, dset->nr);
+	cnt = 0;
+	for(i=0; i<dset->rnr && cnt<n; i++)
+	{
+		d = dset->ring[(lo+i)%dset->rnr].dst;
+		if(mark[d])
+			continue;
+		mark[d] = 1;
+		if(ds_skip_dst(dset->dlist[d].flags))
+			continue;
+		order[cnt++] = d;
+	}
+	return cnt;
+}
+
+/**
+ * fill in order up to n active destinations, by the weighted rendezvous
+ * score of each one for the key: weight/-ln(u), with u in (0,1) from the
+ * hash of the key and of the destination
+ * - score must have space for dset->nr items
+ * - return the number of destinations filled in
+ */
+int ds_hrw_select(ds_set_t *dset, unsigned int key, int *order, int n,
+		double *score)
+{
+	int m, j, best, cnt;
+	double u;
+
+	m = ds_ring_members(dset);
+	key = ds_mix32(key);
+	for(j=0; j<m; j++)
+	{
+		if(ds_skip_dst(dset->dlist[j].flags))
+		{
+			score[j] = -1;
+			continue;
+		}
+		u = ((double)ds_mix32(key ^ dset->dlist[j].uhash) + 0.5)
+			/ 4294967296.0;
+		score[j] = ds_dst_weight(&dset->dlist[j]) / -log(u);
+	}
+
+	for(cnt=0; cnt<n; cnt++)
+	{
+		best = -1;
+		for(j=0; j<m; j++)
+		{
+			if(score[j]>=0 && (best<0 || score[j]>score[best]))
+				best = j;
+		}
+		if(best<0)
+			break;
+		order[cnt] = best;
+		score[best] = -1;
+	}
+	return cnt;
+}
@@ -0,0 +1,50 @@
+/**
+ * Copyright (C) 2015 kamailio.org
+ *
+ * This file is part of Kamailio, a free SIP server.
+ *
+ * Kamailio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * Kamailio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*! \file
+ * \ingroup dispatcher
+ * \brief Dispatcher :: Consistent hash ring and rendezvous hashing
+ *
+ * The hash ring of a set has, for each destination, a number of points
+ * (virtual nodes) proportional to its weight. It is built when the set is
+ * loaded; a key goes to the destination of the first point at or after
+ * its hash, so that when a destination becomes inactive only its keys
+ * move to other destinations. Rendezvous (highest random weight) hashing
+ * gives the same property without a ring, scoring each destination for
+ * the key.
+ *
+ * Both fill the destinations in the order to be tried for a key, skipping
+ * the inactive ones and the default destination (when use_default is set).
+ */
+
+#ifndef _DS_RING_H_
+#define _DS_RING_H_
+
+#include "dispatch.h"
+
+int ds_ring_init(ds_set_t *dset);
+void ds_ring_free(ds_set_t *dset);
+int ds_ring_members(ds_set_t *dset);
+int ds_ring_select(ds_set_t *dset, unsigned int key, int *order, int n,
+		char *mark);
+int ds_hrw_select(ds_set_t *dset, unsigned int key, int *order, int n,
+		double *score);
+
+#endif
@@ -28,6 +28,7 @@
 #include "peer.h"
 #include "dmqnode.h"
 #include "dmq_funcs.h"
+#include "dmq_batch.h"
 
 typedef int (*bcast_message_t)(dmq_peer_t* peer, str* body, dmq_node_t* except,
 		dmq_resp_cback_t* resp_cback, int max_forwards, str* content_type);
@@ -40,6 +41,7 @@ typedef struct dmq_api {
 	bcast_message_t bcast_message;
 	send_message_t send_message;
 	find_dmq_node_uri_t find_dmq_node_uri;
+	batch_message_t batch_message;
 } dmq_api_t;
 
 typedef int (*bind_dmq_f)(dmq_api_t* api);
@@ -46,6 +46,7 @@
 #include "message.h"
 #include "notification_peer.h"
 #include "dmqnode.h"
+#include "dmq_batch.h"
 
 static int mod_init(void);
 static int child_init(int);
@@ -112,6 +113,9 @@ static param_export_t params[] = {
 	{"server_address", PARAM_STR, &dmq_server_address},
 	{"notification_address", PARAM_STR, &dmq_notification_address},
 	{"multi_notify", INT_PARAM, &multi_notify},
+	{"batch_window", INT_PARAM, &dmq_batch_window},
+	{"batch_max_size", INT_PARAM, &dmq_batch_max_size},
+	{"batch_compress", INT_PARAM, &dmq_batch_compress},
 	{0, 0, 0}
 };
 
@@ -270,6 +274,10 @@ static int mod_init(void)
 		return -1;
 	}
 
+	if(dmq_batch_init()<0) {
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -295,6 +303,9 @@ static int child_init(int rank)
 				workers[i].pid = newpid;
 			}
 		}
+		if(dmq_batch_child_init()<0) {
+			return -1;
+		}
 		/* notification_node - the node from which the Kamailio instance
 		 * gets the server list on startup.
 		 * the address is given as a module parameter in dmq_notification_address
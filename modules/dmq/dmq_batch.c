@@ -0,0 +1,377 @@
+/**
+ * dmq module - distributed message queue
+ *
+ * Copyright (C) 2015 kamailio.org
+ *
+ * This file is part of Kamailio, a free SIP server.
+ *
+ * Kamailio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * Kamailio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <string.h>
+#include <arpa/inet.h>
+#include <zlib.h>
+
+#include "../../mem/mem.h"
+#include "../../mem/shm_mem.h"
+#include "../../timer_proc.h"
+#include "../../trim.h"
+#include "../../parser/parse_content.h"
+#include "dmq.h"
+#include "dmq_funcs.h"
+#include "dmq_batch.h"
+
+/* batch window in milliseconds, 0 sends every record on its own */
+int dmq_batch_window = 0;
+/* maximum size of the records of a batch, before compression */
+int dmq_batch_max_size = 8192;
+/* compress the batches with deflate */
+int dmq_batch_compress = 0;
+
+str dmq_batch_content_type = str_init("application/x-kamailio-dmq-batch");
+
+static int dmq_batch_resp_f(struct sip_msg* msg, int code,
+		dmq_node_t* node, void* param)
+{
+	LM_DBG("dmq batch response [%p %d]\n", msg, code);
+	return 0;
+}
+
+static dmq_resp_cback_t dmq_batch_resp_cback = {&dmq_batch_resp_f, 0};
+
+/**
+ * @brief check the batch parameters and register the flush timer
+ */
+int dmq_batch_init(void)
+{
+	if(dmq_batch_max_size < 512) {
+		dmq_batch_max_size = 512;
+	}
+	if(dmq_batch_window < 0) {
+		dmq_batch_window = 0;
+	}
+	if(dmq_batch_window > 0 && register_basic_timers(1) < 0) {
+		LM_ERR("failed to register the batch timer\n");
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief start the flush timer, called from child_init(PROC_MAIN)
+ */
+int dmq_batch_child_init(void)
+{
+	if(dmq_batch_window <= 0)
+		return 0;
+	if(fork_basic_utimer(PROC_TIMER, "DMQ BATCH TIMER", 1,
+				dmq_batch_timer, NULL, dmq_batch_window*1000) < 0) {
+		LM_ERR("failed to start the batch timer\n");
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief allocate the batch of a peer
+ */
+dmq_batch_t* dmq_batch_new(void)
+{
+	dmq_batch_t* batch;
+
+	batch = shm_malloc(sizeof(dmq_batch_t) + dmq_batch_max_size);
+	if(batch==NULL) {
+		LM_ERR("no more shm\n");
+		return NULL;
+	}
+	memset(batch, 0, sizeof(dmq_batch_t));
+	batch->buf = (char*)batch + sizeof(dmq_batch_t);
+	lock_init(&batch->lock);
+	return batch;
+}
+
+/**
+ * @brief build the body from the records and broadcast it
+ *
+ * buf has DMQ_BATCH_HEAD_SIZE free bytes before the records and is
+ * freed here
+ */
+static int dmq_batch_send(dmq_peer_t* peer, char* buf, int len,
+		unsigned int records)
+{
+	unsigned int n;
+	uLongf zlen;
+	char* zbuf = NULL;
+	str body;
+	int ret;
+
+	body.s = buf;
+	body.len = DMQ_BATCH_HEAD_SIZE + len;
+	memcpy(buf, DMQ_BATCH_MAGIC, 3);
+	buf[3] = 0;
+
+	if(dmq_batch_compress) {
+		zlen = compressBound(len);
+		zbuf = pkg_malloc(DMQ_BATCH_HEAD_SIZE + zlen);
+		if(zbuf==NULL) {
+			LM_ERR("no more pkg\n");
+		} else if(compress2((Bytef*)zbuf + DMQ_BATCH_HEAD_SIZE, &zlen,
+					(Bytef*)buf + DMQ_BATCH_HEAD_SIZE, len,
+					Z_DEFAULT_COMPRESSION)!=Z_OK || zlen>=len) {
+			/* not worth it, send the records as they are */
+			pkg_free(zbuf);
+			zbuf = NULL;
+		} else {
+			memcpy(zbuf, buf, 4);
+			zbuf[3] |= DMQ_BATCH_DEFLATE;
+			body.s = zbuf;
+			body.len = DMQ_BATCH_HEAD_SIZE + zlen;
+		}
+	}
+	n = htonl(records);
+	memcpy(body.s + 4, &n, 4);
+	n = htonl((unsigned int)len);
+	memcpy(body.s + 8, &n, 4);
+
+	LM_DBG("sending batch of %u records for peer %.*s (%d/%d bytes)\n",
+			records, STR_FMT(&peer->peer_id), body.len,
+			DMQ_BATCH_HEAD_SIZE + len);
+	ret = bcast_dmq_message(peer, &body, 0, &dmq_batch_resp_cback, 1,
+			&dmq_batch_content_type);
+	if(zbuf)
+		pkg_free(zbuf);
+	pkg_free(buf);
+	return ret;
+}
+
+/**
+ * @brief copy out the pending records of a batch, must be called locked
+ */
+static char* dmq_batch_take(dmq_batch_t* batch, int* len,
+		unsigned int* records)
+{
+	char* buf;
+
+	buf = pkg_malloc(DMQ_BATCH_HEAD_SIZE + batch->len);
+	if(buf==NULL) {
+		LM_ERR("no more pkg - dropping %u records\n", batch->records);
+	} else {
+		memcpy(buf + DMQ_BATCH_HEAD_SIZE, batch->buf, batch->len);
+		*len = batch->len;
+		*records = batch->records;
+	}
+	batch->len = 0;
+	batch->records = 0;
+	return buf;
+}
+
+/**
+ * @brief queue a record for broadcasting on behalf of a peer
+ *
+ * The batch is sent right away when the record does not fit in it or
+ * when no batch window is set.
+ */
+int dmq_batch_add(dmq_peer_t* peer, str* rec)
+{
+	dmq_batch_t* batch;
+	unsigned int n;
+	unsigned int records = 0;
+	char* out = NULL;
+	char* own = NULL;
+	int len = 0;
+	int ret = 0;
+
+	batch = peer->batch;
+	if(batch==NULL) {
+		LM_ERR("peer %.*s has no batch callback\n", STR_FMT(&peer->peer_id));
+		return -1;
+	}
+	if(4 + rec->len > dmq_batch_max_size) {
+		/* too big to be queued, goes on its own */
+		own = pkg_malloc(DMQ_BATCH_HEAD_SIZE + 4 + rec->len);
+		if(own==NULL) {
+			LM_ERR("no more pkg\n");
+			return -1;
+		}
+		n = htonl((unsigned int)rec->len);
+		memcpy(own + DMQ_BATCH_HEAD_SIZE, &n, 4);
+		memcpy(own + DMQ_BATCH_HEAD_SIZE + 4, rec->s, rec->len);
+	}
+
+	lock_get(&batch->lock);
+	if(batch->len > 0 && (own!=NULL
+				|| batch->len + 4 + rec->len > dmq_batch_max_size)) {
+		out = dmq_batch_take(batch, &len, &records);
+	}
+	if(own==NULL) {
+		n = htonl((unsigned int)rec->len);
+		memcpy(batch->buf + batch->len, &n, 4);
+		memcpy(batch->buf + batch->len + 4, rec->s, rec->len);
+		batch->len += 4 + rec->len;
+		batch->records++;
+		if(dmq_batch_window<=0 && out==NULL) {
+			out = dmq_batch_take(batch, &len, &records);
+		}
+	}
+	lock_release(&batch->lock);
+
+	/* keep the order of the records */
+	if(out!=NULL && dmq_batch_send(peer, out, len, records)<0)
+		ret = -1;
+	if(own!=NULL && dmq_batch_send(peer, own, 4 + rec->len, 1)<0)
+		ret = -1;
+	return ret;
+}
+
+/**
+ * @brief send the pending records of a peer
+ */
+void dmq_batch_flush(dmq_peer_t* peer)
+{
+	dmq_batch_t* batch;
+	unsigned int records = 0;
+	char* out = NULL;
+	int len = 0;
+
+	batch = peer->batch;
+	/* unlocked peek, a record added meanwhile goes with the next round */
+	if(batch==NULL || batch->len==0)
+		return;
+	lock_get(&batch->lock);
+	if(batch->len > 0)
+		out = dmq_batch_take(batch, &len, &records);
+	lock_release(&batch->lock);
+	if(out!=NULL)
+		dmq_batch_send(peer, out, len, records);
+}
+
+/**
+ * @brief timer routine sending the batches at the end of each window
+ */
+void dmq_batch_timer(unsigned int ticks, void* param)
+{
+	dmq_peer_t* peer;
+
+	/* peers are only added at startup, the list can be walked unlocked */
+	for(peer = peer_list->peers; peer; peer = peer->next) {
+		dmq_batch_flush(peer);
+	}
+}
+
+/**
+ * @brief check if the body of a KDMQ request is a batch
+ */
+int dmq_batch_is_batch(struct sip_msg* msg)
+{
+	str ct;
+
+	if(msg->content_type==NULL)
+		return 0;
+	ct = msg->content_type->body;
+	trim(&ct);
+	return (ct.len==dmq_batch_content_type.len
+			&& strncasecmp(ct.s, dmq_batch_content_type.s, ct.len)==0);
+}
+
+/**
+ * @brief apply the records of a batch with the batch callback of the peer
+ */
+int dmq_batch_apply(dmq_peer_t* peer, struct sip_msg* msg,
+		peer_reponse_t* resp, dmq_node_t* node)
+{
+	unsigned int records, rawlen, n, i;
+	unsigned int failed = 0;
+	char* zbuf = NULL;
+	uLongf zlen;
+	str body, rec;
+	char* p;
+	char* end;
+
+	body.s = get_body(msg);
+	body.len = (msg->content_length)?get_content_length(msg):0;
+	if(body.s==NULL || body.len < DMQ_BATCH_HEAD_SIZE
+			|| memcmp(body.s, DMQ_BATCH_MAGIC, 3)!=0) {
+		LM_ERR("invalid batch body\n");
+		goto invalid;
+	}
+	memcpy(&n, body.s + 4, 4);
+	records = ntohl(n);
+	memcpy(&n, body.s + 8, 4);
+	rawlen = ntohl(n);
+
+	p = body.s + DMQ_BATCH_HEAD_SIZE;
+	if(body.s[3] & DMQ_BATCH_DEFLATE) {
+		if(rawlen > DMQ_BATCH_MAX_RAW) {
+			LM_ERR("batch too big: %u\n", rawlen);
+			goto invalid;
+		}
+		zbuf = pkg_malloc(rawlen + 1);
+		if(zbuf==NULL) {
+			LM_ERR("no more pkg\n");
+			goto error;
+		}
+		zlen = rawlen;
+		if(uncompress((Bytef*)zbuf, &zlen, (Bytef*)p,
+					body.len - DMQ_BATCH_HEAD_SIZE)!=Z_OK || zlen!=rawlen) {
+			LM_ERR("cannot inflate batch\n");
+			goto invalid;
+		}
+		p = zbuf;
+	} else if(rawlen != body.len - DMQ_BATCH_HEAD_SIZE) {
+		LM_ERR("invalid batch length %u/%d\n", rawlen, body.len);
+		goto invalid;
+	}
+	end = p + rawlen;
+
+	LM_DBG("applying batch of %u records for peer %.*s\n", records,
+			STR_FMT(&peer->peer_id));
+	for(i = 0; i < records; i++) {
+		if(end - p < 4)
+			goto truncated;
+		memcpy(&n, p, 4);
+		n = ntohl(n);
+		if(n > end - p - 4)
+			goto truncated;
+		rec.s = p + 4;
+		rec.len = n;
+		p += 4 + n;
+		if(peer->batch_callback(&rec, node) < 0)
+			failed++;
+	}
+	if(zbuf)
+		pkg_free(zbuf);
+	if(failed) {
+		LM_ERR("failed to apply %u of %u records\n", failed, records);
+		resp->reason = dmq_500_rpl;
+		resp->resp_code = 500;
+		return 0;
+	}
+	resp->reason = dmq_200_rpl;
+	resp->resp_code = 200;
+	return 0;
+
+truncated:
+	LM_ERR("truncated batch (%u of %u records)\n", i, records);
+invalid:
+	if(zbuf)
+		pkg_free(zbuf);
+	resp->reason = dmq_400_rpl;
+	resp->resp_code = 400;
+	return 0;
+error:
+	resp->reason = dmq_500_rpl;
+	resp->resp_code = 500;
+	return 0;
+}
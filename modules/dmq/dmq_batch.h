@@ -0,0 +1,70 @@
+/**
+ * dmq module - distributed message queue
+ *
+ * Copyright (C) 2015 kamailio.org
+ *
+ * This file is part of Kamailio, a free SIP server.
+ *
+ * Kamailio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * Kamailio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Batched replication: the records queued by a peer are sent as one KDMQ
+ * message to every node, either when the batch window elapses or when the
+ * batch is full. The body is a header followed by the records, each one
+ * prefixed by its length (4 bytes, network order), optionally compressed
+ * with deflate. The receiving worker hands the records one by one to the
+ * batch callback of the peer.
+ */
+
+#ifndef _DMQ_BATCH_H_
+#define _DMQ_BATCH_H_
+
+#include "../../str.h"
+#include "../../locking.h"
+#include "../../parser/msg_parser.h"
+#include "peer.h"
+#include "dmqnode.h"
+
+#define DMQ_BATCH_MAGIC       "KDB"
+#define DMQ_BATCH_DEFLATE     (1<<0)
+#define DMQ_BATCH_HEAD_SIZE   12
+#define DMQ_BATCH_MAX_RAW     (16*1024*1024)
+
+typedef struct dmq_batch {
+	gen_lock_t lock;
+	char* buf;
+	int len;
+	unsigned int records;
+} dmq_batch_t;
+
+extern int dmq_batch_window;
+extern int dmq_batch_max_size;
+extern int dmq_batch_compress;
+extern str dmq_batch_content_type;
+
+int dmq_batch_init(void);
+int dmq_batch_child_init(void);
+dmq_batch_t* dmq_batch_new(void);
+int dmq_batch_add(dmq_peer_t* peer, str* rec);
+void dmq_batch_flush(dmq_peer_t* peer);
+void dmq_batch_timer(unsigned int ticks, void* param);
+int dmq_batch_is_batch(struct sip_msg* msg);
+int dmq_batch_apply(dmq_peer_t* peer, struct sip_msg* msg,
+		peer_reponse_t* resp, dmq_node_t* node);
+
+typedef int (*batch_message_t)(dmq_peer_t* peer, str* rec);
+
+#endif
@@ -43,6 +43,7 @@ int add_notification_peer()
 	memset(&not_peer, 0, sizeof(dmq_peer_t));
 	not_peer.callback = dmq_notification_callback;
 	not_peer.init_callback = NULL;
+	not_peer.batch_callback = NULL;
 	not_peer.description.s = "notification_peer";
 	not_peer.description.len = 17;
 	not_peer.peer_id.s = "notification_peer";
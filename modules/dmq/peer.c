@@ -23,6 +23,7 @@
 
 #include "peer.h"
 #include "dmq.h"
+#include "dmq_batch.h"
 
 /**
  * @brief init peer list
@@ -70,7 +71,15 @@ dmq_peer_t* add_peer(dmq_peer_list_t* peer_list, dmq_peer_t* peer)
 		return NULL;
 	}
 	*new_peer = *peer;
-	
+	new_peer->batch = NULL;
+	if(new_peer->batch_callback) {
+		new_peer->batch = dmq_batch_new();
+		if(new_peer->batch==NULL) {
+			shm_free(new_peer);
+			return NULL;
+		}
+	}
+
 	/* copy the str's */
 	new_peer->peer_id.s = (char*)new_peer + sizeof(dmq_peer_t);
 	memcpy(new_peer->peer_id.s, peer->peer_id.s, peer->peer_id.len);
@@ -42,12 +42,16 @@ typedef struct peer_response {
 
 typedef int(*peer_callback_t)(struct sip_msg*, peer_reponse_t* resp, dmq_node_t* node);
 typedef int(*init_callback_t)();
+typedef int(*peer_batch_callback_t)(str* rec, dmq_node_t* node);
 
 typedef struct dmq_peer {
 	str peer_id;
 	str description;
 	peer_callback_t callback;
 	init_callback_t init_callback;
+	/* receives the records of batched messages, set to use batching */
+	peer_batch_callback_t batch_callback;
+	struct dmq_batch* batch;
 	struct dmq_peer* next;
 } dmq_peer_t;
 
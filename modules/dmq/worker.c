@@ -24,6 +24,7 @@
 #include "dmq.h"
 #include "peer.h"
 #include "worker.h"
+#include "dmq_batch.h"
 #include "../../data_lump_rpl.h"
 #include "../../mod_fix.h"
 #include "../../sip_msg_clone.h"
@@ -102,7 +103,14 @@ void worker_loop(int id)
 					dmq_node = find_dmq_node_uri(node_list, &((struct to_body*)current_job->msg->from->parsed)->uri);
 				}
 
-				ret_value = current_job->f(current_job->msg, &peer_response, dmq_node);
+				if(current_job->orig_peer->batch_callback
+						&& dmq_batch_is_batch(current_job->msg)) {
+					ret_value = dmq_batch_apply(current_job->orig_peer,
+							current_job->msg, &peer_response, dmq_node);
+				} else {
+					ret_value = current_job->f(current_job->msg, &peer_response,
+							dmq_node);
+				}
 				if(ret_value < 0) {
 					LM_ERR("running job failed\n");
 					continue;
@@ -42,6 +42,7 @@ MODULE_VERSION
 
 static param_export_t params[] = {
 	{"enable", INT_PARAM, &dmq_usrloc_enable},
+	{"batch", INT_PARAM, &dmq_usrloc_batch},
 	{0, 0, 0}
 };
 
@@ -20,6 +20,8 @@
 *
 */
 
+#include <arpa/inet.h>
+
 #include "usrloc_sync.h"
 #include "../usrloc/usrloc.h"
 #include "../usrloc/ul_callback.h"
@@ -33,6 +35,20 @@ static str dmq_200_rpl  = str_init("OK");
 static str dmq_400_rpl  = str_init("Bad Request");
 static str dmq_500_rpl  = str_init("Server Internal Error");
 
+/* integer fields and string lengths of a batch record, 4 bytes each */
+enum {
+	UL_REC_ACTION = 0, UL_REC_EXPIRES, UL_REC_CSEQ, UL_REC_FLAGS,
+	UL_REC_CFLAGS, UL_REC_Q, UL_REC_LAST_MODIFIED, UL_REC_METHODS,
+	UL_REC_REG_ID, UL_REC_INTS
+};
+enum {
+	UL_REC_AOR = 0, UL_REC_RUID, UL_REC_C, UL_REC_RECEIVED, UL_REC_PATH,
+	UL_REC_CALLID, UL_REC_USER_AGENT, UL_REC_INSTANCE, UL_REC_STRS
+};
+#define UL_REC_SIZE ((UL_REC_INTS + UL_REC_STRS) * 4)
+
+int dmq_usrloc_batch = 0;
+
 dmq_api_t usrloc_dmqb;
 dmq_peer_t* usrloc_dmq_peer = NULL;
 dmq_resp_cback_t usrloc_dmq_resp_callback = {&usrloc_dmq_resp_callback_f, 0};
@@ -200,6 +216,8 @@ int usrloc_dmq_initialize()
 	}
 	not_peer.callback = usrloc_dmq_handle_msg;
 	not_peer.init_callback = usrloc_dmq_request_sync;
+	/* batches are accepted whatever is the local sending mode */
+	not_peer.batch_callback = usrloc_dmq_handle_record;
 	not_peer.description.s = "usrloc";
 	not_peer.description.len = 6;
 	not_peer.peer_id.s = "usrloc";
@@ -425,12 +443,146 @@ error:
 	return -1;
 }
 
+/**
+* @brief dmq callback for a contact record of a batch
+*/
+int usrloc_dmq_handle_record(str* rec, dmq_node_t* node)
+{
+	static ucontact_info_t ci;
+	unsigned int v[UL_REC_INTS + UL_REC_STRS];
+	str st[UL_REC_STRS];
+	char *p;
+	long len;
+	int i;
+
+	if (rec->len < UL_REC_SIZE) {
+		LM_ERR("invalid record\n");
+		return -1;
+	}
+	memcpy(v, rec->s, UL_REC_SIZE);
+	p = rec->s + UL_REC_SIZE;
+	len = UL_REC_SIZE;
+	for (i = 0; i < UL_REC_INTS + UL_REC_STRS; i++) {
+		v[i] = ntohl(v[i]);
+	}
+	for (i = 0; i < UL_REC_STRS; i++) {
+		/* the lengths come from the peer, check them as unsigned against
+		 * the bytes left before using them as int */
+		if (v[UL_REC_INTS + i] > (unsigned long)(rec->len - len)) {
+			LM_ERR("invalid record length\n");
+			return -1;
+		}
+		st[i].s = p;
+		st[i].len = (int)v[UL_REC_INTS + i];
+		len += st[i].len;
+		p += st[i].len;
+	}
+
+	if (v[UL_REC_ACTION] != DMQ_UPDATE) {
+		LM_DBG("Received action %u in batch. Not used...\n", v[UL_REC_ACTION]);
+		return 0;
+	}
+
+	memset( &ci, 0, sizeof(ucontact_info_t));
+	ci.ruid = st[UL_REC_RUID];
+	ci.c = &st[UL_REC_C];
+	ci.received = st[UL_REC_RECEIVED];
+	ci.path = &st[UL_REC_PATH];
+	ci.expires = (int)v[UL_REC_EXPIRES];
+	ci.q = (int)v[UL_REC_Q];
+	ci.callid = &st[UL_REC_CALLID];
+	ci.cseq = (int)v[UL_REC_CSEQ];
+	ci.flags = v[UL_REC_FLAGS];
+	ci.flags |= FL_RPL;
+	ci.cflags = v[UL_REC_CFLAGS];
+	ci.user_agent = &st[UL_REC_USER_AGENT];
+	ci.methods = v[UL_REC_METHODS];
+	ci.instance = st[UL_REC_INSTANCE];
+	ci.reg_id = v[UL_REC_REG_ID];
+	ci.tcpconn_id = -1;
+	ci.last_modified = (int)v[UL_REC_LAST_MODIFIED];
+
+	LM_DBG("Received DMQ_UPDATE in batch. Update contact info...\n");
+	return add_contact(st[UL_REC_AOR], &ci);
+}
+
+/**
+* @brief queue a contact in the dmq batch, as a record of integers and
+* string lengths followed by the strings
+*/
+static int usrloc_dmq_batch_contact(ucontact_t* ptr, str aor, int action)
+{
+	unsigned int v[UL_REC_INTS + UL_REC_STRS];
+	str* st[UL_REC_STRS];
+	char buf[UL_REC_SIZE + 1024];
+	str rec;
+	char *p;
+	int i;
+	int ret;
+
+	st[UL_REC_AOR] = &aor;
+	st[UL_REC_RUID] = &ptr->ruid;
+	st[UL_REC_C] = &ptr->c;
+	st[UL_REC_RECEIVED] = &ptr->received;
+	st[UL_REC_PATH] = &ptr->path;
+	st[UL_REC_CALLID] = &ptr->callid;
+	st[UL_REC_USER_AGENT] = &ptr->user_agent;
+	st[UL_REC_INSTANCE] = &ptr->instance;
+
+	v[UL_REC_ACTION] = action;
+	v[UL_REC_EXPIRES] = (unsigned int)ptr->expires;
+	v[UL_REC_CSEQ] = ptr->cseq;
+	v[UL_REC_FLAGS] = ptr->flags & ~FL_RPL;
+	v[UL_REC_CFLAGS] = ptr->cflags;
+	v[UL_REC_Q] = ptr->q;
+	v[UL_REC_LAST_MODIFIED] = (unsigned int)ptr->last_modified;
+	v[UL_REC_METHODS] = ptr->methods;
+	v[UL_REC_REG_ID] = ptr->reg_id;
+
+	rec.len = UL_REC_SIZE;
+	for (i = 0; i < UL_REC_STRS; i++) {
+		v[UL_REC_INTS + i] = (st[i]->s)?st[i]->len:0;
+		rec.len += v[UL_REC_INTS + i];
+	}
+	if (rec.len <= sizeof(buf)) {
+		rec.s = buf;
+	} else {
+		rec.s = (char*)pkg_malloc(rec.len);
+		if (rec.s == NULL) {
+			LM_ERR("no more pkg\n");
+			return -1;
+		}
+	}
+
+	p = rec.s + UL_REC_SIZE;
+	for (i = 0; i < UL_REC_STRS; i++) {
+		if (v[UL_REC_INTS + i] > 0) {
+			memcpy(p, st[i]->s, v[UL_REC_INTS + i]);
+			p += v[UL_REC_INTS + i];
+		}
+	}
+	for (i = 0; i < UL_REC_INTS + UL_REC_STRS; i++) {
+		v[i] = htonl(v[i]);
+	}
+	memcpy(rec.s, v, UL_REC_SIZE);
+
+	ret = usrloc_dmqb.batch_message(usrloc_dmq_peer, &rec);
+	if (rec.s != buf)
+		pkg_free(rec.s);
+	return ret;
+}
+
 int usrloc_dmq_send_contact(ucontact_t* ptr, str aor, int action, dmq_node_t* node) {
 	srjson_doc_t jdoc;
-	srjson_InitDoc(&jdoc, NULL);
-
 	int flags;
 
+	/* broadcast updates go in the batch, the sync to a node as before */
+	if (dmq_usrloc_batch && node == NULL) {
+		return usrloc_dmq_batch_contact(ptr, aor, action);
+	}
+
+	srjson_InitDoc(&jdoc, NULL);
+
 	jdoc.root = srjson_CreateObject(&jdoc);
 	if(jdoc.root==NULL) {
 		LM_ERR("cannot create json root\n");
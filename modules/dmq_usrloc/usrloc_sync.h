@@ -31,6 +31,7 @@
 
 
 extern usrloc_api_t dmq_ul;
+extern int dmq_usrloc_batch;
 
 typedef enum {
 	DMQ_NONE,
@@ -42,6 +43,7 @@ typedef enum {
 int usrloc_dmq_resp_callback_f(struct sip_msg* msg, int code, dmq_node_t* node, void* param);
 int usrloc_dmq_initialize();
 int usrloc_dmq_handle_msg(struct sip_msg* msg, peer_reponse_t* resp, dmq_node_t* node);
+int usrloc_dmq_handle_record(str* rec, dmq_node_t* node);
 int usrloc_dmq_request_sync();
 void dmq_ul_cb_contact(ucontact_t* c, int type, void* param);
 
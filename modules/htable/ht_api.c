@@ -40,6 +40,7 @@
 
 ht_t *_ht_root = NULL;
 ht_cell_t *ht_expired_cell;
+int ht_timer_slice = 100;
 
 typedef struct _keyvalue {
 	str key;
@@ -170,6 +171,28 @@ void ht_slot_unlock(ht_t *ht, int idx)
 	}
 }
 
+/**
+ * release the slot locks of all hash tables, at shutdown, in case a
+ * process was killed while holding one
+ */
+void ht_slot_unlock_all(void)
+{
+	ht_t *ht;
+	int i;
+
+	for(ht=_ht_root; ht!=NULL; ht=ht->next)
+	{
+		if(ht->entries==NULL)
+			continue;
+		for(i=0; i<ht->htsize; i++)
+		{
+			ht->entries[i].rec_lock_level = 0;
+			atomic_set(&ht->entries[i].locker_pid, 0);
+			lock_release(&ht->entries[i].lock);
+		}
+	}
+}
+
 ht_cell_t* ht_cell_new(str *name, int type, int_str *val, unsigned int cellid)
 {
 	ht_cell_t *cell;
@@ -224,6 +247,490 @@ int ht_cell_pkg_free(ht_cell_t *cell)
 }
 
 
+/**
+ * expire queue of a slot - the items with an expire time, ordered by it;
+ * an update of the expire time is mostly a move at the end, as it becomes
+ * now + autoexpire
+ */
+static void ht_elist_rm(ht_entry_t *e, ht_cell_t *it)
+{
+	if(it->eprev!=NULL)
+		it->eprev->enext = it->enext;
+	else if(e->ehead==it)
+		e->ehead = it->enext;
+	else
+		return; /* not in queue */
+	if(it->enext!=NULL)
+		it->enext->eprev = it->eprev;
+	else
+		e->etail = it->eprev;
+	it->eprev = NULL;
+	it->enext = NULL;
+	e->emin = (e->ehead!=NULL)?e->ehead->expire:0;
+}
+
+static void ht_elist_add(ht_entry_t *e, ht_cell_t *it)
+{
+	ht_cell_t *p;
+
+	if(it->expire==0)
+		return;
+	for(p=e->etail; p!=NULL && p->expire>it->expire; p=p->eprev);
+	it->eprev = p;
+	if(p!=NULL)
+	{
+		it->enext = p->enext;
+		p->enext = it;
+	} else {
+		it->enext = e->ehead;
+		e->ehead = it;
+	}
+	if(it->enext!=NULL)
+		it->enext->eprev = it;
+	else
+		e->etail = it;
+	e->emin = e->ehead->expire;
+}
+
+static void ht_elist_update(ht_entry_t *e, ht_cell_t *it)
+{
+	ht_elist_rm(e, it);
+	ht_elist_add(e, it);
+}
+
+/* flat layout - state of the buckets kept in the fingerprints array */
+#define HT_FLAT_EMPTY		0
+#define HT_FLAT_DELETED		1
+#define HT_FLAT_MIN_SIZE	8
+#define ht_flat_fp(_h)		(((_h)<2)?(_h)+2:(_h))
+/* the low bits of the hash select the slot, mix all of them for the
+ * position in the buckets of the slot (any number of buckets) */
+#define ht_flat_pos(_h, _size) \
+	((unsigned int)(((unsigned long long)(((_h)^((_h)>>16))*0x45d9f3b) \
+			* (_size))>>32))
+#define ht_flat_next(_p, _size)	(((_p)+1<(_size))?(_p)+1:0)
+
+/**
+ * find an item of a flat layout slot - the fingerprints are probed and
+ * only the items with the same one are read
+ * - pos is set to its bucket, if not NULL
+ */
+static ht_cell_t* ht_flat_find(ht_entry_t *e, unsigned int hid, str *name,
+		unsigned int *pos)
+{
+	unsigned int fp;
+	unsigned int p;
+	unsigned int n;
+
+	if(e->fsize==0)
+		return NULL;
+	fp = ht_flat_fp(hid);
+	p = ht_flat_pos(hid, e->fsize);
+	for(n=0; n<e->fsize; n++)
+	{
+		if(e->fps[p]==HT_FLAT_EMPTY)
+			return NULL;
+		if(e->fps[p]==fp && e->fcells[p]->name.len==name->len
+				&& strncmp(e->fcells[p]->name.s, name->s, name->len)==0)
+		{
+			if(pos)
+				*pos = p;
+			return e->fcells[p];
+		}
+		p = ht_flat_next(p, e->fsize);
+	}
+	return NULL;
+}
+
+/**
+ * bucket of an item of a flat layout slot
+ */
+static unsigned int ht_flat_bucket(ht_entry_t *e, ht_cell_t *it)
+{
+	unsigned int p;
+
+	p = ht_flat_pos(it->cellid, e->fsize);
+	while(e->fcells[p]!=it)
+		p = ht_flat_next(p, e->fsize);
+	return p;
+}
+
+/**
+ * rebuild the buckets of a slot, sized for a load a bit over half
+ * - the items are not moved, only their references
+ */
+static int ht_flat_resize(ht_t *ht, int idx)
+{
+	ht_entry_t *e;
+	ht_cell_t **nfcells;
+	ht_cell_t *it;
+	unsigned int *nfps;
+	unsigned int nsize;
+	unsigned int fpsize;
+	unsigned int pos;
+	char *p;
+
+	e = &ht->entries[idx];
+	nsize = (e->esize + 1)*7/4;
+	if(nsize < HT_FLAT_MIN_SIZE)
+		nsize = HT_FLAT_MIN_SIZE;
+	/* fingerprints and references in one block */
+	fpsize = (nsize*sizeof(unsigned int) + 7) & ~7;
+	p = (char*)shm_malloc(fpsize + nsize*sizeof(ht_cell_t*));
+	if(p==NULL)
+	{
+		LM_ERR("no more shm\n");
+		return -1;
+	}
+	memset(p, 0, fpsize + nsize*sizeof(ht_cell_t*));
+	nfps = (unsigned int*)p;
+	nfcells = (ht_cell_t**)(p + fpsize);
+
+	for(it=e->first; it!=NULL; it=it->next)
+	{
+		pos = ht_flat_pos(it->cellid, nsize);
+		while(nfps[pos]!=HT_FLAT_EMPTY)
+			pos = ht_flat_next(pos, nsize);
+		nfps[pos] = ht_flat_fp(it->cellid);
+		nfcells[pos] = it;
+	}
+	if(e->fps!=NULL)
+		shm_free(e->fps);
+	e->fps = nfps;
+	e->fcells = nfcells;
+	e->fsize = nsize;
+	e->fused = e->esize;
+	return 0;
+}
+
+/**
+ * add a new item to a slot of a flat layout table - it must not exist
+ */
+static ht_cell_t* ht_flat_add(ht_t *ht, int idx, unsigned int hid,
+		str *name, int type, int_str *val)
+{
+	ht_entry_t *e;
+	ht_cell_t *cell;
+	unsigned int pos;
+
+	e = &ht->entries[idx];
+	/* keep the load under 7/8, deleted buckets included - the probing
+	 * goes over the fingerprints */
+	if((e->fused + 1)*8 > e->fsize*7 && ht_flat_resize(ht, idx)<0)
+		return NULL;
+	cell = ht_cell_new(name, type, val, hid);
+	if(cell==NULL)
+		return NULL;
+	pos = ht_flat_pos(hid, e->fsize);
+	while(e->fps[pos]>HT_FLAT_DELETED)
+		pos = ht_flat_next(pos, e->fsize);
+	if(e->fps[pos]==HT_FLAT_EMPTY)
+		e->fused++;
+	e->fps[pos] = ht_flat_fp(hid);
+	e->fcells[pos] = cell;
+	/* append to keep the order of walking the items */
+	cell->prev = e->last;
+	if(e->last)
+		e->last->next = cell;
+	else
+		e->first = cell;
+	e->last = cell;
+	e->esize++;
+	return cell;
+}
+
+/**
+ * put a new item in place of an old one of a flat layout slot (same name),
+ * the old one is freed
+ */
+static void ht_flat_replace(ht_entry_t *e, unsigned int pos, ht_cell_t *it,
+		ht_cell_t *cell)
+{
+	cell->prev = it->prev;
+	cell->next = it->next;
+	if(it->prev)
+		it->prev->next = cell;
+	else
+		e->first = cell;
+	if(it->next)
+		it->next->prev = cell;
+	else
+		e->last = cell;
+	ht_elist_rm(e, it);
+	ht_elist_add(e, cell);
+	e->fcells[pos] = cell;
+	ht_cell_free(it);
+}
+
+/**
+ * remove an item of a flat layout table - the bucket is marked as deleted
+ */
+static void ht_flat_rm(ht_entry_t *e, ht_cell_t *it)
+{
+	unsigned int pos;
+
+	pos = ht_flat_bucket(e, it);
+	ht_elist_rm(e, it);
+	if(it->prev==NULL)
+		e->first = it->next;
+	else
+		it->prev->next = it->next;
+	if(it->next)
+		it->next->prev = it->prev;
+	else
+		e->last = it->prev;
+	e->fps[pos] = HT_FLAT_DELETED;
+	e->fcells[pos] = NULL;
+	e->esize--;
+	if(e->esize==0)
+	{
+		/* no probe chain left, drop the deleted buckets */
+		memset(e->fps, 0, e->fsize*sizeof(unsigned int));
+		e->fused = 0;
+	}
+	ht_cell_free(it);
+}
+
+/**
+ * pkg copy of an item, with own name and value
+ */
+static ht_cell_t* ht_flat_cell_pkg_copy(ht_cell_t *it, ht_cell_t *old)
+{
+	ht_cell_t *cell;
+
+	if(old!=NULL && old->msize>=it->msize)
+	{
+		cell = old;
+	} else {
+		cell = (ht_cell_t*)pkg_malloc(it->msize);
+		if(cell==NULL)
+			return NULL;
+	}
+	memcpy(cell, it, sizeof(ht_cell_t));
+	cell->name.s = (char*)cell + sizeof(ht_cell_t);
+	memcpy(cell->name.s, it->name.s, it->name.len + 1);
+	if(it->flags&AVP_VAL_STR)
+	{
+		cell->value.s.s = cell->name.s + it->name.len + 1;
+		memcpy(cell->value.s.s, it->value.s.s, it->value.s.len + 1);
+	}
+	cell->prev = NULL;
+	cell->next = NULL;
+	return cell;
+}
+
+static int ht_flat_set_cell(ht_t *ht, int idx, unsigned int hid, str *name,
+		int type, int_str *val, int mode)
+{
+	ht_cell_t *it, *cell;
+	unsigned int pos;
+	time_t now;
+
+	now = 0;
+	if(ht->htexpire>0)
+		now = time(NULL);
+	if(mode) ht_slot_lock(ht, idx);
+	it = ht_flat_find(&ht->entries[idx], hid, name, &pos);
+	if(it!=NULL)
+	{
+		if((type&AVP_VAL_STR) && (!(it->flags&AVP_VAL_STR)
+					|| it->value.s.len < val->s.len))
+		{
+			/* no room for the string value - new item, like the chained
+			 * layout does */
+			cell = ht_cell_new(name, type, val, hid);
+			if(cell==NULL)
+			{
+				LM_ERR("cannot create new cell\n");
+				if(mode) ht_slot_unlock(ht, idx);
+				return -1;
+			}
+			cell->expire = now + ht->htexpire;
+			ht_flat_replace(&ht->entries[idx], pos, it, cell);
+			if(mode) ht_slot_unlock(ht, idx);
+			return 0;
+		}
+		if(type&AVP_VAL_STR)
+		{
+			it->value.s.len = val->s.len;
+			memcpy(it->value.s.s, val->s.s, val->s.len);
+			it->value.s.s[it->value.s.len] = '\0';
+		} else {
+			it->flags &= ~AVP_VAL_STR;
+			it->value.n = val->n;
+		}
+		if(ht->updateexpire)
+		{
+			it->expire = now + ht->htexpire;
+			ht_elist_update(&ht->entries[idx], it);
+		}
+		if(mode) ht_slot_unlock(ht, idx);
+		return 0;
+	}
+	cell = ht_flat_add(ht, idx, hid, name, type, val);
+	if(cell==NULL)
+	{
+		LM_ERR("cannot create new cell.\n");
+		if(mode) ht_slot_unlock(ht, idx);
+		return -1;
+	}
+	cell->expire = now + ht->htexpire;
+	ht_elist_add(&ht->entries[idx], cell);
+	if(mode) ht_slot_unlock(ht, idx);
+	return 0;
+}
+
+static ht_cell_t* ht_flat_cell_value_add(ht_t *ht, int idx, unsigned int hid,
+		str *name, int val, int mode, ht_cell_t *old)
+{
+	ht_cell_t *it, *cell;
+	time_t now;
+	int_str isval;
+
+	now = 0;
+	if(ht->htexpire>0)
+		now = time(NULL);
+	if(mode) ht_slot_lock(ht, idx);
+	it = ht_flat_find(&ht->entries[idx], hid, name, NULL);
+	if(it!=NULL)
+	{
+		if(now>0 && it->expire!=0 && it->expire<now) {
+			/* entry has expired */
+			ht_handle_expired_record(ht, it);
+
+			if(ht->flags==PV_VAL_INT) {
+				/* initval is integer, use it to create a fresh entry */
+				it->flags &= ~AVP_VAL_STR;
+				it->value.n = ht->initval.n;
+			} else {
+				/* delete expired entry */
+				ht_flat_rm(&ht->entries[idx], it);
+				if(mode) ht_slot_unlock(ht, idx);
+				return NULL;
+			}
+		}
+		if(it->flags&AVP_VAL_STR)
+		{
+			/* string value cannot be incremented */
+			if(mode) ht_slot_unlock(ht, idx);
+			return NULL;
+		}
+		it->value.n += val;
+		it->expire = now + ht->htexpire;
+		ht_elist_update(&ht->entries[idx], it);
+	} else {
+		/* add val if htable has an integer init value */
+		if(ht->flags!=PV_VAL_INT)
+		{
+			if(mode) ht_slot_unlock(ht, idx);
+			return NULL;
+		}
+		isval.n = ht->initval.n + val;
+		it = ht_flat_add(ht, idx, hid, name, 0, &isval);
+		if(it==NULL)
+		{
+			LM_ERR("cannot create new cell.\n");
+			if(mode) ht_slot_unlock(ht, idx);
+			return NULL;
+		}
+		it->expire = now + ht->htexpire;
+		ht_elist_add(&ht->entries[idx], it);
+	}
+	cell = ht_flat_cell_pkg_copy(it, old);
+	if(mode) ht_slot_unlock(ht, idx);
+	return cell;
+}
+
+/**
+ * remove an item from a slot, the slot must be locked
+ */
+void ht_slot_rm_cell(ht_t *ht, int idx, ht_cell_t *it)
+{
+	if(ht->layout==HT_LAYOUT_FLAT)
+	{
+		ht_flat_rm(&ht->entries[idx], it);
+		return;
+	}
+	if(it->prev==NULL)
+		ht->entries[idx].first = it->next;
+	else
+		it->prev->next = it->next;
+	if(it->next)
+		it->next->prev = it->prev;
+	ht_elist_rm(&ht->entries[idx], it);
+	ht->entries[idx].esize--;
+	ht_cell_free(it);
+}
+
+/**
+ * exchange the items of two slots (not the locks)
+ */
+void ht_slot_swap_items(ht_entry_t *a, ht_entry_t *b)
+{
+	ht_entry_t t;
+
+	t.esize = a->esize;
+	t.first = a->first;
+	t.ehead = a->ehead;
+	t.etail = a->etail;
+	t.emin = a->emin;
+	t.last = a->last;
+	t.fsize = a->fsize;
+	t.fused = a->fused;
+	t.fps = a->fps;
+	t.fcells = a->fcells;
+
+	a->esize = b->esize;
+	a->first = b->first;
+	a->ehead = b->ehead;
+	a->etail = b->etail;
+	a->emin = b->emin;
+	a->last = b->last;
+	a->fsize = b->fsize;
+	a->fused = b->fused;
+	a->fps = b->fps;
+	a->fcells = b->fcells;
+
+	b->esize = t.esize;
+	b->first = t.first;
+	b->ehead = t.ehead;
+	b->etail = t.etail;
+	b->emin = t.emin;
+	b->last = t.last;
+	b->fsize = t.fsize;
+	b->fused = t.fused;
+	b->fps = t.fps;
+	b->fcells = t.fcells;
+}
+
+/**
+ * free all the items of a slot
+ */
+void ht_slot_free_items(ht_t *ht, ht_entry_t *e)
+{
+	ht_cell_t *it, *it0;
+
+	it = e->first;
+	while(it)
+	{
+		it0 = it;
+		it = it->next;
+		ht_cell_free(it0);
+	}
+	if(e->fps!=NULL)
+		shm_free(e->fps);
+	e->first = NULL;
+	e->ehead = NULL;
+	e->etail = NULL;
+	e->emin = 0;
+	e->last = NULL;
+	e->esize = 0;
+	e->fsize = 0;
+	e->fused = 0;
+	e->fps = NULL;
+	e->fcells = NULL;
+}
+
 ht_t *ht_get_root(void)
 {
 	return _ht_root;
@@ -252,7 +759,8 @@ ht_t* ht_get_table(str *name)
 }
 
 int ht_add_table(str *name, int autoexp, str *dbtable, int size, int dbmode,
-		int itype, int_str *ival, int updateexpire, int dmqreplicate)
+		int itype, int_str *ival, int updateexpire, int dmqreplicate,
+		str *snapfile, int layout)
 {
 	unsigned int htid;
 	ht_t *ht;
@@ -296,6 +804,21 @@ int ht_add_table(str *name, int autoexp, str *dbtable, int size, int dbmode,
 	if(ival!=NULL)
 		ht->initval = *ival;
 	ht->dmqreplicate = dmqreplicate;
+	ht->layout = layout;
+	if(snapfile!=NULL && snapfile->len>0)
+	{
+		/* zero terminated, it is used as file path */
+		ht->snapfile.s = (char*)shm_malloc(snapfile->len + 1);
+		if(ht->snapfile.s==NULL)
+		{
+			LM_ERR("no more shared memory\n");
+			shm_free(ht);
+			return -1;
+		}
+		memcpy(ht->snapfile.s, snapfile->s, snapfile->len);
+		ht->snapfile.s[snapfile->len] = '\0';
+		ht->snapfile.len = snapfile->len;
+	}
 	ht->next = _ht_root;
 	_ht_root = ht;
 	return 0;
@@ -369,7 +892,6 @@ int ht_init_tables(void)
 int ht_destroy(void)
 {
 	int i;
-	ht_cell_t *it, *it0;
 	ht_t *ht;
 	ht_t *ht0;
 
@@ -385,18 +907,14 @@ int ht_destroy(void)
 			for(i=0; i<ht->htsize; i++)
 			{
 				/* free entries */
-				it = ht->entries[i].first;
-				while(it)
-				{
-					it0 = it;
-					it = it->next;
-					ht_cell_free(it0);
-				}
+				ht_slot_free_items(ht, &ht->entries[i]);
 				/* free locks */
 				lock_destroy(&ht->entries[i].lock);
 			}
 			shm_free(ht->entries);
 		}
+		if(ht->snapfile.s!=NULL)
+			shm_free(ht->snapfile.s);
 		shm_free(ht);
 		ht = ht0;
 	}
@@ -419,6 +937,9 @@ int ht_set_cell(ht_t *ht, str *name, int type, int_str *val, int mode)
 	
 	idx = ht_get_entry(hid, ht->htsize);
 
+	if(ht->layout==HT_LAYOUT_FLAT)
+		return ht_flat_set_cell(ht, idx, hid, name, type, val, mode);
+
 	now = 0;
 	if(ht->htexpire>0)
 		now = time(NULL);
@@ -448,7 +969,10 @@ int ht_set_cell(ht_t *ht, str *name, int type, int_str *val, int mode)
 						it->value.s.s[it->value.s.len] = '\0';
 						
 						if(ht->updateexpire)
+						{
 							it->expire = now + ht->htexpire;
+							ht_elist_update(&ht->entries[idx], it);
+						}
 					} else {
 						/* new */
 						cell = ht_cell_new(name, type, val, hid);
@@ -467,6 +991,8 @@ int ht_set_cell(ht_t *ht, str *name, int type, int_str *val, int mode)
 							ht->entries[idx].first = cell;
 						if(it->next)
 							it->next->prev = cell;
+						ht_elist_rm(&ht->entries[idx], it);
+						ht_elist_add(&ht->entries[idx], cell);
 						ht_cell_free(it);
 					}
 				} else {
@@ -474,7 +1000,10 @@ int ht_set_cell(ht_t *ht, str *name, int type, int_str *val, int mode)
 					it->value.n = val->n;
 
 					if(ht->updateexpire)
+					{
 						it->expire = now + ht->htexpire;
+						ht_elist_update(&ht->entries[idx], it);
+					}
 				}
 				if(mode) ht_slot_unlock(ht, idx);
 				return 0;
@@ -498,12 +1027,17 @@ int ht_set_cell(ht_t *ht, str *name, int type, int_str *val, int mode)
 						ht->entries[idx].first = cell;
 					if(it->next)
 						it->next->prev = cell;
+					ht_elist_rm(&ht->entries[idx], it);
+					ht_elist_add(&ht->entries[idx], cell);
 					ht_cell_free(it);
 				} else {
 					it->value.n = val->n;
 
 					if(ht->updateexpire)
+					{
 						it->expire = now + ht->htexpire;
+						ht_elist_update(&ht->entries[idx], it);
+					}
 				}
 				if(mode) ht_slot_unlock(ht, idx);
 				return 0;
@@ -536,6 +1070,7 @@ int ht_set_cell(ht_t *ht, str *name, int type, int_str *val, int mode)
 			prev->next->prev = cell;
 		prev->next = cell;
 	}
+	ht_elist_add(&ht->entries[idx], cell);
 	ht->entries[idx].esize++;
 	if(mode) ht_slot_unlock(ht, idx);
 	return 0;
@@ -559,6 +1094,14 @@ int ht_del_cell(ht_t *ht, str *name)
 		return 0;
 	
 	ht_slot_lock(ht, idx);
+	if(ht->layout==HT_LAYOUT_FLAT)
+	{
+		it = ht_flat_find(&ht->entries[idx], hid, name, NULL);
+		if(it!=NULL)
+			ht_flat_rm(&ht->entries[idx], it);
+		ht_slot_unlock(ht, idx);
+		return 0;
+	}
 	it = ht->entries[idx].first;
 	while(it!=NULL && it->cellid < hid)
 		it = it->next;
@@ -574,6 +1117,7 @@ int ht_del_cell(ht_t *ht, str *name)
 				it->prev->next = it->next;
 			if(it->next)
 				it->next->prev = it->prev;
+			ht_elist_rm(&ht->entries[idx], it);
 			ht->entries[idx].esize--;
 			ht_slot_unlock(ht, idx);
 			ht_cell_free(it);
@@ -601,6 +1145,9 @@ ht_cell_t* ht_cell_value_add(ht_t *ht, str *name, int val, int mode,
 
 	idx = ht_get_entry(hid, ht->htsize);
 
+	if(ht->layout==HT_LAYOUT_FLAT)
+		return ht_flat_cell_value_add(ht, idx, hid, name, val, mode, old);
+
 	now = 0;
 	if(ht->htexpire>0)
 		now = time(NULL);
@@ -635,6 +1182,7 @@ ht_cell_t* ht_cell_value_add(ht_t *ht, str *name, int val, int mode,
 						it->prev->next = it->next;
 					if(it->next)
 						it->next->prev = it->prev;
+					ht_elist_rm(&ht->entries[idx], it);
 					ht->entries[idx].esize--;
 					if(mode) ht_slot_unlock(ht, idx);
 					ht_cell_free(it);
@@ -650,6 +1198,7 @@ ht_cell_t* ht_cell_value_add(ht_t *ht, str *name, int val, int mode,
 			} else {
 				it->value.n += val;
 				it->expire = now + ht->htexpire;
+				ht_elist_update(&ht->entries[idx], it);
 				if(old!=NULL)
 				{
 					if(old->msize>=it->msize)
@@ -700,6 +1249,7 @@ ht_cell_t* ht_cell_value_add(ht_t *ht, str *name, int val, int mode,
 			prev->next->prev = it;
 		prev->next = it;
 	}
+	ht_elist_add(&ht->entries[idx], it);
 	ht->entries[idx].esize++;
 	if(old!=NULL)
 	{
@@ -737,6 +1287,25 @@ ht_cell_t* ht_cell_pkg_copy(ht_t *ht, str *name, ht_cell_t *old)
 		return NULL;
 	
 	ht_slot_lock(ht, idx);
+	if(ht->layout==HT_LAYOUT_FLAT)
+	{
+		it = ht_flat_find(&ht->entries[idx], hid, name, NULL);
+		if(it==NULL)
+		{
+			ht_slot_unlock(ht, idx);
+			return NULL;
+		}
+		if(ht->htexpire>0 && it->expire!=0 && it->expire<time(NULL)) {
+			/* entry has expired, delete it and return NULL */
+			ht_handle_expired_record(ht, it);
+			ht_flat_rm(&ht->entries[idx], it);
+			ht_slot_unlock(ht, idx);
+			return NULL;
+		}
+		cell = ht_flat_cell_pkg_copy(it, old);
+		ht_slot_unlock(ht, idx);
+		return cell;
+	}
 	it = ht->entries[idx].first;
 	while(it!=NULL && it->cellid < hid)
 		it = it->next;
@@ -756,6 +1325,7 @@ ht_cell_t* ht_cell_pkg_copy(ht_t *ht, str *name, ht_cell_t *old)
 					it->prev->next = it->next;
 				if(it->next)
 					it->next->prev = it->prev;
+				ht_elist_rm(&ht->entries[idx], it);
 				ht->entries[idx].esize--;
 				ht_slot_unlock(ht, idx);
 				ht_cell_free(it);
@@ -821,11 +1391,13 @@ int ht_table_spec(char *spec)
 	keyvalue_t kval;
 	str name;
 	str dbtable = {0, 0};
+	str snapfile = {0, 0};
 	unsigned int autoexpire = 0;
 	unsigned int size = 4;
 	unsigned int dbmode = 0;
 	unsigned int updateexpire = 1;
 	unsigned int dmqreplicate = 0;
+	int layout = HT_LAYOUT_CHAINED;
 	str in;
 	str tok;
 	param_t *pit=NULL;
@@ -887,11 +1459,23 @@ int ht_table_spec(char *spec)
 				goto error;
 
 			LM_DBG("htable [%.*s] - dmqreplicate [%u]\n", name.len, name.s, dmqreplicate); 
+		} else if(pit->name.len==6 && strncmp(pit->name.s, "layout", 6)==0) {
+			if(tok.len==4 && strncmp(tok.s, "flat", 4)==0)
+				layout = HT_LAYOUT_FLAT;
+			else if(tok.len==7 && strncmp(tok.s, "chained", 7)==0)
+				layout = HT_LAYOUT_CHAINED;
+			else
+				goto error;
+			LM_DBG("htable [%.*s] - layout [%d]\n", name.len, name.s, layout);
+		} else if(pit->name.len==8 && strncmp(pit->name.s, "snapshot", 8)==0) {
+			snapfile = tok;
+			LM_DBG("htable [%.*s] - snapshot [%.*s]\n", name.len, name.s,
+					snapfile.len, snapfile.s);
 		} else { goto error; }
 	}
 
 	return ht_add_table(&name, autoexpire, &dbtable, size, dbmode,
-			itype, &ival, updateexpire, dmqreplicate);
+			itype, &ival, updateexpire, dmqreplicate, &snapfile, layout);
 
 error:
 	LM_ERR("invalid htable parameter [%.*s]\n", in.len, in.s);
@@ -961,9 +1545,9 @@ void ht_timer(unsigned int ticks, void *param)
 {
 	ht_t *ht;
 	ht_cell_t *it;
-	ht_cell_t *it0;
 	time_t now;
 	int i;
+	int n;
 
 	if(_ht_root==NULL)
 		return;
@@ -977,26 +1561,27 @@ void ht_timer(unsigned int ticks, void *param)
 		{
 			for(i=0; i<ht->htsize; i++)
 			{
-				/* free entries */
+				/* read without lock - a stale value only delays the
+				 * removal to next run or takes the lock for nothing */
+				if(ht->entries[i].emin==0 || ht->entries[i].emin>=now)
+					continue;
+				/* free expired entries, from the head of expire queue */
 				ht_slot_lock(ht, i);
-				it = ht->entries[i].first;
-				while(it)
+				n = 0;
+				while((it=ht->entries[i].ehead)!=NULL && it->expire<now)
 				{
-					it0 = it->next;
-					if(it->expire!=0 && it->expire<now)
+					if(n>=ht_timer_slice)
 					{
-						/* expired */
-						ht_handle_expired_record(ht, it);
-						if(it->prev==NULL)
-							ht->entries[i].first = it->next;
-						else
-							it->prev->next = it->next;
-						if(it->next)
-							it->next->prev = it->prev;
-						ht->entries[i].esize--;
-						ht_cell_free(it);
+						/* let the others get the slot */
+						ht_slot_unlock(ht, i);
+						n = 0;
+						ht_slot_lock(ht, i);
+						continue;
 					}
-					it = it0;
+					/* expired */
+					ht_handle_expired_record(ht, it);
+					ht_slot_rm_cell(ht, i, it);
+					n++;
 				}
 				ht_slot_unlock(ht, i);
 			}
@@ -1074,6 +1659,17 @@ int ht_set_cell_expire(ht_t *ht, str *name, int type, int_str *val)
 			val->n);
 
 	ht_slot_lock(ht, idx);
+	if(ht->layout==HT_LAYOUT_FLAT)
+	{
+		it = ht_flat_find(&ht->entries[idx], hid, name, NULL);
+		if(it!=NULL)
+		{
+			it->expire = now;
+			ht_elist_update(&ht->entries[idx], it);
+		}
+		ht_slot_unlock(ht, idx);
+		return 0;
+	}
 	it = ht->entries[idx].first;
 	while(it!=NULL && it->cellid < hid)
 		it = it->next;
@@ -1084,6 +1680,7 @@ int ht_set_cell_expire(ht_t *ht, str *name, int type, int_str *val)
 		{
 			/* update value */
 			it->expire = now;
+			ht_elist_update(&ht->entries[idx], it);
 			ht_slot_unlock(ht, idx);
 			return 0;
 		}
@@ -1114,6 +1711,14 @@ int ht_get_cell_expire(ht_t *ht, str *name, unsigned int *val)
 
 	now = time(NULL);
 	ht_slot_lock(ht, idx);
+	if(ht->layout==HT_LAYOUT_FLAT)
+	{
+		it = ht_flat_find(&ht->entries[idx], hid, name, NULL);
+		if(it!=NULL)
+			*val = (unsigned int)(it->expire - now);
+		ht_slot_unlock(ht, idx);
+		return 0;
+	}
 	it = ht->entries[idx].first;
 	while(it!=NULL && it->cellid < hid)
 		it = it->next;
@@ -1170,16 +1775,7 @@ int ht_rm_cell_re(str *sre, ht_t *ht, int mode)
 						match = 1;
 			}
 			if(match==1)
-			{
-				if(it->prev==NULL)
-					ht->entries[i].first = it->next;
-				else
-					it->prev->next = it->next;
-				if(it->next)
-					it->next->prev = it->prev;
-				ht->entries[i].esize--;
-				ht_cell_free(it);
-			}
+				ht_slot_rm_cell(ht, i, it);
 			it = it0;
 		}
 		ht_slot_unlock(ht, i);
@@ -1205,14 +1801,7 @@ int ht_reset_content(ht_t *ht)
 		while(it)
 		{
 			it0 = it->next;
-			if(it->prev==NULL)
-				ht->entries[i].first = it->next;
-			else
-				it->prev->next = it->next;
-			if(it->next)
-				it->next->prev = it->prev;
-			ht->entries[i].esize--;
-			ht_cell_free(it);
+			ht_slot_rm_cell(ht, i, it);
 			it = it0;
 		}
 		ht_slot_unlock(ht, i);
@@ -42,8 +42,13 @@ typedef struct _ht_cell
 	time_t  expire;
     struct _ht_cell *prev;
     struct _ht_cell *next;
+	struct _ht_cell *eprev; /* expire queue of the slot */
+	struct _ht_cell *enext;
 } ht_cell_t;
 
+#define HT_LAYOUT_CHAINED	0
+#define HT_LAYOUT_FLAT		1
+
 typedef struct _ht_entry
 {
 	unsigned int esize;  /* number of items in the slot */
@@ -51,6 +56,18 @@ typedef struct _ht_entry
 	gen_lock_t lock;     /* mutex to access items in the slot */
 	atomic_t locker_pid; /* pid of the process that holds the lock */
 	int rec_lock_level;  /* recursive lock count */
+	/* items with expire time, in the order they expire */
+	ht_cell_t *ehead;
+	ht_cell_t *etail;
+	time_t emin;         /* expire time of ehead, 0 if none */
+	/* flat layout - open addressing array of buckets with the fingerprint
+	 * of the name and a reference to the item, the items are in the list
+	 * of the slot as for the chained layout */
+	ht_cell_t *last;     /* last item in the slot */
+	unsigned int fsize;  /* number of buckets */
+	unsigned int fused;  /* number of used and deleted buckets */
+	unsigned int *fps;   /* fingerprints of the buckets */
+	ht_cell_t **fcells;  /* items of the buckets, same block as fps */
 } ht_entry_t;
 
 typedef struct _ht
@@ -65,6 +82,8 @@ typedef struct _ht
 	int updateexpire;
 	unsigned int htsize;
 	int dmqreplicate;
+	str snapfile;
+	int layout;
 	int evrt_expired;
 	ht_entry_t *entries;
 	struct _ht *next;
@@ -77,7 +96,8 @@ typedef struct _ht_pv {
 } ht_pv_t, *ht_pv_p;
 
 int ht_add_table(str *name, int autoexp, str *dbtable, int size, int dbmode,
-		int itype, int_str *ival, int updateexpire, int dmqreplicate);
+		int itype, int_str *ival, int updateexpire, int dmqreplicate,
+		str *snapfile, int layout);
 int ht_init_tables(void);
 int ht_destroy(void);
 int ht_set_cell(ht_t *ht, str *name, int type, int_str *val, int mode);
@@ -95,6 +115,8 @@ ht_t* ht_get_table(str *name);
 int ht_db_load_tables(void);
 int ht_db_sync_tables(void);
 
+extern int ht_timer_slice;
+
 int ht_has_autoexpire(void);
 void ht_timer(unsigned int ticks, void *param);
 void ht_handle_expired_record(ht_t *ht, ht_cell_t *cell);
@@ -115,4 +137,8 @@ ht_cell_t* ht_iterator_get_current(str *iname);
 
 void ht_slot_lock(ht_t *ht, int idx);
 void ht_slot_unlock(ht_t *ht, int idx);
+void ht_slot_unlock_all(void);
+void ht_slot_rm_cell(ht_t *ht, int idx, ht_cell_t *it);
+void ht_slot_swap_items(ht_entry_t *a, ht_entry_t *b);
+void ht_slot_free_items(ht_t *ht, ht_entry_t *e);
 #endif
@@ -21,6 +21,8 @@
  */
 
 
+#include <arpa/inet.h>
+
 #include "ht_dmq.h"
 #include "ht_api.h"
 
@@ -39,6 +41,15 @@ typedef struct _ht_dmq_repdata {
 	int expire;
 } ht_dmq_repdata_t;
 
+/* flags of a batch record */
+#define HT_DMQ_REC_STRVAL	(1<<0)
+#define HT_DMQ_REC_CNAME	(1<<1)
+
+/* fixed part of a batch record, followed by htname, cname and strval */
+#define HT_DMQ_REC_SIZE	16
+
+int ht_dmq_batch = 0;
+
 dmq_api_t ht_dmqb;
 dmq_peer_t* ht_dmq_peer = NULL;
 dmq_resp_cback_t ht_dmq_resp_callback = {&ht_dmq_resp_callback_f, 0};
@@ -60,6 +71,8 @@ int ht_dmq_initialize()
 
 	not_peer.callback = ht_dmq_handle_msg;
 	not_peer.init_callback = NULL;
+	/* batches are accepted whatever is the local sending mode */
+	not_peer.batch_callback = ht_dmq_handle_record;
 	not_peer.description.s = "htable";
 	not_peer.description.len = 6;
 	not_peer.peer_id.s = "htable";
@@ -185,12 +198,156 @@ error:
 	return 0;
 }
 
+/**
+ * @brief ht dmq callback for a record of a batch
+ */
+int ht_dmq_handle_record(str* rec, dmq_node_t* dmq_node)
+{
+	unsigned short l16;
+	unsigned int l32;
+	ht_dmq_action_t action;
+	str htname, cname;
+	int type, mode, flags;
+	int_str val;
+	char *sre = NULL;
+	char *p;
+	int ret;
+
+	if(rec->len < HT_DMQ_REC_SIZE) {
+		LM_ERR("invalid record\n");
+		return -1;
+	}
+	p = rec->s;
+	action = (unsigned char)p[0];
+	flags = (unsigned char)p[1];
+	mode = (unsigned char)p[2];
+	memcpy(&l32, p + 4, 4);
+	val.n = (int)ntohl(l32);
+	memcpy(&l16, p + 8, 2);
+	htname.len = ntohs(l16);
+	memcpy(&l16, p + 10, 2);
+	cname.len = ntohs(l16);
+	memcpy(&l32, p + 12, 4);
+	l32 = ntohl(l32);
+	if(HT_DMQ_REC_SIZE + htname.len + cname.len + (long)l32 != rec->len) {
+		LM_ERR("invalid record length\n");
+		return -1;
+	}
+	htname.s = p + HT_DMQ_REC_SIZE;
+	cname.s = htname.s + htname.len;
+	/* the item name is sent for all the actions but the regexp removal */
+	if(!(flags & HT_DMQ_REC_CNAME)
+			&& (cname.len!=0 || action!=HT_DMQ_RM_CELL_RE)) {
+		LM_ERR("invalid record item name\n");
+		return -1;
+	}
+	type = 0;
+	if(flags & HT_DMQ_REC_STRVAL) {
+		type = AVP_VAL_STR;
+		val.s.s = cname.s + cname.len;
+		val.s.len = l32;
+	}
+
+	if(action==HT_DMQ_RM_CELL_RE) {
+		if(type!=AVP_VAL_STR || l32==0) {
+			LM_ERR("invalid record regexp\n");
+			return -1;
+		}
+		/* regcomp() needs the regexp zero terminated */
+		sre = (char*)pkg_malloc(l32 + 1);
+		if(sre==NULL) {
+			LM_ERR("no more pkg\n");
+			return -1;
+		}
+		memcpy(sre, val.s.s, l32);
+		sre[l32] = '\0';
+		val.s.s = sre;
+	}
+
+	ret = ht_dmq_replay_action(action, &htname, &cname, type, &val, mode);
+	if(sre!=NULL)
+		pkg_free(sre);
+	if (ret!=0) {
+		LM_ERR("failed to replay action\n");
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief queue an action in the dmq batch, as a record of fixed part
+ * followed by the strings
+ */
+static int ht_dmq_batch_action(ht_dmq_action_t action, str* htname,
+		str* cname, int type, int_str* val, int mode)
+{
+	char buf[HT_DMQ_REC_SIZE + 512];
+	unsigned short l16;
+	unsigned int l32;
+	str sval = {0, 0};
+	str rec;
+	char *p;
+	int ret;
+
+	if (val!=NULL && (action==HT_DMQ_SET_CELL || action==HT_DMQ_SET_CELL_EXPIRE
+				|| action==HT_DMQ_RM_CELL_RE) && (type&AVP_VAL_STR)) {
+		sval = val->s;
+	}
+	if (htname->len>65535 || (cname!=NULL && cname->len>65535)) {
+		LM_ERR("name too long\n");
+		return -1;
+	}
+	rec.len = HT_DMQ_REC_SIZE + htname->len + ((cname)?cname->len:0)
+		+ sval.len;
+	if (rec.len<=sizeof(buf)) {
+		rec.s = buf;
+	} else {
+		rec.s = (char*)pkg_malloc(rec.len);
+		if (rec.s==NULL) {
+			LM_ERR("no more pkg\n");
+			return -1;
+		}
+	}
+
+	p = rec.s;
+	memset(p, 0, HT_DMQ_REC_SIZE);
+	p[0] = (char)action;
+	p[1] = ((sval.s)?HT_DMQ_REC_STRVAL:0) | ((cname)?HT_DMQ_REC_CNAME:0);
+	p[2] = (char)mode;
+	l32 = htonl((val!=NULL && sval.s==NULL)?(unsigned int)val->n:0);
+	memcpy(p + 4, &l32, 4);
+	l16 = htons((unsigned short)htname->len);
+	memcpy(p + 8, &l16, 2);
+	l16 = htons((unsigned short)((cname)?cname->len:0));
+	memcpy(p + 10, &l16, 2);
+	l32 = htonl((unsigned int)sval.len);
+	memcpy(p + 12, &l32, 4);
+	p += HT_DMQ_REC_SIZE;
+	memcpy(p, htname->s, htname->len);
+	p += htname->len;
+	if (cname!=NULL) {
+		memcpy(p, cname->s, cname->len);
+		p += cname->len;
+	}
+	if (sval.len>0)
+		memcpy(p, sval.s, sval.len);
+
+	ret = ht_dmqb.batch_message(ht_dmq_peer, &rec);
+	if (rec.s!=buf)
+		pkg_free(rec.s);
+	return ret;
+}
+
 int ht_dmq_replicate_action(ht_dmq_action_t action, str* htname, str* cname, int type, int_str* val, int mode) {
 
 	srjson_doc_t jdoc;
 
         LM_DBG("replicating action to dmq peers...\n");
 
+	if (ht_dmq_batch) {
+		return ht_dmq_batch_action(action, htname, cname, type, val, mode);
+	}
+
 	srjson_InitDoc(&jdoc, NULL);
 
 	jdoc.root = srjson_CreateObject(&jdoc);
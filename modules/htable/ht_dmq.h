@@ -27,6 +27,7 @@
 #include "../../parser/msg_parser.h"
 #include "../../parser/parse_content.h"
 
+extern int ht_dmq_batch;
 extern dmq_api_t ht_dmqb;
 extern dmq_peer_t* ht_dmq_peer;
 extern dmq_resp_cback_t ht_dmq_resp_callback;
@@ -41,6 +42,7 @@ typedef enum {
 
 int ht_dmq_initialize();
 int ht_dmq_handle_msg(struct sip_msg* msg, peer_reponse_t* resp, dmq_node_t* dmq_node);
+int ht_dmq_handle_record(str* rec, dmq_node_t* dmq_node);
 int ht_dmq_replicate_action(ht_dmq_action_t action, str* htname, str* cname, int type, int_str* val, int mode);
 int ht_dmq_replay_action(ht_dmq_action_t action, str* htname, str* cname, int type, int_str* val, int mode);
 int ht_dmq_resp_callback_f(struct sip_msg* msg, int code, dmq_node_t* node, void* param);
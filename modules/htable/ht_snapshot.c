@@ -0,0 +1,324 @@
+/**
+ * Copyright (C) 2015 kamailio.org
+ *
+ * This file is part of kamailio, a free SIP server.
+ *
+ * Kamailio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * Kamailio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+#include "../../dprint.h"
+#include "../../mem/mem.h"
+#include "../../mem/shm_mem.h"
+#include "../../timer_proc.h"
+#include "../../lib/srutils/snapfile.h"
+#include "ht_api.h"
+#include "ht_snapshot.h"
+
+int ht_snapshot_interval = 0;
+
+/* set once the snapshots are loaded, nothing is written before */
+static int _ht_snapshot_loaded = 0;
+
+/**
+ * check the snapshot attributes and register the snapshot timer
+ */
+int ht_snapshot_init(void)
+{
+	ht_t *ht;
+	int n;
+
+	n = 0;
+	for(ht=ht_get_root(); ht!=NULL; ht=ht->next)
+	{
+		if(ht->snapfile.len<=0)
+			continue;
+		if(ht->dbtable.len>0)
+		{
+			LM_WARN("htable [%.*s] loaded from db table, ignoring snapshot"
+					" file\n", ht->name.len, ht->name.s);
+			shm_free(ht->snapfile.s);
+			ht->snapfile.s = NULL;
+			ht->snapfile.len = 0;
+			continue;
+		}
+		n++;
+	}
+	if(n>0 && ht_snapshot_interval>0)
+	{
+		if(register_basic_timers(1)<0)
+		{
+			LM_ERR("failed to register the snapshot timer\n");
+			return -1;
+		}
+	} else if(n==0) {
+		ht_snapshot_interval = 0;
+	}
+	return 0;
+}
+
+static int ht_snap_add(snapfile_t *sf, ht_cell_t *it)
+{
+	ht_snap_rec_t rec;
+	char *p;
+
+	memset(&rec, 0, sizeof(ht_snap_rec_t));
+	rec.flags = it->flags;
+	rec.expire = (long long)it->expire;
+	rec.nlen = it->name.len;
+	if(it->flags&AVP_VAL_STR)
+		rec.vlen = it->value.s.len;
+	else
+		rec.ival = it->value.n;
+	rec.rsize = SNAPFILE_ALIGN(sizeof(ht_snap_rec_t) + rec.nlen + rec.vlen);
+
+	p = snapfile_rec(sf, rec.rsize);
+	if(p==NULL)
+		return -1;
+	memcpy(p, &rec, sizeof(ht_snap_rec_t));
+	p += sizeof(ht_snap_rec_t);
+	memcpy(p, it->name.s, rec.nlen);
+	p += rec.nlen;
+	if(rec.vlen>0)
+		memcpy(p, it->value.s.s, rec.vlen);
+	return 0;
+}
+
+/**
+ * write the items of a hash table to its snapshot file
+ */
+static int ht_snapshot_save(ht_t *ht)
+{
+	ht_snap_head_t head;
+	snapfile_t sf;
+	ht_cell_t *it;
+	time_t now;
+	int i;
+
+	now = time(NULL);
+	memset(&head, 0, sizeof(ht_snap_head_t));
+	memcpy(head.magic, HT_SNAP_MAGIC, 4);
+	head.version = HT_SNAP_VERSION;
+	head.stime = (long long)now;
+	if(snapfile_open(&sf, &ht->snapfile, &head, sizeof(ht_snap_head_t))<0)
+		return -1;
+
+	for(i=0; i<ht->htsize; i++)
+	{
+		ht_slot_lock(ht, i);
+		for(it=ht->entries[i].first; it!=NULL; it=it->next)
+		{
+			if(ht->htexpire>0 && it->expire!=0 && it->expire<=now)
+				continue;
+			if(ht_snap_add(&sf, it)<0)
+			{
+				ht_slot_unlock(ht, i);
+				goto error;
+			}
+		}
+		ht_slot_unlock(ht, i);
+
+		if(snapfile_flush(&sf)<0)
+			goto error;
+	}
+
+	head.records = sf.records;
+	if(snapfile_close(&sf, &head, sizeof(ht_snap_head_t))<0)
+		return -1;
+
+	LM_DBG("saved %u items of htable [%.*s] to %s\n", head.records,
+			ht->name.len, ht->name.s, ht->snapfile.s);
+	return 0;
+
+error:
+	snapfile_abort(&sf);
+	return -1;
+}
+
+/**
+ * load the items of a hash table from its snapshot file
+ */
+static int ht_snapshot_load(ht_t *ht)
+{
+	struct stat st;
+	struct timeval tstart, tend;
+	ht_snap_head_t *head;
+	ht_snap_rec_t *rec;
+	unsigned int loaded, skipped, n;
+	int_str val;
+	int_str expires;
+	str name;
+	char *p;
+	size_t off;
+	time_t now;
+	int fd;
+	int ret;
+
+	fd = open(ht->snapfile.s, O_RDONLY);
+	if(fd<0)
+	{
+		if(errno==ENOENT)
+		{
+			LM_INFO("no snapshot file %s for htable [%.*s]\n",
+					ht->snapfile.s, ht->name.len, ht->name.s);
+			return 0;
+		}
+		LM_ERR("cannot open %s: %s\n", ht->snapfile.s, strerror(errno));
+		return -1;
+	}
+	if(fstat(fd, &st)<0 || st.st_size<sizeof(ht_snap_head_t))
+	{
+		LM_ERR("invalid snapshot file %s\n", ht->snapfile.s);
+		close(fd);
+		return -1;
+	}
+	p = (char*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if(p==MAP_FAILED)
+	{
+		LM_ERR("cannot map %s: %s\n", ht->snapfile.s, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	ret = -1;
+	gettimeofday(&tstart, NULL);
+	head = (ht_snap_head_t*)p;
+	if(memcmp(head->magic, HT_SNAP_MAGIC, 4)!=0
+			|| head->version!=HT_SNAP_VERSION)
+	{
+		LM_ERR("unknown format of snapshot file %s\n", ht->snapfile.s);
+		goto done;
+	}
+
+	now = time(NULL);
+	loaded = skipped = 0;
+	off = sizeof(ht_snap_head_t);
+	for(n=0; n<head->records; n++)
+	{
+		if(off + sizeof(ht_snap_rec_t) > st.st_size)
+			goto truncated;
+		rec = (ht_snap_rec_t*)(p + off);
+		if(rec->rsize<sizeof(ht_snap_rec_t) || off + rec->rsize > st.st_size
+				|| sizeof(ht_snap_rec_t) + (size_t)rec->nlen
+					+ (size_t)rec->vlen > rec->rsize)
+			goto truncated;
+		name.s = p + off + sizeof(ht_snap_rec_t);
+		name.len = rec->nlen;
+		off += rec->rsize;
+
+		if(ht->htexpire>0 && rec->expire!=0 && rec->expire<=(long long)now)
+		{
+			skipped++;
+			continue;
+		}
+		if(rec->flags&AVP_VAL_STR)
+		{
+			val.s.s = name.s + name.len;
+			val.s.len = rec->vlen;
+		} else {
+			val.n = rec->ival;
+		}
+		if(ht_set_cell(ht, &name, rec->flags&AVP_VAL_STR, &val, 0)!=0)
+		{
+			LM_ERR("error adding to hash table [%.*s]\n", ht->name.len,
+					ht->name.s);
+			goto done;
+		}
+		if(ht->htexpire>0 && rec->expire!=0)
+		{
+			expires.n = (int)(rec->expire - now);
+			if(ht_set_cell_expire(ht, &name, 0, &expires)!=0)
+			{
+				LM_ERR("error setting expires to hash entry [%.*s]\n",
+						name.len, name.s);
+				goto done;
+			}
+		}
+		loaded++;
+	}
+
+	gettimeofday(&tend, NULL);
+	LM_INFO("loaded %u items of htable [%.*s] from %s (%u expired skipped)"
+			" in %u ms\n", loaded, ht->name.len, ht->name.s, ht->snapfile.s,
+			skipped, (unsigned int)((tend.tv_sec - tstart.tv_sec)*1000
+				+ (tend.tv_usec - tstart.tv_usec)/1000));
+	ret = 0;
+	goto done;
+
+truncated:
+	LM_ERR("truncated snapshot file %s\n", ht->snapfile.s);
+done:
+	munmap(p, st.st_size);
+	close(fd);
+	return ret;
+}
+
+/**
+ * load all hash tables that have a snapshot file
+ */
+int ht_snapshot_load_tables(void)
+{
+	ht_t *ht;
+
+	for(ht=ht_get_root(); ht!=NULL; ht=ht->next)
+	{
+		if(ht->snapfile.len<=0)
+			continue;
+		if(ht_snapshot_load(ht)!=0)
+			return -1;
+	}
+	_ht_snapshot_loaded = 1;
+	return 0;
+}
+
+/**
+ * save all hash tables that have a snapshot file
+ */
+int ht_snapshot_save_tables(void)
+{
+	ht_t *ht;
+	int ret;
+
+	/* a failed startup must not overwrite the previous snapshots */
+	if(_ht_snapshot_loaded==0)
+		return 0;
+	ret = 0;
+	for(ht=ht_get_root(); ht!=NULL; ht=ht->next)
+	{
+		if(ht->snapfile.len<=0)
+			continue;
+		if(ht_snapshot_save(ht)!=0)
+			ret = -1;
+	}
+	return ret;
+}
+
+/**
+ * timer routine writing the snapshots periodically
+ */
+void ht_snapshot_timer(unsigned int ticks, void *param)
+{
+	ht_snapshot_save_tables();
+}
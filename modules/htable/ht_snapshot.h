@@ -0,0 +1,61 @@
+/**
+ * Copyright (C) 2015 kamailio.org
+ *
+ * This file is part of kamailio, a free SIP server.
+ *
+ * Kamailio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * Kamailio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Snapshot file of a hash table, keeping its items over restarts without
+ * a database. The file has a header followed by one record per item,
+ * aligned to 8 bytes and made of a fixed part, the name and the value (for
+ * string values).
+ */
+
+#ifndef _HT_SNAPSHOT_H_
+#define _HT_SNAPSHOT_H_
+
+#define HT_SNAP_MAGIC   "KHTS"
+#define HT_SNAP_VERSION 1
+
+typedef struct _ht_snap_head
+{
+	char magic[4];
+	unsigned int version;
+	unsigned int records;
+	unsigned int reserved;
+	long long stime;
+} ht_snap_head_t;
+
+typedef struct _ht_snap_rec
+{
+	unsigned int rsize;
+	unsigned int flags;
+	long long expire;
+	int ival;
+	unsigned int nlen;
+	unsigned int vlen;
+	unsigned int reserved;
+} ht_snap_rec_t;
+
+extern int ht_snapshot_interval;
+
+int ht_snapshot_init(void);
+int ht_snapshot_load_tables(void);
+int ht_snapshot_save_tables(void);
+void ht_snapshot_timer(unsigned int ticks, void *param);
+
+#endif
@@ -28,6 +28,7 @@
 
 #include "../../sr_module.h"
 #include "../../timer.h"
+#include "../../timer_proc.h"
 #include "../../route.h"
 #include "../../dprint.h"
 #include "../../hashes.h"
@@ -44,6 +45,7 @@
 #include "ht_var.h"
 #include "api.h"
 #include "ht_dmq.h"
+#include "ht_snapshot.h"
 
 
 MODULE_VERSION
@@ -142,8 +144,11 @@ static param_export_t params[]={
 	{"array_size_suffix",  PARAM_STR, &ht_array_size_suffix},
 	{"fetch_rows",         INT_PARAM, &ht_fetch_rows},
 	{"timer_interval",     INT_PARAM, &ht_timer_interval},
+	{"timer_slice",        INT_PARAM, &ht_timer_slice},
 	{"db_expires",         INT_PARAM, &ht_db_expires_flag},
 	{"enable_dmq",         INT_PARAM, &ht_enable_dmq},
+	{"dmq_batch",          INT_PARAM, &ht_dmq_batch},
+	{"snapshot_interval",  INT_PARAM, &ht_snapshot_interval},
 	{0,0,0}
 };
 
@@ -197,11 +202,17 @@ static int mod_init(void)
 		}
 		ht_db_close_con();
 	}
+	if(ht_snapshot_init()!=0)
+		return -1;
+	if(ht_snapshot_load_tables()!=0)
+		return -1;
 	if(ht_has_autoexpire())
 	{
 		LM_DBG("starting auto-expire timer\n");
 		if(ht_timer_interval<=0)
 			ht_timer_interval = 20;
+		if(ht_timer_slice<=0)
+			ht_timer_slice = 100;
 		if(register_timer(ht_timer, 0, ht_timer_interval)<0)
 		{
 			LM_ERR("failed to register timer function\n");
@@ -227,6 +238,15 @@ static int child_init(int rank)
 	int rtb, rt;
 
 	LM_DBG("rank is (%d)\n", rank);
+	if (rank==PROC_MAIN && ht_snapshot_interval>0)
+	{
+		if(fork_basic_timer(PROC_TIMER, "HTABLE Snapshot", 1,
+					ht_snapshot_timer, NULL, ht_snapshot_interval)<0)
+		{
+			LM_ERR("failed to start snapshot timer process\n");
+			return -1;
+		}
+	}
 	if (rank!=PROC_INIT)
 		return 0;
 	
@@ -256,6 +276,8 @@ static int child_init(int rank)
  */
 static void destroy(void)
 {
+	/* a process may have been killed while holding a slot lock */
+	ht_slot_unlock_all();
 	/* sync back to db */
 	if(ht_db_url.len>0)
 	{
@@ -268,6 +290,8 @@ static void destroy(void)
 			}
 		}
 	}
+	/* keep the items for the next start */
+	ht_snapshot_save_tables();
 	ht_destroy();
 }
 
@@ -546,8 +570,6 @@ static struct mi_root* ht_mi_reload(struct mi_root* cmd_tree, void* param)
 	str htname;
 	ht_t *ht;
 	ht_t nht;
-	ht_cell_t *first;
-	ht_cell_t *it;
 	int i;
 
 	if(ht_db_url.len<=0)
@@ -592,15 +614,7 @@ static struct mi_root* ht_mi_reload(struct mi_root* cmd_tree, void* param)
 	{
 		/* free any entry set if it was a partial load */
 		for(i=0; i<nht.htsize; i++)
-		{
-			first = nht.entries[i].first;
-			while(first)
-			{
-				it = first;
-				first = first->next;
-				ht_cell_free(it);
-			}
-		}
+			ht_slot_free_items(&nht, &nht.entries[i]);
 		free(nht.entries);
 		ht_db_close_con();
 		return init_mi_tree(500, MI_ERR_RELOAD, MI_ERR_RELOAD_LEN);
@@ -610,23 +624,12 @@ static struct mi_root* ht_mi_reload(struct mi_root* cmd_tree, void* param)
 	for(i=0; i<nht.htsize; i++)
 	{
 		ht_slot_lock(ht, i);
-		first = ht->entries[i].first;
-		ht->entries[i].first = nht.entries[i].first;
-		ht->entries[i].esize = nht.entries[i].esize;
+		ht_slot_swap_items(&ht->entries[i], &nht.entries[i]);
 		ht_slot_unlock(ht, i);
-		nht.entries[i].first = first;
 	}
 	/* free old entries */
 	for(i=0; i<nht.htsize; i++)
-	{
-		first = nht.entries[i].first;
-		while(first)
-		{
-			it = first;
-			first = first->next;
-			ht_cell_free(it);
-		}
-	}
+		ht_slot_free_items(&nht, &nht.entries[i]);
 	free(nht.entries);
 	ht_db_close_con();
 	return init_mi_tree( 200, MI_OK_S, MI_OK_LEN);
@@ -1126,8 +1129,6 @@ static void htable_rpc_reload(rpc_t* rpc, void* c)
 	str htname;
 	ht_t *ht;
 	ht_t nht;
-	ht_cell_t *first;
-	ht_cell_t *it;
 	int i;
 
 	if(ht_db_url.len<=0) {
@@ -1171,15 +1172,7 @@ static void htable_rpc_reload(rpc_t* rpc, void* c)
 	{
 		/* free any entry set if it was a partial load */
 		for(i=0; i<nht.htsize; i++)
-		{
-			first = nht.entries[i].first;
-			while(first)
-			{
-				it = first;
-				first = first->next;
-				ht_cell_free(it);
-			}
-		}
+			ht_slot_free_items(&nht, &nht.entries[i]);
 		free(nht.entries);
 		ht_db_close_con();
 		rpc->fault(c, 500, "Mtree reload failed");
@@ -1190,23 +1183,12 @@ static void htable_rpc_reload(rpc_t* rpc, void* c)
 	for(i=0; i<nht.htsize; i++)
 	{
 		ht_slot_lock(ht, i);
-		first = ht->entries[i].first;
-		ht->entries[i].first = nht.entries[i].first;
-		ht->entries[i].esize = nht.entries[i].esize;
+		ht_slot_swap_items(&ht->entries[i], &nht.entries[i]);
 		ht_slot_unlock(ht, i);
-		nht.entries[i].first = first;
 	}
 	/* free old entries */
 	for(i=0; i<nht.htsize; i++)
-	{
-		first = nht.entries[i].first;
-		while(first)
-		{
-			it = first;
-			first = first->next;
-			ht_cell_free(it);
-		}
-	}
+		ht_slot_free_items(&nht, &nht.entries[i]);
 	free(nht.entries);
 	ht_db_close_con();
 	return;
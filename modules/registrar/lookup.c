@@ -109,6 +109,7 @@ int lookup_helper(struct sip_msg* _m, udomain_t* _d, str* _uri, int _mode)
 	ucontact_t* ptr = 0;
 	int res;
 	int ret;
+	int shared = 0;
 	str path_dst;
 	flag_t old_bflags;
 	int i;
@@ -167,12 +168,13 @@ int lookup_helper(struct sip_msg* _m, udomain_t* _d, str* _uri, int _mode)
 
 	if(puri.gr.s==NULL || puri.gr_val.len>0)
 	{
-		/* aor or pub-gruu lookup */
-		ul.lock_udomain(_d, &aor);
+		/* aor or pub-gruu lookup - read only, shared with other readers */
+		shared = 1;
+		ul.rlock_udomain(_d, &aor);
 		res = ul.get_urecord(_d, &aor, &r);
 		if (res > 0) {
 			LM_DBG("'%.*s' Not found in usrloc\n", aor.len, ZSW(aor.s));
-			ul.unlock_udomain(_d, &aor);
+			ul.runlock_udomain(_d, &aor);
 			return -1;
 		}
 
@@ -422,8 +424,16 @@ int lookup_helper(struct sip_msg* _m, udomain_t* _d, str* _uri, int _mode)
 	}
 
 done:
-	ul.release_urecord(r);
-	ul.unlock_udomain(_d, &aor);
+	if (shared) {
+		/* nothing can be changed with shared access, only the
+		 * private record copy of db_only mode has to be freed */
+		if (ul.db_mode==DB_ONLY)
+			ul.release_urecord(r);
+		ul.runlock_udomain(_d, &aor);
+	} else {
+		ul.release_urecord(r);
+		ul.unlock_udomain(_d, &aor);
+	}
 	return ret;
 }
 
@@ -660,11 +670,11 @@ int registered4(struct sip_msg* _m, udomain_t* _d, str* _uri, int match_flag, in
 		return -1;
 	}
 	
-	ul.lock_udomain(_d, &aor);
+	ul.rlock_udomain(_d, &aor);
 	res = ul.get_urecord(_d, &aor, &r);
 
 	if (res < 0) {
-		ul.unlock_udomain(_d, &aor);
+		ul.runlock_udomain(_d, &aor);
 		LM_ERR("failed to query usrloc\n");
 		return -1;
 	}
@@ -721,15 +731,16 @@ int registered4(struct sip_msg* _m, udomain_t* _d, str* _uri, int match_flag, in
 				}
 			}
 
-			ul.release_urecord(r);
-			ul.unlock_udomain(_d, &aor);
+			if (ul.db_mode==DB_ONLY)
+				ul.release_urecord(r);
+			ul.runlock_udomain(_d, &aor);
 			LM_DBG("'%.*s' found in usrloc\n", aor.len, ZSW(aor.s));
 
 			return 1;
 		}
 	}
 
-	ul.unlock_udomain(_d, &aor);
+	ul.runlock_udomain(_d, &aor);
 	LM_DBG("'%.*s' not found in usrloc\n", aor.len, ZSW(aor.s));
 	return -1;
 }
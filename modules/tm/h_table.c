@@ -36,6 +36,7 @@
 #include "../../globals.h"
 #include "../../error.h"
 #include "../../char_msg_val.h"
+#include "../../sip_msg_clone.h"
 #include "defs.h"
 #include "t_reply.h"
 #include "t_cancel.h"
@@ -52,6 +53,28 @@ static enum kill_reason kr;
    lives */
 struct s_table*  _tm_table;
 
+/* number of entries of the transaction table (power of 2) */
+unsigned int tm_hash_size = TABLE_ENTRIES;
+
+/* if 1, the request clone is carved from the same shm block as the cell */
+int tm_cell_inline_req = 0;
+
+/* extra room reserved for the inline request clone, for what the request
+ * callbacks may parse after the clone size is estimated */
+#define TM_CELL_REQ_SLACK	256
+
+/* size of a cell with its md5 and uac array, without the inline request */
+#define tm_cell_base_size() \
+	ROUND_POINTER(sizeof(struct cell) + MD5_LEN \
+			- sizeof(((struct cell*)0)->md5) \
+			+ (sr_dst_max_branches * sizeof(struct ua_client)))
+
+/* true if the cell request was cloned in the cell block (a separate shm
+ * block can never start right after the cell because of the fragment
+ * header) */
+#define tm_cell_req_inline(c) \
+	((char*)(c)->uas.request==(char*)(c)+tm_cell_base_size())
+
 struct s_table* tm_get_table(void) {
 	return _tm_table;
 }
@@ -107,7 +130,7 @@ unsigned int transaction_count( void )
 	unsigned int count;
 
 	count=0;	
-	for (i=0; i<TABLE_ENTRIES; i++) 
+	for (i=0; i<_tm_table->size; i++) 
 		count+=_tm_table->entries[i].cur_entries;
 	return count;
 }
@@ -129,8 +152,21 @@ void free_cell( struct cell* dead_cell )
 
 	shm_lock();
 	/* UA Server */
-	if ( dead_cell->uas.request )
-		sip_msg_free_unsafe( dead_cell->uas.request );
+	if ( dead_cell->uas.request ) {
+		if (tm_cell_req_inline(dead_cell)) {
+			/* only the lumps, if cloned later, have their own block */
+			rpl = dead_cell->uas.request;
+			membar_depends();
+			if (rpl->add_rm)
+				shm_free_unsafe(rpl->add_rm);
+			else if (rpl->body_lumps)
+				shm_free_unsafe(rpl->body_lumps);
+			else if (rpl->reply_lump)
+				shm_free_unsafe(rpl->reply_lump);
+		} else {
+			sip_msg_free_unsafe( dead_cell->uas.request );
+		}
+	}
 	if ( dead_cell->uas.response.buffer )
 		shm_free_unsafe( dead_cell->uas.response.buffer );
 #ifdef CANCEL_REASON_SUPPORT
@@ -290,6 +326,7 @@ struct cell*  build_cell( struct sip_msg* p_msg )
 	sr_xavp_t** xold;
 #endif
 	unsigned int cell_size;
+	unsigned int req_size;
 
 	/* allocs a new cell, add space for:
 	 * md5 (MD5_LEN - sizeof(struct cell.md5))
@@ -297,7 +334,15 @@ struct cell*  build_cell( struct sip_msg* p_msg )
 	cell_size = sizeof( struct cell ) + MD5_LEN - sizeof(((struct cell*)0)->md5)
 				+ (sr_dst_max_branches * sizeof(struct ua_client));
 
-	new_cell = (struct cell*)shm_malloc( cell_size );
+	/* and, with cell_inline_req, space for the request clone, so that the
+	 * cell, the branches and the request need a single shm allocation */
+	req_size = 0;
+	if (tm_cell_inline_req && p_msg) {
+		req_size = sip_msg_shm_clone_len(p_msg, 0) + TM_CELL_REQ_SLACK;
+		cell_size = tm_cell_base_size();
+	}
+
+	new_cell = (struct cell*)shm_malloc( cell_size + req_size );
 	if  ( !new_cell ) {
 		ser_error=E_OUT_OF_MEM;
 		return NULL;
@@ -357,7 +402,21 @@ struct cell*  build_cell( struct sip_msg* p_msg )
 	}
 
 	if (p_msg) {
-		new_cell->uas.request = sip_msg_cloner(p_msg,&sip_msg_len);
+		if (p_msg->via1)
+			new_cell->tid_hash = tm_tid_hash(p_msg->via1);
+		if (p_msg->callid)
+			new_cell->callid_hash = get_hash1_raw(p_msg->callid->body.s,
+											p_msg->callid->body.len);
+		new_cell->uas.request = 0;
+		if (req_size) {
+			/* the callbacks might have parsed more in the meantime */
+			sip_msg_len = sip_msg_shm_clone_len(p_msg, 0);
+			if (sip_msg_len <= req_size)
+				new_cell->uas.request = sip_msg_shm_clone_buf(p_msg,
+											(char*)new_cell + cell_size, 0);
+		}
+		if (!new_cell->uas.request)
+			new_cell->uas.request = sip_msg_cloner(p_msg,&sip_msg_len);
 		if (!new_cell->uas.request)
 			goto error;
 		new_cell->uas.end_request=((char*)new_cell->uas.request)+sip_msg_len;
@@ -423,7 +482,7 @@ void free_hash_table(  )
 	if (_tm_table)
 	{
 		/* remove the data contained by each entry */
-		for( i = 0 ; i<TABLE_ENTRIES; i++)
+		for( i = 0 ; i<_tm_table->size; i++)
 		{
 			release_entry_lock( (_tm_table->entries)+i );
 			/* delete all synonyms at hash-collision-slot i */
@@ -432,6 +491,7 @@ void free_hash_table(  )
 				free_cell(p_cell);
 			}
 		}
+		shm_free(_tm_table->entries);
 		shm_free(_tm_table);
 		_tm_table = 0;
 	}
@@ -455,12 +515,24 @@ struct s_table* init_hash_table()
 
 	memset( _tm_table, 0, sizeof (struct s_table ) );
 
+	_tm_table->entries = (struct entry*)shm_malloc(
+								tm_hash_size * sizeof(struct entry) );
+	if ( !_tm_table->entries ) {
+		LOG(L_ERR, "ERROR: init_hash_table: no shmem for %u TM entries\n",
+				tm_hash_size);
+		shm_free(_tm_table);
+		_tm_table = 0;
+		goto error0;
+	}
+	memset( _tm_table->entries, 0, tm_hash_size * sizeof(struct entry) );
+	_tm_table->size = tm_hash_size;
+
 	/* try first allocating all the structures needed for syncing */
 	if (lock_initialize()==-1)
 		goto error1;
 
 	/* inits the entriess */
-	for(  i=0 ; i<TABLE_ENTRIES; i++ )
+	for(  i=0 ; i<_tm_table->size; i++ )
 	{
 		init_entry_lock( _tm_table, (_tm_table->entries)+i );
 		_tm_table->entries[i].next_label = rand();
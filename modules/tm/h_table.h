@@ -355,6 +355,11 @@ typedef struct cell
 	unsigned int  hash_index;
 	/* sequence number within hash collision slot */
 	unsigned int  label;
+	/* cached hashes of the uas request, compared before the strings
+	 * during the lookups: via1 transaction id (branch without the magic
+	 * cookie, 0 if none) and call-id */
+	unsigned int  tid_hash;
+	unsigned int  callid_hash;
 	/* different information about the transaction */
 	unsigned short flags;
 	/* number of forks */
@@ -503,10 +508,35 @@ typedef struct entry
 /* transaction table */
 struct s_table
 {
+	/* number of hash entries (power of 2, set with the hash_size param) */
+	unsigned int size;
 	/* table of hash entries; each of them is a list of synonyms  */
-	struct entry   entries[ TABLE_ENTRIES ];
+	struct entry*  entries;
 };
 
+/* hash table size, set before init_hash_table() */
+extern unsigned int tm_hash_size;
+extern int tm_cell_inline_req;
+
+#define TM_HASH_SIZE_MIN	(1<<8)
+#define TM_HASH_SIZE_MAX	(1<<24)
+
+/* hash of the rfc3261 transaction id of a request (via1 branch without
+ * the magic cookie), 0 if the branch has no magic cookie */
+static inline unsigned int tm_tid_hash(struct via_body* via1)
+{
+	if (via1->branch==0 || via1->branch->value.s==0
+			|| via1->branch->value.len<=MCOOKIE_LEN
+			|| memcmp(via1->branch->value.s, MCOOKIE, MCOOKIE_LEN)!=0)
+		return 0;
+	return get_hash1_raw(via1->branch->value.s+MCOOKIE_LEN,
+							via1->branch->value.len-MCOOKIE_LEN);
+}
+
+/* hash table entry for a call-id and cseq number */
+#define tm_hash(cid, cseq) \
+	(get_hash2_raw(&(cid), &(cseq)) & (_tm_table->size-1))
+
 /* pointer to the big table where all the transaction data
    lives */
 extern struct s_table*  _tm_table; /* private internal stuff, don't touch
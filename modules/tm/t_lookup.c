@@ -301,6 +301,7 @@ static int matching_3261( struct sip_msg *p_msg, struct cell **trans,
 	int is_ack;
 	int dlg_parsed;
 	int ret = 0;
+	unsigned int tid_hash;
 	struct entry* hash_bucket;
 
 	*cancel=0;
@@ -311,6 +312,7 @@ static int matching_3261( struct sip_msg *p_msg, struct cell **trans,
 	/* update parsed tid */
 	via1->tid.s=via1->branch->value.s+MCOOKIE_LEN;
 	via1->tid.len=via1->branch->value.len-MCOOKIE_LEN;
+	tid_hash=get_hash1_raw(via1->tid.s, via1->tid.len);
 
 	hash_bucket=&(get_tm_table()->entries[p_msg->hash_index]);
 	clist_foreach(hash_bucket, p_cell, next_c){
@@ -386,6 +388,8 @@ static int matching_3261( struct sip_msg *p_msg, struct cell **trans,
 		}
 		/* now real tid matching occurs  for negative ACKs and any 
 		 * other requests */
+		if (p_cell->tid_hash!=tid_hash)
+			continue;
 		if (!via_matching(t_msg->via1 /* inv via */, via1 /* ack */ ))
 			continue;
 		/* check if call-id is still the same */
@@ -446,6 +450,7 @@ int t_lookup_request( struct sip_msg* p_msg , int leave_new_locked,
 	int match_status;
 	struct cell *e2e_ack_trans;
 	struct entry* hash_bucket;
+	unsigned int callid_hash;
 
 	/* parse all*/
 	if (unlikely(check_transaction_quadruple(p_msg)==0))
@@ -458,7 +463,7 @@ int t_lookup_request( struct sip_msg* p_msg , int leave_new_locked,
 
 	/* start searching into the table */
 	if (!(p_msg->msg_flags & FL_HASH_INDEX)){
-		p_msg->hash_index=hash( p_msg->callid->body , get_cseq(p_msg)->number);
+		p_msg->hash_index=tm_hash( p_msg->callid->body , get_cseq(p_msg)->number);
 		p_msg->msg_flags|=FL_HASH_INDEX;
 	}
 	isACK = p_msg->REQ_METHOD==METHOD_ACK;
@@ -504,6 +509,7 @@ int t_lookup_request( struct sip_msg* p_msg , int leave_new_locked,
 	LOCK_HASH(p_msg->hash_index);
 
 	hash_bucket=&(get_tm_table()->entries[p_msg->hash_index]);
+	callid_hash=get_hash1_raw(p_msg->callid->body.s, p_msg->callid->body.len);
 	
 	if (likely(!isACK)) {	
 		/* all the transactions from the entry are compared */
@@ -517,7 +523,8 @@ int t_lookup_request( struct sip_msg* p_msg , int leave_new_locked,
 			if ((t_msg->REQ_METHOD!=p_msg->REQ_METHOD) &&
 					(t_msg->REQ_METHOD!=METHOD_CANCEL))
 					continue;
-			/* compare lengths first */ 
+			/* compare the cached call-id hash and the lengths first */
+			if (p_cell->callid_hash!=callid_hash) continue;
 			if (!EQ_LEN(callid)) continue;
 			/* CSeq only the number without method ! */
 			if (get_cseq(t_msg)->number.len!=get_cseq(p_msg)->number.len)
@@ -559,7 +566,8 @@ int t_lookup_request( struct sip_msg* p_msg , int leave_new_locked,
 			/* ACK's relate only to INVITEs */
 			if (t_msg->REQ_METHOD!=METHOD_INVITE) continue;
 			/* From|To URI , CallID, CSeq # must be always there */
-			/* compare lengths now */
+			/* compare the cached call-id hash and the lengths now */
+			if (p_cell->callid_hash!=callid_hash) continue;
 			if (!EQ_LEN(callid)) continue;
 			/* CSeq only the number without method ! */
 			if (get_cseq(t_msg)->number.len!=get_cseq(p_msg)->number.len)
@@ -680,6 +688,7 @@ struct cell* t_lookupOriginalT(  struct sip_msg* p_msg )
 	struct sip_msg  *t_msg;
 	struct via_param *branch;
 	struct entry* hash_bucket;
+	unsigned int callid_hash;
 	int foo;
 	int ret;
 
@@ -694,7 +703,7 @@ struct cell* t_lookupOriginalT(  struct sip_msg* p_msg )
 			/* stop processing */
 			return 0;
 		}
-		p_msg->hash_index=hash( p_msg->callid->body , get_cseq(p_msg)->number);
+		p_msg->hash_index=tm_hash( p_msg->callid->body , get_cseq(p_msg)->number);
 		p_msg->msg_flags|=FL_HASH_INDEX;
 	}
 	hash_index = p_msg->hash_index;
@@ -727,6 +736,7 @@ struct cell* t_lookupOriginalT(  struct sip_msg* p_msg )
 	LOCK_HASH(hash_index);
 
 	hash_bucket=&(get_tm_table()->entries[hash_index]);
+	callid_hash=get_hash1_raw(p_msg->callid->body.s, p_msg->callid->body.len);
 	/* all the transactions from the entry are compared */
 	clist_foreach(hash_bucket, p_cell, next_c){
 		prefetch_loc_r(p_cell->next_c, 1);
@@ -738,7 +748,9 @@ struct cell* t_lookupOriginalT(  struct sip_msg* p_msg )
 		if (unlikely(t_msg->REQ_METHOD==METHOD_CANCEL))
 			continue;
 
-		/* check lengths now */	
+		/* check the cached call-id hash and the lengths now */
+		if (p_cell->callid_hash!=callid_hash)
+			continue;
 		if (!EQ_LEN(callid))
 			continue;
 		if (get_cseq(t_msg)->number.len!=get_cseq(p_msg)->number.len)
@@ -873,7 +885,7 @@ int t_reply_matching( struct sip_msg *p_msg , int *p_branch )
 
 	/* sanity check */
 	if (unlikely(reverse_hex2int(hashi, hashl, &hash_index)<0
-		||hash_index>=TABLE_ENTRIES
+		||hash_index>=get_tm_table()->size
 		|| reverse_hex2int(branchi, branchl, &branch_id)<0
 		|| branch_id>=sr_dst_max_branches
 		|| loopl!=MD5_LEN)
@@ -1551,7 +1563,7 @@ int t_lookup_ident(struct cell ** trans, unsigned int hash_index,
 	struct cell* p_cell;
 	struct entry* hash_bucket;
 
-	if(unlikely(hash_index >= TABLE_ENTRIES)){
+	if(unlikely(hash_index >= get_tm_table()->size)){
 		LOG(L_ERR,"ERROR: t_lookup_ident: invalid hash_index=%u\n",hash_index);
 		return -1;
 	}
@@ -1641,9 +1653,9 @@ int t_lookup_callid(struct cell ** trans, str callid, str cseq) {
 	invite_method.len = INVITE_LEN;
 	
 	/* lookup the hash index where the transaction is stored */
-	hash_index=hash(callid, cseq);
+	hash_index=tm_hash(callid, cseq);
 
-	if(unlikely(hash_index >= TABLE_ENTRIES)){
+	if(unlikely(hash_index >= get_tm_table()->size)){
 		LOG(L_ERR,"ERROR: t_lookup_callid: invalid hash_index=%u\n",hash_index);
 		return -1;
 	}
@@ -29,9 +29,7 @@
 #include "../../dprint.h"
 #include "../../config.h"
 #include "../../pt.h"
-#ifdef TM_HASH_STATS
 #include "h_table.h"
-#endif
 
 union t_stats *tm_stats=0;
 
@@ -191,7 +189,7 @@ void tm_rpc_hash_stats(rpc_t* rpc, void* c)
 	crt_zeroes=0;
 	crt_dev_no=0;
 	crt_dev=0;
-	for (r=0; r<TABLE_ENTRIES; r++){
+	for (r=0; r<_tm_table->size; r++){
 		acc=_tm_table->entries[r].acc_entries;
 		crt=_tm_table->entries[r].cur_entries;
 		
@@ -205,10 +203,10 @@ void tm_rpc_hash_stats(rpc_t* rpc, void* c)
 		if (crt>crt_max) crt_max=crt;
 		if (crt==0) crt_zeroes++;
 	}
-	acc_average=acc_count/(double)TABLE_ENTRIES;
-	crt_average=crt_count/(double)TABLE_ENTRIES;
+	acc_average=acc_count/(double)_tm_table->size;
+	crt_average=crt_count/(double)_tm_table->size;
 	
-	for (r=0; r<TABLE_ENTRIES; r++){
+	for (r=0; r<_tm_table->size; r++){
 		acc=_tm_table->entries[r].acc_entries;
 		crt=_tm_table->entries[r].cur_entries;
 		
@@ -225,7 +223,7 @@ void tm_rpc_hash_stats(rpc_t* rpc, void* c)
 	}
 	
 	if (rpc->add(c, "{", &st) < 0) return;
-	rpc->struct_add(st, "d", "hash_size", (unsigned) TABLE_ENTRIES);
+	rpc->struct_add(st, "d", "hash_size", _tm_table->size);
 	rpc->struct_add(st, "d", "crt_transactions", (unsigned)crt_count);
 	rpc->struct_add(st, "f", "crt_target_per_cell", crt_average);
 	rpc->struct_add(st, "dd", "crt_min", (unsigned)crt_min,
@@ -249,3 +247,54 @@ void tm_rpc_hash_stats(rpc_t* rpc, void* c)
 				"recompiling with -DTM_HASH_STATS)");
 #endif /* TM_HASH_STATS */
 }
+
+
+
+/* chain length intervals reported by tm.hash_chains (upper limits) */
+static unsigned int tm_chain_len_limits[] = {
+	0, 1, 2, 4, 8, 16, 32, 64, 128, 256, (unsigned int)-1
+};
+static char* tm_chain_len_names[] = {
+	"0", "1", "2", "3-4", "5-8", "9-16", "17-32", "33-64", "65-128",
+	"129-256", "257+"
+};
+#define TM_CHAIN_LEN_INTERVALS \
+	(sizeof(tm_chain_len_limits)/sizeof(tm_chain_len_limits[0]))
+
+/* hash table chain length distribution (walks the current chains, the
+ * TM_HASH_STATS counters are not needed) */
+void tm_rpc_hash_chains(rpc_t* rpc, void* c)
+{
+	void* st;
+	void* dst;
+	struct cell* p_cell;
+	unsigned long dist[TM_CHAIN_LEN_INTERVALS];
+	unsigned long total;
+	unsigned int len, max;
+	unsigned int r, k;
+
+	memset(dist, 0, sizeof(dist));
+	total=0;
+	max=0;
+	for (r=0; r<_tm_table->size; r++){
+		len=0;
+		lock_hash(r);
+		clist_foreach(&_tm_table->entries[r], p_cell, next_c)
+			len++;
+		unlock_hash(r);
+		for (k=0; len>tm_chain_len_limits[k]; k++);
+		dist[k]++;
+		total+=len;
+		if (len>max) max=len;
+	}
+
+	if (rpc->add(c, "{", &st) < 0) return;
+	rpc->struct_add(st, "d", "hash_size", _tm_table->size);
+	rpc->struct_add(st, "d", "transactions", (unsigned)total);
+	rpc->struct_add(st, "f", "average_length",
+						total/(double)_tm_table->size);
+	rpc->struct_add(st, "d", "max_length", max);
+	if (rpc->struct_add(st, "{", "distribution", &dst) < 0) return;
+	for (k=0; k<TM_CHAIN_LEN_INTERVALS; k++)
+		rpc->struct_add(dst, "d", tm_chain_len_names[k], (unsigned)dist[k]);
+}
@@ -135,6 +135,7 @@ void free_tm_stats(void);
 void tm_rpc_stats(rpc_t* rpc, void* c);
 
 void tm_rpc_hash_stats(rpc_t* rpc, void* c);
+void tm_rpc_hash_chains(rpc_t* rpc, void* c);
 
 typedef int (*tm_get_stats_f)(struct t_proc_stats *all);
 int tm_get_stats(struct t_proc_stats *all);
@@ -514,6 +514,8 @@ static param_export_t params[]={
 	{"e2e_cancel_reason",   PARAM_INT, &default_tm_cfg.e2e_cancel_reason     },
 #endif /* CANCEL_REASON_SUPPORT */
 	{"xavp_contact",        PARAM_STR, &ulattrs_xavp_name                    },
+	{"hash_size",           PARAM_INT, &tm_hash_size                         },
+	{"cell_inline_req",     PARAM_INT, &tm_cell_inline_req                   },
 	{0,0,0}
 };
 
@@ -768,6 +770,19 @@ static int mod_init(void)
 		return -1;
 	}
 
+	/* the hash table size must be a power of 2 */
+	if (tm_hash_size<TM_HASH_SIZE_MIN || tm_hash_size>TM_HASH_SIZE_MAX) {
+		LOG(L_CRIT, "invalid hash_size %u (allowed: %u - %u)\n",
+			tm_hash_size, TM_HASH_SIZE_MIN, TM_HASH_SIZE_MAX);
+		return -1;
+	}
+	if (tm_hash_size & (tm_hash_size-1)) {
+		LOG(L_WARN, "hash_size is not a power of 2 as it should be"
+			" -> rounding down %u\n", tm_hash_size);
+		while (tm_hash_size & (tm_hash_size-1))
+			tm_hash_size &= tm_hash_size-1; /* clear the lowest bit set */
+	}
+
 	/* building the hash table*/
 	if (!init_hash_table()) {
 		LOG(L_ERR, "ERROR: mod_init: initializing hash_table failed\n");
@@ -2341,6 +2356,12 @@ static const char* tm_rpc_hash_stats_doc[2] = {
 	0
 };
 
+static const char* tm_rpc_hash_chains_doc[2] = {
+	"Prints the size of the hash table and the distribution of the"
+		" transaction chain lengths.",
+	0
+};
+
 static const char* rpc_t_uac_start_doc[2] = {
 	"starts a tm uac using  a list of string parameters: method, ruri, dst_uri"
 		", send_sock, headers (CRLF separated) and body (optional)",
@@ -2361,6 +2382,7 @@ static rpc_export_t tm_rpc[] = {
 	{"tm.reply",  rpc_reply,    rpc_reply_doc,    0},
 	{"tm.stats",  tm_rpc_stats, tm_rpc_stats_doc, 0},
 	{"tm.hash_stats",  tm_rpc_hash_stats, tm_rpc_hash_stats_doc, 0},
+	{"tm.hash_chains", tm_rpc_hash_chains, tm_rpc_hash_chains_doc, 0},
 	{"tm.t_uac_start", rpc_t_uac_start, rpc_t_uac_start_doc, 0 },
 	{"tm.t_uac_wait",  rpc_t_uac_wait,  rpc_t_uac_wait_doc, RET_ARRAY},
 	{0, 0, 0, 0}
@@ -673,7 +673,7 @@ struct mi_root* mi_tm_hash(struct mi_root* cmd_tree, void* param)
 	rpl = &rpl_tree->node;
 	tm_t = _tmx_tmb.get_table();
 
-	for (i=0; i<TABLE_ENTRIES; i++) {
+	for (i=0; i<tm_t->size; i++) {
 		if(tm_t->entries[i].cur_entries==0
 				&& tm_t->entries[i].acc_entries==0)
 			continue;
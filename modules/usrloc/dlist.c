@@ -31,6 +31,7 @@
 #include <stdlib.h>	       /* abort */
 #include <string.h>            /* strlen, memcmp */
 #include <stdio.h>             /* printf */
+#include <sys/time.h>          /* gettimeofday */
 #include "../../ut.h"
 #include "../../lib/srdb1/db_ut.h"
 #include "../../mem/shm_mem.h"
@@ -42,6 +43,31 @@
 #include "utime.h"
 #include "ul_mod.h"
 
+/*! \brief write-back timer gauges, written by the timer process owning
+ * the slot and read by the statistics */
+typedef struct ul_wb_gauge {
+	unsigned int backlog;  /*!< contacts found dirty by the last run */
+	unsigned int flush_ms; /*!< duration of the last run */
+} ul_wb_gauge_t;
+
+static ul_wb_gauge_t* _ul_wb_gauges = NULL;
+static int _ul_wb_gauges_no = 0;
+
+unsigned int ul_wb_backlog = 0;
+
+/*! \brief shared state of the preload, the tasks are the parts of the
+ * tables, numbered domain after domain */
+typedef struct ul_preload_ctl {
+	gen_lock_t lock;        /*!< protects the fields and the domain ones */
+	int next;               /*!< next task to take */
+	int pending;            /*!< tasks not completed yet */
+	unsigned int contacts;  /*!< contacts loaded so far */
+	unsigned int time_ms;   /*!< duration of the preload, 0 until done */
+	struct timeval start;   /*!< start of the preload */
+} ul_preload_ctl_t;
+
+static ul_preload_ctl_t* _ul_preload = NULL;
+
 
 /*! \brief Global list of all registered domains */
 dlist_t* root = 0;
@@ -750,6 +776,7 @@ int synchronize_all_udomains(int istart, int istep)
 {
 	int res = 0;
 	dlist_t* ptr;
+	struct timeval tv_start, tv_end;
 
 	get_act_time(); /* Get and save actual time */
 
@@ -757,14 +784,227 @@ int synchronize_all_udomains(int istart, int istep)
 		for( ptr=root ; ptr ; ptr=ptr->next)
 			res |= db_timer_udomain(ptr->d);
 	} else {
+		ul_wb_backlog = 0;
+		gettimeofday(&tv_start, NULL);
 		for( ptr=root ; ptr ; ptr=ptr->next)
 			mem_timer_udomain(ptr->d, istart, istep);
+		gettimeofday(&tv_end, NULL);
+		if (_ul_wb_gauges!=NULL && istart<_ul_wb_gauges_no) {
+			_ul_wb_gauges[istart].backlog = ul_wb_backlog;
+			_ul_wb_gauges[istart].flush_ms =
+				(tv_end.tv_sec - tv_start.tv_sec)*1000
+				+ (tv_end.tv_usec - tv_start.tv_usec)/1000;
+		}
 	}
 
 	return res;
 }
 
 
+/*!
+ * \brief Initialize the shared state of the preload
+ * \return 0 on success, -1 on failure
+ */
+int ul_init_preload(void)
+{
+	_ul_preload = (ul_preload_ctl_t*)shm_malloc(sizeof(ul_preload_ctl_t));
+	if (_ul_preload==NULL) {
+		LM_ERR("no more shm memory\n");
+		return -1;
+	}
+	memset(_ul_preload, 0, sizeof(ul_preload_ctl_t));
+	_ul_preload->pending = -1;
+	if (lock_init(&_ul_preload->lock)==0) {
+		LM_ERR("failed to init the lock\n");
+		shm_free(_ul_preload);
+		_ul_preload = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+
+static inline unsigned int ul_elapsed_ms(struct timeval* _start)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - _start->tv_sec)*1000
+		+ (now.tv_usec - _start->tv_usec)/1000;
+}
+
+
+/*!
+ * \brief Load the contacts of all domains from the database
+ * \param _c database connection
+ * \param _procs number of parts of each table
+ * \return 0 on success, -1 on failure
+ */
+int preload_all_udomains(db1_con_t* _c, int _procs)
+{
+	dlist_t* ptr;
+	struct timeval start;
+	long long max_id, step, id_start, id_end;
+	unsigned int loaded;
+	int ndomains;
+	int task, part, i;
+	int ready;
+	int done;
+
+	if (_ul_preload==NULL || _procs<=0)
+		return -1;
+	ndomains = 0;
+	for (ptr=root; ptr; ptr=ptr->next)
+		ndomains++;
+
+	for(;;) {
+		lock_get(&_ul_preload->lock);
+		if (_ul_preload->pending<0) {
+			_ul_preload->pending = ndomains * _procs;
+			gettimeofday(&_ul_preload->start, NULL);
+		}
+		task = _ul_preload->next;
+		if (task>=ndomains * _procs) {
+			lock_release(&_ul_preload->lock);
+			return 0;
+		}
+		_ul_preload->next++;
+		for (ptr=root, i=task/_procs; i>0; ptr=ptr->next, i--);
+		part = task % _procs;
+		ready = ptr->preload_ready;
+		max_id = ptr->preload_max_id;
+		lock_release(&_ul_preload->lock);
+
+		/* the id range of the parts is set once, by the first process
+		 * getting it. The query is done without the lock, so the other
+		 * processes are not stuck behind it: the ones taking a part of the
+		 * same table meanwhile do the query too, but only the first result
+		 * is used */
+		if (_procs>1 && !ready) {
+			max_id = udomain_max_id(_c, ptr->d);
+			if (max_id<0) {
+				LM_ERR("cannot get the id range of table '%.*s'\n",
+						ptr->name.len, ZSW(ptr->name.s));
+				return -1;
+			}
+			lock_get(&_ul_preload->lock);
+			if (!ptr->preload_ready) {
+				ptr->preload_max_id = max_id;
+				ptr->preload_ready = 1;
+			}
+			max_id = ptr->preload_max_id;
+			lock_release(&_ul_preload->lock);
+		}
+
+		if (_procs>1) {
+			step = max_id / _procs + 1;
+			id_start = (part>0)?(part * step):-1;
+			id_end = (part<_procs-1)?((part + 1) * step):-1;
+		} else {
+			id_start = id_end = -1;
+		}
+
+		gettimeofday(&start, NULL);
+		if (preload_udomain_range(_c, ptr->d, id_start, id_end, &loaded) < 0) {
+			LM_ERR("failed to preload part %d/%d of domain '%.*s'\n",
+					part + 1, _procs, ptr->name.len, ZSW(ptr->name.s));
+			return -1;
+		}
+		LM_INFO("loaded %u contacts in part %d/%d of domain '%.*s'"
+				" in %u ms\n", loaded, part + 1, _procs,
+				ptr->name.len, ZSW(ptr->name.s), ul_elapsed_ms(&start));
+
+		lock_get(&_ul_preload->lock);
+		_ul_preload->contacts += loaded;
+		ptr->preload_done++;
+		done = (ptr->preload_done==_procs);
+		_ul_preload->pending--;
+		if (_ul_preload->pending==0) {
+			_ul_preload->time_ms = ul_elapsed_ms(&_ul_preload->start);
+			LM_INFO("preload of %u contacts completed in %u ms\n",
+					_ul_preload->contacts, _ul_preload->time_ms);
+		}
+		lock_release(&_ul_preload->lock);
+
+		/* the attributes are matched to the contacts by ruid, so they are
+		 * loaded once all the parts of the table are in */
+		if (done)
+			uldb_preload_attrs(ptr->d);
+	}
+}
+
+
+/*!
+ * \brief Number of contacts loaded so far by the preload
+ * \return number of contacts, could be zero
+ */
+unsigned long ul_get_preload_contacts(void)
+{
+	return (_ul_preload)?_ul_preload->contacts:0;
+}
+
+
+/*!
+ * \brief Duration of the preload
+ * \return duration in milliseconds, 0 if not completed yet
+ */
+unsigned long ul_get_preload_time(void)
+{
+	return (_ul_preload)?_ul_preload->time_ms:0;
+}
+
+
+/*!
+ * \brief Allocate the write-back gauges, one per timer process
+ * \param _procs number of timer processes
+ * \return 0 on success, -1 on failure
+ */
+int ul_init_wb_gauges(int _procs)
+{
+	if (_procs<=0)
+		_procs = 1;
+	_ul_wb_gauges = (ul_wb_gauge_t*)shm_malloc(_procs*sizeof(ul_wb_gauge_t));
+	if (_ul_wb_gauges==NULL) {
+		LM_ERR("no more shm memory\n");
+		return -1;
+	}
+	memset(_ul_wb_gauges, 0, _procs*sizeof(ul_wb_gauge_t));
+	_ul_wb_gauges_no = _procs;
+	return 0;
+}
+
+
+/*!
+ * \brief Sum of the contacts found dirty by the last write-back timer runs
+ * \return backlog of contacts, could be zero
+ */
+unsigned long ul_get_wb_backlog(void)
+{
+	unsigned long backlog = 0;
+	int i;
+
+	for (i=0; _ul_wb_gauges!=NULL && i<_ul_wb_gauges_no; i++)
+		backlog += _ul_wb_gauges[i].backlog;
+	return backlog;
+}
+
+
+/*!
+ * \brief Longest duration of the last write-back timer runs
+ * \return duration in milliseconds, could be zero
+ */
+unsigned long ul_get_wb_flush_time(void)
+{
+	unsigned long ms = 0;
+	int i;
+
+	for (i=0; _ul_wb_gauges!=NULL && i<_ul_wb_gauges_no; i++)
+		if (_ul_wb_gauges[i].flush_ms > ms)
+			ms = _ul_wb_gauges[i].flush_ms;
+	return ms;
+}
+
+
 /*!
  * \brief Find a particular domain, small wrapper around find_dlist
  * \param _d domain name
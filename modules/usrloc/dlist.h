@@ -40,6 +40,9 @@ typedef struct dlist {
 	str name;            /*!< Name of the domain (null terminated) */
 	udomain_t* d;        /*!< Payload */
 	struct dlist* next;  /*!< Next element in the list */
+	long long preload_max_id; /*!< Highest id in the table at preload */
+	int preload_ready;   /*!< preload_max_id is set */
+	int preload_done;    /*!< Preloaded parts of the table */
 } dlist_t;
 
 /*! \brief Global list of all registered domains */
@@ -79,6 +82,66 @@ void print_all_udomains(FILE* _f);
 int synchronize_all_udomains(int istart, int istep);
 
 
+/*! \brief contacts found dirty by the running write-back timer run */
+extern unsigned int ul_wb_backlog;
+
+/*!
+ * \brief Initialize the shared state of the preload
+ * \return 0 on success, -1 on failure
+ */
+int ul_init_preload(void);
+
+
+/*!
+ * \brief Load the contacts of all domains from the database
+ *
+ * Load the contacts of all domains from the database. The table of
+ * each domain is split in _procs parts by id ranges, the processes
+ * calling this function take the parts until all are loaded, so that
+ * a single process loads all of them if no other one helps.
+ * \param _c database connection
+ * \param _procs number of parts of each table
+ * \return 0 on success, -1 on failure
+ */
+int preload_all_udomains(db1_con_t* _c, int _procs);
+
+
+/*!
+ * \brief Number of contacts loaded so far by the preload
+ * \return number of contacts, could be zero
+ */
+unsigned long ul_get_preload_contacts(void);
+
+
+/*!
+ * \brief Duration of the preload
+ * \return duration in milliseconds, 0 if not completed yet
+ */
+unsigned long ul_get_preload_time(void);
+
+
+/*!
+ * \brief Allocate the write-back gauges, one per timer process
+ * \param _procs number of timer processes
+ * \return 0 on success, -1 on failure
+ */
+int ul_init_wb_gauges(int _procs);
+
+
+/*!
+ * \brief Sum of the contacts found dirty by the last write-back timer runs
+ * \return backlog of contacts, could be zero
+ */
+unsigned long ul_get_wb_backlog(void);
+
+
+/*!
+ * \brief Longest duration of the last write-back timer runs
+ * \return duration in milliseconds, could be zero
+ */
+unsigned long ul_get_wb_flush_time(void);
+
+
 /*!
  * \brief Get all contacts from the usrloc, in partitions if wanted
  *
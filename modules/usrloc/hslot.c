@@ -130,6 +130,8 @@ void init_slot(struct udomain* _d, hslot_t* _s, int n)
 	_s->first = 0;
 	_s->last = 0;
 	_s->d = _d;
+	_s->writer = 0;
+	atomic_set(&_s->readers, 0);
 
 #ifdef GEN_LOCK_T_PREFERED
 	_s->lock = &ul_locks->locks[n%ul_locks_no];
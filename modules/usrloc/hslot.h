@@ -28,7 +28,9 @@
 #ifndef HSLOT_H
 #define HSLOT_H
 
+#include <sched.h>
 #include "../../locking.h"
+#include "../../atomic_ops.h"
 
 #include "udomain.h"
 #include "urecord.h"
@@ -48,8 +50,101 @@ typedef struct hslot {
 #else
 	int lockidx;            /*!< Lock index for hash entry - the rest*/
 #endif
+	volatile int writer;    /*!< Set while the lock owner may change it */
+	atomic_t readers;       /*!< Number of readers with shared access */
 } hslot_t;
 
+/*! spins before yielding while waiting for shared slot access */
+#define UL_SLOT_SPINS 64
+
+
+/*! \brief
+ * Get shared (read-only) access to a slot: readers do not exclude each
+ * other, they wait only for a writer holding the slot lock
+ */
+static inline void slot_rlock(hslot_t* _s)
+{
+	int i;
+
+	for(i=0; ; i++) {
+		if(likely(_s->writer==0)) {
+			atomic_inc(&_s->readers);
+			membar_atomic_op();
+			if(likely(_s->writer==0))
+				return;
+			atomic_dec(&_s->readers);
+		}
+		if(i>=UL_SLOT_SPINS)
+			sched_yield();
+	}
+}
+
+
+/*! \brief
+ * Release shared access to a slot
+ */
+static inline void slot_runlock(hslot_t* _s)
+{
+	membar_read_atomic_op();
+	atomic_dec(&_s->readers);
+}
+
+
+#ifndef GEN_LOCK_T_PREFERED
+void ul_lock_idx(int idx);
+void ul_release_idx(int idx);
+#endif
+
+
+/*! \brief
+ * Get exclusive access to a slot: takes the slot lock, blocks new readers
+ * and waits for the current ones to finish. The slot lock is released
+ * while waiting, so the other writers of the slot (and of the slots
+ * sharing the lock) are not stuck behind the readers
+ */
+static inline void slot_wlock(hslot_t* _s)
+{
+	int i;
+
+	for(;;) {
+#ifdef GEN_LOCK_T_PREFERED
+		lock_get(_s->lock);
+#else
+		ul_lock_idx(_s->lockidx);
+#endif
+		_s->writer = 1;
+		membar();
+		if(likely(atomic_get(&_s->readers)==0))
+			break;
+		/* the writer flag stays set, so the readers drain */
+#ifdef GEN_LOCK_T_PREFERED
+		lock_release(_s->lock);
+#else
+		ul_release_idx(_s->lockidx);
+#endif
+		for(i=0; atomic_get(&_s->readers); i++) {
+			if(i>=UL_SLOT_SPINS)
+				sched_yield();
+		}
+	}
+	membar();
+}
+
+
+/*! \brief
+ * Release the exclusive access got with slot_wlock()
+ */
+static inline void slot_wunlock(hslot_t* _s)
+{
+	membar_write();
+	_s->writer = 0;
+#ifdef GEN_LOCK_T_PREFERED
+	lock_release(_s->lock);
+#else
+	ul_release_idx(_s->lockidx);
+#endif
+}
+
 /*! \brief
  * Initialize slot structure
  */
@@ -87,9 +182,4 @@ int ul_init_locks(void);
 void ul_unlock_locks(void);
 void ul_destroy_locks(void);
 
-#ifndef GEN_LOCK_T_PREFERED
-void ul_lock_idx(int idx);
-void ul_release_idx(int idx);
-#endif
-
 #endif /* HSLOT_H */
@@ -28,6 +28,7 @@
 
 #include "ucontact.h"
 #include <string.h>             /* memcpy */
+#include "../../mem/mem.h"
 #include "../../mem/shm_mem.h"
 #include "../../ut.h"
 #include "../../ip_addr.h"
@@ -462,26 +463,18 @@ extern unsigned int _ul_max_partition;
 static unsigned int _ul_partition_counter = 0;
 
 /*!
- * \brief Insert contact into the database
- * \param _c inserted contact
- * \return 0 on success, -1 on failure
+ * \brief Fill in the columns of the database row of a contact
+ * \param _c contact
+ * \param keys column names, room for UL_DB_ROW_COLS items
+ * \param vals column values, room for UL_DB_ROW_COLS items
+ * \param _nulls if not 0, the unset optional columns are added as null
+ * \return number of columns
  */
-int db_insert_ucontact(ucontact_t* _c)
+static int db_ucontact_row(ucontact_t* _c, db_key_t* keys, db_val_t* vals,
+		int _nulls)
 {
 	char* dom;
-	db_key_t keys[22];
-	db_val_t vals[22];
 	int nr_cols;
-	
-	if (_c->flags & FL_MEM) {
-		return 0;
-	}
-	if(unlikely(_c->ruid.len<=0)) {
-		LM_ERR("invalid ruid for aor: %.*s\n",
-				_c->aor->len, ZSW(_c->aor->s));
-		return -1;
-	}
-
 
 	keys[0] = &user_col;
 	vals[0].type = DB1_STR;
@@ -540,7 +533,7 @@ int db_insert_ucontact(ucontact_t* _c)
 		vals[nr_cols].val.str_val.s = _c->received.s;
 		vals[nr_cols].val.str_val.len = _c->received.len;
 		nr_cols++;
-	} else if(ul_db_insert_null!=0) {
+	} else if(_nulls) {
 		keys[nr_cols] = &received_col;
 		vals[nr_cols].type = DB1_STR;
 		vals[nr_cols].nul = 1;
@@ -554,7 +547,7 @@ int db_insert_ucontact(ucontact_t* _c)
 		vals[nr_cols].val.str_val.s = _c->path.s;
 		vals[nr_cols].val.str_val.len = _c->path.len;
 		nr_cols++;
-	} else if(ul_db_insert_null!=0) {
+	} else if(_nulls) {
 		keys[nr_cols] = &path_col;
 		vals[nr_cols].type = DB1_STR;
 		vals[nr_cols].nul = 1;
@@ -567,7 +560,7 @@ int db_insert_ucontact(ucontact_t* _c)
 		vals[nr_cols].val.str_val = _c->sock->sock_str;
 		vals[nr_cols].nul = 0;
 		nr_cols++;
-	} else if(ul_db_insert_null!=0) {
+	} else if(_nulls) {
 		keys[nr_cols] = &sock_col;
 		vals[nr_cols].type = DB1_STR;
 		vals[nr_cols].nul = 1;
@@ -580,7 +573,7 @@ int db_insert_ucontact(ucontact_t* _c)
 		vals[nr_cols].val.bitmap_val = _c->methods;
 		vals[nr_cols].nul = 0;
 		nr_cols++;
-	} else if(ul_db_insert_null!=0) {
+	} else if(_nulls) {
 		keys[nr_cols] = &methods_col;
 		vals[nr_cols].type = DB1_BITMAP;
 		vals[nr_cols].nul = 1;
@@ -600,7 +593,7 @@ int db_insert_ucontact(ucontact_t* _c)
 		vals[nr_cols].nul = 0;
 		vals[nr_cols].val.str_val = _c->ruid;
 		nr_cols++;
-	} else if(ul_db_insert_null!=0) {
+	} else if(_nulls) {
 		keys[nr_cols] = &ruid_col;
 		vals[nr_cols].type = DB1_STR;
 		vals[nr_cols].nul = 1;
@@ -614,7 +607,7 @@ int db_insert_ucontact(ucontact_t* _c)
 		vals[nr_cols].nul = 0;
 		vals[nr_cols].val.str_val = _c->instance;
 		nr_cols++;
-	} else if(ul_db_insert_null!=0) {
+	} else if(_nulls) {
 		keys[nr_cols] = &instance_col;
 		vals[nr_cols].type = DB1_STR;
 		vals[nr_cols].nul = 1;
@@ -674,6 +667,33 @@ int db_insert_ucontact(ucontact_t* _c)
 		nr_cols++;
 	}
 
+	return nr_cols;
+}
+
+
+/*!
+ * \brief Insert contact into the database
+ * \param _c inserted contact
+ * \return 0 on success, -1 on failure
+ */
+int db_insert_ucontact(ucontact_t* _c)
+{
+	db_key_t keys[UL_DB_ROW_COLS];
+	db_val_t vals[UL_DB_ROW_COLS];
+	int nr_cols;
+	
+	if (_c->flags & FL_MEM) {
+		return 0;
+	}
+	if(unlikely(_c->ruid.len<=0)) {
+		LM_ERR("invalid ruid for aor: %.*s\n",
+				_c->aor->len, ZSW(_c->aor->s));
+		return -1;
+	}
+
+
+	nr_cols = db_ucontact_row(_c, keys, vals, ul_db_insert_null);
+
 	if (ul_dbf.use_table(ul_dbh, _c->domain) < 0) {
 		LM_ERR("sql use_table failed\n");
 		return -1;
@@ -694,6 +714,262 @@ int db_insert_ucontact(ucontact_t* _c)
 }
 
 
+/* contacts queued for the bulk write, per process. The rows are copies,
+ * so that they are written after the hash slot is unlocked */
+typedef struct ul_bulk_row {
+	unsigned int aorhash;
+	cstate_t old_state;
+	int op;
+	int failed;
+	char* buf; /* copy of the string values */
+} ul_bulk_row_t;
+
+static db_key_t _ul_bulk_keys[UL_DB_ROW_COLS];
+static db_key_t _ul_bulk_ukeys[UL_DB_ROW_COLS]; /* updated on duplicate */
+static int _ul_bulk_ucols = 0;
+static int _ul_bulk_ruid = -1; /* ruid column index */
+static db_val_t* _ul_bulk_vals = 0;
+static ul_bulk_row_t* _ul_bulk_rows = 0;
+static int _ul_bulk_nr = 0;
+static int _ul_bulk_max = 0;
+static int _ul_bulk_cols = 0;
+static str* _ul_bulk_domain = 0;
+
+
+/*!
+ * \brief Queue a contact for the bulk write into the database
+ * \param _c contact
+ * \param _old_state state of the contact before st_flush_ucontact()
+ * \param _op operation returned by st_flush_ucontact()
+ * \return 0 if queued, -1 if the contact must be written one by one
+ */
+int db_bulk_add_ucontact(ucontact_t* _c, cstate_t _old_state, int _op)
+{
+	db_key_t keys[UL_DB_ROW_COLS];
+	db_val_t vals[UL_DB_ROW_COLS];
+	ul_bulk_row_t* rows;
+	db_val_t* rvals;
+	char* p;
+	int nr_cols;
+	int len;
+	int n;
+	int i;
+
+	if (ul_db_bulk_size<=1
+			|| !DB_CAPABILITY(ul_dbf, DB_CAP_INSERT_UPDATE_BULK))
+		return -1;
+	/* memory only contacts and the ones without ruid (the upsert key)
+	 * take the usual way */
+	if ((_c->flags & FL_MEM) || _c->ruid.len<=0)
+		return -1;
+
+	/* all the columns are set (the unset ones as null), so the rows of a
+	 * domain have the same columns, in the same order */
+	nr_cols = db_ucontact_row(_c, keys, vals, 1);
+	if (_ul_bulk_nr>0 && (_ul_bulk_domain!=_c->domain
+				|| nr_cols!=_ul_bulk_cols
+				|| memcmp(_ul_bulk_keys, keys, nr_cols*sizeof(db_key_t)))) {
+		LM_ERR("contact row differs from the queued ones (aor: %.*s)\n",
+				_c->aor->len, ZSW(_c->aor->s));
+		return -1;
+	}
+	/* the queue holds all the dirty contacts of a slot, it grows by
+	 * db_bulk_size rows */
+	if (_ul_bulk_nr>=_ul_bulk_max) {
+		n = _ul_bulk_max + ul_db_bulk_size;
+		rows = (ul_bulk_row_t*)pkg_malloc(n * (sizeof(ul_bulk_row_t)
+					+ UL_DB_ROW_COLS*sizeof(db_val_t)));
+		if (rows==0) {
+			LM_ERR("no more pkg memory\n");
+			return -1;
+		}
+		rvals = (db_val_t*)(rows + n);
+		if (_ul_bulk_nr>0) {
+			memcpy(rows, _ul_bulk_rows, _ul_bulk_nr*sizeof(ul_bulk_row_t));
+			memcpy(rvals, _ul_bulk_vals,
+					_ul_bulk_nr*_ul_bulk_cols*sizeof(db_val_t));
+		}
+		if (_ul_bulk_rows)
+			pkg_free(_ul_bulk_rows);
+		_ul_bulk_rows = rows;
+		_ul_bulk_vals = rvals;
+		_ul_bulk_max = n;
+	}
+	for (i=0, len=0; i<nr_cols; i++)
+		if (vals[i].type==DB1_STR && !vals[i].nul)
+			len += vals[i].val.str_val.len;
+	p = (char*)pkg_malloc(len + 1);
+	if (p==0) {
+		LM_ERR("no more pkg memory\n");
+		return -1;
+	}
+	if (_ul_bulk_nr==0) {
+		memcpy(_ul_bulk_keys, keys, nr_cols*sizeof(db_key_t));
+		_ul_bulk_cols = nr_cols;
+		_ul_bulk_domain = _c->domain;
+		/* an updated contact keeps its partition */
+		for (i=0, _ul_bulk_ucols=0; i<nr_cols; i++) {
+			if (keys[i]==&ruid_col)
+				_ul_bulk_ruid = i;
+			if (keys[i]!=&partition_col)
+				_ul_bulk_ukeys[_ul_bulk_ucols++] = keys[i];
+		}
+	}
+	rvals = _ul_bulk_vals + _ul_bulk_nr*_ul_bulk_cols;
+	memcpy(rvals, vals, nr_cols*sizeof(db_val_t));
+	_ul_bulk_rows[_ul_bulk_nr].buf = p;
+	for (i=0; i<nr_cols; i++) {
+		if (vals[i].type==DB1_STR && !vals[i].nul) {
+			memcpy(p, vals[i].val.str_val.s, vals[i].val.str_val.len);
+			rvals[i].val.str_val.s = p;
+			p += vals[i].val.str_val.len;
+		}
+	}
+	_ul_bulk_rows[_ul_bulk_nr].aorhash = ul_get_aorhash(_c->aor);
+	_ul_bulk_rows[_ul_bulk_nr].old_state = _old_state;
+	_ul_bulk_rows[_ul_bulk_nr].op = _op;
+	_ul_bulk_rows[_ul_bulk_nr].failed = 0;
+	_ul_bulk_nr++;
+
+	/* the attributes are written now, they are not in the copy */
+	if (ul_xavp_contact_name.s) {
+		if (_op==2)
+			uldb_delete_attrs(_c->domain, &rvals[0].val.str_val,
+					use_domain?&rvals[nr_cols-1].val.str_val:NULL,
+					&_c->ruid);
+		uldb_insert_attrs(_c->domain, &rvals[0].val.str_val,
+				use_domain?&rvals[nr_cols-1].val.str_val:NULL,
+				&_c->ruid, _c->xavp);
+	}
+	return 0;
+}
+
+
+/*!
+ * \brief Number of contacts queued for the bulk write
+ */
+int db_bulk_nr_ucontacts(void)
+{
+	return _ul_bulk_nr;
+}
+
+
+/*!
+ * \brief Write a queued row alone, when the bulk statement failed
+ */
+static int db_bulk_write_row(int _i)
+{
+	db_key_t keys[UL_DB_ROW_COLS];
+	db_val_t vals[UL_DB_ROW_COLS];
+	db_val_t* row;
+	int n;
+	int i;
+
+	row = _ul_bulk_vals + _i*_ul_bulk_cols;
+	if (_ul_bulk_rows[_i].op==1 || ul_db_update_as_insert)
+		return ul_dbf.insert(ul_dbh, _ul_bulk_keys, row, _ul_bulk_cols);
+	/* update by ruid, the partition is kept */
+	for (i=0, n=0; i<_ul_bulk_cols; i++) {
+		if (i==_ul_bulk_ruid || _ul_bulk_keys[i]==&partition_col)
+			continue;
+		keys[n] = _ul_bulk_keys[i];
+		vals[n] = row[i];
+		n++;
+	}
+	return ul_dbf.update(ul_dbh, &_ul_bulk_keys[_ul_bulk_ruid], 0,
+			&row[_ul_bulk_ruid], keys, vals, 1, n);
+}
+
+
+/*!
+ * \brief Write the queued contacts into the database
+ * \return number of contacts that could not be written
+ */
+int db_bulk_flush_ucontacts(void)
+{
+	int res;
+	int failed;
+	int i, n;
+
+	if (_ul_bulk_nr==0)
+		return 0;
+
+	if (ul_dbf.use_table(ul_dbh, _ul_bulk_domain) < 0) {
+		LM_ERR("sql use_table failed\n");
+		for (i=0; i<_ul_bulk_nr; i++)
+			_ul_bulk_rows[i].failed = 1;
+		return _ul_bulk_nr;
+	}
+
+	failed = 0;
+	for (i=0; i<_ul_bulk_nr; i+=n) {
+		n = _ul_bulk_nr - i;
+		if (n > ul_db_bulk_size)
+			n = ul_db_bulk_size;
+		res = ul_dbf.insert_update_bulk(ul_dbh, _ul_bulk_keys,
+				_ul_bulk_vals + i*_ul_bulk_cols, _ul_bulk_cols, n,
+				_ul_bulk_ukeys, _ul_bulk_ucols);
+		if (res >= 0)
+			continue;
+		LM_WARN("bulk write of %d contacts failed, writing them"
+				" one by one\n", n);
+		for (res=i; res<i+n; res++) {
+			if (db_bulk_write_row(res) < 0) {
+				LM_ERR("writing contact into database failed (aor: %.*s)\n",
+						_ul_bulk_vals[res*_ul_bulk_cols].val.str_val.len,
+						ZSW(_ul_bulk_vals[res*_ul_bulk_cols].val.str_val.s));
+				_ul_bulk_rows[res].failed = 1;
+				failed++;
+			}
+		}
+	}
+	return failed;
+}
+
+
+/*!
+ * \brief Check the written contacts against the slot and empty the queue
+ * \param _s slot of the queued contacts, locked
+ */
+void db_bulk_check_ucontacts(struct hslot* _s)
+{
+	db_key_t keys[1];
+	ul_bulk_row_t* row;
+	db_val_t* ruid;
+	urecord_t* r;
+	ucontact_t* c;
+	int i, n;
+
+	for (i=0; i<_ul_bulk_nr; i++) {
+		row = &_ul_bulk_rows[i];
+		ruid = &_ul_bulk_vals[i*_ul_bulk_cols + _ul_bulk_ruid];
+		c = 0;
+		for (r=_s->first, n=0; r && c==0 && n<_s->n; r=r->next, n++) {
+			if (r->aorhash!=row->aorhash)
+				continue;
+			for (c=r->contacts; c; c=c->next)
+				if (c->ruid.len==ruid->val.str_val.len
+						&& !memcmp(c->ruid.s, ruid->val.str_val.s,
+							ruid->val.str_val.len))
+					break;
+		}
+		if (c==0) {
+			/* removed from the database while its copy was written */
+			keys[0] = &ruid_col;
+			if (ul_dbf.use_table(ul_dbh, _ul_bulk_domain) < 0
+					|| ul_dbf.delete(ul_dbh, keys, 0, ruid, 1) < 0)
+				LM_ERR("deleting removed contact from database failed\n");
+		} else if (row->failed && c->state==CS_SYNC) {
+			/* not changed since, written again by the next run */
+			c->state = row->old_state;
+		}
+		pkg_free(row->buf);
+	}
+	_ul_bulk_nr = 0;
+	_ul_bulk_domain = 0;
+}
+
+
 /*!
  * \brief Update contact in the database by address
  * \param _c updated contact
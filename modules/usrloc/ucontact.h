@@ -37,6 +37,9 @@
 /*! \brief ancient time used for marking the contacts forced to expired */
 #define UL_EXPIRED_TIME 10
 
+/*! \brief maximum number of columns in the database row of a contact */
+#define UL_DB_ROW_COLS 22
+
 
 /*!
  * \brief Create a new contact structure
@@ -132,6 +135,54 @@ int db_update_ucontact(ucontact_t* _c);
  */
 int db_delete_ucontact(ucontact_t* _c);
 
+
+/*!
+ * \brief Queue a contact for the bulk write into the database
+ *
+ * Queue a copy of the database row of a contact for the bulk write, used
+ * by the write-back timer with the slot of the contact locked. The queued
+ * rows are written by db_bulk_flush_ucontacts(), after the slot is
+ * unlocked, then checked by db_bulk_check_ucontacts() with the slot
+ * locked again. All the queued contacts must be of the same domain.
+ * \param _c contact
+ * \param _old_state state of the contact before st_flush_ucontact()
+ * \param _op operation returned by st_flush_ucontact()
+ * \return 0 if queued, -1 if the contact must be written one by one
+ */
+int db_bulk_add_ucontact(ucontact_t* _c, cstate_t _old_state, int _op);
+
+
+/*!
+ * \brief Number of contacts queued for the bulk write
+ */
+int db_bulk_nr_ucontacts(void);
+
+
+/*!
+ * \brief Write the queued contacts into the database
+ *
+ * Write the queued contacts into the database, with statements of at
+ * most db_bulk_size rows. If a statement fails, its contacts are written
+ * one by one. No lock is needed, the rows are copies.
+ * \return number of contacts that could not be written
+ */
+int db_bulk_flush_ucontacts(void);
+
+
+struct hslot;
+
+/*!
+ * \brief Check the written contacts against the slot and empty the queue
+ *
+ * Must be called with the slot of the queued contacts locked, after
+ * db_bulk_flush_ucontacts(). The contacts that could not be written get
+ * back their old state, unless they changed meanwhile, to be written by
+ * the next timer run. The rows of the contacts removed from the slot
+ * while the queue was written are deleted from the database again.
+ * \param _s slot of the queued contacts
+ */
+void db_bulk_check_ucontacts(struct hslot* _s);
+
 /* ====== Module interface ====== */
 
 /*!
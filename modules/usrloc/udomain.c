@@ -373,19 +373,37 @@ static inline ucontact_info_t* dbrow2info(db_val_t *vals, str *contact, int rcon
  * \return 0 on success, -1 on failure
  */
 int preload_udomain(db1_con_t* _c, udomain_t* _d)
+{
+	return preload_udomain_range(_c, _d, -1, -1, NULL);
+}
+
+
+/*!
+ * \brief Load the records with the id in a range from a udomain
+ * \param _c database connection
+ * \param _d loaded domain
+ * \param _start lowest id to load, no low limit if negative
+ * \param _end id after the last id to load, no high limit if negative
+ * \param _loaded if not NULL, set to the number of loaded contacts
+ * \return 0 on success, -1 on failure
+ */
+int preload_udomain_range(db1_con_t* _c, udomain_t* _d, long long _start,
+		long long _end, unsigned int* _loaded)
 {
 	char uri[MAX_URI_SIZE];
 	ucontact_info_t *ci;
 	db_row_t *row;
 	db_key_t columns[21];
 	db1_res_t* res = NULL;
-	db_key_t keys[1]; /* where */
-	db_val_t vals[1];
-	db_op_t  ops[1];
+	db_key_t keys[3]; /* where */
+	db_val_t vals[3];
+	db_op_t  ops[3];
 	str user, contact;
 	char* domain;
 	int i;
 	int n;
+	int nk;
+	unsigned int loaded;
 
 	urecord_t* r;
 	ucontact_t* c;
@@ -421,19 +439,39 @@ int preload_udomain(db1_con_t* _c, udomain_t* _d)
 	LM_NOTICE("load start time [%d]\n", (int)time(NULL));
 #endif
 
+	nk = 0;
 	if (ul_db_srvid) {
 		LM_NOTICE("filtered by server_id[%d]\n", server_id);
-		keys[0] = &srv_id_col;
-		ops[0] = OP_EQ;
-		vals[0].type = DB1_INT;
-		vals[0].nul = 0;
-		vals[0].val.int_val = server_id;
-	}
+		keys[nk] = &srv_id_col;
+		ops[nk] = OP_EQ;
+		vals[nk].type = DB1_INT;
+		vals[nk].nul = 0;
+		vals[nk].val.int_val = server_id;
+		nk++;
+	}
+	if (_start >= 0) {
+		keys[nk] = &id_col;
+		ops[nk] = OP_GEQ;
+		vals[nk].type = DB1_BIGINT;
+		vals[nk].nul = 0;
+		vals[nk].val.ll_val = _start;
+		nk++;
+	}
+	if (_end >= 0) {
+		keys[nk] = &id_col;
+		ops[nk] = OP_LT;
+		vals[nk].type = DB1_BIGINT;
+		vals[nk].nul = 0;
+		vals[nk].val.ll_val = _end;
+		nk++;
+	}
+	loaded = 0;
+	if (_loaded)
+		*_loaded = 0;
 
 	if (DB_CAPABILITY(ul_dbf, DB_CAP_FETCH)) {
-		if (ul_dbf.query(_c, (ul_db_srvid)?(keys):(0),
-							(ul_db_srvid)?(ops):(0), (ul_db_srvid)?(vals):(0),
-							columns, (ul_db_srvid)?(1):(0),
+		if (ul_dbf.query(_c, (nk)?(keys):(0), (nk)?(ops):(0),
+							(nk)?(vals):(0), columns, nk,
 							(use_domain)?(21):(20), 0, 0) < 0)
 		{
 			LM_ERR("db_query (1) failed\n");
@@ -444,9 +482,8 @@ int preload_udomain(db1_con_t* _c, udomain_t* _d)
 			return -1;
 		}
 	} else {
-		if (ul_dbf.query(_c, (ul_db_srvid)?(keys):(0),
-							(ul_db_srvid)?(ops):(0), (ul_db_srvid)?(vals):(0),
-							columns, (ul_db_srvid)?(1):(0),
+		if (ul_dbf.query(_c, (nk)?(keys):(0), (nk)?(ops):(0),
+							(nk)?(vals):(0), columns, nk,
 							(use_domain)?(21):(20), 0, &res) < 0)
 		{
 			LM_ERR("db_query failed\n");
@@ -520,7 +557,10 @@ int preload_udomain(db1_con_t* _c, udomain_t* _d)
 			 * and we have the contact in the database already */
 			c->state = CS_SYNC;
 			unlock_udomain(_d, &user);
+			loaded++;
 		}
+		if (_loaded)
+			*_loaded = loaded;
 
 		if (DB_CAPABILITY(ul_dbf, DB_CAP_FETCH)) {
 			if(ul_dbf.fetch_result(_c, &res, ul_fetch_rows)<0) {
@@ -548,6 +588,61 @@ error:
 }
 
 
+/*!
+ * \brief Get the highest id of the records of a udomain
+ * \param _c database connection
+ * \param _d domain
+ * \return highest id, 0 if the table is empty, -1 on failure
+ */
+long long udomain_max_id(db1_con_t* _c, udomain_t* _d)
+{
+	static char order_buf[64];
+	static str order = {0, 0};
+	db_key_t columns[1];
+	db1_res_t* res = NULL;
+	db_val_t* val;
+	long long id;
+
+	/* only the first row of the result is fetched */
+	if (!DB_CAPABILITY(ul_dbf, DB_CAP_FETCH)) {
+		LM_ERR("database module does not support fetching the result\n");
+		return -1;
+	}
+	if (order.s==NULL) {
+		order.len = snprintf(order_buf, sizeof(order_buf), "%.*s desc",
+				id_col.len, id_col.s);
+		if (order.len<0 || order.len>=sizeof(order_buf)) {
+			LM_ERR("id column name too long\n");
+			return -1;
+		}
+		order.s = order_buf;
+	}
+
+	if (ul_dbf.use_table(_c, _d->name) < 0) {
+		LM_ERR("sql use_table failed\n");
+		return -1;
+	}
+	columns[0] = &id_col;
+	if (ul_dbf.query(_c, 0, 0, 0, columns, 0, 1, &order, 0) < 0) {
+		LM_ERR("db_query failed\n");
+		return -1;
+	}
+	if (ul_dbf.fetch_result(_c, &res, 1) < 0) {
+		LM_ERR("fetching rows failed\n");
+		return -1;
+	}
+
+	id = 0;
+	if (RES_ROW_N(res) > 0) {
+		val = ROW_VALUES(RES_ROWS(res));
+		if (!VAL_NULL(val))
+			id = (VAL_TYPE(val)==DB1_BIGINT)?VAL_BIGINT(val):VAL_INT(val);
+	}
+	ul_dbf.free_result(_c, res);
+	return id;
+}
+
+
 /*!
  * \brief Loads from DB all contacts for an AOR
  * \param _c database connection
@@ -1015,6 +1110,13 @@ void mem_timer_udomain(udomain_t* _d, int istart, int istep)
 			}
 		}
 		unlock_ulslot(_d, i);
+		/* the queued rows are copies, written without the slot lock */
+		if (db_mode==WRITE_BACK && db_bulk_nr_ucontacts()>0) {
+			db_bulk_flush_ucontacts();
+			lock_ulslot(_d, i);
+			db_bulk_check_ucontacts(&_d->table[i]);
+			unlock_ulslot(_d, i);
+		}
 	}
 }
 
@@ -1031,11 +1133,7 @@ void lock_udomain(udomain_t* _d, str* _aor)
 	{
 		sl = ul_get_aorhash(_aor) & (_d->size - 1);
 
-#ifdef GEN_LOCK_T_PREFERED
-		lock_get(_d->table[sl].lock);
-#else
-		ul_lock_idx(_d->table[sl].lockidx);
-#endif
+		slot_wlock(&_d->table[sl]);
 	}
 }
 
@@ -1051,11 +1149,45 @@ void unlock_udomain(udomain_t* _d, str* _aor)
 	if (db_mode!=DB_ONLY)
 	{
 		sl = ul_get_aorhash(_aor) & (_d->size - 1);
-#ifdef GEN_LOCK_T_PREFERED
-		lock_release(_d->table[sl].lock);
-#else
-		ul_release_idx(_d->table[sl].lockidx);
-#endif
+		slot_wunlock(&_d->table[sl]);
+	}
+}
+
+
+/*!
+ * \brief Get shared (read-only) access to the slot of an AOR
+ *
+ * Other readers of the same slot are not blocked, writers (that hold the
+ * lock from lock_udomain() or lock_ulslot()) are. While holding it, the
+ * records and contacts of the slot can only be looked up and read, e.g.
+ * with get_urecord(); release_urecord() must not be called, records
+ * without contacts are removed later by the timer.
+ * \param _d domain
+ * \param _aor address of record, uses as hash source for the lock slot
+ */
+void rlock_udomain(udomain_t* _d, str* _aor)
+{
+	unsigned int sl;
+	if (db_mode!=DB_ONLY)
+	{
+		sl = ul_get_aorhash(_aor) & (_d->size - 1);
+		slot_rlock(&_d->table[sl]);
+	}
+}
+
+
+/*!
+ * \brief Release the shared access got with rlock_udomain()
+ * \param _d domain
+ * \param _aor address of record, uses as hash source for the lock slot
+ */
+void runlock_udomain(udomain_t* _d, str* _aor)
+{
+	unsigned int sl;
+	if (db_mode!=DB_ONLY)
+	{
+		sl = ul_get_aorhash(_aor) & (_d->size - 1);
+		slot_runlock(&_d->table[sl]);
 	}
 }
 
@@ -1066,12 +1198,9 @@ void unlock_udomain(udomain_t* _d, str* _aor)
  */
 void lock_ulslot(udomain_t* _d, int i)
 {
-	if (db_mode!=DB_ONLY)
-#ifdef GEN_LOCK_T_PREFERED
-		lock_get(_d->table[i].lock);
-#else
-		ul_lock_idx(_d->table[i].lockidx);
-#endif
+	if (db_mode!=DB_ONLY) {
+		slot_wlock(&_d->table[i]);
+	}
 }
 
 
@@ -1082,12 +1211,9 @@ void lock_ulslot(udomain_t* _d, int i)
  */
 void unlock_ulslot(udomain_t* _d, int i)
 {
-	if (db_mode!=DB_ONLY)
-#ifdef GEN_LOCK_T_PREFERED
-		lock_release(_d->table[i].lock);
-#else
-		ul_release_idx(_d->table[i].lockidx);
-#endif
+	if (db_mode!=DB_ONLY) {
+		slot_wunlock(&_d->table[i]);
+	}
 }
 
 
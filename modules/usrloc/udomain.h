@@ -91,6 +91,32 @@ void print_udomain(FILE* _f, udomain_t* _d);
 int preload_udomain(db1_con_t* _c, udomain_t* _d);
 
 
+/*!
+ * \brief Load the records with the id in a range from a udomain
+ *
+ * Load the records with the id in the [_start, _end) range from a
+ * udomain, used to split the preload of a large table over several
+ * processes.
+ * \param _c database connection
+ * \param _d loaded domain
+ * \param _start lowest id to load, no low limit if negative
+ * \param _end id after the last id to load, no high limit if negative
+ * \param _loaded if not NULL, set to the number of loaded contacts
+ * \return 0 on success, -1 on failure
+ */
+int preload_udomain_range(db1_con_t* _c, udomain_t* _d, long long _start,
+		long long _end, unsigned int* _loaded);
+
+
+/*!
+ * \brief Get the highest id of the records of a udomain
+ * \param _c database connection
+ * \param _d domain
+ * \return highest id, 0 if the table is empty, -1 on failure
+ */
+long long udomain_max_id(db1_con_t* _c, udomain_t* _d);
+
+
 /*!
  * \brief performs a dummy query just to see if DB is ok
  * \param con database connection
@@ -148,6 +174,22 @@ void lock_udomain(udomain_t* _d, str *_aor);
 void unlock_udomain(udomain_t* _d, str *_aor);
 
 
+/*!
+ * \brief Get shared (read-only) access to the slot of an AOR
+ * \param _d domain
+ * \param _aor address of record, uses as hash source for the lock slot
+ */
+void rlock_udomain(udomain_t* _d, str *_aor);
+
+
+/*!
+ * \brief Release the shared access got with rlock_udomain()
+ * \param _d domain
+ * \param _aor address of record, uses as hash source for the lock slot
+ */
+void runlock_udomain(udomain_t* _d, str *_aor);
+
+
 /*!
  * \brief  Get lock for a slot
  * \param _d domain
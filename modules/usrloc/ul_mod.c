@@ -56,10 +56,12 @@
 #include "ul_mi.h"
 #include "ul_rpc.h"
 #include "ul_callback.h"
+#include "ul_snapshot.h"
 #include "usrloc.h"
 
 MODULE_VERSION
 
+#define ID_COL         "id"
 #define RUID_COL       "ruid"
 #define USER_COL       "username"
 #define DOMAIN_COL     "domain"
@@ -107,6 +109,8 @@ extern int bind_usrloc(usrloc_api_t* api);
 extern int ul_locks_no;
 int ul_db_update_as_insert = 0;
 int ul_timer_procs = 0;
+int ul_db_bulk_size = 0;
+int ul_preload_procs = 1;
 int ul_db_check_update = 0;
 int ul_keepalive_timeout = 0;
 
@@ -123,6 +127,7 @@ sruid_t _ul_sruid;
  * Module parameters and their default values
  */
 
+str id_col          = str_init(ID_COL); 		/*!< Name of column containing the row id */
 str ruid_col        = str_init(RUID_COL); 		/*!< Name of column containing record unique id */
 str user_col        = str_init(USER_COL); 		/*!< Name of column containing usernames */
 str domain_col      = str_init(DOMAIN_COL); 	/*!< Name of column containing domains */
@@ -189,6 +194,7 @@ static cmd_export_t cmds[] = {
  * Exported parameters 
  */
 static param_export_t params[] = {
+	{"id_column",           PARAM_STR, &id_col        },
 	{"ruid_column",         PARAM_STR, &ruid_col      },
 	{"user_column",         PARAM_STR, &user_col      },
 	{"domain_column",       PARAM_STR, &domain_col    },
@@ -224,6 +230,10 @@ static param_export_t params[] = {
 	{"preload",             PARAM_STRING|USE_FUNC_PARAM, (void*)ul_preload_param},
 	{"db_update_as_insert", INT_PARAM, &ul_db_update_as_insert},
 	{"timer_procs",         INT_PARAM, &ul_timer_procs},
+	{"db_bulk_size",        PARAM_INT, &ul_db_bulk_size},
+	{"preload_procs",       PARAM_INT, &ul_preload_procs},
+	{"snapshot_file",       PARAM_STR, &ul_snapshot_file},
+	{"snapshot_interval",   PARAM_INT, &ul_snapshot_interval},
 	{"db_check_update",     INT_PARAM, &ul_db_check_update},
 	{"xavp_contact",        PARAM_STR, &ul_xavp_contact_name},
 	{"db_ops_ruid",         INT_PARAM, &ul_db_ops_ruid},
@@ -237,6 +247,10 @@ static param_export_t params[] = {
 
 stat_export_t mod_stats[] = {
 	{"registered_users" ,  STAT_IS_FUNC, (stat_var**)get_number_of_users  },
+	{"wb_backlog" ,        STAT_IS_FUNC, (stat_var**)ul_get_wb_backlog    },
+	{"wb_flush_time" ,     STAT_IS_FUNC, (stat_var**)ul_get_wb_flush_time },
+	{"preload_contacts" ,  STAT_IS_FUNC, (stat_var**)ul_get_preload_contacts },
+	{"preload_time" ,      STAT_IS_FUNC, (stat_var**)ul_get_preload_time  },
 	{0,0,0}
 };
 
@@ -357,6 +371,33 @@ static int mod_init(void)
 			LM_ERR("invalid fetch_rows number '%d'\n", ul_fetch_rows);
 			return -1;
 		}
+		if (ul_preload_procs>1 && !DB_CAPABILITY(ul_dbf, DB_CAP_FETCH)) {
+			LM_WARN("database module does not support fetching the result,"
+					" preload done by one process\n");
+			ul_preload_procs = 1;
+		}
+		if (ul_db_bulk_size>1 && db_mode==WRITE_BACK
+				&& !DB_CAPABILITY(ul_dbf, DB_CAP_INSERT_UPDATE_BULK)) {
+			LM_WARN("database module does not support bulk insert-update,"
+					" contacts are written one by one\n");
+		}
+	}
+
+	if (ul_preload_procs<=0)
+		ul_preload_procs = 1;
+	if (db_mode!=NO_DB && db_mode!=DB_ONLY && ul_init_preload()<0) {
+		LM_ERR("failed to init the preload\n");
+		return -1;
+	}
+
+	if (ul_snapshot_init()<0) {
+		LM_ERR("failed to init the snapshot\n");
+		return -1;
+	}
+
+	if (db_mode==WRITE_BACK && ul_init_wb_gauges(ul_timer_procs)<0) {
+		LM_ERR("failed to init the write-back gauges\n");
+		return -1;
 	}
 
 	if (nat_bflag==(unsigned int)-1) {
@@ -384,9 +425,12 @@ static int mod_init(void)
 }
 
 
+/*! \brief children helping with the preload */
+#define UL_PRELOAD_RANK(_rank) \
+	((_rank)>=PROC_SIPINIT && (_rank)<PROC_SIPINIT+ul_preload_procs)
+
 static int child_init(int _rank)
 {
-	dlist_t* ptr;
 	int i;
 
 	if(sruid_init(&_ul_sruid, '-', "ulcx", SRUID_INC)<0)
@@ -404,6 +448,22 @@ static int child_init(int _rank)
 		}
 	}
 
+	if(_rank==PROC_MAIN && ul_snapshot_file.len>0 && ul_snapshot_interval>0)
+	{
+		if(fork_basic_timer(PROC_TIMER, "USRLOC Snapshot", 1 /*socks flag*/,
+				ul_snapshot_timer, NULL, ul_snapshot_interval /*sec*/)<0) {
+			LM_ERR("failed to start snapshot timer routine as process\n");
+			return -1; /* error */
+		}
+	}
+	/* _rank==PROC_SIPINIT is used even when fork is disabled */
+	if(_rank==PROC_SIPINIT && ul_snapshot_file.len>0) {
+		if(ul_snapshot_load()<0) {
+			LM_ERR("child(%d): failed to load the snapshot\n", _rank);
+			return -1;
+		}
+	}
+
 	/* connecting to DB ? */
 	switch (db_mode) {
 		case NO_DB:
@@ -416,13 +476,13 @@ static int child_init(int _rank)
 			break;
 		case WRITE_BACK:
 			/* connect to db only from TIMER (for flush), from MAIN (for
-			 * final flush() and from child 1 for preload */
-			if (_rank!=PROC_TIMER && _rank!=PROC_MAIN && _rank!=PROC_SIPINIT)
+			 * final flush() and from the first children for preload */
+			if (_rank!=PROC_TIMER && _rank!=PROC_MAIN && !UL_PRELOAD_RANK(_rank))
 				return 0;
 			break;
 		case DB_READONLY:
-			/* connect to db only from child 1 for preload */
-			if(_rank!=PROC_SIPINIT)
+			/* connect to db only from the first children for preload */
+			if(!UL_PRELOAD_RANK(_rank))
 				return 0;
 			break;
 	}
@@ -432,16 +492,19 @@ static int child_init(int _rank)
 		LM_ERR("child(%d): failed to connect to database\n", _rank);
 		return -1;
 	}
-	/* _rank==PROC_SIPINIT is used even when fork is disabled */
-	if (_rank==PROC_SIPINIT && db_mode!=DB_ONLY) {
+	/* _rank==PROC_SIPINIT is used even when fork is disabled, so it
+	 * loads alone what the other children do not take */
+	if (UL_PRELOAD_RANK(_rank) && db_mode!=DB_ONLY) {
 		/* if cache is used, populate domains from DB */
-		for( ptr=root ; ptr ; ptr=ptr->next) {
-			if (preload_udomain(ul_dbh, ptr->d) < 0) {
-				LM_ERR("child(%d): failed to preload domain '%.*s'\n",
-						_rank, ptr->name.len, ZSW(ptr->name.s));
-				return -1;
-			}
-			uldb_preload_attrs(ptr->d);
+		if (preload_all_udomains(ul_dbh, ul_preload_procs) < 0) {
+			LM_ERR("child(%d): failed to preload domains\n", _rank);
+			return -1;
+		}
+		if (_rank!=PROC_SIPINIT
+				&& (db_mode==WRITE_BACK || db_mode==DB_READONLY)) {
+			/* connected only for the preload */
+			ul_dbf.close(ul_dbh);
+			ul_dbh = 0;
 		}
 	}
 
@@ -486,6 +549,13 @@ static void destroy(void)
 		}
 		ul_dbf.close(ul_dbh);
 	}
+	/* keep the cache for the next start */
+	if (ul_snapshot_file.len>0) {
+		ul_unlock_locks();
+		if (ul_snapshot_save() != 0) {
+			LM_ERR("saving the snapshot failed\n");
+		}
+	}
 
 	free_all_udomains();
 	ul_destroy_locks();
@@ -41,6 +41,7 @@
 
 #define UL_TABLE_VERSION 8
 
+extern str id_col;
 extern str ruid_col;
 extern str user_col;
 extern str domain_col;
@@ -82,6 +83,7 @@ extern int cseq_delay;
 extern int ul_fetch_rows;
 extern int ul_hash_size;
 extern int ul_db_update_as_insert;
+extern int ul_db_bulk_size;
 extern int ul_db_check_update;
 extern int ul_keepalive_timeout;
 extern int handle_lost_tcp;
@@ -0,0 +1,411 @@
+/*
+ * Copyright (C) 2015 kamailio.org
+ *
+ * This file is part of Kamailio, a free SIP server.
+ *
+ * Kamailio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * Kamailio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*! \file
+ *  \brief USRLOC - Snapshot file of the location cache
+ *  \ingroup usrloc
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+#include "../../dprint.h"
+#include "../../mem/mem.h"
+#include "../../mem/shm_mem.h"
+#include "../../socket_info.h"
+#include "../../timer_proc.h"
+#include "../../ut.h"
+#include "../../lib/srutils/snapfile.h"
+#include "ul_mod.h"
+#include "dlist.h"
+#include "udomain.h"
+#include "urecord.h"
+#include "ul_snapshot.h"
+
+str ul_snapshot_file = {0, 0};
+int ul_snapshot_interval = 0;
+
+/*! set once the snapshot is loaded, before that the timer must not
+ * overwrite it with a partial cache */
+static int* _ul_snapshot_ready = NULL;
+
+
+/*!
+ * \brief Initialize the snapshot support, called from mod_init
+ * \return 0 on success, -1 on failure
+ */
+int ul_snapshot_init(void)
+{
+	if (ul_snapshot_file.len<=0)
+		return 0;
+	if (db_mode!=NO_DB) {
+		LM_WARN("snapshot file is used only with db_mode 0, ignoring it\n");
+		ul_snapshot_file.len = 0;
+		return 0;
+	}
+	_ul_snapshot_ready = (int*)shm_malloc(sizeof(int));
+	if (_ul_snapshot_ready==NULL) {
+		LM_ERR("no more shm memory\n");
+		return -1;
+	}
+	*_ul_snapshot_ready = 0;
+	if (ul_snapshot_interval>0 && register_basic_timers(1)<0) {
+		LM_ERR("failed to register the snapshot timer\n");
+		return -1;
+	}
+	return 0;
+}
+
+
+static int ul_snap_add(snapfile_t* _sf, ul_snap_rec_t* _r, str* _s)
+{
+	char* p;
+	int size;
+	int i;
+
+	size = sizeof(ul_snap_rec_t);
+	for (i=0; i<UL_SNAP_STRS; i++)
+		size += _s[i].len;
+
+	p = snapfile_rec(_sf, size);
+	if (p==NULL)
+		return -1;
+	_r->rsize = SNAPFILE_ALIGN(size);
+	for (i=0; i<UL_SNAP_STRS; i++)
+		_r->len[i] = _s[i].len;
+	memcpy(p, _r, sizeof(ul_snap_rec_t));
+	p += sizeof(ul_snap_rec_t);
+	for (i=0; i<UL_SNAP_STRS; i++) {
+		if (_s[i].len>0)
+			memcpy(p, _s[i].s, _s[i].len);
+		p += _s[i].len;
+	}
+	return 0;
+}
+
+
+static int ul_snap_add_contact(snapfile_t* _sf, ucontact_t* _c)
+{
+	ul_snap_rec_t rec;
+	str s[UL_SNAP_STRS];
+
+	memset(&rec, 0, sizeof(ul_snap_rec_t));
+	memset(s, 0, sizeof(s));
+	rec.type = UL_SNAP_CONTACT;
+	rec.expires = (long long)_c->expires;
+	rec.last_modified = (long long)_c->last_modified;
+	rec.q = _c->q;
+	rec.cseq = _c->cseq;
+	rec.flags = _c->flags;
+	rec.cflags = _c->cflags;
+	rec.methods = _c->methods;
+	rec.reg_id = _c->reg_id;
+	rec.server_id = _c->server_id;
+	rec.keepalive = _c->keepalive;
+
+	s[UL_SNAP_AOR] = *_c->aor;
+	s[UL_SNAP_CONTACT_ADDR] = _c->c;
+	s[UL_SNAP_CALLID] = _c->callid;
+	s[UL_SNAP_USER_AGENT] = _c->user_agent;
+	s[UL_SNAP_RECEIVED] = _c->received;
+	s[UL_SNAP_PATH] = _c->path;
+	if (_c->sock)
+		s[UL_SNAP_SOCKET] = _c->sock->sock_str;
+	s[UL_SNAP_RUID] = _c->ruid;
+	s[UL_SNAP_INSTANCE] = _c->instance;
+
+	return ul_snap_add(_sf, &rec, s);
+}
+
+
+/*!
+ * \brief Write all the domains to the snapshot file
+ * \return 0 on success, -1 on failure
+ */
+int ul_snapshot_save(void)
+{
+	ul_snap_head_t head;
+	ul_snap_rec_t rec;
+	snapfile_t sf;
+	str s[UL_SNAP_STRS];
+	dlist_t* dl;
+	urecord_t* r;
+	ucontact_t* c;
+	time_t now;
+	int i;
+
+	/* not before the old snapshot is loaded, it would be lost */
+	if (ul_snapshot_file.len<=0 || _ul_snapshot_ready==NULL
+			|| *_ul_snapshot_ready==0)
+		return 0;
+
+	now = time(NULL);
+	memset(&head, 0, sizeof(ul_snap_head_t));
+	memcpy(head.magic, UL_SNAP_MAGIC, 4);
+	head.version = UL_SNAP_VERSION;
+	head.stime = (long long)now;
+	if (snapfile_open(&sf, &ul_snapshot_file, &head,
+				sizeof(ul_snap_head_t))<0)
+		return -1;
+
+	for (dl=root; dl; dl=dl->next) {
+		memset(&rec, 0, sizeof(ul_snap_rec_t));
+		memset(s, 0, sizeof(s));
+		rec.type = UL_SNAP_DOMAIN;
+		s[UL_SNAP_AOR] = dl->name;
+		if (ul_snap_add(&sf, &rec, s)<0)
+			goto error;
+
+		for (i=0; i<dl->d->size; i++) {
+			lock_ulslot(dl->d, i);
+			for (r=dl->d->table[i].first; r; r=r->next) {
+				for (c=r->contacts; c; c=c->next) {
+					if (!VALID_CONTACT(c, now))
+						continue;
+					if (ul_snap_add_contact(&sf, c)<0) {
+						unlock_ulslot(dl->d, i);
+						goto error;
+					}
+				}
+			}
+			unlock_ulslot(dl->d, i);
+
+			if (snapfile_flush(&sf)<0)
+				goto error;
+		}
+	}
+
+	head.records = sf.records;
+	if (snapfile_close(&sf, &head, sizeof(ul_snap_head_t))<0)
+		return -1;
+
+	LM_DBG("saved %u records to %.*s\n", head.records,
+			ul_snapshot_file.len, ul_snapshot_file.s);
+	return 0;
+
+error:
+	snapfile_abort(&sf);
+	return -1;
+}
+
+
+static int ul_snap_load_contact(udomain_t* _d, ul_snap_rec_t* _r, str* _s)
+{
+	static ucontact_info_t ci;
+	char sockbuf[MAX_SOCKET_STR];
+	str host;
+	int port, proto;
+	urecord_t* r;
+	ucontact_t* c;
+
+	memset(&ci, 0, sizeof(ucontact_info_t));
+	ci.ruid = _s[UL_SNAP_RUID];
+	ci.c = &_s[UL_SNAP_CONTACT_ADDR];
+	ci.received = _s[UL_SNAP_RECEIVED];
+	ci.path = &_s[UL_SNAP_PATH];
+	ci.expires = (time_t)_r->expires;
+	ci.q = _r->q;
+	ci.callid = &_s[UL_SNAP_CALLID];
+	ci.cseq = _r->cseq;
+	ci.flags = _r->flags;
+	ci.cflags = _r->cflags;
+	ci.user_agent = &_s[UL_SNAP_USER_AGENT];
+	ci.methods = _r->methods;
+	ci.instance = _s[UL_SNAP_INSTANCE];
+	ci.reg_id = _r->reg_id;
+	ci.server_id = _r->server_id;
+	ci.tcpconn_id = -1;
+	ci.keepalive = _r->keepalive;
+	ci.last_modified = (time_t)_r->last_modified;
+
+	if (_s[UL_SNAP_SOCKET].len>0) {
+		if (_s[UL_SNAP_SOCKET].len>=MAX_SOCKET_STR) {
+			LM_ERR("socket too long\n");
+			return -1;
+		}
+		memcpy(sockbuf, _s[UL_SNAP_SOCKET].s, _s[UL_SNAP_SOCKET].len);
+		sockbuf[_s[UL_SNAP_SOCKET].len] = 0;
+		if (parse_phostport(sockbuf, &host.s, &host.len, &port, &proto)!=0) {
+			LM_ERR("bad socket <%s>\n", sockbuf);
+			return -1;
+		}
+		ci.sock = grep_sock_info(&host, (unsigned short)port, proto);
+		if (ci.sock==0) {
+			LM_DBG("non-local socket <%s>...ignoring\n", sockbuf);
+		}
+	}
+
+	lock_udomain(_d, &_s[UL_SNAP_AOR]);
+	if (get_urecord(_d, &_s[UL_SNAP_AOR], &r) > 0) {
+		if (mem_insert_urecord(_d, &_s[UL_SNAP_AOR], &r) < 0) {
+			LM_ERR("failed to create a record\n");
+			unlock_udomain(_d, &_s[UL_SNAP_AOR]);
+			return -1;
+		}
+	}
+	if ((c=mem_insert_ucontact(r, &_s[UL_SNAP_CONTACT_ADDR], &ci)) == 0) {
+		LM_ERR("inserting contact failed\n");
+		unlock_udomain(_d, &_s[UL_SNAP_AOR]);
+		return -1;
+	}
+	c->state = CS_SYNC;
+	unlock_udomain(_d, &_s[UL_SNAP_AOR]);
+	return 0;
+}
+
+
+/*!
+ * \brief Load the contacts from the snapshot file
+ * \return 0 on success (also when there is no file), -1 on failure
+ */
+int ul_snapshot_load(void)
+{
+	struct stat st;
+	struct timeval start, end;
+	ul_snap_head_t* head;
+	ul_snap_rec_t* rec;
+	str s[UL_SNAP_STRS];
+	udomain_t* d;
+	unsigned int loaded, skipped, n;
+	char* p;
+	char* sp;
+	size_t off;
+	time_t now;
+	int fd;
+	int ret;
+	int i;
+
+	if (ul_snapshot_file.len<=0)
+		return 0;
+
+	ret = -1;
+	fd = open(ul_snapshot_file.s, O_RDONLY);
+	if (fd<0) {
+		if (errno==ENOENT) {
+			LM_INFO("no snapshot file %.*s\n", ul_snapshot_file.len,
+					ul_snapshot_file.s);
+			*_ul_snapshot_ready = 1;
+			return 0;
+		}
+		LM_ERR("cannot open %.*s: %s\n", ul_snapshot_file.len,
+				ul_snapshot_file.s, strerror(errno));
+		return -1;
+	}
+	if (fstat(fd, &st)<0 || st.st_size<sizeof(ul_snap_head_t)) {
+		LM_ERR("invalid snapshot file %.*s\n", ul_snapshot_file.len,
+				ul_snapshot_file.s);
+		close(fd);
+		return -1;
+	}
+	p = (char*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p==MAP_FAILED) {
+		LM_ERR("cannot map %.*s: %s\n", ul_snapshot_file.len,
+				ul_snapshot_file.s, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	gettimeofday(&start, NULL);
+	head = (ul_snap_head_t*)p;
+	if (memcmp(head->magic, UL_SNAP_MAGIC, 4)!=0
+			|| head->version!=UL_SNAP_VERSION) {
+		LM_ERR("unknown format of snapshot file %.*s\n", ul_snapshot_file.len,
+				ul_snapshot_file.s);
+		goto done;
+	}
+
+	now = time(NULL);
+	d = NULL;
+	loaded = skipped = 0;
+	off = sizeof(ul_snap_head_t);
+	for (n=0; n<head->records; n++) {
+		if (off + sizeof(ul_snap_rec_t) > st.st_size)
+			goto truncated;
+		rec = (ul_snap_rec_t*)(p + off);
+		if (rec->rsize<sizeof(ul_snap_rec_t) || off + rec->rsize > st.st_size)
+			goto truncated;
+		sp = p + off + sizeof(ul_snap_rec_t);
+		for (i=0; i<UL_SNAP_STRS; i++) {
+			if (sp + rec->len[i] > p + off + rec->rsize)
+				goto truncated;
+			s[i].s = (rec->len[i]>0)?sp:NULL;
+			s[i].len = rec->len[i];
+			sp += rec->len[i];
+		}
+		off += rec->rsize;
+
+		if (rec->type==UL_SNAP_DOMAIN) {
+			if (find_domain(&s[UL_SNAP_AOR], &d)!=1) {
+				LM_WARN("domain %.*s not in use, skipping its contacts\n",
+						s[UL_SNAP_AOR].len, s[UL_SNAP_AOR].s);
+				d = NULL;
+			}
+			continue;
+		}
+		if (d==NULL || rec->type!=UL_SNAP_CONTACT)
+			continue;
+		if (rec->expires!=0 && rec->expires<=(long long)now) {
+			skipped++;
+			continue;
+		}
+		if (s[UL_SNAP_AOR].len<=0 || s[UL_SNAP_CONTACT_ADDR].len<=0
+				|| s[UL_SNAP_CALLID].len<=0) {
+			LM_ERR("skipping invalid contact record\n");
+			continue;
+		}
+		if (ul_snap_load_contact(d, rec, s)<0)
+			goto done;
+		loaded++;
+	}
+
+	gettimeofday(&end, NULL);
+	LM_INFO("loaded %u contacts from %.*s (%u expired skipped) in %u ms\n",
+			loaded, ul_snapshot_file.len, ul_snapshot_file.s, skipped,
+			(unsigned int)((end.tv_sec - start.tv_sec)*1000
+				+ (end.tv_usec - start.tv_usec)/1000));
+	*_ul_snapshot_ready = 1;
+	ret = 0;
+	goto done;
+
+truncated:
+	LM_ERR("truncated snapshot file %.*s\n", ul_snapshot_file.len,
+			ul_snapshot_file.s);
+done:
+	munmap(p, st.st_size);
+	close(fd);
+	return ret;
+}
+
+
+/*!
+ * \brief Timer routine writing the snapshot periodically
+ */
+void ul_snapshot_timer(unsigned int ticks, void* param)
+{
+	ul_snapshot_save();
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2015 kamailio.org
+ *
+ * This file is part of Kamailio, a free SIP server.
+ *
+ * Kamailio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * Kamailio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*! \file
+ *  \brief USRLOC - Snapshot file of the location cache
+ *  \ingroup usrloc
+ *
+ * The snapshot keeps the contacts over restarts when no database is used
+ * (db_mode 0). The file starts with a header followed by records aligned
+ * to 8 bytes, each one made of a fixed part and the strings it refers to,
+ * so that it can be walked in place once mapped in memory. A domain
+ * record is followed by the contacts of that domain.
+ */
+
+#ifndef _UL_SNAPSHOT_H_
+#define _UL_SNAPSHOT_H_
+
+#include "../../str.h"
+
+#define UL_SNAP_MAGIC   "KULS"
+#define UL_SNAP_VERSION 1
+
+/*! \brief type of a snapshot record */
+#define UL_SNAP_DOMAIN  1
+#define UL_SNAP_CONTACT 2
+
+/*! \brief strings of a contact record, stored in this order */
+enum ul_snap_str {
+	UL_SNAP_AOR = 0, UL_SNAP_CONTACT_ADDR, UL_SNAP_CALLID,
+	UL_SNAP_USER_AGENT, UL_SNAP_RECEIVED, UL_SNAP_PATH, UL_SNAP_SOCKET,
+	UL_SNAP_RUID, UL_SNAP_INSTANCE, UL_SNAP_STRS
+};
+
+/*! \brief snapshot file header */
+typedef struct ul_snap_head {
+	char magic[4];
+	unsigned int version;
+	unsigned int records;      /*!< number of records after the header */
+	unsigned int reserved;
+	long long stime;           /*!< time when the snapshot was taken */
+} ul_snap_head_t;
+
+/*! \brief snapshot record, followed by its strings */
+typedef struct ul_snap_rec {
+	unsigned int rsize;        /*!< size of the record, 8 bytes aligned */
+	unsigned int type;         /*!< UL_SNAP_DOMAIN or UL_SNAP_CONTACT */
+	long long expires;
+	long long last_modified;
+	int q;
+	int cseq;
+	unsigned int flags;
+	unsigned int cflags;
+	unsigned int methods;
+	unsigned int reg_id;
+	int server_id;
+	int keepalive;
+	/*! string lengths, a domain record has only the domain name, stored
+	 * as UL_SNAP_AOR */
+	unsigned int len[UL_SNAP_STRS];
+} ul_snap_rec_t;
+
+extern str ul_snapshot_file;
+extern int ul_snapshot_interval;
+
+/*!
+ * \brief Initialize the snapshot support, called from mod_init
+ * \return 0 on success, -1 on failure
+ */
+int ul_snapshot_init(void);
+
+/*!
+ * \brief Write all the domains to the snapshot file
+ *
+ * The file is written under a temporary name and renamed when complete.
+ * Each hash slot is locked only while its contacts are copied. Nothing
+ * is written until the previous snapshot is loaded.
+ * \return 0 on success, -1 on failure
+ */
+int ul_snapshot_save(void);
+
+/*!
+ * \brief Load the contacts from the snapshot file
+ *
+ * Load the contacts from the snapshot file into the registered domains,
+ * skipping the ones already expired.
+ * \return 0 on success (also when there is no file), -1 on failure
+ */
+int ul_snapshot_load(void);
+
+/*!
+ * \brief Timer routine writing the snapshot periodically
+ */
+void ul_snapshot_timer(unsigned int ticks, void* param);
+
+#endif
@@ -36,6 +36,7 @@
 #include "../../tcp_conn.h"
 #include "../../pass_fd.h"
 #include "ul_mod.h"
+#include "dlist.h"
 #include "usrloc.h"
 #include "utime.h"
 #include "ul_callback.h"
@@ -406,6 +407,12 @@ static inline void wb_timer(urecord_t* _r)
 			/* Determine the operation we have to do */
 			old_state = ptr->state;
 			op = st_flush_ucontact(ptr);
+			if (op != 0) {
+				ul_wb_backlog++;
+				/* queued for the bulk write, written by the caller */
+				if (db_bulk_add_ucontact(ptr, old_state, op) == 0)
+					op = 0;
+			}
 
 			switch(op) {
 			case 0: /* do nothing, contact is synchronized */
@@ -61,6 +61,8 @@ int bind_usrloc(usrloc_api_t* api)
 	api->get_urecord        = get_urecord;
 	api->lock_udomain       = lock_udomain;
 	api->unlock_udomain     = unlock_udomain;
+	api->rlock_udomain      = rlock_udomain;
+	api->runlock_udomain    = runlock_udomain;
 	api->release_urecord    = release_urecord;
 	api->insert_ucontact    = insert_ucontact;
 	api->delete_ucontact    = delete_ucontact;
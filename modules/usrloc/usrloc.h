@@ -215,6 +215,8 @@ typedef struct usrloc_api {
 	get_urecord_t        get_urecord;
 	lock_udomain_t       lock_udomain;
 	unlock_udomain_t     unlock_udomain;
+	lock_udomain_t       rlock_udomain;
+	unlock_udomain_t     runlock_udomain;
 
 	release_urecord_t    release_urecord;
 	insert_ucontact_t    insert_ucontact;
@@ -1451,6 +1451,223 @@ skip_nop_after:
 }
 
 
+/* adds a chunk to a scatter/gather message, merging it with the previous
+ * one if they are contiguous
+ * returns 0 on success, -1 if there is no more space for chunks */
+static inline int msg_sg_add(struct msg_sg* sg, char* s, unsigned int len)
+{
+	struct iovec* v;
+
+	if (len==0)
+		return 0;
+	if (sg->iov_no){
+		v=&sg->iov[sg->iov_no-1];
+		if ((char*)v->iov_base+v->iov_len==s){
+			v->iov_len+=len;
+			sg->len+=len;
+			return 0;
+		}
+	}
+	if (unlikely(sg->iov_no==MSG_SG_IOV_MAX))
+		return -1;
+	sg->iov[sg->iov_no].iov_base=s;
+	sg->iov[sg->iov_no].iov_len=len;
+	sg->iov_no++;
+	sg->len+=len;
+	return 0;
+}
+
+
+
+/* prints a subst lump in the scratch space of sg and adds it as a chunk
+ * (the lump is printed alone, with process_lumps())
+ * returns 0 on success, -1 on error (no more space) */
+static int msg_sg_add_subst(struct msg_sg* sg, struct sip_msg* msg,
+							struct lump* l, struct dest_info* send_info)
+{
+	struct lump s;
+	unsigned int offset, s_offset;
+	int len;
+
+	s=*l;
+	s.next=s.before=s.after=0;
+	len=lumps_len(msg, &s, send_info);
+	if (unlikely(sg->scratch_len+len>MSG_SG_SCRATCH_SIZE))
+		return -1;
+	offset=sg->scratch_len;
+	s_offset=0;
+	process_lumps(msg, &s, sg->scratch, &offset, &s_offset, send_info,
+					FLAG_MSG_ALL);
+	if (msg_sg_add(sg, sg->scratch+sg->scratch_len,
+					offset-sg->scratch_len)<0)
+		return -1;
+	sg->scratch_len=offset;
+	return 0;
+}
+
+
+
+/* adds the before (dir==0) or after (dir!=0) lumps of l to sg
+ * returns 0 on success, -1 on error */
+static int msg_sg_add_lump_chain(struct msg_sg* sg, struct sip_msg* msg,
+							struct lump* l, int dir, struct dest_info* send_info)
+{
+	struct lump* r;
+
+	for(r=dir?l->after:l->before; r; r=dir?r->after:r->before){
+		switch (r->op){
+			case LUMP_ADD:
+				if (msg_sg_add(sg, r->u.value, r->len)<0)
+					return -1;
+				break;
+			case LUMP_ADD_SUBST:
+				if (msg_sg_add_subst(sg, msg, r, send_info)<0)
+					return -1;
+				break;
+			case LUMP_ADD_OPT:
+				/* stop if this is an OPT lump and the condition is
+				 * not satisfied */
+				if (!lump_check_opt(r, msg, send_info))
+					return 0;
+				break;
+			default:
+				/* only ADD allowed for before/after */
+				LM_CRIT("invalid op for data lump (%x)\n", r->op);
+		}
+	}
+	return 0;
+}
+
+
+
+/* scatter/gather version of process_lumps(..., FLAG_MSG_ALL): instead of
+ * copying, adds chunks pointing to msg->buf and to the lump values to sg
+ * returns 0 on success, -1 on error (sg full) */
+static int msg_sg_process_lumps(struct msg_sg* sg, struct sip_msg* msg,
+						struct lump* lumps, unsigned int* orig_offs,
+						struct dest_info* send_info)
+{
+	struct lump* t;
+	unsigned int s_offset;
+	int size;
+
+	s_offset=*orig_offs;
+	for (t=lumps; t; t=t->next){
+		switch(t->op){
+			case LUMP_ADD:
+			case LUMP_ADD_SUBST:
+			case LUMP_ADD_OPT:
+				if ((t->op==LUMP_ADD_OPT) &&
+						(!lump_check_opt(t, msg, send_info)))
+					continue;
+				if (msg_sg_add_lump_chain(sg, msg, t, 0, send_info)<0)
+					return -1;
+				if (t->op==LUMP_ADD){
+					if (msg_sg_add(sg, t->u.value, t->len)<0)
+						return -1;
+				}else if (t->op==LUMP_ADD_SUBST){
+					if (msg_sg_add_subst(sg, msg, t, send_info)<0)
+						return -1;
+				}
+				if (msg_sg_add_lump_chain(sg, msg, t, 1, send_info)<0)
+					return -1;
+				break;
+			case LUMP_NOP:
+			case LUMP_DEL:
+				if (s_offset>t->u.offset){
+					LM_DBG("WARNING: (%d) overlapped lumps offsets,"
+						" ignoring(%x, %x)\n", t->op, s_offset,t->u.offset);
+					break;
+				}
+				size=t->u.offset-s_offset;
+				if (size>0){
+					if (msg_sg_add(sg, msg->buf+s_offset, size)<0)
+						return -1;
+					s_offset+=size;
+				}
+				if (msg_sg_add_lump_chain(sg, msg, t, 0, send_info)<0)
+					return -1;
+				if (t->op==LUMP_DEL)
+					s_offset+=t->len;
+				if (msg_sg_add_lump_chain(sg, msg, t, 1, send_info)<0)
+					return -1;
+				break;
+			default:
+				LM_CRIT("unknown op (%x)\n", t->op);
+		}
+	}
+	*orig_offs=s_offset;
+	return 0;
+}
+
+
+
+/* fills sg with the chunks of msg with all its lumps applied and with the
+ * request uri replaced by new_uri (if non-null)
+ * returns 0 on success, -1 if it does not fit in sg */
+static int msg_sg_build(struct msg_sg* sg, struct sip_msg* msg, str* new_uri,
+						struct dest_info* send_info)
+{
+	unsigned int s_offset;
+
+	msg_sg_init(sg);
+	s_offset=0;
+	if (new_uri){
+		/* message up to uri, then our uri */
+		s_offset=msg->first_line.u.request.uri.s-msg->buf;
+		if (msg_sg_add(sg, msg->buf, s_offset)<0 ||
+				msg_sg_add(sg, new_uri->s, new_uri->len)<0)
+			return -1;
+		s_offset+=msg->first_line.u.request.uri.len; /* skip original uri */
+	}
+	if (msg_sg_process_lumps(sg, msg, msg->add_rm, &s_offset, send_info)<0 ||
+			msg_sg_process_lumps(sg, msg, msg->body_lumps, &s_offset,
+									send_info)<0)
+		return -1;
+	/* the rest of the message */
+	return msg_sg_add(sg, msg->buf+s_offset, msg->len-s_offset);
+}
+
+
+
+/* sets a flat message (new_buf, pkg) as the only chunk of sg */
+static void msg_sg_set_buf(struct msg_sg* sg, char* new_buf,
+							unsigned int new_len)
+{
+	msg_sg_init(sg);
+	sg->buf=new_buf;
+	sg->iov[0].iov_base=new_buf;
+	sg->iov[0].iov_len=new_len;
+	sg->iov_no=1;
+	sg->len=new_len;
+}
+
+
+
+char* msg_sg_flatten(struct msg_sg* sg)
+{
+	char* p;
+	int i;
+
+	if (sg->buf)
+		return sg->buf;
+	sg->buf=pkg_malloc(sg->len+1);
+	if (sg->buf==0){
+		LM_ERR("out of pkg memory\n");
+		return 0;
+	}
+	p=sg->buf;
+	for (i=0; i<sg->iov_no; i++){
+		memcpy(p, sg->iov[i].iov_base, sg->iov[i].iov_len);
+		p+=sg->iov[i].iov_len;
+	}
+	*p=0;
+	msg_sg_set_buf(sg, sg->buf, sg->len);
+	return sg->buf;
+}
+
+
+
 /*
  * Adjust/insert Content-Length if necessary
  */
@@ -1906,14 +2123,19 @@ clean:
   *                   msg->path_vec content.
   *                 * BUILD_IN_SHM - build the result in shm memory
   *
+  * @param sg - if non-null, the request is not copied, sg is filled with
+  *             its chunks instead (see struct msg_sg)
+  *
   * @return pointer to the new request (pkg_malloc'ed or shm_malloc'ed,
   * depending on the presence of the BUILD_IN_SHM flag, needs freeing when
-  *   done) and sets returned_len or 0 on error.
+  *   done) and sets returned_len or 0 on error. In sg mode it returns a
+  *   pointer to the first chunk.
   */
-char * build_req_buf_from_sip_req( struct sip_msg* msg,
+static char* build_req_from_sip_req( struct sip_msg* msg,
 								unsigned int *returned_len,
 								struct dest_info* send_info,
-								unsigned int mode)
+								unsigned int mode,
+								struct msg_sg* sg)
 {
 	unsigned int len, new_len, received_len, rport_len, uri_len, via_len,
 				 body_delta;
@@ -2145,6 +2367,18 @@ after_update_via1:
 		uri_len=msg->new_uri.len;
 		new_len=new_len-msg->first_line.u.request.uri.len+uri_len;
 	}
+	if (sg && di.proto==PROTO_NONE){
+		if (msg_sg_build(sg, msg, msg->new_uri.s?&msg->new_uri:0,
+							send_info)==0){
+			if (likely(sg->len==new_len)){
+				*returned_len=new_len;
+				return sg->iov[0].iov_base;
+			}
+			LM_CRIT("BUG: scatter/gather length mismatch: %u != %u\n",
+					sg->len, new_len);
+		}
+		/* too many chunks, build it in one buffer */
+	}
 	if(unlikely(mode&BUILD_IN_SHM))
 		new_buf=(char*)shm_malloc(new_len+1);
 	else
@@ -2188,6 +2422,8 @@ after_update_via1:
 	}
 #endif
 
+	if (sg)
+		msg_sg_set_buf(sg, new_buf, new_len);
 	*returned_len=new_len;
 	return new_buf;
 
@@ -2205,8 +2441,32 @@ error00:
 	return 0;
 }
 
-char * generate_res_buf_from_sip_res( struct sip_msg* msg,
-				unsigned int *returned_len, unsigned int mode)
+char * build_req_buf_from_sip_req( struct sip_msg* msg,
+								unsigned int *returned_len,
+								struct dest_info* send_info,
+								unsigned int mode)
+{
+	return build_req_from_sip_req(msg, returned_len, send_info, mode, 0);
+}
+
+int build_req_sg_from_sip_req(struct sip_msg* msg, struct msg_sg* sg,
+				struct dest_info* send_info, unsigned int mode)
+{
+	unsigned int len;
+
+	msg_sg_init(sg);
+	if (build_req_from_sip_req(msg, &len, send_info, mode&~BUILD_IN_SHM,
+								sg)==0)
+		return -1;
+	return 0;
+}
+
+/* builds a reply in memory from another sip reply, removing the first via
+ * - if sg is non-null, fills it with the chunks of the new reply instead of
+ *   copying it (see struct msg_sg) and returns a pointer to the first one */
+static char* generate_res_from_sip_res( struct sip_msg* msg,
+				unsigned int *returned_len, unsigned int mode,
+				struct msg_sg* sg)
 {
 	unsigned int new_len, via_len, body_delta;
 	char* new_buf;
@@ -2254,6 +2514,17 @@ char * generate_res_buf_from_sip_res( struct sip_msg* msg,
 														know the send sock */
 
 	LM_DBG("old size: %d, new size: %d\n", len, new_len);
+	if (sg){
+		if (msg_sg_build(sg, msg, 0, 0)==0){
+			if (likely(sg->len==new_len)){
+				*returned_len=new_len;
+				return sg->iov[0].iov_base;
+			}
+			LM_CRIT("BUG: scatter/gather length mismatch: %u != %u\n",
+					sg->len, new_len);
+		}
+		/* too many chunks, build it in one buffer */
+	}
 	new_buf=(char*)pkg_malloc(new_len+1); /* +1 is for debugging
 											 (\0 to print it )*/
 	if (new_buf==0){
@@ -2273,6 +2544,8 @@ char * generate_res_buf_from_sip_res( struct sip_msg* msg,
 	LM_DBG("copied size: orig:%d, new: %d, rest: %d msg=\n%s\n",
 			s_offset, offset, len-s_offset, new_buf);
 
+	if (sg)
+		msg_sg_set_buf(sg, new_buf, new_len);
 	*returned_len=new_len;
 	return new_buf;
 error:
@@ -2280,12 +2553,28 @@ error:
 	return 0;
 }
 
+char * generate_res_buf_from_sip_res( struct sip_msg* msg,
+				unsigned int *returned_len, unsigned int mode)
+{
+	return generate_res_from_sip_res(msg, returned_len, mode, 0);
+}
+
 char * build_res_buf_from_sip_res( struct sip_msg* msg,
 				unsigned int *returned_len)
 {
 	return generate_res_buf_from_sip_res(msg, returned_len, 0);
 }
 
+int build_res_sg_from_sip_res(struct sip_msg* msg, struct msg_sg* sg)
+{
+	unsigned int len;
+
+	msg_sg_init(sg);
+	if (generate_res_from_sip_res(msg, &len, 0, sg)==0)
+		return -1;
+	return 0;
+}
+
 char * build_res_buf_from_sip_req( unsigned int code, str *text ,str *new_tag,
 		struct sip_msg* msg, unsigned int *returned_len, struct bookmark *bmark)
 {
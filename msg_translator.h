@@ -51,8 +51,45 @@
 #define BUILD_NO_PATH			(1<<2)
 #define BUILD_IN_SHM			(1<<7)
 
+#include <sys/uio.h>
 #include "parser/msg_parser.h"
 #include "ip_addr.h"
+#include "mem/mem.h"
+
+#define MSG_SG_IOV_MAX		64  /* max chunks of a scatter/gather message */
+#define MSG_SG_SCRATCH_SIZE	512 /* space for the printed subst lumps */
+
+/* scatter/gather view of a message built from another one: the chunks
+ * point to the unchanged parts of the original msg->buf and to the lump
+ * values, only the subst lumps (received/sending address, port a.s.o.)
+ * are printed in scratch.
+ * If the new message does not fit in it, it is built as usual in buf
+ * (pkg_malloc'ed) and iov has only one chunk, pointing to buf.
+ * The chunks are valid as long as the original message and its lumps are
+ * not changed or freed. */
+struct msg_sg {
+	struct iovec iov[MSG_SG_IOV_MAX];
+	int iov_no;
+	unsigned int len; /* total length */
+	char* buf; /* flat copy, if any */
+	unsigned int scratch_len;
+	char scratch[MSG_SG_SCRATCH_SIZE];
+};
+
+static inline void msg_sg_init(struct msg_sg* sg)
+{
+	sg->iov_no=0;
+	sg->len=0;
+	sg->buf=0;
+	sg->scratch_len=0;
+}
+
+static inline void msg_sg_free(struct msg_sg* sg)
+{
+	if (sg->buf)
+		pkg_free(sg->buf);
+	msg_sg_init(sg);
+}
 
 /* point to some remarkable positions in a SIP message */
 struct bookmark {
@@ -85,6 +122,20 @@ char * build_req_buf_from_sip_req(struct sip_msg* msg,
 char * build_res_buf_from_sip_res(struct sip_msg* msg,
 				unsigned int *returned_len);
 
+/* same as build_req_buf_from_sip_req() and build_res_buf_from_sip_res(),
+ * but the result is a scatter/gather list, without copying the message
+ * (BUILD_IN_SHM is not supported)
+ * returns 0 on success and -1 on error, sg must be released with
+ * msg_sg_free() */
+int build_req_sg_from_sip_req(struct sip_msg* msg, struct msg_sg* sg,
+				struct dest_info* send_info, unsigned int mode);
+
+int build_res_sg_from_sip_res(struct sip_msg* msg, struct msg_sg* sg);
+
+/* returns the message in sg in one pkg buffer (sg->buf), copying the
+ * chunks if needed, or 0 on error */
+char* msg_sg_flatten(struct msg_sg* sg);
+
 char * generate_res_buf_from_sip_res(struct sip_msg* msg,
 				unsigned int *returned_len, unsigned int mode);
 
@@ -308,6 +308,7 @@ int parse_headers(struct sip_msg* const msg, const hdr_flags_t flags, const int
 	char* rest;
 	char* end;
 	hdr_flags_t orig_flag;
+	hdr_flags_t want;
 
 	end=msg->buf+msg->len;
 	tmp=msg->unparsed;
@@ -318,10 +319,16 @@ int parse_headers(struct sip_msg* const msg, const hdr_flags_t flags, const int
 	}else
 		orig_flag=0;
 
+	/* with the header index, don't look for the types which are not in the
+	 * message, unless the end of header was asked for */
+	want=flags;
+	if (msg->hdr_present && flags!=HDR_EOH_F)
+		want&=msg->hdr_present;
+
 #ifdef EXTRA_DEBUG
 	DBG("parse_headers: flags=%llx\n", (unsigned long long)flags);
 #endif
-	while( tmp<end && (flags & msg->parsed_flag) != flags){
+	while( tmp<end && (want & msg->parsed_flag) != want){
 		prefetch_loc_r(tmp+64, 1);
 		hf=pkg_malloc(sizeof(struct hdr_field));
 		if (unlikely(hf==0)){
@@ -580,6 +587,50 @@ error:
 
 
 /* returns 0 if ok, -1 for errors */
+/** builds the header index of a message: the types of all the header fields,
+ * found in one pass over the header lines, without parsing the bodies.
+ * parse_headers() uses it to stop early when asked for missing headers.
+ * The lines are split with memchr(), vectorized by the libc.
+ * @return 0 on success, -1 if the headers can't be indexed (msg->hdr_present
+ *  stays 0 and the message is parsed as usual)
+ */
+int parse_hdr_index(struct sip_msg* const msg)
+{
+	struct hdr_field hf;
+	hdr_flags_t present;
+	char* p;
+	char* end;
+	char* eol;
+
+	present=0;
+	end=msg->buf+msg->len;
+	p=msg->unparsed;
+	while(p<end){
+		if (*p=='\n' || *p=='\r'){
+			/* end of header; a second via might be in the first via body */
+			if (present & HDR_VIA_F)
+				present|=HDR_VIA2_F;
+			msg->hdr_present=present;
+			return 0;
+		}
+		hf.type=HDR_ERROR_T;
+		parse_hname2(p, end, &hf);
+		if (hf.type==HDR_ERROR_T)
+			return -1; /* let parse_headers() complain about it */
+		present|=HDR_T2F(hf.type);
+		/* next header line, skipping the folded ones */
+		do{
+			eol=memchr(p, '\n', end-p);
+			if (eol==0)
+				return -1;
+			p=eol+1;
+		}while(p<end && (*p==' ' || *p=='\t'));
+	}
+	return -1;
+}
+
+
+
 int parse_msg(char* const buf, const unsigned int len, struct sip_msg* const msg)
 {
 
@@ -629,6 +680,8 @@ int parse_msg(char* const buf, const unsigned int len, struct sip_msg* const msg
 			goto error;
 	}
 	msg->unparsed=tmp;
+	if (sip_hdr_index)
+		parse_hdr_index(msg);
 	/*find first Via: */
 	if (parse_headers(msg, flags, 0)==-1) goto error;
 
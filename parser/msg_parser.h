@@ -269,6 +269,8 @@ typedef struct sip_msg {
 	struct hdr_field* headers;     /*!< All the parsed headers*/
 	struct hdr_field* last_header; /*!< Pointer to the last parsed header*/
 	hdr_flags_t parsed_flag;    /*!< Already parsed header field types */
+	hdr_flags_t hdr_present;    /*!< Header field types present in the
+								  message, 0 if not indexed */
 
 	     /* Via, To, CSeq, Call-Id, From, end of header*/
 	     /* pointers to the first occurrences of these headers;
@@ -394,6 +396,8 @@ extern unsigned int global_req_flags;
 
 int parse_msg(char* const buf, const unsigned int len, struct sip_msg* const msg);
 
+int parse_hdr_index(struct sip_msg* const msg);
+
 int parse_headers(struct sip_msg* const msg, const hdr_flags_t flags, const int next);
 
 char* get_hdr_field(char* const buf, char* const end, struct hdr_field* const hdr);
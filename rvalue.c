@@ -76,6 +76,26 @@
  * strops without reallocs) */
 #define RV_STR_EXTRA 80
 
+/* max. number of freed rvalues kept in each rv cache size class */
+#ifndef RV_CACHE_MAX
+#define RV_CACHE_MAX 16
+#endif
+
+/* extra size of the rvalues in each rv cache size class: ints and two
+ * classes for the strings built by the string operations. The latter ask
+ * for RV_STR_EXTRA more than the result, test/rvalue_cache_bench -d shows
+ * them between 80 and 192 bytes for typical uri, contact and key
+ * concatenations, most of them under 128 */
+static const int rv_cache_size[]={0, 128, 192};
+#define RV_CACHE_CLASSES (sizeof(rv_cache_size)/sizeof(rv_cache_size[0]))
+
+/* per process cache of freed rvalues, so that the temporary values of an
+ * expression evaluation do not need a pkg_malloc() and a pkg_free() each.
+ * The extra size of a new rvalue is rounded up to the one of the smallest
+ * class it fits in, bigger rvalues are not cached */
+static struct rvalue* rv_cache[RV_CACHE_CLASSES][RV_CACHE_MAX];
+static int rv_cache_no[RV_CACHE_CLASSES];
+
 #define rv_ref(rv) ((rv)->refcnt++)
 
 /** unref rv and returns true if 0 */
@@ -117,6 +137,8 @@ inline static void rval_force_clean(struct rvalue* rv)
  */
 void rval_destroy(struct rvalue* rv)
 {
+	int c;
+
 	if (rv && rv_unref(rv)){
 		rval_force_clean(rv);
 		/* still an un-regfreed RE ? */
@@ -126,6 +148,11 @@ void rval_destroy(struct rvalue* rv)
 			regfree(rv->v.re.regex);
 		}
 		if (rv->flags & RV_RV_ALLOCED_F){
+			c=RV_RV_CACHE_CLASS(rv->flags);
+			if (c>=0 && rv_cache_no[c]<RV_CACHE_MAX){
+				rv_cache[c][rv_cache_no[c]++]=rv;
+				return;
+			}
 			pkg_free(rv);
 		}
 	}
@@ -219,12 +246,28 @@ struct rvalue* rval_new_empty(int extra_size)
 {
 	struct rvalue* rv;
 	int size; /* extra size at the end */
+	int c; /* rv cache size class */
+	short flags;
 	
+	flags=RV_RV_ALLOCED_F;
+	c=-1;
+	if (RV_CACHE_MAX){
+		for (c=0; c<RV_CACHE_CLASSES && extra_size>rv_cache_size[c]; c++);
+		if (c<RV_CACHE_CLASSES){
+			extra_size=rv_cache_size[c];
+			flags|=RV_RV_CACHE_F(c);
+		}else{
+			c=-1;
+		}
+	}
 	size=ROUND_LONG(sizeof(*rv)-sizeof(rv->buf)+extra_size); /* round up */
-	rv=pkg_malloc(size);
+	if (c>=0 && rv_cache_no[c])
+		rv=rv_cache[c][--rv_cache_no[c]];
+	else
+		rv=pkg_malloc(size);
 	if (likely(rv)){
 		rv->bsize=size-sizeof(*rv)-sizeof(rv->buf); /* remaining size->buffer*/
-		rv->flags=RV_RV_ALLOCED_F;
+		rv->flags=flags;
 		rv->refcnt=1;
 		rv->type=RV_NONE;
 	}
@@ -118,6 +118,9 @@ struct rvalue{
 #define RV_ALL_ALLOCED_F  (RV_CNT_ALLOCED|RV_RV_ALLOCED)
 #define RV_RE_F  4 /**< string is a RE with a valid v->re member */
 #define RV_RE_ALLOCED_F 8 /**< v->re.regex must be freed */
+#define RV_RV_CACHE_MASK 48 /**< rv cache size class + 1, 0 if not cached */
+#define RV_RV_CACHE_F(c) (((c)+1)<<4)
+#define RV_RV_CACHE_CLASS(f) ((((f) & RV_RV_CACHE_MASK)>>4)-1)
 
 struct rval_expr{
 	enum rval_expr_op op;
@@ -23,6 +23,11 @@ struct sip_msg*  sip_msg_shm_clone(	struct sip_msg *org_msg,
 									int *sip_msg_len,
 									int clone_lumps);
 
+unsigned int sip_msg_shm_clone_len(struct sip_msg *org_msg, int clone_lumps);
+
+struct sip_msg* sip_msg_shm_clone_buf(struct sip_msg *org_msg, char *p,
+									int clone_lumps);
+
 int msg_lump_cloner(struct sip_msg *pkg_msg,
 					struct lump** add_rm,
 					struct lump** body_lumps,
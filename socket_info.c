@@ -307,6 +307,7 @@ static void free_sock_info(struct socket_info* si)
 		if(si->useinfo.name.s) pkg_free(si->useinfo.name.s);
 		if(si->useinfo.port_no_str.s) pkg_free(si->useinfo.port_no_str.s);
 		if(si->useinfo.sock_str.s) pkg_free(si->useinfo.sock_str.s);
+		if(si->rp_socket) pkg_free(si->rp_socket);
 	}
 }
 
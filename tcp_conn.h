@@ -55,6 +55,8 @@
 #define F_CONN_WANTS_RD  4096  /* conn. should be watched for READ */
 #define F_CONN_WANTS_WR  8192  /* conn. should be watched for WRITE */
 #define F_CONN_PASSIVE  16384 /* conn. created via accept() and not connect()*/
+#define F_CONN_OWNED    32768 /* accepted and kept by a tcp reader, never
+								 passed to tcp_main (tcp_reuse_port) */
 
 #ifndef NO_READ_HTTP11
 #define READ_HTTP11
@@ -215,6 +217,9 @@ struct tcp_connection{
 #ifdef TCP_ASYNC
 	struct tcp_wbuffer_queue wbuf_q;
 #endif
+	struct tcp_connection* ho_next; /* next in the owner handoff queue */
+	unsigned short ho_cmds; /* commands queued for the owner (TCP_HO_*) */
+	short owner; /* index of the owner reader (F_CONN_OWNED) */
 };
 
 
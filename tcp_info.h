@@ -32,6 +32,12 @@ struct tcp_gen_info{
 	int tls_connections_no; /* crt. tls connections number */
 	int tcp_write_queued; /* total bytes queued for write, 0 if no
 							 write queued support is enabled */
+	/* tcp readers owning their connections (tcp_reuse_port), summed over
+	 * all the readers, 0 when not used */
+	int owned_readers; /* readers with a handoff queue */
+	int owned_connections; /* connections kept by the readers */
+	unsigned long owned_accepted; /* connections accepted by the readers */
+	unsigned long owned_handoffs; /* connections handed to the readers */
 };
 
 
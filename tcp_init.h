@@ -54,6 +54,8 @@ struct tcp_child{
 int init_tcp(void);
 void destroy_tcp(void);
 int tcp_init(struct socket_info* sock_info);
+int tcp_reuse_port_init(void);
+int tcp_reuse_port_socket(struct socket_info* si, int r);
 int tcp_init_children(void);
 void tcp_main_loop(void);
 void tcp_receive_loop(int unix_sock);
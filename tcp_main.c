@@ -86,6 +86,7 @@
 #ifdef CORE_TLS
 #include "tls/tls_server.h"
 #define tls_loaded() 1
+#define tls_has_init_si() 1
 #else
 #include "tls_hooks_init.h"
 #include "tls_hooks.h"
@@ -96,6 +97,7 @@
 
 #include "tcp_info.h"
 #include "tcp_options.h"
+#include "tcp_reactor.h"
 #include "ut.h"
 #include "cfg/cfg_struct.h"
 
@@ -984,7 +986,9 @@ struct tcp_connection* tcpconn_new(int sock, union sockaddr_union* su,
 	print_ip("tcpconn_new: new tcp connection: ", &c->rcv.src_ip, "\n");
 	LM_DBG("on port %d, type %d\n", c->rcv.src_port, type);
 	init_tcp_req(&c->req, (char*)c+sizeof(struct tcp_connection), rd_b_size);
-	c->id=(*connection_id)++;
+	/* connections are created also by the tcp readers (tcp_reuse_port)
+	 * and by the senders */
+	c->id=atomic_add_int(connection_id, 1)-1;
 	c->rcv.proto_reserved1=0; /* this will be filled before receive_message*/
 	c->rcv.proto_reserved2=0;
 	c->state=state;
@@ -2101,6 +2105,81 @@ end_no_conn:
 
 
 
+/* passes a command for a connection kept by a tcp reader (F_CONN_OWNED) to
+ * the owner reader instead of tcp_main: CONN_QUEUED_WRITE - write the
+ * queue, CONN_EOF / CONN_ERROR - close the connection.
+ * Like the commands sent to tcp_main, it auto-dec. the refcnt.
+ * returns 0 on success, -1 on error */
+static int tcpconn_owned_cmd(struct tcp_connection* c, long cmd)
+{
+	int ret;
+
+	ret=tcp_reactor_push(c, (cmd==CONN_QUEUED_WRITE)?TCP_HO_WRITE:
+												TCP_HO_CLOSE);
+	tcpconn_chld_put(c);
+	return ret;
+}
+
+
+
+#ifdef TCP_ASYNC
+/* queues data on a connection kept by another tcp reader and wakes up the
+ * reader if the write queue was empty (the reader is already writing
+ * otherwise). It doesn't touch the ref. counters.
+ * @return len on success, -1 on error (the connection will be closed)
+ */
+static int tcpconn_owned_queue(struct tcp_connection* c, const char* buf,
+								unsigned len, snd_flags_t send_flags)
+{
+	int was_empty;
+#ifdef USE_TLS
+	const char* rest_buf;
+	const char* t_buf;
+	unsigned rest_len, t_len;
+	snd_flags_t t_send_flags;
+	int n;
+#endif /* USE_TLS */
+
+	lock_get(&c->write_lock);
+		tcpconn_set_send_flags(c, send_flags);
+		was_empty=_wbufq_empty(c);
+#ifdef USE_TLS
+		if (unlikely(c->type==PROTO_TLS || c->type==PROTO_WSS)) {
+			t_buf = buf;
+			t_len = len;
+			do {
+				t_send_flags = send_flags;
+				n = tls_encode(c, &t_buf, &t_len, &rest_buf, &rest_len,
+								&t_send_flags);
+				if (unlikely((n < 0) || (t_len &&
+								(_wbufq_add(c, t_buf, t_len) < 0))))
+					goto error;
+				t_buf = rest_buf;
+				t_len = rest_len;
+			} while(unlikely(rest_len && n > 0));
+		} else
+#endif /* USE_TLS */
+			if (unlikely(len && (_wbufq_add(c, buf, len) < 0)))
+				goto error;
+	lock_release(&c->write_lock);
+	if (was_empty || (send_flags.f & SND_F_CON_CLOSE)){
+		/* (close after send is handled by the reader, once the queue is
+		 *  written) */
+		if (unlikely(tcp_reactor_push(c, TCP_HO_WRITE)<0))
+			return -1;
+	}
+	return len;
+error:
+	lock_release(&c->write_lock);
+	c->state=S_CONN_BAD;
+	c->timeout=get_ticks_raw(); /* force timeout */
+	tcp_reactor_push(c, TCP_HO_CLOSE);
+	return -1;
+}
+#endif /* TCP_ASYNC */
+
+
+
 /** sends on an existing tcpconn and auto-dec. con. ref counter.
  * As opposed to tcp_send(), this function requires an existing
  * tcp connection.
@@ -2136,11 +2215,16 @@ static int tcpconn_send_put(struct tcp_connection* c, const char* buf,
 	response[1] = CONN_NOP;
 #ifdef TCP_ASYNC
 	/* if data is already queued, we don't need the fd */
+	/* (the connections kept by a reader are always written from their
+	 *  write queue once something was queued) */
 #ifdef TCP_CONNECT_WAIT
-		if (unlikely(cfg_get(tcp, tcp_cfg, async) &&
+		if (unlikely((cfg_get(tcp, tcp_cfg, async) ||
+							(c->flags & F_CONN_OWNED)) &&
 						(_wbufq_non_empty(c) || (c->flags&F_CONN_PENDING)) ))
 #else /* ! TCP_CONNECT_WAIT */
-		if (unlikely(cfg_get(tcp, tcp_cfg, async) && (_wbufq_non_empty(c)) ))
+		if (unlikely((cfg_get(tcp, tcp_cfg, async) ||
+							(c->flags & F_CONN_OWNED)) &&
+						(_wbufq_non_empty(c)) ))
 #endif /* TCP_CONNECT_WAIT */
 		{
 			lock_get(&c->write_lock);
@@ -2188,6 +2272,12 @@ static int tcpconn_send_put(struct tcp_connection* c, const char* buf,
 				}
 			lock_release(&c->write_lock);
 		}
+		/* connection kept by another tcp reader: its fd is known only
+		 * there => queue the data and hand the connection to the reader */
+		if (unlikely((c->flags & F_CONN_OWNED) && c->reader_pid!=my_pid())){
+			n=tcpconn_owned_queue(c, buf, len, send_flags);
+			goto release_c;
+		}
 #endif /* TCP_ASYNC */
 		/* check if this is not the same reader process holding
 		 *  c  and if so send directly on c->fd */
@@ -2290,7 +2380,10 @@ static int tcpconn_send_put(struct tcp_connection* c, const char* buf,
 	if (unlikely(response[1] != CONN_NOP)) {
 error:
 		response[0]=(long)c;
-		if (send_all(unix_tcp_sock, response, sizeof(response)) <= 0) {
+		if (unlikely(c->flags & F_CONN_OWNED)) {
+			/* handled by the owner reader (auto-dec refcnt too) */
+			tcpconn_owned_cmd(c, response[1]);
+		} else if (send_all(unix_tcp_sock, response, sizeof(response)) <= 0) {
 			BUG("tcp_main command %ld sending failed (write):%s (%d)\n",
 					response[1], strerror(errno), errno);
 			/* all commands != CONN_NOP returned by tcpconn_do_send()
@@ -2376,7 +2469,9 @@ int tcpconn_send_unsafe(int fd, struct tcp_connection *c,
 		 */
 		atomic_inc(&c->refcnt);
 		response[0]=(long)c;
-		if (send_all(unix_tcp_sock, response, sizeof(response)) <= 0) {
+		if (unlikely(c->flags & F_CONN_OWNED)) {
+			tcpconn_owned_cmd(c, response[1]);
+		} else if (send_all(unix_tcp_sock, response, sizeof(response)) <= 0) {
 			BUG("connection %p command %ld sending failed (write):%s (%d)\n",
 					c, response[1], strerror(errno), errno);
 			/* send failed => deref. it back by hand */
@@ -2746,6 +2841,17 @@ int tcp_init(struct socket_info* sock_info)
 		LM_ERR("setsockopt %s\n", strerror(errno));
 		goto error;
 	}
+#endif
+#ifdef SO_REUSEPORT
+	/* allow one listen socket per tcp reader on the same address */
+	if (tcp_reuse_port){
+		optval=1;
+		if (setsockopt(sock_info->socket, SOL_SOCKET, SO_REUSEPORT,
+					(void*)&optval, sizeof(optval))==-1) {
+			LM_ERR("setsockopt SO_REUSEPORT: %s\n", strerror(errno));
+			goto error;
+		}
+	}
 #endif
 	/* tos */
 	optval = tos;
@@ -2823,6 +2929,116 @@ error:
 
 
 
+/* opens the SO_REUSEPORT listen sockets of a tcp listener accepting
+ * directly in n tcp readers - the reader with index k in the group of
+ * the listener accepts on rp_socket[k] (rp_socket[0] is the socket opened
+ * by tcp_init()); the sockets are non-blocking, the readers accept until
+ * EAGAIN
+ * returns 0 on success, -1 on error */
+static int tcp_init_reuse_port(struct socket_info* sock_info, int n)
+{
+#ifdef SO_REUSEPORT
+	int sock;
+	int flags;
+	int i;
+
+	if (n<=0)
+		return 0;
+	sock_info->rp_socket=(int*)pkg_malloc(n*sizeof(int));
+	if (sock_info->rp_socket==0){
+		LM_ERR("out of pkg memory\n");
+		return -1;
+	}
+	sock=sock_info->socket;
+	for (i=0; i<n; i++){
+		/* tcp_init() opens, binds and listens on a new socket in ->socket */
+		if (i>0 && tcp_init(sock_info)==-1){
+			sock_info->socket=sock;
+			return -1;
+		}
+		flags=fcntl(sock_info->socket, F_GETFL);
+		if (flags==-1 ||
+				fcntl(sock_info->socket, F_SETFL, flags|O_NONBLOCK)==-1){
+			LM_ERR("fcntl: set non-blocking failed: %s (%d)\n",
+					strerror(errno), errno);
+			if (i>0) tcp_safe_close(sock_info->socket);
+			sock_info->socket=sock;
+			return -1;
+		}
+		sock_info->rp_socket[i]=sock_info->socket;
+		sock_info->rp_socket_no++;
+	}
+	sock_info->socket=sock;
+	LM_DBG("%d SO_REUSEPORT sockets opened for %.*s\n", n,
+			sock_info->sock_str.len, sock_info->sock_str.s);
+	return 0;
+#else
+	LM_WARN("SO_REUSEPORT not supported, tcp_reuse_port ignored\n");
+	return 0;
+#endif /* SO_REUSEPORT */
+}
+
+
+
+/* tcp_reuse_port: opens the listen sockets of the tcp readers and their
+ * handoff queues - a listener with its own workers is shared by them, the
+ * other listeners by the generic readers (at the beginning of the
+ * tcp_children array, see tcp_init_children())
+ * must be called from main, after the tcp and tls listeners are opened and
+ * before forking
+ * returns 0 on success, -1 on error */
+int tcp_reuse_port_init(void)
+{
+	struct socket_info* si;
+	int gworkers;
+
+	/* same split as in get_max_procs() and tcp_init_children() */
+	gworkers=tcp_children_no;
+	for(si=tcp_listen; si; si=si->next)
+		if (si->workers>0) gworkers-=si->workers;
+#ifdef USE_TLS
+	for(si=tls_listen; si; si=si->next)
+		if (si->workers>0) gworkers-=si->workers;
+#endif /* USE_TLS */
+	for(si=tcp_listen; si; si=si->next)
+		if (tcp_init_reuse_port(si, (si->workers>0)?si->workers:gworkers)<0)
+			return -1;
+#ifdef USE_TLS
+	if (!tls_disable && tls_has_init_si())
+		for(si=tls_listen; si; si=si->next)
+			if (tcp_init_reuse_port(si,
+						(si->workers>0)?si->workers:gworkers)<0)
+				return -1;
+#endif /* USE_TLS */
+	return tcp_reactors_init(tcp_children_no);
+}
+
+
+
+/* returns the SO_REUSEPORT listen socket of the tcp reader with index r for
+ * the listener si, -1 if the reader doesn't accept on si */
+int tcp_reuse_port_socket(struct socket_info* si, int r)
+{
+	int k;
+
+	if (si->rp_socket_no<=0 || r<0 || r>=tcp_children_no)
+		return -1;
+	if (tcp_children[r].mysocket){
+		if (tcp_children[r].mysocket!=si)
+			return -1;
+		k=r-si->workers_tcpidx;
+	}else{
+		if (si->workers>0)
+			return -1;
+		k=r;
+	}
+	if (k<0 || k>=si->rp_socket_no)
+		return -1;
+	return si->rp_socket[k];
+}
+
+
+
 /* close tcp_main's fd from a tcpconn
  * WARNING: call only in tcp_main context */
 inline static void tcpconn_close_main_fd(struct tcp_connection* tcpconn)
@@ -2893,9 +3109,9 @@ inline static void tcpconn_destroy(struct tcp_connection* tcpconn)
 		if (likely(!(tcpconn->flags & F_CONN_FD_CLOSED))){
 			tcpconn_close_main_fd(tcpconn);
 			tcpconn->flags|=F_CONN_FD_CLOSED;
-			(*tcp_connections_no)--;
+			atomic_dec_int(tcp_connections_no);
 			if (unlikely(tcpconn->type==PROTO_TLS || tcpconn->type==PROTO_WSS))
-				(*tls_connections_no)--;
+				atomic_dec_int(tls_connections_no);
 		}
 		_tcpconn_free(tcpconn); /* destroys also the wbuf_q if still present*/
 }
@@ -2940,9 +3156,9 @@ inline static int tcpconn_put_destroy(struct tcp_connection* tcpconn)
 	if (likely(!(tcpconn->flags & F_CONN_FD_CLOSED))){
 		tcpconn_close_main_fd(tcpconn);
 		tcpconn->flags|=F_CONN_FD_CLOSED;
-		(*tcp_connections_no)--;
+		atomic_dec_int(tcp_connections_no);
 		if (unlikely(tcpconn->type==PROTO_TLS || tcpconn->type==PROTO_WSS))
-				(*tls_connections_no)--;
+				atomic_dec_int(tls_connections_no);
 	}
 	/* all the flags / ops on the tcpconn must be done prior to decrementing
 	 * the refcnt. and at least a membar_write_atomic_op() mem. barrier or
@@ -3481,6 +3697,26 @@ inline static int handle_ser_child(struct process_table* p, int fd_i)
 				 	(int)(p-&pt[0]), p->pid, response[0], response[1]) ;
 		goto end;
 	}
+	if (unlikely(tcpconn->flags & F_CONN_OWNED)){
+		/* kept by a tcp reader (tcp_reuse_port) => tcp_main has no fd for
+		 * it, pass the command to the owner */
+		switch(cmd){
+			case CONN_ERROR:
+			case CONN_EOF:
+			case CONN_QUEUED_WRITE:
+				tcpconn_owned_cmd(tcpconn, cmd); /* auto-dec refcnt */
+				break;
+			case CONN_GET_FD:
+				tmp = 0;
+				if (unlikely(send_all(p->unix_sock, &tmp, sizeof(tmp)) <= 0))
+					BUG("handle_ser_child: CONN_GET_FD: send_all failed\n");
+				break;
+			default:
+				LM_CRIT("unexpected command %d for %p (id %d) kept by a tcp"
+						" reader\n", cmd, tcpconn, tcpconn->id);
+		}
+		goto end;
+	}
 	switch(cmd){
 		case CONN_ERROR:
 			LM_ERR("received CON_ERROR for %p (id %d), refcnt %d, flags 0x%0x\n",
@@ -3546,9 +3782,9 @@ inline static int handle_ser_child(struct process_table* p, int fd_i)
 				tcpconn_put_destroy(tcpconn);
 				break;
 			}
-			(*tcp_connections_no)++;
+			atomic_inc_int(tcp_connections_no);
 			if (unlikely(tcpconn->type==PROTO_TLS))
-				(*tls_connections_no)++;
+				atomic_inc_int(tls_connections_no);
 			tcpconn->s=fd;
 			/* add tcpconn to the list*/
 			tcpconn_add(tcpconn);
@@ -3671,9 +3907,9 @@ inline static int handle_ser_child(struct process_table* p, int fd_i)
 				tcpconn_put_destroy(tcpconn);
 				break;
 			}
-			(*tcp_connections_no)++;
+			atomic_inc_int(tcp_connections_no);
 			if (unlikely(tcpconn->type==PROTO_TLS))
-				(*tls_connections_no)++;
+				atomic_inc_int(tls_connections_no);
 			tcpconn->s=fd;
 			/* update the timeout*/
 			t=get_ticks_raw();
@@ -3913,9 +4149,9 @@ static inline int handle_new_connect(struct socket_info* si)
 		tcp_safe_close(new_sock);
 		return 1; /* success, because the accept was succesfull */
 	}
-	(*tcp_connections_no)++;
+	atomic_inc_int(tcp_connections_no);
 	if (unlikely(si->proto==PROTO_TLS))
-		(*tls_connections_no)++;
+		atomic_inc_int(tls_connections_no);
 	/* stats for established connections are incremented after
 	   the first received or sent packet.
 	   Alternatively they could be incremented here for accepted
@@ -3976,15 +4212,150 @@ static inline int handle_new_connect(struct socket_info* si)
 	}else{ /*tcpconn==0 */
 		LM_ERR("tcpconn_new failed, closing socket\n");
 		tcp_safe_close(new_sock);
-		(*tcp_connections_no)--;
+		atomic_dec_int(tcp_connections_no);
 		if (unlikely(si->proto==PROTO_TLS))
-			(*tls_connections_no)--;
+			atomic_dec_int(tls_connections_no);
 	}
 	return 1; /* accept() was succesfull */
 }
 
 
 
+/* accepts a new connection on a SO_REUSEPORT listen socket of this tcp
+ * reader (tcp_reuse_port): the connection is hashed and kept by the reader,
+ * it will never be passed to tcp_main (refcnt 1, the hash reference, held
+ * by the reader).
+ * params: si - listener
+ *         sock - the listen socket of this reader for si
+ *         pc - filled with the new connection, 0 if it was rejected
+ * returns -1 on error, 0 if there is nothing to accept (EAGAIN), 1 if
+ * accept() was successful */
+int tcpconn_owned_accept(struct socket_info* si, int sock,
+							struct tcp_connection** pc)
+{
+	union sockaddr_union su;
+	union sockaddr_union sock_name;
+	unsigned sock_name_len;
+	union sockaddr_union* dst_su;
+	struct tcp_connection* tcpconn;
+	socklen_t su_len;
+	int new_sock;
+	
+	*pc=0;
+	su_len=sizeof(su);
+	new_sock=accept(sock, &(su.s), &su_len);
+	if (unlikely(new_sock==-1)){
+		if ((errno==EAGAIN)||(errno==EWOULDBLOCK)||(errno==EINTR))
+			return 0;
+		LM_ERR("error while accepting connection(%d): %s\n", errno,
+				strerror(errno));
+		return -1;
+	}
+	if (unlikely(*tcp_connections_no>=cfg_get(tcp, tcp_cfg, max_connections))){
+		LM_ERR("maximum number of connections exceeded: %d/%d\n",
+					*tcp_connections_no,
+					cfg_get(tcp, tcp_cfg, max_connections));
+		tcp_safe_close(new_sock);
+		TCP_STATS_LOCAL_REJECT();
+		return 1;
+	}
+	if (unlikely(si->proto==PROTO_TLS)) {
+		if (unlikely(*tls_connections_no>=cfg_get(tcp, tcp_cfg, max_tls_connections))){
+			LM_ERR("maximum number of tls connections exceeded: %d/%d\n",
+					*tls_connections_no,
+					cfg_get(tcp, tcp_cfg, max_tls_connections));
+			tcp_safe_close(new_sock);
+			TCP_STATS_LOCAL_REJECT();
+			return 1;
+		}
+	}
+	if (unlikely(init_sock_opt_accept(new_sock)<0)){
+		LM_ERR("init_sock_opt failed\n");
+		tcp_safe_close(new_sock);
+		return 1;
+	}
+	dst_su=&si->su;
+	if (unlikely(si->flags & SI_IS_ANY)){
+		/* INADDR_ANY => get local dst */
+		sock_name_len=sizeof(sock_name);
+		if (getsockname(new_sock, &sock_name.s, &sock_name_len)!=0){
+			LM_ERR("getsockname failed: %s(%d)\n",
+						strerror(errno), errno);
+		}else{
+			dst_su=&sock_name;
+		}
+	}
+	tcpconn=tcpconn_new(new_sock, &su, dst_su, si, si->proto, S_CONN_ACCEPT);
+	if (unlikely(tcpconn==0)){
+		LM_ERR("tcpconn_new failed, closing socket\n");
+		tcp_safe_close(new_sock);
+		return 1;
+	}
+	atomic_inc_int(tcp_connections_no);
+	if (unlikely(si->proto==PROTO_TLS))
+		atomic_inc_int(tls_connections_no);
+	tcpconn->flags|=F_CONN_PASSIVE|F_CONN_OWNED;
+	tcpconn->fd=new_sock; /* same fd, used by the reader */
+	tcpconn->reader_pid=my_pid();
+	tcpconn->owner=tcp_reactor_idx;
+	tcpconn->timeout=get_ticks_raw()+cfg_get(tcp, tcp_cfg, con_lifetime);
+	atomic_set(&tcpconn->refcnt, 1); /* safe, not yet available to the
+										outside world */
+	tcpconn_add(tcpconn);
+	LM_DBG("new connection from %s kept by reader %d: %p %d flags: %04x\n",
+			su2a(&su, sizeof(su)), tcp_reactor_idx, tcpconn, tcpconn->s,
+			tcpconn->flags);
+	*pc=tcpconn;
+	return 1;
+}
+
+
+
+/* writes the queued data of a connection kept by this tcp reader
+ * returns -1 on error or if the connection must be closed (close after
+ * send), 0 if the write queue is empty, 1 if some data is left (the fd
+ * must be watched for write) */
+int tcpconn_owned_flush(struct tcp_connection* c)
+{
+#ifdef TCP_ASYNC
+	int empty;
+
+	if (unlikely(wbufq_run(c->fd, c, &empty)<0))
+		return -1;
+	if (likely(empty))
+		return tcpconn_close_after_send(c)?-1:0;
+	return 1;
+#else /* ! TCP_ASYNC */
+	return 0;
+#endif /* TCP_ASYNC */
+}
+
+
+
+/* closes and unhashes a connection kept by this tcp reader and releases the
+ * reader reference (the connection is freed when the last process using
+ * it releases it)
+ * WARNING: the fd must not be watched anymore and the reader timer must be
+ * stopped */
+void tcpconn_owned_destroy(struct tcp_connection* c)
+{
+	c->flags&=~(F_CONN_READ_W|F_CONN_WRITE_W);
+	tcpconn_try_unhash(c);
+	c->fd=-1; /* closed below, it is also c->s */
+	tcpconn_put_destroy(c);
+}
+
+
+
+/* releases a reference to a connection kept by a tcp reader, taken
+ * while handing the connection to the reader */
+int tcpconn_owned_put(struct tcp_connection* c)
+{
+	return tcpconn_chld_put(c);
+}
+
+
+
 /* handles an io event on one of the watched tcp connections
  * 
  * params: tcpconn - pointer to the tcp_connection for which we have an io ev.
@@ -4332,7 +4703,9 @@ static inline void tcpconn_destroy_all(void)
 						local_timer_del(&tcp_main_ltimer, &c->timer);
 						c->flags&=~F_CONN_MAIN_TIMER;
 					} /* else still in some reader */
-					fd=c->s;
+					/* the fd of a connection kept by a reader is not
+					 * open in tcp_main */
+					fd=(c->flags & F_CONN_OWNED)?-1:c->s;
 					if (fd>0 && (c->flags & (F_CONN_READ_W|F_CONN_WRITE_W))){
 						io_watch_del(&io_h, fd, -1, IO_FD_CLOSING);
 						c->flags&=~(F_CONN_READ_W|F_CONN_WRITE_W);
@@ -4344,9 +4717,9 @@ static inline void tcpconn_destroy_all(void)
 				if (fd>0 && (c->type==PROTO_TLS || c->type==PROTO_WSS))
 					tls_close(c, fd);
 				if (unlikely(c->type==PROTO_TLS || c->type==PROTO_WSS))
-					(*tls_connections_no)--;
+					atomic_dec_int(tls_connections_no);
 #endif
-				(*tcp_connections_no)--;
+				atomic_dec_int(tcp_connections_no);
 				c->flags &= ~F_CONN_HASHED;
 				_tcpconn_rm(c);
 				if (fd>0) {
@@ -4399,7 +4772,10 @@ void tcp_main_loop()
 #endif /* TCP_FD_CACHE */
 	
 	/* add all the sockets we listen on for connections */
+	/* (with tcp_reuse_port the readers accept the connections themselves) */
 	for (si=tcp_listen; si; si=si->next){
+		if (si->rp_socket_no>0)
+			continue;
 		if ((si->proto==PROTO_TCP) &&(si->socket!=-1)){
 			if (io_watch_add(&io_h, si->socket, POLLIN, F_SOCKINFO, si)<0){
 				LM_CRIT("failed to add listen socket to the fd list\n");
@@ -4412,6 +4788,8 @@ void tcp_main_loop()
 #ifdef USE_TLS
 	if (!tls_disable && tls_loaded()){
 		for (si=tls_listen; si; si=si->next){
+			if (si->rp_socket_no>0)
+				continue;
 			if ((si->proto==PROTO_TLS) && (si->socket!=-1)){
 				if (io_watch_add(&io_h, si->socket, POLLIN, F_SOCKINFO, si)<0){
 					LM_CRIT("failed to add tls listen socket to the fd list\n");
@@ -4570,6 +4948,7 @@ void destroy_tcp()
 			pkg_free(tcp_children);
 			tcp_children=0;
 		}
+		tcp_reactors_destroy();
 		destroy_local_timer(&tcp_main_ltimer);
 }
 
@@ -4784,6 +5163,8 @@ int tcp_init_children()
 			/* child */
 			bind_address=0; /* force a SEGFAULT if someone uses a non-init.
 							   bind address on tcp */
+			if (tcp_reactors)
+				tcp_reactor_child_init(r);
 			tcp_receive_loop(reader_fd_1);
 		}
 	}
@@ -4796,6 +5177,8 @@ error:
 
 void tcp_get_info(struct tcp_gen_info *ti)
 {
+	int r;
+
 	ti->tcp_readers=tcp_children_no;
 	ti->tcp_max_connections=tcp_max_connections;
 	ti->tls_max_connections=tls_max_connections;
@@ -4806,6 +5189,16 @@ void tcp_get_info(struct tcp_gen_info *ti)
 #else
 	ti->tcp_write_queued=0;
 #endif /* TCP_ASYNC */
+	ti->owned_readers=tcp_reactors_no;
+	ti->owned_connections=0;
+	ti->owned_accepted=0;
+	ti->owned_handoffs=0;
+	for (r=0; r<tcp_reactors_no; r++){
+		/* updated by the owner, read without locking */
+		ti->owned_connections+=tcp_reactors[r].conns;
+		ti->owned_accepted+=tcp_reactors[r].accepted;
+		ti->owned_handoffs+=tcp_reactors[r].handoffs;
+	}
 }
 
 #endif
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2015 kamailio.org
+ *
+ * This file is part of Kamailio, a free SIP server.
+ *
+ * Kamailio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * Kamailio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/** Kamailio core :: handoff queues of the tcp readers owning connections.
+ * @file tcp_reactor.c
+ * @ingroup core
+ * Module: @ref core
+ */
+
+#ifdef USE_TCP
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "tcp_reactor.h"
+#include "mem/shm_mem.h"
+#include "dprint.h"
+#include "pt.h"
+
+struct tcp_reactor* tcp_reactors=0;
+int tcp_reactors_no=0;
+int tcp_reactor_idx=-1; /* index of this process, -1 if not a tcp reader */
+
+
+
+int tcp_reactors_init(int n)
+{
+	struct tcp_reactor* r;
+	int p[2];
+	int i;
+
+	if (n<=0)
+		return 0;
+	tcp_reactors=shm_malloc(n*sizeof(struct tcp_reactor));
+	if (tcp_reactors==0){
+		LM_ERR("out of shm memory\n");
+		return -1;
+	}
+	memset(tcp_reactors, 0, n*sizeof(struct tcp_reactor));
+	for (i=0; i<n; i++){
+		r=&tcp_reactors[i];
+		r->rd_fd=r->wr_fd=-1;
+		if (lock_init(&r->lock)==0){
+			LM_ERR("failed to init lock\n");
+			goto error;
+		}
+		if (pipe(p)==-1){
+			LM_ERR("pipe: %s [%d]\n", strerror(errno), errno);
+			goto error;
+		}
+		r->rd_fd=p[0];
+		r->wr_fd=p[1];
+		tcp_reactors_no++;
+		/* a wake up is never waited for and a full pipe already means
+		 * a pending one */
+		if (fcntl(p[0], F_SETFL, fcntl(p[0], F_GETFL)|O_NONBLOCK)==-1 ||
+				fcntl(p[1], F_SETFL, fcntl(p[1], F_GETFL)|O_NONBLOCK)==-1){
+			LM_ERR("fcntl: %s [%d]\n", strerror(errno), errno);
+			goto error;
+		}
+	}
+	return 0;
+error:
+	tcp_reactors_destroy();
+	return -1;
+}
+
+
+
+void tcp_reactors_destroy(void)
+{
+	int i;
+
+	if (tcp_reactors==0)
+		return;
+	for (i=0; i<tcp_reactors_no; i++){
+		lock_destroy(&tcp_reactors[i].lock);
+		if (tcp_reactors[i].rd_fd!=-1) close(tcp_reactors[i].rd_fd);
+		if (tcp_reactors[i].wr_fd!=-1) close(tcp_reactors[i].wr_fd);
+	}
+	shm_free(tcp_reactors);
+	tcp_reactors=0;
+	tcp_reactors_no=0;
+}
+
+
+
+void tcp_reactor_child_init(int idx)
+{
+	if (idx>=0 && idx<tcp_reactors_no)
+		tcp_reactor_idx=idx;
+}
+
+
+
+int tcp_reactor_push(struct tcp_connection* c, int cmd)
+{
+	struct tcp_reactor* r;
+	int wakeup;
+	char b;
+
+	if (unlikely(c->owner<0 || c->owner>=tcp_reactors_no)){
+		BUG("connection %p (id %d) has no owner (%d)\n", c, c->id, c->owner);
+		return -1;
+	}
+	r=&tcp_reactors[c->owner];
+	wakeup=0;
+	lock_get(&r->lock);
+		if (c->ho_cmds==0){
+			/* not yet queued */
+			atomic_inc(&c->refcnt);
+			c->ho_next=0;
+			if (r->last)
+				r->last->ho_next=c;
+			else{
+				r->first=c;
+				wakeup=1; /* the reader might wait in poll */
+			}
+			r->last=c;
+			r->handoffs++;
+		}
+		c->ho_cmds|=cmd;
+	lock_release(&r->lock);
+	if (wakeup){
+		b=0;
+		while (write(r->wr_fd, &b, 1)==-1 && errno==EINTR);
+		/* EAGAIN - the pipe is full, the reader will wake up anyway */
+	}
+	return 0;
+}
+
+
+
+struct tcp_connection* tcp_reactor_pop(int* cmds)
+{
+	struct tcp_reactor* r;
+	struct tcp_connection* c;
+
+	r=&tcp_reactors[tcp_reactor_idx];
+	if (r->first==0)
+		return 0;
+	lock_get(&r->lock);
+		c=r->first;
+		if (c){
+			r->first=c->ho_next;
+			if (r->first==0)
+				r->last=0;
+			c->ho_next=0;
+			*cmds=c->ho_cmds;
+			c->ho_cmds=0;
+		}
+	lock_release(&r->lock);
+	return c;
+}
+
+
+
+void tcp_reactor_wakeup_clear(void)
+{
+	char buf[64];
+	int n;
+
+	do{
+		n=read(tcp_reactors[tcp_reactor_idx].rd_fd, buf, sizeof(buf));
+	}while(n==sizeof(buf) || (n==-1 && errno==EINTR));
+}
+
+#endif /* USE_TCP */
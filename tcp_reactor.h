@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2015 kamailio.org
+ *
+ * This file is part of Kamailio, a free SIP server.
+ *
+ * Kamailio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * Kamailio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/** Kamailio core :: tcp readers owning their connections (tcp_reuse_port).
+ * @file tcp_reactor.h
+ * @ingroup core
+ * Module: @ref core
+ *
+ * With tcp_reuse_port each tcp reader accepts the connections on its own
+ * SO_REUSEPORT listen sockets and keeps them until they are closed, without
+ * passing them to/from tcp_main. The other processes find a connection in
+ * the tcp hash (the id -> connection map), queue the data to send in its
+ * write buffer and hand the connection to its owner reader, which does the
+ * actual write. The handoff queue of a reader is a list of connections
+ * (linked through the connections, so it never fills up) with a pipe used
+ * to wake up the reader.
+ */
+
+#ifndef _tcp_reactor_h
+#define _tcp_reactor_h
+
+#ifdef USE_TCP
+
+#include "tcp_conn.h"
+#include "locking.h"
+
+/* commands for the reader owning a connection (tcp_connection->ho_cmds) */
+#define TCP_HO_WRITE	1	/* write the queued data */
+#define TCP_HO_CLOSE	2	/* close the connection */
+
+struct tcp_reactor{
+	gen_lock_t lock;
+	struct tcp_connection* first; /* connections with pending commands */
+	struct tcp_connection* last;
+	int rd_fd; /* wake up pipe, read by the owner */
+	int wr_fd; /* wake up pipe, written by the other processes */
+	/* statistics */
+	int conns; /* connections kept by the reader */
+	unsigned long accepted; /* accepted connections */
+	unsigned long handoffs; /* connections handed to the reader */
+};
+
+extern struct tcp_reactor* tcp_reactors;
+extern int tcp_reactors_no;
+extern int tcp_reactor_idx;
+
+/* allocates the handoff queues of n readers, must be called before forking
+ * any process that might send on tcp */
+int tcp_reactors_init(int n);
+void tcp_reactors_destroy(void);
+/* called in the tcp reader with index idx, after fork */
+void tcp_reactor_child_init(int idx);
+
+/* queues cmd for the reader owning c and wakes it up, if not yet queued
+ * (a reference to c is kept until the reader handles it)
+ * returns 0 on success, -1 on error */
+int tcp_reactor_push(struct tcp_connection* c, int cmd);
+/* gets the next connection with pending commands of this reader, the
+ * caller must release the reference with tcpconn_owned_put() (0 if none) */
+struct tcp_connection* tcp_reactor_pop(int* cmds);
+/* empties the wake up pipe, before handling the queued connections */
+void tcp_reactor_wakeup_clear(void);
+
+/* connections kept by a reader, in tcp_main.c */
+int tcpconn_owned_accept(struct socket_info* si, int sock,
+							struct tcp_connection** pc);
+int tcpconn_owned_flush(struct tcp_connection* c);
+void tcpconn_owned_destroy(struct tcp_connection* c);
+int tcpconn_owned_put(struct tcp_connection* c);
+
+#endif /* USE_TCP */
+
+#endif /* _tcp_reactor_h */
@@ -43,6 +43,8 @@
 #include "dprint.h"
 #include "tcp_conn.h"
 #include "tcp_read.h"
+#include "tcp_init.h"
+#include "tcp_reactor.h"
 #include "tcp_stats.h"
 #include "tcp_ev.h"
 #include "pass_fd.h"
@@ -54,6 +56,7 @@
 #include "trim.h"
 #include "pt.h"
 #include "cfg/cfg_struct.h"
+#include "socket_info.h"
 #ifdef CORE_TLS
 #include "tls/tls_server.h"
 #else
@@ -79,7 +82,9 @@
 #define TCPCONN_TIMEOUT_MIN_RUN  1 /* run the timers each new tick */
 
 /* types used in io_wait* */
-enum fd_types { F_NONE, F_TCPMAIN, F_TCPCONN };
+enum fd_types { F_NONE, F_TCPMAIN, F_TCPCONN,
+				F_TCPLISTEN /* own listen socket (tcp_reuse_port) */,
+				F_TCPHANDOFF /* handoff queue wake up (tcp_reuse_port) */ };
 
 /* list of tcp connections handled by this process */
 static struct tcp_connection* tcp_conn_lst=0;
@@ -1446,6 +1451,14 @@ void release_tcpconn(struct tcp_connection* c, long state, int unix_sock)
 {
 	long response[2];
 	
+		if (unlikely(c->flags & F_CONN_OWNED)){
+			/* kept by this reader (tcp_reuse_port) => close it here */
+			LM_DBG("closing con %p, state %ld, fd=%d, id=%d\n",
+					c, state, c->fd, c->id);
+			tcp_reactors[tcp_reactor_idx].conns--;
+			tcpconn_owned_destroy(c);
+			return;
+		}
 		LM_DBG("releasing con %p, state %ld, fd=%d, id=%d\n",
 				c, state, c->fd, c->id);
 		LM_DBG("extra_data %p\n", c->extra_data);
@@ -1465,6 +1478,124 @@ void release_tcpconn(struct tcp_connection* c, long state, int unix_sock)
 
 
 
+static ticks_t tcpconn_read_timeout(ticks_t t, struct timer_ln* tl,
+										void* data);
+
+
+
+/* closes a connection kept by this reader (tcp_reuse_port)
+ * idx - index in the fd_array (or -1 if not known) */
+static void tcpconn_owned_close(struct tcp_connection* c, int idx)
+{
+	if (unlikely(io_watch_del(&io_w, c->fd, idx, IO_FD_CLOSING)<0)){
+		LM_ERR("io_watch_del failed for %p id %d fd %d, state %d, flags %x\n",
+					c, c->id, c->fd, c->state, c->flags);
+	}
+	tcpconn_listrm(tcp_conn_lst, c, c_next, c_prev);
+	local_timer_del(&tcp_reader_ltimer, &c->timer);
+	release_tcpconn(c, CONN_ERROR, tcpmain_sock);
+}
+
+
+
+/* timer handler for the connections kept by this reader
+ * (called from tcpconn_read_timeout()) */
+static ticks_t tcpconn_owned_timeout(ticks_t t, struct tcp_connection* c)
+{
+	if (likely(!(c->state<0) && TICKS_LT(t, c->timeout))){
+#ifdef TCP_ASYNC
+		if (unlikely(c->wbuf_q.first)){
+			if (TICKS_LT(t, c->wbuf_q.wr_timeout))
+				return (ticks_t)MIN_unsigned(c->timeout-t,
+												c->wbuf_q.wr_timeout-t);
+			/* nothing could be written for send_timeout */
+#ifdef USE_DST_BLACKLIST
+			(void)dst_blacklist_su(BLST_ERR_SEND, c->rcv.proto,
+									&c->rcv.src_su, &c->send_flags, 0);
+#endif /* USE_DST_BLACKLIST */
+			TCP_EV_SEND_TIMEOUT(0, &c->rcv);
+			TCP_STATS_SEND_TIMEOUT();
+			goto close;
+		}
+#endif /* TCP_ASYNC */
+		return (ticks_t)(c->timeout - t);
+	}
+	if (likely(!(c->state<0))){
+		/* idle timeout */
+		TCP_EV_IDLE_CONN_CLOSED(0, &c->rcv);
+		TCP_STATS_CON_TIMEOUT();
+	}
+#ifdef TCP_ASYNC
+close:
+#endif /* TCP_ASYNC */
+	if (unlikely(io_watch_del(&io_w, c->fd, -1, IO_FD_CLOSING)<0)){
+		LM_ERR("io_watch_del failed for %p id %d fd %d, state %d, flags %x\n",
+					c, c->id, c->fd, c->state, c->flags);
+	}
+	tcpconn_listrm(tcp_conn_lst, c, c_next, c_prev);
+	release_tcpconn(c, CONN_ERROR, tcpmain_sock);
+	return 0;
+}
+
+
+
+/* writes the queue of a connection kept by this reader and watches the fd
+ * for write while data is left
+ * returns 0 on success, -1 if the connection was closed */
+static int tcpconn_owned_write(struct tcp_connection* c, int idx)
+{
+	int r;
+
+	r=tcpconn_owned_flush(c);
+	if (unlikely(r<0)){
+		tcpconn_owned_close(c, idx);
+		return -1;
+	}
+	if (r>0 && !(c->flags & F_CONN_WANTS_WR)){
+		if (unlikely(io_watch_chg(&io_w, c->fd, POLLIN|POLLOUT, idx)<0)){
+			LM_ERR("io_watch_chg failed for %p id %d fd %d\n",
+					c, c->id, c->fd);
+			tcpconn_owned_close(c, idx);
+			return -1;
+		}
+		c->flags|=F_CONN_WANTS_WR;
+	}else if (r==0 && (c->flags & F_CONN_WANTS_WR)){
+		if (unlikely(io_watch_chg(&io_w, c->fd, POLLIN, idx)<0))
+			LM_ERR("io_watch_chg failed for %p id %d fd %d\n",
+					c, c->id, c->fd);
+		c->flags&=~F_CONN_WANTS_WR;
+	}
+	return 0;
+}
+
+
+
+/* starts handling a connection accepted by this reader */
+static void tcpconn_owned_add(struct tcp_connection* c)
+{
+	ticks_t t;
+	ticks_t con_lifetime;
+
+	tcp_reactors[tcp_reactor_idx].accepted++;
+	tcp_reactors[tcp_reactor_idx].conns++;
+	/* must be before io_watch_add (see F_TCPMAIN in handle_io()) */
+	tcpconn_listadd(tcp_conn_lst, c, c_next, c_prev);
+	t=get_ticks_raw();
+	con_lifetime=cfg_get(tcp, tcp_cfg, con_lifetime);
+	c->timeout=t+con_lifetime;
+	c->timer.f=tcpconn_read_timeout;
+	local_timer_reinit(&c->timer);
+	local_timer_add(&tcp_reader_ltimer, &c->timer, con_lifetime, t);
+	if (unlikely(io_watch_add(&io_w, c->fd, POLLIN, F_TCPCONN, c)<0)){
+		LM_CRIT("io_watch_add failed for %p id %d fd %d\n", c, c->id, c->fd);
+		tcpconn_listrm(tcp_conn_lst, c, c_next, c_prev);
+		local_timer_del(&tcp_reader_ltimer, &c->timer);
+		release_tcpconn(c, CONN_ERROR, tcpmain_sock);
+	}
+}
+
+
+
 static ticks_t tcpconn_read_timeout(ticks_t t, struct timer_ln* tl, void* data)
 {
 	struct tcp_connection *c;
@@ -1472,6 +1603,10 @@ static ticks_t tcpconn_read_timeout(ticks_t t, struct timer_ln* tl, void* data)
 	c=(struct tcp_connection*)data; 
 	/* or (struct tcp...*)(tl-offset(c->timer)) */
 	
+	if (unlikely(c->flags & F_CONN_OWNED))
+		/* kept by this reader => lifetime and write queue timeouts,
+		 * like tcp_main does for the other connections */
+		return tcpconn_owned_timeout(t, c);
 	if (likely(!(c->state<0) && TICKS_LT(t, c->timeout))){
 		/* timeout extended, exit */
 		return (ticks_t)(c->timeout - t);
@@ -1604,6 +1739,21 @@ repeat_1st_read:
 			break;
 		case F_TCPCONN:
 			con=(struct tcp_connection*)fm->data;
+			if (unlikely((con->flags & F_CONN_OWNED) && (events & POLLOUT))){
+				/* write queue of a connection kept by this reader */
+				if (unlikely(tcpconn_owned_write(con, idx)<0)){
+					ret=-1;
+					break;
+				}
+				if (!(events & (POLLIN|POLLPRI|POLLERR|POLLHUP
+#ifdef POLLRDHUP
+								|POLLRDHUP
+#endif /* POLLRDHUP */
+							))){
+					ret=0;
+					break;
+				}
+			}
 			if (unlikely(con->state==S_CONN_BAD)){
 				resp=CONN_ERROR;
 				if (!(con->send_flags.f & SND_F_CON_CLOSE))
@@ -1642,14 +1792,44 @@ read_error:
 				if (unlikely(read_flags & RD_CONN_REPEAT_READ))
 						goto repeat_read;
 #endif /* USE_TLS */
-				/* update timeout */
-				con->timeout=get_ticks_raw()+S_TO_TICKS(TCP_CHILD_TIMEOUT);
+				/* update timeout (the connections kept by this reader
+				 * are not released after TCP_CHILD_TIMEOUT, only closed
+				 * after con_lifetime) */
+				if (unlikely(con->flags & F_CONN_OWNED))
+					con->timeout=get_ticks_raw()+
+									cfg_get(tcp, tcp_cfg, con_lifetime);
+				else
+					con->timeout=get_ticks_raw()+
+									S_TO_TICKS(TCP_CHILD_TIMEOUT);
 				/* ret= 0 (read the whole socket buffer) if short read & 
 				 *  !POLLPRI,  bytes read otherwise */
 				ret&=(((read_flags & RD_CONN_SHORT_READ) &&
 						!(events & POLLPRI)) - 1);
 			}
 			break;
+		case F_TCPLISTEN:
+			/* new connection on the own listen socket (tcp_reuse_port) */
+			ret=tcpconn_owned_accept((struct socket_info*)fm->data, fm->fd,
+										&con);
+			if (likely(con))
+				tcpconn_owned_add(con);
+			break;
+		case F_TCPHANDOFF:
+			/* connections handed to this reader by other processes */
+			tcp_reactor_wakeup_clear();
+			while((con=tcp_reactor_pop(&n))!=0){
+				/* skip it if already closed */
+				if (likely(!(con->flags & F_CONN_FD_CLOSED))){
+					if (unlikely(n & TCP_HO_CLOSE)){
+						con->state=S_CONN_BAD;
+						tcpconn_owned_close(con, -1);
+					}else
+						tcpconn_owned_write(con, -1);
+				}
+				tcpconn_owned_put(con);
+			}
+			ret=0;
+			break;
 		case F_NONE:
 			LM_CRIT("empty fd map %p (%d): {%d, %d, %p}\n",
 						fm, (int)(fm-io_w.fd_hash),
@@ -1684,6 +1864,44 @@ inline static void tcp_reader_timer_run(void)
 
 
 
+/* adds to the watched fds the listen sockets of this reader and the wake up
+ * pipe of its handoff queue (tcp_reuse_port)
+ * returns 0 on success, -1 on error */
+static int tcp_reader_watch_listeners(void)
+{
+	struct socket_info* si;
+	struct socket_info** lists[2];
+	int sock;
+	int i;
+
+	if (io_watch_add(&io_w, tcp_reactors[tcp_reactor_idx].rd_fd, POLLIN,
+						F_TCPHANDOFF, 0)<0){
+		LM_CRIT("failed to add the handoff pipe to the fd list\n");
+		return -1;
+	}
+	lists[0]=&tcp_listen;
+#ifdef USE_TLS
+	lists[1]=&tls_listen;
+#else
+	lists[1]=0;
+#endif
+	for (i=0; i<2 && lists[i]; i++){
+		for (si=*lists[i]; si; si=si->next){
+			sock=tcp_reuse_port_socket(si, tcp_reactor_idx);
+			if (sock<0)
+				continue;
+			if (io_watch_add(&io_w, sock, POLLIN, F_TCPLISTEN, si)<0){
+				LM_CRIT("failed to add listen socket %.*s to the fd list\n",
+						si->sock_str.len, si->sock_str.s);
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+
+
 void tcp_receive_loop(int unix_sock)
 {
 	
@@ -1699,6 +1917,9 @@ void tcp_receive_loop(int unix_sock)
 		LM_CRIT("failed to add socket to the fd list\n");
 		goto error;
 	}
+	/* own listen sockets and handoff queue (tcp_reuse_port) */
+	if (tcp_reactor_idx>=0 && tcp_reader_watch_listeners()<0)
+		goto error;
 
 	/* initialize the config framework */
 	if (cfg_child_init()) goto error;
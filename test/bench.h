@@ -0,0 +1,37 @@
+/*
+ * Common part of the standalone benchmarks and checks in this directory.
+ *
+ * A bench includes the .c file of the code it measures, so the static
+ * functions can be called, and links with bench_core.c for the core
+ * symbols the logging macros need. Define BENCH_MALLOC before including
+ * this file to map the shm and pkg allocators to malloc()/free(); the
+ * benches that need shared memory between processes or allocation stats
+ * map them on their own before including the measured code.
+ *
+ * Build with: make -f Makefile.bench (see there for the flags)
+ */
+
+#ifndef _bench_h
+#define _bench_h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#ifdef BENCH_MALLOC
+#define shm_mem_h
+#define mem_h
+#define shm_malloc(s) malloc(s)
+#define shm_free(p) free(p)
+#define pkg_malloc(s) malloc(s)
+#define pkg_free(p) free(p)
+#define PKG_MEM_ERROR
+#define SHM_MEM_ERROR
+#endif
+
+/* wall clock time in usec */
+double bench_now_us(void);
+
+#endif /* _bench_h */
@@ -0,0 +1,30 @@
+/*
+ * Core symbols needed by the code included in the benchmarks (logging),
+ * nothing is logged below L_ALERT.
+ */
+
+#include <unistd.h>
+#include <sys/time.h>
+#include "../dprint.h"
+#include "bench.h"
+
+int log_stderr=1;
+int log_color=0;
+volatile int dprint_crit=0;
+str* log_prefix_val=0;
+struct log_level_info log_level_info[L_DBG-L_ALERT+1];
+int process_no=0;
+
+int get_debug_level(char *mname, int mnlen) { return L_ALERT-1; }
+int get_debug_facility(char *mname, int mnlen) { return 0; }
+void dprint_color(int level) { }
+void dprint_color_reset(void) { }
+int my_pid(void) { return getpid(); }
+
+double bench_now_us(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, 0);
+	return tv.tv_sec*1000000.0 + tv.tv_usec;
+}
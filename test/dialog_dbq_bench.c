@@ -0,0 +1,354 @@
+/*
+ * dialog db queue benchmark: compares writing the dialogs to the database
+ * from the SIP workers (db_mode 1 as it was before, one statement per
+ * change) with the queue of the db writer processes (db_async_procs), for
+ * the time spent by the workers, the number of statements and the time of
+ * the writer.
+ *
+ * The database is a fake driver that waits a round trip time for each
+ * statement and keeps which dialogs are in the table, to check that each
+ * dialog is inserted once, updated only while in the table and deleted at
+ * the end.
+ *
+ * Each dialog is created (inserted), confirmed (updated) after half of the
+ * active dialogs were created after it and terminated (deleted) after all
+ * of them. The writer runs after a number of changes, like its timer does.
+ *
+ * Run: ./dialog_dbq_bench [-n dialogs] [-a active] [-w changes] [-b batch]
+ *                         [-r rtt]
+ *  -n  number of dialogs (default 20000)
+ *  -a  number of active dialogs (default 1000)
+ *  -w  changes between two runs of the writer (default 100)
+ *  -b  db_async_batch (default 100)
+ *  -r  round trip time of a statement, in usec (default 100)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/time.h>
+
+/* system allocator in place of the shm and pkg pools */
+#define BENCH_MALLOC
+#include "bench.h"
+
+
+#include "../modules/dialog/dlg_db_queue.c"
+
+/* stubs for the core and the module */
+int register_basic_timers(int timers) { return 0; }
+int fork_basic_utimer(int child_id, char* desc, int make_sock,
+		timer_function* f, void* param, int uinterval) { return 0; }
+int srjson_InitDoc(srjson_doc_t *doc, srjson_Hooks *hooks)
+{
+	memset(doc, 0, sizeof(srjson_doc_t));
+	return 0;
+}
+void srjson_DestroyDoc(srjson_doc_t *doc) { }
+int dlg_connect_db(const str *db_url) { return 0; }
+void destroy_dlg_db(void) { }
+
+str h_entry_column = str_init(HASH_ENTRY_COL);
+str h_id_column = str_init(HASH_ID_COL);
+str state_column = str_init(STATE_COL);
+str dialog_table_name = str_init(DIALOG_TABLE_NAME);
+str vars_h_entry_column = str_init(VARS_HASH_ENTRY_COL);
+str vars_h_id_column = str_init(VARS_HASH_ID_COL);
+str dialog_vars_table_name = str_init(DIALOG_VARS_TABLE_NAME);
+db_key_t dialog_row_keys[DIALOG_TABLE_COL_NO];
+db_key_t dialog_vars_row_keys[DIALOG_VARS_TABLE_COL_NO];
+db1_con_t* dialog_db_handle = (db1_con_t*)1;
+db_func_t dialog_dbf;
+struct dlg_table *d_table = 0;
+
+static str bench_str = str_init("sip:alice@example.com");
+
+void dlg_db_fill_row(struct dlg_cell *cell, db_val_t *values,
+		srjson_doc_t *jdoc)
+{
+	int i;
+
+	for(i=0; i<DIALOG_TABLE_COL_NO; i++) {
+		VAL_TYPE(values+i) = DB1_STR;
+		VAL_NULL(values+i) = 0;
+		VAL_STR(values+i) = bench_str;
+	}
+	VAL_TYPE(values) = VAL_TYPE(values+1) = VAL_TYPE(values+10) = DB1_INT;
+	VAL_INT(values) = cell->h_entry;
+	VAL_INT(values+1) = cell->h_id;
+	VAL_INT(values+10) = cell->state;
+}
+
+int use_dialog_table(void) { return 0; }
+int use_dialog_vars_table(void) { return 0; }
+
+/* the fake database */
+static int bench_rtt = 100;
+static char *bench_in_db;		/* by h_id */
+static int bench_stmts = 0;
+static int bench_errors = 0;
+
+static void bench_round_trip(void)
+{
+	struct timespec ts;
+
+	bench_stmts++;
+	ts.tv_sec = 0;
+	ts.tv_nsec = bench_rtt*1000;
+	nanosleep(&ts, NULL);
+}
+
+static void bench_row_in(const db_val_t *v)
+{
+	if(bench_in_db[VAL_INT(v+1)]) bench_errors++;
+	bench_in_db[VAL_INT(v+1)] = 1;
+}
+
+static int bench_insert(const db1_con_t* _h, const db_key_t* _k,
+		const db_val_t* _v, const int _n)
+{
+	bench_round_trip();
+	bench_row_in(_v);
+	return 0;
+}
+
+static int bench_insert_bulk(const db1_con_t* _h, const db_key_t* _k,
+		const db_val_t* _v, const int _n, const int _nr, const db_key_t* _uk,
+		const int _un)
+{
+	int i;
+
+	bench_round_trip();
+	for(i=0; i<_nr; i++)
+		bench_row_in(_v + i*_n);
+	return 0;
+}
+
+static int bench_update(const db1_con_t* _h, const db_key_t* _k,
+		const db_op_t* _o, const db_val_t* _v, const db_key_t* _uk,
+		const db_val_t* _uv, const int _n, const int _un)
+{
+	bench_round_trip();
+	if(!bench_in_db[VAL_INT(_v+1)]) bench_errors++;
+	return 0;
+}
+
+static int bench_delete(const db1_con_t* _h, const db_key_t* _k,
+		const db_op_t* _o, const db_val_t* _v, const int _n)
+{
+	bench_round_trip();
+	bench_in_db[VAL_INT(_v+1)] = 0;
+	return 0;
+}
+
+static int bench_raw_query(const db1_con_t* _h, const str* _s,
+		db1_res_t** _r)
+{
+	unsigned int id;
+	char *p;
+
+	bench_round_trip();
+	/* only the deletes of the dialog table are checked */
+	if(strncmp(_s->s, "delete from dialog where", 24)!=0)
+		return 0;
+	for(p=_s->s; (p=strstr(p, "hash_id="))!=NULL; p++) {
+		if(sscanf(p, "hash_id=%u", &id)==1)
+			bench_in_db[id] = 0;
+	}
+	return 0;
+}
+
+/* the worker side: new dialog, confirmed, terminated */
+static struct dlg_cell *bench_new(unsigned int id, int async)
+{
+	struct dlg_cell *dlg;
+	struct dlg_entry *entry;
+	db_val_t values[DIALOG_TABLE_COL_NO];
+
+	dlg = (struct dlg_cell*)calloc(1, sizeof(struct dlg_cell));
+	dlg->h_entry = id & (d_table->size-1);
+	dlg->h_id = id;
+	dlg->state = 1;
+	entry = &d_table->entries[dlg->h_entry];
+	dlg_lock(d_table, entry);
+	dlg->next = entry->first;
+	if(entry->first) entry->first->prev = dlg;
+	entry->first = dlg;
+	dlg->dflags = DLG_FLAG_NEW;
+	if(async) {
+		dlg_dbq_push(dlg, DLG_DBQ_UPDATE);
+	} else {
+		dlg_db_fill_row(dlg, values, NULL);
+		bench_insert(0, dialog_row_keys, values, DIALOG_TABLE_COL_NO);
+		dlg->dflags &= ~DLG_FLAG_NEW;
+	}
+	dlg_unlock(d_table, entry);
+	return dlg;
+}
+
+static void bench_change(struct dlg_cell *dlg, int async)
+{
+	struct dlg_entry *entry;
+	db_val_t values[DIALOG_TABLE_COL_NO];
+
+	entry = &d_table->entries[dlg->h_entry];
+	dlg_lock(d_table, entry);
+	dlg->state = 4;
+	dlg->dflags |= DLG_FLAG_CHANGED;
+	if(async) {
+		if(!(dlg->dflags & DLG_FLAG_DBQUEUED))
+			dlg_dbq_push(dlg, DLG_DBQ_UPDATE);
+	} else {
+		dlg_db_fill_row(dlg, values, NULL);
+		bench_update(0, dialog_row_keys, 0, values, dialog_row_keys+10,
+				values+10, 2, 4);
+		dlg->dflags &= ~DLG_FLAG_CHANGED;
+	}
+	dlg_unlock(d_table, entry);
+}
+
+static void bench_end(struct dlg_cell *dlg, int async)
+{
+	struct dlg_entry *entry;
+
+	entry = &d_table->entries[dlg->h_entry];
+	dlg_lock(d_table, entry);
+	if(dlg->prev) dlg->prev->next = dlg->next;
+	else entry->first = dlg->next;
+	if(dlg->next) dlg->next->prev = dlg->prev;
+	if(!(dlg->dflags & DLG_FLAG_NEW)) {
+		if(!async || dlg_dbq_push(dlg, DLG_DBQ_DELETE)<0)
+			dlg_dbq_delete_one(dlg->h_entry, dlg->h_id);
+	}
+	dlg_unlock(d_table, entry);
+	free(dlg);
+}
+
+int main(int argc, char** argv)
+{
+	struct dlg_cell **dlgs;
+	int dialogs, active, wevery, c, i, async, changes;
+	double t0, t1, tw[2], twr, tall[2];
+	int stmts[2], wstmts;
+
+	dialogs = 20000;
+	active = 1000;
+	wevery = 100;
+	dlg_db_async_batch = 100;
+	while((c=getopt(argc, argv, "n:a:w:b:r:"))!=-1){
+		switch(c){
+			case 'n':
+				dialogs = atoi(optarg);
+				break;
+			case 'a':
+				active = atoi(optarg);
+				break;
+			case 'w':
+				wevery = atoi(optarg);
+				break;
+			case 'b':
+				dlg_db_async_batch = atoi(optarg);
+				break;
+			case 'r':
+				bench_rtt = atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-n dialogs] [-a active]"
+						" [-w changes] [-b batch] [-r rtt]\n", argv[0]);
+				return 1;
+		}
+	}
+	if(active<2) active = 2;
+	if(dialogs<active) dialogs = active;
+	if(wevery<1) wevery = 1;
+
+	d_table = (struct dlg_table*)calloc(1, sizeof(struct dlg_table));
+	d_table->size = 4096;
+	d_table->entries = (struct dlg_entry*)calloc(d_table->size,
+			sizeof(struct dlg_entry));
+	for(i=0; i<d_table->size; i++)
+		lock_init(&d_table->entries[i].lock);
+	dialog_dbf.cap = DB_CAP_ALL | DB_CAP_RAW_QUERY | DB_CAP_INSERT_UPDATE_BULK;
+	dialog_dbf.insert = bench_insert;
+	dialog_dbf.insert_update_bulk = bench_insert_bulk;
+	dialog_dbf.update = bench_update;
+	dialog_dbf.delete = bench_delete;
+	dialog_dbf.raw_query = bench_raw_query;
+	dlg_db_async_procs = 1;
+	dlg_db_async_queue_size = 2*active;
+	if(dlg_dbq_init()<0) {
+		fprintf(stderr, "cannot init the queue\n");
+		return 1;
+	}
+	bench_in_db = (char*)calloc(dialogs+1, 1);
+	dlgs = (struct dlg_cell**)calloc(dialogs+1, sizeof(struct dlg_cell*));
+
+	twr = 0;
+	wstmts = 0;
+	for(async=0; async<2; async++) {
+		bench_stmts = 0;
+		tw[async] = 0;
+		changes = 0;
+		t0 = bench_now_us();
+		for(i=1; i<=dialogs+active; i++) {
+			t1 = bench_now_us();
+			if(i<=dialogs) {
+				dlgs[i] = bench_new(i, async);
+				changes++;
+			}
+			if(i>active/2 && i-active/2<=dialogs) {
+				bench_change(dlgs[i-active/2], async);
+				changes++;
+			}
+			if(i>active) {
+				bench_end(dlgs[i-active], async);
+				changes++;
+			}
+			tw[async] += bench_now_us() - t1;
+			if(async && changes>=wevery) {
+				c = bench_stmts;
+				t1 = bench_now_us();
+				dlg_dbq_run(&_dlg_dbq[0]);
+				twr += bench_now_us() - t1;
+				wstmts += bench_stmts - c;
+				changes = 0;
+			}
+		}
+		if(async) {
+			c = bench_stmts;
+			t1 = bench_now_us();
+			dlg_dbq_run(&_dlg_dbq[0]);
+			twr += bench_now_us() - t1;
+			wstmts += bench_stmts - c;
+		}
+		tall[async] = bench_now_us() - t0;
+		stmts[async] = bench_stmts;
+		for(i=1; i<=dialogs; i++)
+			if(bench_in_db[i])
+				bench_errors++;
+		if(bench_errors) {
+			fprintf(stderr, "%d errors in the %s writes\n", bench_errors,
+					async?"queued":"direct");
+			return 1;
+		}
+	}
+
+	printf("%d dialogs, %d active, writer every %d changes, batch %d,"
+			" %d us per statement\n\n", dialogs, active, wevery,
+			dlg_db_async_batch, bench_rtt);
+	printf("%-30s %14s %14s\n", "", "workers", "queue");
+	printf("%-30s %14.2f %14.2f\n", "worker time per change (us)",
+			tw[0]/(3.0*dialogs), tw[1]/(3.0*dialogs));
+	printf("%-30s %14.2f %14.2f\n", "statements per dialog",
+			(double)stmts[0]/dialogs, (double)stmts[1]/dialogs);
+	printf("%-30s %14s %14.2f\n", "writer time per dialog (us)", "-",
+			twr/dialogs);
+	printf("%-30s %14.1f %14.1f\n", "total time (ms)", tall[0]/1000.0,
+			tall[1]/1000.0);
+	printf("\nqueue: %lu rows, longest flush %lu us, overflows %lu,"
+			" %d statements by the writer\n", dlg_dbq_get_rows(),
+			dlg_dbq_get_flush_max_time(), dlg_dbq_get_overflows(), wstmts);
+	return 0;
+}
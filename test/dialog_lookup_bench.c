@@ -0,0 +1,288 @@
+/*
+ * dialog lookup benchmark: compares the lookup of dialogs by callid and
+ * tags as done before (slot locked, the strings of every dialog in the slot
+ * compared) with the lookup comparing the fingerprints first, with the
+ * slot locked and without locking it (lockfree_lookup).
+ *
+ * The shm allocator is mapped to a shared memory arena, so that the worker
+ * processes do the lookups on the same table, with the same locks, like the
+ * SIP workers. The freed memory is not reused by the arena.
+ *
+ * With -c, one more process keeps creating and destroying dialogs in the
+ * same slots during the lookups, which also runs the deferred free.
+ *
+ * Run: ./dialog_lookup_bench [-n dialogs] [-s hash_size] [-p procs]
+ *          [-l lookups] [-c churn]
+ *  -n  number of dialogs (default 1000000)
+ *  -s  size of the dialog hash table (default 4096, like the module)
+ *  -p  number of processes doing lookups (default 4)
+ *  -l  lookups per process (default 1000000)
+ *  -c  dialogs created and destroyed during the lookups (default 0)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "bench.h"
+
+/* shared memory arena in place of the shm pool */
+#define shm_mem_h
+#define mem_h
+static char *bench_arena = NULL;
+static unsigned long bench_arena_size = 0;
+static volatile unsigned long *bench_arena_used = NULL;
+static void *bench_shm_malloc(unsigned long size)
+{
+	unsigned long off;
+
+	size = (size + 15) & ~15UL;
+	off = __sync_fetch_and_add(bench_arena_used, size);
+	if (off + size > bench_arena_size)
+		return NULL;
+	return bench_arena + off;
+}
+#define shm_malloc(s) bench_shm_malloc(s)
+#define shm_free(p) do { } while(0)
+#define pkg_malloc(s) malloc(s)
+#define pkg_free(p) free(p)
+#define PKG_MEM_ERROR
+#define SHM_MEM_ERROR
+
+#include "../modules/dialog/dlg_hash.c"
+
+/* stubs for the core and the module */
+char ut_buf_int2str[INT2STR_MAX_LEN];
+struct route_list main_rt;
+int dlg_db_mode = 0;
+int dlg_ka_interval = 0;
+static int bench_procs = 4;
+int get_max_procs(void) { return bench_procs + 2; }
+ticks_t get_ticks(void) { return 0; }
+int route_lookup(struct route_list* rt, char* name) { return -1; }
+int remove_dialog_timer(struct dlg_tl *tl) { return 0; }
+int update_dlg_timer(struct dlg_tl *tl, int timeout) { return 0; }
+int remove_dialog_from_db(struct dlg_cell *cell) { return 0; }
+void destroy_dlg_callbacks_list(struct dlg_callback *cb) { }
+void destroy_linkers(dlg_profile_link_t *linker) { }
+void run_dlg_callbacks(int type, struct dlg_cell *dlg, struct sip_msg *req,
+		struct sip_msg *rpl, unsigned int dir, void *dlg_data) { }
+int dlg_bye_all(struct dlg_cell *dlg, str *hdrs) { return 0; }
+int dlg_send_ka(dlg_cell_t *dlg, int dir) { return 0; }
+struct mi_root *init_mi_tree(unsigned int code, char *reason, int reason_len)
+{ return NULL; }
+void free_mi_tree(struct mi_root *parent) { }
+struct mi_node *add_mi_node_child(struct mi_node *parent, int flags,
+	char *name, int name_len, char *value, int value_len) { return NULL; }
+struct mi_attr *addf_mi_attr(struct mi_node *node, int flags,
+	char *name, int name_len, char *fmt_val, ...) { return NULL; }
+
+/* keeps the lookups from being optimized out */
+volatile int bench_sink = 0;
+
+/* the lookup as done before, strings compared with the slot locked */
+static dlg_cell_t* old_get_dlg(str *callid, str *ftag, str *ttag,
+		unsigned int *dir)
+{
+	dlg_cell_t *dlg;
+	dlg_entry_t *d_entry;
+
+	d_entry = &(d_table->entries[core_hash(callid, 0, d_table->size)]);
+	dlg_lock(d_table, d_entry);
+	for(dlg = d_entry->first; dlg; dlg = dlg->next) {
+		if(match_dialog(dlg, callid, ftag, ttag, dir)==1) {
+			ref_dlg_unsafe(dlg, 1);
+			dlg_unlock(d_table, d_entry);
+			return dlg;
+		}
+	}
+	dlg_unlock(d_table, d_entry);
+	return NULL;
+}
+
+static void dlg_ids(int i, char *cid, char *ft, char *tt)
+{
+	/* fixed length ids, like the ones of most UAs */
+	sprintf(cid, "a84b4c76e66710%08x%08x@pc33.atlanta.example.com",
+			(unsigned int)i*2654435761u, (unsigned int)i);
+	sprintf(ft, "19283017%08x", (unsigned int)i*40503u);
+	sprintf(tt, "a6c85cf%08x", (unsigned int)i*69069u);
+}
+
+static dlg_cell_t* new_dlg(int i)
+{
+	char cid[128], ft[32], tt[32];
+	str callid, ftag, ttag, uri, empty = {"", 0};
+	dlg_cell_t *dlg;
+
+	dlg_ids(i, cid, ft, tt);
+	callid.s = cid; callid.len = strlen(cid);
+	ftag.s = ft; ftag.len = strlen(ft);
+	ttag.s = tt; ttag.len = strlen(tt);
+	uri.s = "sip:bob@biloxi.example.com"; uri.len = strlen(uri.s);
+	dlg = build_new_dlg(&callid, &uri, &uri, &ftag, &uri);
+	if(dlg==NULL
+			|| dlg_set_leg_info(dlg, &ftag, &empty, &uri, &empty,
+				DLG_CALLER_LEG)!=0
+			|| dlg_set_leg_info(dlg, &ttag, &empty, &uri, &empty,
+				DLG_CALLEE_LEG)!=0) {
+		fprintf(stderr, "cannot build dialog %d\n", i);
+		exit(1);
+	}
+	dlg->state = DLG_STATE_CONFIRMED;
+	link_dlg(dlg, 0, 0);
+	return dlg;
+}
+
+/* lookups of random dialogs, half of them upstream (tags swapped) */
+static int run_lookups(int mode, int dialogs, int lookups, unsigned int seed)
+{
+	char cid[128], ft[32], tt[32];
+	str callid, ftag, ttag;
+	dlg_cell_t *dlg;
+	unsigned int dir;
+	int i, k;
+
+	for(i=0; i<lookups; i++) {
+		seed = seed*1103515245 + 12345;
+		k = (seed>>4) % dialogs;
+		dlg_ids(k, cid, ft, tt);
+		callid.s = cid; callid.len = strlen(cid);
+		ftag.s = (i&1)?tt:ft; ftag.len = strlen(ftag.s);
+		ttag.s = (i&1)?ft:tt; ttag.len = strlen(ttag.s);
+		dir = DLG_DIR_NONE;
+		dlg = (mode==0)?old_get_dlg(&callid, &ftag, &ttag, &dir)
+			:get_dlg(&callid, &ftag, &ttag, &dir);
+		if(dlg==NULL || dir!=((i&1)?DLG_DIR_UPSTREAM:DLG_DIR_DOWNSTREAM)) {
+			fprintf(stderr, "dialog %d not found\n", k);
+			return 1;
+		}
+		dlg_release(dlg);
+	}
+	return 0;
+}
+
+/* dialogs created and destroyed in the same slots as the looked up ones */
+static void run_churn(int dialogs, int churn)
+{
+	dlg_cell_t *dlg;
+	int i;
+
+	for(i=0; i<churn; i++) {
+		dlg = new_dlg(dialogs + i);
+		dlg_unref(dlg, 1);
+		if(i%1000==0)
+			dlg_gc_run();
+	}
+	dlg_gc_run();
+	dlg_gc_run();
+}
+
+static const char *mode_names[] = {"locked, strings (before)",
+	"locked, fingerprint", "lock-free, fingerprint"};
+
+int main(int argc, char** argv)
+{
+	int dialogs, hsize, lookups, churn, mode, c, i, st, fails;
+	pid_t pid;
+	double t0, t1;
+
+	dialogs = 1000000;
+	hsize = 4096;
+	lookups = 1000000;
+	churn = 0;
+	while((c=getopt(argc, argv, "n:s:p:l:c:"))!=-1){
+		switch(c){
+			case 'n':
+				dialogs = atoi(optarg);
+				break;
+			case 's':
+				hsize = atoi(optarg);
+				break;
+			case 'p':
+				bench_procs = atoi(optarg);
+				break;
+			case 'l':
+				lookups = atoi(optarg);
+				break;
+			case 'c':
+				churn = atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-n dialogs] [-s hash_size]"
+						" [-p procs] [-l lookups] [-c churn]\n", argv[0]);
+				return 1;
+		}
+	}
+	if(dialogs<=0) dialogs = 1;
+	if(bench_procs<=0) bench_procs = 1;
+	if(lookups<=0) lookups = 1;
+	if(churn<0) churn = 0;
+	for(i=1; i<hsize; i<<=1);
+	hsize = i;
+
+	bench_arena_size = (unsigned long)(dialogs + churn) * 1024 + (1<<24);
+	bench_arena = mmap(NULL, bench_arena_size + 64, PROT_READ|PROT_WRITE,
+			MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if(bench_arena==MAP_FAILED) {
+		fprintf(stderr, "cannot map %lu bytes\n", bench_arena_size);
+		return 1;
+	}
+	bench_arena_used = (volatile unsigned long*)(bench_arena
+			+ bench_arena_size);
+
+	if(init_dlg_table(hsize)<0 || dlg_gc_init()<0) {
+		fprintf(stderr, "cannot init the dialog table\n");
+		return 1;
+	}
+	t0 = bench_now_us();
+	for(i=0; i<dialogs; i++)
+		new_dlg(i);
+	t1 = bench_now_us();
+	printf("%d dialogs in %d slots (%d per slot), built in %.0f ms\n",
+			dialogs, hsize, dialogs/hsize, (t1-t0)/1000);
+	printf("%d processes x %d lookups, %d dialogs created and destroyed\n\n",
+			bench_procs, lookups, churn);
+	printf("%-28s %14s %12s\n", "lookup", "lookups/s", "ns/lookup");
+
+	for(mode=0; mode<3; mode++) {
+		/* modes 0 and 1 lock the slot, like with lockfree_lookup 0 */
+		dlg_lockfree_lookup = (mode==2);
+		t0 = bench_now_us();
+		for(i=0; i<bench_procs + (churn>0); i++) {
+			pid = fork();
+			if(pid<0) {
+				fprintf(stderr, "cannot fork\n");
+				return 1;
+			}
+			if(pid==0) {
+				process_no = i + 1;
+				if(mode<2)
+					dlg_gc = NULL;
+				if(i==bench_procs) {
+					run_churn(dialogs, churn);
+					_exit(0);
+				}
+				_exit(run_lookups(mode, dialogs, lookups, 7+i));
+			}
+		}
+		fails = 0;
+		while(wait(&st)>0)
+			if(!WIFEXITED(st) || WEXITSTATUS(st)!=0)
+				fails++;
+		t1 = bench_now_us();
+		if(fails) {
+			fprintf(stderr, "%d processes failed\n", fails);
+			return 1;
+		}
+		printf("%-28s %14.0f %12.1f\n", mode_names[mode],
+				bench_procs*(double)lookups*1000000.0/(t1-t0),
+				(t1-t0)*1000.0/((double)bench_procs*lookups));
+	}
+
+	bench_sink += dialogs;
+	return 0;
+}
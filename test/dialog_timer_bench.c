@@ -0,0 +1,259 @@
+/*
+ * dialog timer benchmark: compares the sorted list of dialog timeouts of
+ * the dialog module as it was before (one lock, insertion walking from the
+ * tail) with the timer wheel (a slot per second, a lock per slot), for
+ * the insert, update and remove of timeouts with many active dialogs, and
+ * for the expiration.
+ *
+ * The ticks are driven by the benchmark. The timeouts are spread between
+ * short ones (like the default for not acknowledged dialogs) and long call
+ * durations.
+ *
+ * Run: ./dialog_timer_bench [-n dialogs] [-o operations] [-w wheel_size]
+ *  -n  number of active dialogs (default 200000)
+ *  -o  number of timed operations of each kind (default 2000)
+ *  -w  number of slots of the wheel (default 4096, like the module)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+/* system allocator in place of the shm and pkg pools */
+#define BENCH_MALLOC
+#include "bench.h"
+
+
+#include "../modules/dialog/dlg_timer.c"
+
+/* stubs for the core and the module */
+void dlg_gc_run(void) { }
+static ticks_t bench_ticks = 1;
+ticks_t get_ticks(void) { return bench_ticks; }
+
+/* the sorted list as it was before */
+static struct dlg_tl old_first;
+static gen_lock_t old_lock;
+
+static void old_insert_unsafe(struct dlg_tl *tl)
+{
+	struct dlg_tl* ptr;
+
+	for(ptr = old_first.prev; ptr != &old_first ; ptr = ptr->prev) {
+		if ( ptr->timeout <= tl->timeout )
+			break;
+	}
+	tl->prev = ptr;
+	tl->next = ptr->next;
+	tl->prev->next = tl;
+	tl->next->prev = tl;
+}
+
+static int old_insert(struct dlg_tl *tl, int interval)
+{
+	lock_get(&old_lock);
+	tl->timeout = get_ticks()+interval;
+	old_insert_unsafe(tl);
+	lock_release(&old_lock);
+	return 0;
+}
+
+static int old_remove(struct dlg_tl *tl)
+{
+	lock_get(&old_lock);
+	remove_dialog_timer_unsafe(tl);
+	tl->next = NULL;
+	tl->prev = NULL;
+	tl->timeout = 0;
+	lock_release(&old_lock);
+	return 0;
+}
+
+static int old_update(struct dlg_tl *tl, int timeout)
+{
+	lock_get(&old_lock);
+	remove_dialog_timer_unsafe(tl);
+	tl->timeout = get_ticks()+timeout;
+	old_insert_unsafe(tl);
+	lock_release(&old_lock);
+	return 0;
+}
+
+static int old_expire(unsigned int time)
+{
+	struct dlg_tl *tl;
+	int n;
+
+	n = 0;
+	lock_get(&old_lock);
+	while(old_first.next!=&old_first && old_first.next->timeout<=time) {
+		tl = old_first.next;
+		remove_dialog_timer_unsafe(tl);
+		tl->next = tl->prev = NULL;
+		tl->timeout = 0;
+		n++;
+	}
+	lock_release(&old_lock);
+	return n;
+}
+
+/* expiration checks of the wheel, counting the expired timers */
+static int bench_expired = 0;
+static int bench_late = 0;
+static void bench_hdl(struct dlg_tl *tl)
+{
+	bench_expired++;
+}
+
+static int cmp_timeout(const void *a, const void *b)
+{
+	return (int)(*(struct dlg_tl**)a)->timeout
+		- (int)(*(struct dlg_tl**)b)->timeout;
+}
+
+/* 30% short timeouts (10..120s), 70% call durations (5min..12h) */
+static int bench_timeout(unsigned int *seed)
+{
+	*seed = *seed*1103515245 + 12345;
+	if((*seed>>8)%10 < 3)
+		return 10 + (*seed>>12)%110;
+	return 300 + (*seed>>12)%43000;
+}
+
+int main(int argc, char** argv)
+{
+	struct dlg_tl *tls;
+	struct dlg_tl **byto;
+	int *tos;
+	int dialogs, ops, c, i, k, impl, n;
+	unsigned int seed;
+	double t0, t1, tins[2], tupd[2], trem[2], texp[2];
+
+	dialogs = 200000;
+	ops = 2000;
+	while((c=getopt(argc, argv, "n:o:w:"))!=-1){
+		switch(c){
+			case 'n':
+				dialogs = atoi(optarg);
+				break;
+			case 'o':
+				ops = atoi(optarg);
+				break;
+			case 'w':
+				dlg_timer_wheel_size = atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-n dialogs] [-o operations]"
+						" [-w wheel_size]\n", argv[0]);
+				return 1;
+		}
+	}
+	if(dialogs<=0) dialogs = 1;
+	if(ops<=0) ops = 1;
+	if(ops>dialogs) ops = dialogs;
+
+	tls = (struct dlg_tl*)calloc(dialogs, sizeof(struct dlg_tl));
+	tos = (int*)malloc(dialogs*sizeof(int));
+	byto = (struct dlg_tl**)malloc(dialogs*sizeof(struct dlg_tl*));
+	seed = 7;
+	for(i=0; i<dialogs; i++)
+		tos[i] = bench_timeout(&seed);
+
+	old_first.next = old_first.prev = &old_first;
+	lock_init(&old_lock);
+	if(init_dlg_timer(bench_hdl)<0) {
+		fprintf(stderr, "cannot init the timer\n");
+		return 1;
+	}
+
+	for(impl=0; impl<2; impl++) {
+		bench_ticks = 1;
+		d_timer->last = 0;
+		memset(tls, 0, dialogs*sizeof(struct dlg_tl));
+		/* active dialogs, the last ones are timed - the list is built
+		 * sorted, inserting in it one by one takes too long */
+		if(impl==0) {
+			for(i=0; i<dialogs-ops; i++) {
+				tls[i].timeout = bench_ticks + tos[i];
+				byto[i] = &tls[i];
+			}
+			qsort(byto, dialogs-ops, sizeof(struct dlg_tl*), cmp_timeout);
+			for(i=0; i<dialogs-ops; i++) {
+				byto[i]->prev = old_first.prev;
+				byto[i]->next = &old_first;
+				old_first.prev->next = byto[i];
+				old_first.prev = byto[i];
+			}
+		} else {
+			for(i=0; i<dialogs-ops; i++)
+				insert_dlg_timer(&tls[i], tos[i]);
+		}
+		t0 = bench_now_us();
+		for(i=dialogs-ops; i<dialogs; i++) {
+			if(impl==0) old_insert(&tls[i], tos[i]);
+			else insert_dlg_timer(&tls[i], tos[i]);
+		}
+		t1 = bench_now_us();
+		tins[impl] = (t1-t0)*1000.0/ops;
+
+		/* updates of random dialogs, like for the 200 ok and the ack */
+		seed = 11;
+		t0 = bench_now_us();
+		for(i=0; i<ops; i++) {
+			seed = seed*1103515245 + 12345;
+			k = (seed>>8) % dialogs;
+			if(impl==0) old_update(&tls[k], tos[(k+1)%dialogs]);
+			else update_dlg_timer(&tls[k], tos[(k+1)%dialogs]);
+		}
+		t1 = bench_now_us();
+		tupd[impl] = (t1-t0)*1000.0/ops;
+
+		/* removes, like for the bye */
+		t0 = bench_now_us();
+		for(i=dialogs-ops; i<dialogs; i++) {
+			if(impl==0) old_remove(&tls[i]);
+			else remove_dialog_timer(&tls[i]);
+		}
+		t1 = bench_now_us();
+		trem[impl] = (t1-t0)*1000.0/ops;
+
+		/* expiration of the remaining ones, second by second */
+		bench_expired = 0;
+		n = 0;
+		t0 = bench_now_us();
+		for(bench_ticks=1; bench_ticks<=44000; bench_ticks++) {
+			if(impl==0) {
+				n += old_expire(bench_ticks);
+			} else {
+				dlg_timer_routine(bench_ticks, NULL);
+			}
+		}
+		t1 = bench_now_us();
+		texp[impl] = (t1-t0)/44000;
+		if(impl==1) {
+			n = bench_expired;
+			for(i=0; i<dialogs; i++)
+				if(tls[i].prev!=NULL || tls[i].timeout!=0)
+					bench_late++;
+		}
+		if(n!=dialogs-ops || bench_late) {
+			fprintf(stderr, "%d timers expired, %d expected, %d left\n",
+					n, dialogs-ops, bench_late);
+			return 1;
+		}
+	}
+
+	printf("%d active dialogs, %d operations, wheel of %u slots\n\n",
+			dialogs, ops, d_timer->size);
+	printf("%-22s %14s %14s\n", "", "list (before)", "wheel");
+	printf("%-22s %14.1f %14.1f\n", "insert (ns)", tins[0], tins[1]);
+	printf("%-22s %14.1f %14.1f\n", "update (ns)", tupd[0], tupd[1]);
+	printf("%-22s %14.1f %14.1f\n", "remove (ns)", trem[0], trem[1]);
+	printf("%-22s %14.1f %14.1f\n", "expire per second (us)", texp[0],
+			texp[1]);
+
+	destroy_dlg_timer();
+	return 0;
+}
@@ -0,0 +1,237 @@
+/*
+ * dispatcher index benchmark: compares walking the list of destination
+ * sets (how the sets and the source addresses were looked up before) with
+ * the index of the dispatcher module (hash tables of the sets by id and of
+ * the destinations by IP address), for a large number of sets.
+ *
+ * The sets are generated in memory: each set has destinations picked from
+ * a pool of gateway addresses, so an address can be in many sets.
+ *
+ * Run: ./dispatcher_index_bench [-s sets] [-d dests_per_set] [-g gateways]
+ *  -s  number of sets (default 3000)
+ *  -d  number of destinations per set (default 4)
+ *  -g  number of distinct gateway addresses (default 5000)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+/* system allocator in place of the shm and pkg pools */
+#define BENCH_MALLOC
+#include "bench.h"
+
+
+#include "../modules/dispatcher/ds_index.c"
+
+
+/* keeps the lookups from being optimized out */
+volatile int bench_sink = 0;
+
+/* the lookups as done before, walking the list */
+static ds_set_t* list_get_set(ds_set_t *list, int id)
+{
+	for(; list!=NULL; list=list->next)
+		if(list->id==id)
+			return list;
+	return NULL;
+}
+
+static int list_match_addr(ds_set_t *list, int group, struct ip_addr *ip,
+		unsigned short port, unsigned short proto, int mode,
+		ds_set_t **set, ds_dest_t **dest)
+{
+	int j;
+
+	for(; list!=NULL; list=list->next)
+	{
+		if(group!=-1 && group!=list->id)
+			continue;
+		for(j=0; j<list->nr; j++)
+		{
+			if(ip_addr_cmp(ip, &list->dlist[j].ip_address)
+					&& ((mode&DS_MATCH_NOPORT) || list->dlist[j].port==0
+						|| port==list->dlist[j].port)
+					&& ((mode&DS_MATCH_NOPROTO)
+						|| proto==list->dlist[j].proto))
+			{
+				*set = list;
+				*dest = &list->dlist[j];
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+static void gw_addr(struct ip_addr *ip, int g)
+{
+	memset(ip, 0, sizeof(struct ip_addr));
+	ip->af = AF_INET;
+	ip->len = 4;
+	ip->u.addr[0] = 10;
+	ip->u.addr[1] = (g>>16)&255;
+	ip->u.addr[2] = (g>>8)&255;
+	ip->u.addr[3] = g&255;
+}
+
+static double ns_per_op(struct timeval *a, struct timeval *b, int n)
+{
+	return ((b->tv_sec-a->tv_sec)*1000000.0+(b->tv_usec-a->tv_usec))
+		*1000.0/n;
+}
+
+int main(int argc, char** argv)
+{
+	struct timeval t0, t1;
+	struct ip_addr *addrs;
+	ds_set_t *list, *sp, *s1, *s2;
+	ds_dest_t *d1, *d2;
+	ds_index_t *dsi;
+	int sets, dests, gws, lookups, llookups;
+	int i, j, c, r1, r2, found;
+	double tl, ti;
+	unsigned int rnd;
+
+	sets = 3000;
+	dests = 4;
+	gws = 5000;
+	while((c=getopt(argc, argv, "s:d:g:"))!=-1){
+		switch(c){
+			case 's':
+				sets = atoi(optarg);
+				break;
+			case 'd':
+				dests = atoi(optarg);
+				break;
+			case 'g':
+				gws = atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-s sets] [-d dests_per_set]"
+						" [-g gateways]\n", argv[0]);
+				return 1;
+		}
+	}
+	if(sets<=0) sets = 1;
+	if(dests<=0) dests = 1;
+	if(gws<=0) gws = 1;
+
+	/* sets are prepended when loaded, the last loaded is the first */
+	rnd = 12345;
+	list = NULL;
+	for(i=0; i<sets; i++)
+	{
+		sp = (ds_set_t*)calloc(1, sizeof(ds_set_t));
+		sp->id = i+1;
+		sp->nr = dests;
+		sp->dlist = (ds_dest_t*)calloc(dests, sizeof(ds_dest_t));
+		for(j=0; j<dests; j++)
+		{
+			rnd = rnd*1103515245 + 12345;
+			gw_addr(&sp->dlist[j].ip_address, (rnd>>8)%gws);
+			sp->dlist[j].port = 5060;
+			sp->dlist[j].proto = PROTO_UDP;
+			if(j<dests-1)
+				sp->dlist[j].next = &sp->dlist[j+1];
+		}
+		sp->next = list;
+		list = sp;
+	}
+
+	gettimeofday(&t0, 0);
+	dsi = ds_index_build(list);
+	gettimeofday(&t1, 0);
+	if(dsi==NULL)
+	{
+		fprintf(stderr, "cannot build the index\n");
+		return 1;
+	}
+	printf("%d sets, %d destinations per set, %d gateways,"
+			" index built in %.1f ms\n", sets, dests, gws,
+			ns_per_op(&t0, &t1, 1)/1000000.0);
+	printf("%-28s %12s %12s\n", "lookup", "list (ns)", "index (ns)");
+
+	/* set by id, like ds_select_dst() - the list walk is much slower,
+	 * it gets fewer rounds */
+	lookups = 1000000;
+	llookups = 20000;
+	found = 0;
+	gettimeofday(&t0, 0);
+	for(i=0; i<llookups; i++)
+		found += (list_get_set(list, (i*7)%sets+1)!=NULL);
+	gettimeofday(&t1, 0);
+	tl = ns_per_op(&t0, &t1, llookups);
+	gettimeofday(&t0, 0);
+	for(i=0; i<llookups; i++)
+		found -= (ds_index_get_set(dsi, (i*7)%sets+1)!=NULL);
+	for(i=llookups; i<lookups; i++)
+		bench_sink += (ds_index_get_set(dsi, (i*7)%sets+1)!=NULL);
+	gettimeofday(&t1, 0);
+	ti = ns_per_op(&t0, &t1, lookups);
+	printf("%-28s %12.1f %12.1f\n", "set by id", tl, ti);
+	if(found!=0)
+	{
+		fprintf(stderr, "set lookups differ\n");
+		return 1;
+	}
+
+	/* the destinations of a set are found in that set */
+	for(sp=list, c=0; sp!=NULL && c<500; sp=sp->next, c++)
+	{
+		for(j=0; j<sp->nr; j++)
+		{
+			r1 = list_match_addr(list, sp->id, &sp->dlist[j].ip_address, 5060,
+					PROTO_TCP, DS_MATCH_NOPROTO, &s1, &d1);
+			r2 = ds_index_match_addr(dsi, sp->id, &sp->dlist[j].ip_address,
+					5060, PROTO_TCP, DS_MATCH_NOPROTO, &s2, &d2);
+			if(r1!=1 || r2!=1 || s1!=s2 || d1!=d2)
+			{
+				fprintf(stderr, "address lookups differ in set %d\n", sp->id);
+				return 1;
+			}
+		}
+	}
+
+	/* source addresses, half of them not in any set */
+	addrs = (struct ip_addr*)malloc(2*gws*sizeof(struct ip_addr));
+	for(i=0; i<2*gws; i++)
+		gw_addr(&addrs[i], i);
+	llookups = 2000;
+	for(c=0; c<2; c++)
+	{
+		/* check that both give the same destination */
+		for(i=0; i<2*gws; i+=(gws>1000)?gws/1000:1)
+		{
+			r1 = list_match_addr(list, (c==0)?-1:(i%sets)+1, &addrs[i], 5060,
+					PROTO_UDP, DS_MATCH_NOPROTO, &s1, &d1);
+			r2 = ds_index_match_addr(dsi, (c==0)?-1:(i%sets)+1, &addrs[i],
+					5060, PROTO_UDP, DS_MATCH_NOPROTO, &s2, &d2);
+			if(r1!=r2 || (r1 && (s1!=s2 || d1!=d2)))
+			{
+				fprintf(stderr, "address lookups differ for %d\n", i);
+				return 1;
+			}
+		}
+		gettimeofday(&t0, 0);
+		for(i=0; i<llookups; i++)
+			bench_sink += list_match_addr(list, (c==0)?-1:(i%sets)+1, &addrs[i%(2*gws)],
+					5060, PROTO_UDP, DS_MATCH_NOPROTO, &s1, &d1);
+		gettimeofday(&t1, 0);
+		tl = ns_per_op(&t0, &t1, llookups);
+		gettimeofday(&t0, 0);
+		for(i=0; i<lookups; i++)
+			bench_sink += ds_index_match_addr(dsi, (c==0)?-1:(i%sets)+1,
+					&addrs[i%(2*gws)], 5060, PROTO_UDP, DS_MATCH_NOPROTO,
+					&s2, &d2);
+		gettimeofday(&t1, 0);
+		ti = ns_per_op(&t0, &t1, lookups);
+		printf("%-28s %12.1f %12.1f\n", (c==0)?"address in any set":
+				"address in one set", tl, ti);
+	}
+
+	ds_index_free(dsi);
+	return 0;
+}
@@ -0,0 +1,260 @@
+/*
+ * dispatcher hash ring benchmark: compares the modulo hashing of the
+ * dispatcher (hash % nr, then the next active destination) with the
+ * consistent hash ring (alg 12) and the rendezvous hashing (alg 13), for
+ * the share of keys that move when one destination becomes inactive or is
+ * removed from the set, how the keys of an inactive destination are spread
+ * over the others, the spread of the keys by weight and the time of a
+ * lookup.
+ *
+ * Run: ./dispatcher_ring_bench [-d dests] [-k keys] [-v vnodes]
+ *  -d  number of destinations in the set (default 10)
+ *  -k  number of keys (default 1000000)
+ *  -v  points on the ring per destination (default 160)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+/* system allocator in place of the shm and pkg pools */
+#define BENCH_MALLOC
+#include "bench.h"
+
+
+#include "../modules/dispatcher/ds_ring.c"
+
+/* stubs for the core and the module */
+int ds_use_default = 0;
+int ds_ring_vnodes = 160;
+
+/* keeps the lookups from being optimized out */
+volatile int bench_sink = 0;
+
+#define ALG_MOD		0
+#define ALG_RING	1
+#define ALG_HRW		2
+
+static const char *alg_names[] = {"modulo", "hash ring", "rendezvous"};
+
+/* the selection of the first active destination, for each algorithm */
+static int select_dst(ds_set_t *sp, int alg, unsigned int key, int *order,
+		char *mark, double *score)
+{
+	int i, h;
+
+	switch(alg)
+	{
+		case ALG_MOD:
+			h = key % sp->nr;
+			for(i=h; ds_skip_dst(sp->dlist[i].flags); )
+			{
+				i = (i+1) % sp->nr;
+				if(i==h)
+					return -1;
+			}
+			return i;
+		case ALG_RING:
+			return (ds_ring_select(sp, key, order, 1, mark)==1)?order[0]:-1;
+		default:
+			return (ds_hrw_select(sp, key, order, 1, score)==1)?order[0]:-1;
+	}
+}
+
+static double ns_per_op(struct timeval *a, struct timeval *b, int n)
+{
+	return ((b->tv_sec-a->tv_sec)*1000000.0+(b->tv_usec-a->tv_usec))
+		*1000.0/n;
+}
+
+int main(int argc, char** argv)
+{
+	struct timeval t0, t1;
+	ds_set_t set;
+	ds_dest_t *dlist;
+	char uri[64];
+	int *before, *order, *hits;
+	char *mark;
+	double *score;
+	int dests, keys, alg, c, i, j, wsum, moved, busiest;
+	unsigned int key;
+	double t, tm, tb, dev, maxdev;
+
+	dests = 10;
+	keys = 1000000;
+	while((c=getopt(argc, argv, "d:k:v:"))!=-1){
+		switch(c){
+			case 'd':
+				dests = atoi(optarg);
+				break;
+			case 'k':
+				keys = atoi(optarg);
+				break;
+			case 'v':
+				ds_ring_vnodes = atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-d dests] [-k keys] [-v vnodes]\n",
+						argv[0]);
+				return 1;
+		}
+	}
+	if(dests<2) dests = 2;
+	if(keys<=0) keys = 1;
+	if(ds_ring_vnodes<=0) ds_ring_vnodes = 1;
+
+	memset(&set, 0, sizeof(ds_set_t));
+	set.id = 1;
+	set.nr = dests;
+	dlist = (ds_dest_t*)calloc(dests, sizeof(ds_dest_t));
+	set.dlist = dlist;
+	for(j=0; j<dests; j++)
+	{
+		snprintf(uri, sizeof(uri), "sip:10.0.%d.%d:5060", j/250, j%250+1);
+		set.dlist[j].uri.s = strdup(uri);
+		set.dlist[j].uri.len = strlen(uri);
+		if(j<dests-1)
+			set.dlist[j].next = &set.dlist[j+1];
+	}
+	before = (int*)malloc(keys*sizeof(int));
+	order = (int*)malloc(dests*sizeof(int));
+	hits = (int*)malloc(dests*sizeof(int));
+	mark = (char*)malloc(dests);
+	score = (double*)malloc(dests*sizeof(double));
+
+	printf("%d destinations, %d keys, %d points per destination\n",
+			dests, keys, ds_ring_vnodes);
+	printf("spread: largest deviation from an even share of the keys\n"
+			"inactive: keys moved when the first destination is inactive\n"
+			"busiest: load of the busiest destination left, over an even"
+			" share\nremoved: keys moved when the first destination is"
+			" removed\n\n");
+	printf("%-12s %12s %12s %12s %12s %10s\n", "alg", "spread (%)",
+			"inactive (%)", "busiest (%)", "removed (%)", "ns/lookup");
+
+	for(alg=ALG_MOD; alg<=ALG_HRW; alg++)
+	{
+		/* same weight for all */
+		set.nr = dests;
+		set.dlist = dlist;
+		for(j=0; j<dests; j++)
+		{
+			dlist[j].attrs.weight = 0;
+			dlist[j].flags = 0;
+		}
+		if(ds_ring_init(&set)<0)
+		{
+			fprintf(stderr, "cannot build the ring\n");
+			return 1;
+		}
+
+		memset(hits, 0, dests*sizeof(int));
+		gettimeofday(&t0, 0);
+		for(i=0, key=1; i<keys; i++, key=key*1103515245+12345)
+		{
+			before[i] = select_dst(&set, alg, key, order, mark, score);
+			hits[before[i]]++;
+		}
+		gettimeofday(&t1, 0);
+		t = ns_per_op(&t0, &t1, keys);
+
+		/* largest deviation from an even spread */
+		maxdev = 0;
+		for(j=0; j<dests; j++)
+		{
+			dev = (hits[j] - (double)keys/dests)*100.0/((double)keys/dests);
+			if(dev<0) dev = -dev;
+			if(dev>maxdev) maxdev = dev;
+		}
+
+		/* the first destination goes inactive: keys that move and the
+		 * load of the busiest destination left, over an even spread */
+		dlist[0].flags = DS_INACTIVE_DST;
+		moved = 0;
+		memset(hits, 0, dests*sizeof(int));
+		for(i=0, key=1; i<keys; i++, key=key*1103515245+12345)
+		{
+			j = select_dst(&set, alg, key, order, mark, score);
+			hits[j]++;
+			if(j!=before[i])
+				moved++;
+		}
+		busiest = 0;
+		for(j=1; j<dests; j++)
+			if(hits[j]>busiest)
+				busiest = hits[j];
+		tm = moved*100.0/keys;
+		tb = busiest*100.0/((double)keys/(dests-1));
+
+		/* the first destination is removed from the set (reload) */
+		dlist[0].flags = 0;
+		set.nr = dests-1;
+		set.dlist = dlist+1;
+		if(ds_ring_init(&set)<0)
+		{
+			fprintf(stderr, "cannot build the ring\n");
+			return 1;
+		}
+		moved = 0;
+		for(i=0, key=1; i<keys; i++, key=key*1103515245+12345)
+			if(select_dst(&set, alg, key, order, mark, score)+1!=before[i])
+				moved++;
+
+		printf("%-12s %12.2f %12.2f %12.2f %12.2f %10.1f\n", alg_names[alg],
+				maxdev, tm, tb, moved*100.0/keys, t);
+	}
+	set.nr = dests;
+	set.dlist = dlist;
+
+	/* spread by weight, destination j has weight j+1 */
+	printf("\nweights 1..%d, share of keys (%%), expected/ring/rendezvous:\n",
+			dests);
+	wsum = 0;
+	for(j=0; j<dests; j++)
+	{
+		set.dlist[j].attrs.weight = j+1;
+		set.dlist[j].flags = 0;
+		wsum += j+1;
+	}
+	ds_ring_init(&set);
+	for(alg=ALG_RING; alg<=ALG_HRW; alg++)
+	{
+		memset(hits, 0, dests*sizeof(int));
+		for(i=0, key=1; i<keys; i++, key=key*1103515245+12345)
+			hits[select_dst(&set, alg, key, order, mark, score)]++;
+		for(j=0; j<dests; j++)
+			before[alg*dests+j] = hits[j];
+	}
+	for(j=0; j<dests; j++)
+		printf("  dst %-3d %8.2f %8.2f %8.2f\n", j, (j+1)*100.0/wsum,
+				before[ALG_RING*dests+j]*100.0/keys,
+				before[ALG_HRW*dests+j]*100.0/keys);
+
+	/* the failover order must be all destinations, distinct */
+	for(i=0, key=7; i<1000; i++, key=key*1103515245+12345)
+	{
+		for(alg=ALG_RING; alg<=ALG_HRW; alg++)
+		{
+			c = (alg==ALG_RING)?ds_ring_select(&set, key, order, dests, mark)
+				:ds_hrw_select(&set, key, order, dests, score);
+			memset(mark, 0, dests);
+			for(j=0; j<c; j++)
+				mark[order[j]]++;
+			for(j=0; j<dests && c==dests; j++)
+				if(mark[j]!=1)
+					break;
+			if(c!=dests || j!=dests
+					|| order[0]!=select_dst(&set, alg, key, hits, mark, score))
+			{
+				fprintf(stderr, "bad failover order for %s\n", alg_names[alg]);
+				return 1;
+			}
+		}
+	}
+
+	ds_ring_free(&set);
+	bench_sink += moved;
+	return 0;
+}
@@ -0,0 +1,163 @@
+/*
+ * Header index benchmark: compares the time needed to find out that some
+ * headers are not in a message by classifying the header names one by one
+ * up to the end of header (parse_hname2() + line scanning, like
+ * parse_headers() does) with building the header index (parse_hname2() +
+ * memchr(), like parse_hdr_index() does) and testing its flags.
+ * Only the name classification is measured: parse_headers() also parses
+ * some header bodies (Via, To, CSeq, Content-Length) and allocates a
+ * hdr_field for each header, which the index avoids for missing headers.
+ *
+ * Takes captured messages (e.g. the *.sip files in this directory).
+ *
+ * Run: ./hdr_index_bench [-n loops] file.sip ...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "bench.h"
+#include "../dprint.h"
+#include "../parser/parse_hname2.h"
+
+/* logging stubs for parse_hname2.c, nothing is logged here */
+
+
+/* first header line of a message */
+static char* first_hdr(char* buf, char* end)
+{
+	char* p;
+
+	p=memchr(buf, '\n', end-buf);
+	return p?p+1:end;
+}
+
+
+/* the current way: classify the headers in order, until the end of header,
+ * finding each line end byte by byte */
+static hdr_flags_t walk_hdrs(char* p, char* end)
+{
+	struct hdr_field hf;
+	hdr_flags_t found;
+
+	found=0;
+	while(p<end && *p!='\n' && *p!='\r'){
+		hf.type=HDR_ERROR_T;
+		parse_hname2(p, end, &hf);
+		if (hf.type==HDR_ERROR_T)
+			break;
+		found|=HDR_T2F(hf.type);
+		for(;;){
+			while(p<end && *p!='\n') p++;
+			p++;
+			if (p>=end || (*p!=' ' && *p!='\t'))
+				break;
+		}
+	}
+	return found;
+}
+
+
+/* the header index: same classification, with memchr() line splitting */
+static hdr_flags_t index_hdrs(char* p, char* end)
+{
+	struct hdr_field hf;
+	hdr_flags_t present;
+	char* eol;
+
+	present=0;
+	while(p<end && *p!='\n' && *p!='\r'){
+		hf.type=HDR_ERROR_T;
+		parse_hname2(p, end, &hf);
+		if (hf.type==HDR_ERROR_T)
+			break;
+		present|=HDR_T2F(hf.type);
+		do{
+			eol=memchr(p, '\n', end-p);
+			if (eol==0)
+				return present;
+			p=eol+1;
+		}while(p<end && (*p==' ' || *p=='\t'));
+	}
+	return present;
+}
+
+
+static double us_diff(struct timeval* a, struct timeval* b)
+{
+	return (b->tv_sec-a->tv_sec)*1000000.0+(b->tv_usec-a->tv_usec);
+}
+
+
+/* looked up headers, usually missing from the captured messages */
+static hdr_flags_t lookups[]={
+	HDR_AUTHORIZATION_F, HDR_PROXYAUTH_F, HDR_SUPPORTED_F, HDR_EVENT_F,
+	HDR_PPI_F, HDR_PRIVACY_F, HDR_IDENTITY_F, HDR_SESSIONEXPIRES_F
+};
+#define LOOKUPS_NO (sizeof(lookups)/sizeof(lookups[0]))
+
+
+int main(int argc, char** argv)
+{
+	char buf[65536];
+	char* hdrs;
+	char* end;
+	FILE* f;
+	int loops;
+	int c, i, r, l;
+	size_t len;
+	volatile hdr_flags_t sink;
+	hdr_flags_t idx;
+	struct timeval t0, t1, t2;
+
+	loops=100000;
+	while((c=getopt(argc, argv, "n:"))!=-1){
+		switch(c){
+			case 'n':
+				loops=atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-n loops] file.sip ...\n",
+							argv[0]);
+				return 1;
+		}
+	}
+	printf("%-28s %12s %12s %8s\n", "message", "walk (ns)", "index (ns)",
+				"speedup");
+	for (i=optind; i<argc; i++){
+		f=fopen(argv[i], "r");
+		if (f==0){
+			perror(argv[i]);
+			continue;
+		}
+		len=fread(buf, 1, sizeof(buf)-1, f);
+		fclose(f);
+		buf[len]=0;
+		end=buf+len;
+		hdrs=first_hdr(buf, end);
+
+		/* the first lookup of a missing header walks all the headers, the
+		 * next ones test the parsed flags */
+		gettimeofday(&t0, 0);
+		for (r=0; r<loops; r++){
+			idx=walk_hdrs(hdrs, end);
+			for (l=0; l<LOOKUPS_NO; l++)
+				sink=idx & lookups[l];
+		}
+		gettimeofday(&t1, 0);
+		/* the index is built once, the lookups test its flags */
+		for (r=0; r<loops; r++){
+			idx=index_hdrs(hdrs, end);
+			for (l=0; l<LOOKUPS_NO; l++)
+				sink=idx & lookups[l];
+		}
+		gettimeofday(&t2, 0);
+		printf("%-28s %12.1f %12.1f %7.2fx\n", argv[i],
+				us_diff(&t0, &t1)*1000/loops, us_diff(&t1, &t2)*1000/loops,
+				us_diff(&t0, &t1)/us_diff(&t1, &t2));
+	}
+	(void)sink;
+	return 0;
+}
@@ -0,0 +1,121 @@
+/*
+ * Header index check: parses captured messages with and without the header
+ * index (sip_hdr_index) and checks that parse_headers() gives the same
+ * result for requests of some headers together with HDR_EOH_F (like
+ * sipcapture and app_python do): the end of header must be found and all
+ * the headers parsed, even if the index has no flag for the end of header.
+ *
+ * Takes captured messages (e.g. the *.sip files in this directory).
+ *
+ * Run: ./hdr_index_check file.sip ...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench.h"
+#include "../dprint.h"
+#include "../cfg_core.h"
+#include "../ip_addr.h"
+#include "../parser/msg_parser.h"
+
+int ser_error=0;
+int phone2tel=1;
+int sip_hdr_index=0;
+char ut_buf_int2str[INT2STR_MAX_LEN];
+static struct cfg_group_core check_core_cfg;
+void* core_cfg=&check_core_cfg;
+void* shm_malloc(unsigned long size) { return malloc(size); }
+void shm_free(void* p) { free(p); }
+void free_lump_list(struct lump* l) { }
+void free_lump_rpl(struct lump_rpl* l) { }
+int get_valid_proto_string(unsigned int iproto, int utype, int vtype,
+		str *sproto) { return -1; }
+
+
+/* requests that must parse up to the end of header */
+static hdr_flags_t eoh_flags[]={
+	HDR_EOH_F,
+	HDR_CALLID_F|HDR_EOH_F,
+	HDR_AUTHORIZATION_F|HDR_EOH_F,
+	~(hdr_flags_t)0
+};
+#define EOH_FLAGS_NO (sizeof(eoh_flags)/sizeof(eoh_flags[0]))
+
+
+/* parses buf with or without the index, returns the number of headers
+ * parsed for flags or -1 on error */
+static int parse_eoh(char* buf, int len, int idx, hdr_flags_t flags,
+						int* eoh_off)
+{
+	struct sip_msg msg;
+	struct hdr_field* hf;
+	int n;
+
+	sip_hdr_index=idx;
+	memset(&msg, 0, sizeof(msg));
+	msg.buf=buf;
+	msg.len=len;
+	if (parse_msg(buf, len, &msg)!=0)
+		return -1;
+	if (parse_headers(&msg, flags, 0)<0 || msg.eoh==0 ||
+			!(msg.parsed_flag & HDR_EOH_F)){
+		free_sip_msg(&msg);
+		return -1;
+	}
+	*eoh_off=msg.eoh-buf;
+	n=0;
+	for (hf=msg.headers; hf; hf=hf->next)
+		n++;
+	free_sip_msg(&msg);
+	return n;
+}
+
+
+int main(int argc, char** argv)
+{
+	char buf[65536];
+	char tmp[65536];
+	FILE* f;
+	int i, l, len, errors, mismatch;
+	int n[2], eoh[2];
+
+	errors=0;
+	for (i=1; i<argc; i++){
+		f=fopen(argv[i], "r");
+		if (f==0){
+			perror(argv[i]);
+			continue;
+		}
+		len=fread(buf, 1, sizeof(buf)-1, f);
+		fclose(f);
+		buf[len]=0;
+		mismatch=0;
+		for (l=0; l<EOH_FLAGS_NO; l++){
+			eoh[0]=eoh[1]=0;
+			/* the parser may change the buffer, use a copy each time */
+			memcpy(tmp, buf, len+1);
+			n[0]=parse_eoh(tmp, len, 0, eoh_flags[l], &eoh[0]);
+			if (n[0]<0)
+				break; /* not a valid message, nothing to compare */
+			memcpy(tmp, buf, len+1);
+			n[1]=parse_eoh(tmp, len, 1, eoh_flags[l], &eoh[1]);
+			if (n[1]!=n[0] || eoh[1]!=eoh[0]){
+				printf("%s: flags %llx: %d headers, eoh at %d without the"
+						" index, %d headers, eoh at %d with it\n", argv[i],
+						(unsigned long long)eoh_flags[l], n[0], eoh[0],
+						n[1], eoh[1]);
+				mismatch++;
+			}
+		}
+		errors+=mismatch;
+		if (mismatch)
+			printf("%-28s FAILED\n", argv[i]);
+		else if (l==EOH_FLAGS_NO)
+			printf("%-28s ok\n", argv[i]);
+		else
+			printf("%-28s skipped (not parsed)\n", argv[i]);
+	}
+	return errors?1:0;
+}
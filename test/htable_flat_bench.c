@@ -0,0 +1,232 @@
+/*
+ * htable layout benchmark: compares the chained layout (one shm block per
+ * item, in a sorted list per slot) with the flat layout (open addressing
+ * buckets per slot with the fingerprint of the name and a reference to the
+ * item, allocated as for the chained layout) of the htable module.
+ *
+ * One process, no lock contention. The memory is what the table allocates
+ * (malloc_usable_size() of the blocks), with the slots.
+ *
+ * The last row is a chained table sized for about one item per slot, the
+ * usual way to get short lists: the flat layout is meant for tables that
+ * cannot be sized so, and it takes more memory than this one.
+ *
+ * Run: ./htable_flat_bench [-n items] [-s size] [-l value_len]
+ *  -n  number of items (default 1000000)
+ *  -s  size attribute of the table, 2^s slots (default 14)
+ *  -l  length of the string values, 0 for integer values (default 0)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <sys/time.h>
+#include "bench.h"
+
+/* system allocator in place of the shm and pkg pools */
+#define shm_mem_h
+#define mem_h
+static size_t bench_mem = 0;
+static void* bench_malloc(size_t s)
+{
+	void *p;
+
+	p = malloc(s);
+	if(p)
+		bench_mem += malloc_usable_size(p);
+	return p;
+}
+static void bench_free(void *p)
+{
+	if(p)
+		bench_mem -= malloc_usable_size(p);
+	free(p);
+}
+#define shm_malloc(s) bench_malloc(s)
+#define shm_free(p) bench_free(p)
+#define shm_malloc_unsafe(s) bench_malloc(s)
+#define shm_free_unsafe(p) bench_free(p)
+#define pkg_malloc(s) bench_malloc(s)
+#define pkg_free(p) bench_free(p)
+#define pkg_realloc(p, s) realloc(p, s)
+#define PKG_MEM_ERROR
+#define SHM_MEM_ERROR
+
+#include "../modules/htable/ht_api.c"
+
+/* stubs for the core and the rest of the module */
+int route_type=0;
+struct route_list event_rt;
+int shm_initialized(void) { return 1; }
+int route_get(struct route_list* rt, char* name) { return -1; }
+int run_top_route(struct action* a, sip_msg_t* msg, struct run_act_ctx* c)
+{ return 0; }
+int faked_msg_init(void) { return 0; }
+sip_msg_t* faked_msg_next(void) { return NULL; }
+int parse_params(str* _s, pclass_t _c, param_hooks_t* _h, param_t** _p)
+{ return -1; }
+void free_params(param_t* _p) { }
+int ht_db_load_table(ht_t *ht, str *dbtable, int mode) { return 0; }
+int ht_db_save_table(ht_t *ht, str *dbtable) { return 0; }
+int ht_db_delete_records(str *dbtable) { return 0; }
+
+
+/* item names like the ones of a rate limiting table */
+static int bench_name(char *buf, int i)
+{
+	return snprintf(buf, 64, "10.%d.%d.%d:%d::rate", (i>>16)&255, (i>>8)&255,
+			i&255, i>>24);
+}
+
+static double ns_per_op(struct timeval *a, struct timeval *b, int n)
+{
+	return ((b->tv_sec-a->tv_sec)*1000000.0+(b->tv_usec-a->tv_usec))
+		*1000.0/n;
+}
+
+static void bench(char *title, int layout, int items, int size, int vlen)
+{
+	static char names[64];
+	static char vbuf[1024];
+	struct timeval t0, t1, t2, t3, t4;
+	ht_cell_t *copy;
+	ht_t *ht;
+	str tname = str_init("bench");
+	str name;
+	int_str val;
+	size_t mem0;
+	int type;
+	int i;
+
+	mem0 = bench_mem;
+	_ht_root = NULL;
+	if(ht_add_table(&tname, 0, NULL, size, 0, 0, NULL, 1, 0, NULL,
+				layout)!=0 || ht_init_tables()!=0)
+	{
+		fprintf(stderr, "cannot create the table\n");
+		exit(1);
+	}
+	ht = ht_get_root();
+
+	memset(vbuf, 'v', sizeof(vbuf));
+	type = (vlen>0)?AVP_VAL_STR:0;
+	name.s = names;
+
+	/* insert */
+	gettimeofday(&t0, 0);
+	for(i=0; i<items; i++)
+	{
+		name.len = bench_name(names, i);
+		if(vlen>0)
+		{
+			val.s.s = vbuf;
+			val.s.len = vlen;
+		} else {
+			val.n = i;
+		}
+		ht_set_cell(ht, &name, type, &val, 1);
+	}
+	gettimeofday(&t1, 0);
+
+	/* lookup, like a $sht() read */
+	copy = NULL;
+	for(i=0; i<items; i++)
+	{
+		name.len = bench_name(names, (int)(((long long)i*7)%items));
+		copy = ht_cell_pkg_copy(ht, &name, copy);
+	}
+	gettimeofday(&t2, 0);
+
+	/* increment, like $shtinc() - integer values only */
+	if(vlen==0)
+	{
+		for(i=0; i<items; i++)
+		{
+			name.len = bench_name(names, i);
+			copy = ht_cell_value_add(ht, &name, 1, 1, copy);
+		}
+	}
+	gettimeofday(&t3, 0);
+
+	/* delete half of the items and add them back */
+	for(i=0; i<items; i+=2)
+	{
+		name.len = bench_name(names, i);
+		ht_del_cell(ht, &name);
+	}
+	for(i=0; i<items; i+=2)
+	{
+		name.len = bench_name(names, i);
+		val.n = i;
+		ht_set_cell(ht, &name, 0, &val, 1);
+	}
+	gettimeofday(&t4, 0);
+
+	/* check the content */
+	for(i=0; i<items; i++)
+	{
+		name.len = bench_name(names, i);
+		copy = ht_cell_pkg_copy(ht, &name, copy);
+		if(copy==NULL || copy->name.len!=name.len
+				|| strncmp(copy->name.s, name.s, name.len)!=0
+				|| ((i&1)==0 && copy->value.n!=i))
+		{
+			fprintf(stderr, "%s: bad item %d\n", title, i);
+			exit(1);
+		}
+	}
+
+	printf("%-8s %8d %10.1f %10.1f %10.1f %10.1f %12.1f\n", title,
+			ht->htsize, ns_per_op(&t0, &t1, items), ns_per_op(&t1, &t2, items),
+			(vlen==0)?ns_per_op(&t2, &t3, items):0.0,
+			ns_per_op(&t3, &t4, items),
+			(double)(bench_mem - mem0)/items);
+	if(copy)
+		pkg_free(copy);
+	ht_destroy();
+}
+
+int main(int argc, char** argv)
+{
+	int items;
+	int size;
+	int vlen;
+	int fit;
+	int c;
+
+	items = 1000000;
+	size = 14;
+	vlen = 0;
+	while((c=getopt(argc, argv, "n:s:l:"))!=-1){
+		switch(c){
+			case 'n':
+				items = atoi(optarg);
+				break;
+			case 's':
+				size = atoi(optarg);
+				break;
+			case 'l':
+				vlen = atoi(optarg);
+				if(vlen<0 || vlen>1000)
+					vlen = 0;
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-n items] [-s size]"
+						" [-l value_len]\n", argv[0]);
+				return 1;
+		}
+	}
+	if(items<=0)
+		items = 1;
+	printf("%d items, %d slots, %s values\n", items, 1<<size,
+			(vlen>0)?"string":"integer");
+	printf("%-8s %8s %10s %10s %10s %10s %12s\n", "layout", "slots",
+			"set (ns)", "get (ns)", "inc (ns)", "del+set", "bytes/item");
+	bench("chained", HT_LAYOUT_CHAINED, items, size, vlen);
+	bench("flat", HT_LAYOUT_FLAT, items, size, vlen);
+	for(fit=2; fit<31 && (1<<fit)<items; fit++);
+	bench("chained", HT_LAYOUT_CHAINED, items, fit, vlen);
+	return 0;
+}
@@ -0,0 +1,242 @@
+/*
+ * rvalue cache benchmark: evaluates script expressions with the generic
+ * rval_expr_eval() (the path taken for string and mixed expressions, each
+ * intermediate result is a new rvalue) and reports the time per
+ * evaluation. rvalue_nocache_bench is the same, built without the cache of
+ * freed rvalues (RV_CACHE_MAX=0).
+ *
+ * The pkg allocator is the f_malloc of the default build. No pkg stats
+ * event handler is registered.
+ *
+ * Run: ./rvalue_cache_bench [-n evaluations] [-f fragmented blocks] [-d]
+ *  -n  number of evaluations of each expression (default 2000000)
+ *  -f  number of pkg blocks allocated before, every other one is freed to
+ *      get a fragmented pkg pool as after some traffic (default 10000)
+ *  -d  prints instead the distribution of the rvalue buffer sizes allocated
+ *      from pkg by one evaluation of each expression (run it with
+ *      rvalue_nocache_bench, so that every rvalue is allocated)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "bench.h"
+
+#include "../events.h"
+#include "../cfg_core.h"
+#include "../mem/f_malloc.c"
+
+/* pkg_malloc() of rvalue.c, records the allocated sizes for -d */
+static void* bench_fm_malloc(struct fm_block* qm, unsigned long size,
+		const char* file, const char* func, unsigned int line);
+#define fm_malloc bench_fm_malloc
+#include "../rvalue.c"
+#undef fm_malloc
+
+#define BENCH_HISTO_STEP 16
+#define BENCH_HISTO_MAX 64
+static int bench_histo_on=0;
+static unsigned long bench_histo[BENCH_HISTO_MAX+1];
+
+static void* bench_fm_malloc(struct fm_block* qm, unsigned long size,
+		const char* file, const char* func, unsigned int line)
+{
+	struct rvalue* rv;
+	unsigned long b;
+
+	if (bench_histo_on && size>=sizeof(*rv)-sizeof(rv->buf)){
+		/* rvalue buffer size */
+		b=(size-(sizeof(*rv)-sizeof(rv->buf)))/BENCH_HISTO_STEP;
+		bench_histo[b<BENCH_HISTO_MAX?b:BENCH_HISTO_MAX]++;
+	}
+	return fm_malloc(qm, size, file, func, line);
+}
+
+int scr_opt_lev=1;
+struct fm_block* mem_block=0;
+static struct cfg_group_core bench_core_cfg;
+void* core_cfg=&bench_core_cfg;
+int sr_event_exec(int type, void *data) { return 0; }
+int eval_expr(struct run_act_ctx* h, struct expr* e, struct sip_msg* msg)
+{ return -1; }
+int fix_actions(struct action* a) { return -1; }
+int fix_expr(struct expr* exp) { return -1; }
+void print_select(select_t* s) { }
+int pv_get_spec_value(struct sip_msg* msg, pv_spec_p sp, pv_value_t *value)
+{ return -1; }
+void pv_value_destroy(pv_value_t *val) { }
+int resolve_select(select_t* s) { return -1; }
+int run_actions_safe(struct run_act_ctx* c, struct action* a,
+		struct sip_msg* msg) { return -1; }
+int run_select(str* res, select_t* s, struct sip_msg* msg) { return -1; }
+avp_t *search_avp_by_index(avp_flags_t flags, avp_name_t name,
+		avp_value_t *val, avp_index_t index) { return 0; }
+
+#define BENCH_PKG_SIZE (32*1024*1024)
+
+static struct cfg_pos bench_pos;
+
+static struct rval_expr* bench_str(char* s)
+{
+	str v;
+
+	v.s=s;
+	v.len=strlen(s);
+	return mk_rval_expr_v(RV_STR, &v, &bench_pos);
+}
+
+static struct rval_expr* bench_int(long i)
+{
+	return mk_rval_expr_v(RV_INT, (void*)i, &bench_pos);
+}
+
+static void bench(char* title, struct rval_expr* rve, int n)
+{
+	struct run_act_ctx ra_ctx;
+	struct rvalue* rv;
+	double t0, t;
+	int i;
+
+	init_run_actions_ctx(&ra_ctx);
+	t0=bench_now_us();
+	for (i=0; i<n; i++){
+		rv=rval_expr_eval(&ra_ctx, 0, rve);
+		if (rv==0){
+			fprintf(stderr, "%s: evaluation failed\n", title);
+			exit(1);
+		}
+		rval_destroy(rv);
+	}
+	t=bench_now_us()-t0;
+	rv=rval_expr_eval(&ra_ctx, 0, rve);
+	if (rv->type==RV_STR)
+		printf("%-28s %-22.*s %8.1f ns\n", title, rv->v.s.len, rv->v.s.s,
+				t*1000.0/n);
+	else
+		printf("%-28s %-22ld %8.1f ns\n", title, rv->v.l, t*1000.0/n);
+	rval_destroy(rv);
+}
+
+static void histo(struct rval_expr** e, int no)
+{
+	struct run_act_ctx ra_ctx;
+	struct rvalue* rv;
+	unsigned long t;
+	int i;
+
+	init_run_actions_ctx(&ra_ctx);
+	bench_histo_on=1;
+	for (i=0; i<no; i++){
+		rv=rval_expr_eval(&ra_ctx, 0, e[i]);
+		if (rv)
+			rval_destroy(rv);
+	}
+	bench_histo_on=0;
+	for (i=0, t=0; i<=BENCH_HISTO_MAX; i++)
+		t+=bench_histo[i];
+	printf("rvalue buffer sizes allocated by one evaluation of each"
+			" expression (%lu):\n", t);
+	for (i=0; i<=BENCH_HISTO_MAX; i++)
+		if (bench_histo[i])
+			printf("  %4d - %4d%s bytes: %lu\n", i*BENCH_HISTO_STEP,
+					(i+1)*BENCH_HISTO_STEP-1, i==BENCH_HISTO_MAX?"+":"",
+					bench_histo[i]);
+}
+
+int main(int argc, char** argv)
+{
+	struct rval_expr* e[6];
+	void** frag;
+	int n, f, d, c, i;
+
+	n=2000000;
+	f=10000;
+	d=0;
+	while((c=getopt(argc, argv, "n:f:d"))!=-1){
+		switch(c){
+			case 'n':
+				n=atoi(optarg);
+				break;
+			case 'f':
+				f=atoi(optarg);
+				break;
+			case 'd':
+				d=1;
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-n evaluations]"
+						" [-f fragmented blocks] [-d]\n", argv[0]);
+				return 1;
+		}
+	}
+	mem_block=fm_malloc_init(malloc(BENCH_PKG_SIZE), BENCH_PKG_SIZE,
+			MEM_TYPE_PKG);
+	if (mem_block==0){
+		fprintf(stderr, "cannot init the pkg pool\n");
+		return 1;
+	}
+	/* every other block freed, of different sizes */
+	frag=malloc(f*sizeof(void*));
+	for (i=0; i<f; i++)
+		frag[i]=pkg_malloc(16+(i%64)*8);
+	for (i=0; i<f; i+=2)
+		pkg_free(frag[i]);
+
+	/* "sip:" + "alice" + "@" + "example.com" */
+	e[0]=mk_rval_expr2(RVE_PLUS_OP,
+			mk_rval_expr2(RVE_PLUS_OP,
+				mk_rval_expr2(RVE_PLUS_OP, bench_str("sip:"),
+					bench_str("alice"), &bench_pos),
+				bench_str("@"), &bench_pos),
+			bench_str("example.com"), &bench_pos);
+	/* "cseq-" + (1 + 2*3) */
+	e[1]=mk_rval_expr2(RVE_PLUS_OP, bench_str("cseq-"),
+			mk_rval_expr2(RVE_IPLUS_OP, bench_int(1),
+				mk_rval_expr2(RVE_MUL_OP, bench_int(2), bench_int(3),
+					&bench_pos), &bench_pos), &bench_pos);
+	/* (10 * 3) + 12 with the generic plus */
+	e[2]=mk_rval_expr2(RVE_PLUS_OP,
+			mk_rval_expr2(RVE_MUL_OP, bench_int(10), bench_int(3),
+				&bench_pos), bench_int(12), &bench_pos);
+	/* $rU@$rd of a registrar/proxy: "sip:" + $rU + "@" + $rd */
+	e[3]=mk_rval_expr2(RVE_PLUS_OP,
+			mk_rval_expr2(RVE_PLUS_OP,
+				mk_rval_expr2(RVE_PLUS_OP, bench_str("sip:"),
+					bench_str("+4915112345678"), &bench_pos),
+				bench_str("@"), &bench_pos),
+			bench_str("sip.example-provider.com"), &bench_pos);
+	/* contact with expires: $ct + ";expires=" + $hdr(Expires) */
+	e[4]=mk_rval_expr2(RVE_PLUS_OP,
+			mk_rval_expr2(RVE_PLUS_OP,
+				bench_str("<sip:alice@192.168.100.23:5060;transport=udp>"),
+				bench_str(";expires="), &bench_pos),
+			bench_int(3600), &bench_pos);
+	/* htable key: $ci + "-" + $ft */
+	e[5]=mk_rval_expr2(RVE_PLUS_OP,
+			mk_rval_expr2(RVE_PLUS_OP,
+				bench_str("a84b4c76e66710@pc33.atlanta.example.com"),
+				bench_str("-"), &bench_pos),
+			bench_str("1928301774"), &bench_pos);
+	for (i=0; i<6; i++){
+		if (e[i]==0){
+			fprintf(stderr, "cannot build the expressions\n");
+			return 1;
+		}
+	}
+	if (d){
+		histo(e, 6);
+		return 0;
+	}
+
+	printf("rvalue cache size: %d, %d evaluations, %d pkg fragments\n",
+			RV_CACHE_MAX, n, f/2);
+	bench("string concat (4 strings)", e[0], n);
+	bench("string + int expression", e[1], n);
+	bench("generic plus on ints", e[2], n);
+	bench("request uri ($rU@$rd)", e[3], n);
+	bench("contact + expires", e[4], n);
+	bench("htable key ($ci-$ft)", e[5], n);
+	return 0;
+}
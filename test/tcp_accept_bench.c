@@ -0,0 +1,349 @@
+/*
+ * tcp accept rate benchmark: compares how the new tcp connections reach
+ * the tcp readers, as it was before (tcp_main accepts them on the listen
+ * socket and passes each fd to a reader with send_fd()/receive_fd()) with
+ * tcp_reuse_port (each reader accepts on its own SO_REUSEPORT listen
+ * socket). Only the way the fd gets to the reader is measured, the
+ * connection structure is not built in either case.
+ *
+ * The client processes connect to 127.0.0.1, wait for the reader to close
+ * the connection and connect again. The readers count the connections in
+ * the accepted/conns fields of their struct tcp_reactor, as the tcp
+ * readers do (exported by core.tcp_info).
+ *
+ * Run: ./tcp_accept_bench [-n connections] [-r readers] [-c clients]
+ *  -n  number of connections (default 20000)
+ *  -r  number of readers (default 4)
+ *  -c  number of client processes (default 8)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "bench.h"
+
+/* shared mapping in place of the shm pool */
+#define shm_mem_h
+#define mem_h
+static char* bench_shm;
+static size_t bench_shm_used, bench_shm_size;
+static void* bench_shm_malloc(size_t s)
+{
+	void* p;
+
+	s=(s+15)&~15;
+	if (bench_shm_used+s>bench_shm_size)
+		return 0;
+	p=bench_shm+bench_shm_used;
+	bench_shm_used+=s;
+	return p;
+}
+#define shm_malloc(s) bench_shm_malloc(s)
+#define shm_free(p)
+#define pkg_malloc(s) malloc(s)
+#define pkg_free(p) free(p)
+#define PKG_MEM_ERROR
+#define SHM_MEM_ERROR
+
+#include "../tcp_reactor.c"
+#include "../pass_fd.c"
+
+
+static int bench_readers;
+static int bench_clients;
+static struct sockaddr_in bench_addr;
+
+static int bench_listen(int reuse_port)
+{
+	socklen_t len;
+	int s, optval;
+
+	s=socket(AF_INET, SOCK_STREAM, 0);
+	if (s<0){
+		perror("socket");
+		exit(1);
+	}
+	optval=1;
+	setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+#ifdef SO_REUSEPORT
+	if (reuse_port &&
+			setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval))<0){
+		perror("setsockopt(SO_REUSEPORT)");
+		exit(1);
+	}
+#endif
+	if (bind(s, (struct sockaddr*)&bench_addr, sizeof(bench_addr))<0){
+		perror("bind");
+		exit(1);
+	}
+	if (listen(s, 1024)<0){
+		perror("listen");
+		exit(1);
+	}
+	/* the first socket picks the port, the others share it */
+	len=sizeof(bench_addr);
+	getsockname(s, (struct sockaddr*)&bench_addr, &len);
+	return s;
+}
+
+/* connects n times, each time waiting for the reader to close */
+static void bench_client(int n)
+{
+	char b;
+	int i, s;
+
+	for (i=0; i<n; i++){
+		s=socket(AF_INET, SOCK_STREAM, 0);
+		if (s<0 || connect(s, (struct sockaddr*)&bench_addr,
+					sizeof(bench_addr))<0){
+			perror("connect");
+			exit(1);
+		}
+		while (read(s, &b, 1)<0 && errno==EINTR);
+		close(s);
+	}
+}
+
+/* a connection reached the reader: count it and close it (the reader
+ * closes first, so the client ports are not kept in TIME_WAIT) */
+static void bench_conn_done(int fd)
+{
+	tcp_reactors[tcp_reactor_idx].accepted++;
+	tcp_reactors[tcp_reactor_idx].conns++;
+	close(fd);
+	tcp_reactors[tcp_reactor_idx].conns--;
+}
+
+/* tcp_main: accepts and passes the fds to the readers, round robin */
+static void bench_main(int ls, int* unix_socks)
+{
+	int fd, r;
+
+	for (r=0;; r=(r+1)%bench_readers){
+		fd=accept(ls, 0, 0);
+		if (fd<0){
+			if (errno==EINTR || errno==ECONNABORTED)
+				continue;
+			perror("accept");
+			exit(1);
+		}
+		if (send_fd(unix_socks[r], &fd, sizeof(fd), fd)<=0)
+			exit(1);
+		close(fd);
+	}
+}
+
+static void bench_reader_pass(int unix_sock)
+{
+	int fd, dummy;
+
+	while (receive_fd(unix_sock, &dummy, sizeof(dummy), &fd, MSG_WAITALL)>0)
+		bench_conn_done(fd);
+}
+
+static void bench_reader_own(int ls)
+{
+	int fd;
+
+	for(;;){
+		fd=accept(ls, 0, 0);
+		if (fd<0){
+			if (errno==EINTR || errno==ECONNABORTED)
+				continue;
+			perror("accept");
+			exit(1);
+		}
+		bench_conn_done(fd);
+	}
+}
+
+/* forks the clients, returns the time until all the connections are done */
+static double bench_run(int n)
+{
+	pid_t* pids;
+	double t0;
+	int i;
+
+	pids=calloc(bench_clients, sizeof(pid_t));
+	fflush(stdout);
+	t0=bench_now_us();
+	for (i=0; i<bench_clients; i++){
+		pids[i]=fork();
+		if (pids[i]==0){
+			bench_client(n/bench_clients+(i<n%bench_clients));
+			exit(0);
+		}
+	}
+	for (i=0; i<bench_clients; i++)
+		waitpid(pids[i], 0, 0);
+	free(pids);
+	return bench_now_us()-t0;
+}
+
+static void bench_stop(pid_t* pids, int n)
+{
+	int i;
+
+	for (i=0; i<n; i++)
+		kill(pids[i], SIGTERM);
+	for (i=0; i<n; i++)
+		waitpid(pids[i], 0, 0);
+}
+
+static void bench_report(const char* name, double t, int n)
+{
+	int i;
+
+	printf("%-22s: %10.0f us  %9.0f conn/s  accepted by reader:", name, t,
+			n/(t/1000000.0));
+	for (i=0; i<bench_readers; i++){
+		printf(" %lu", tcp_reactors[i].accepted);
+		if (tcp_reactors[i].conns)
+			printf("(%d open)", tcp_reactors[i].conns);
+		tcp_reactors[i].accepted=0;
+	}
+	printf("\n");
+}
+
+static double bench_passed(int n)
+{
+	pid_t* pids;
+	int* unix_socks;
+	int sv[2];
+	int ls, i;
+	double t;
+
+	bench_addr.sin_port=0;
+	ls=bench_listen(0);
+	pids=calloc(bench_readers+1, sizeof(pid_t));
+	unix_socks=calloc(bench_readers, sizeof(int));
+	fflush(stdout);
+	for (i=0; i<bench_readers; i++){
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv)<0){
+			perror("socketpair");
+			exit(1);
+		}
+		pids[i]=fork();
+		if (pids[i]==0){
+			close(sv[0]);
+			close(ls);
+			tcp_reactor_idx=i;
+			bench_reader_pass(sv[1]);
+			exit(0);
+		}
+		close(sv[1]);
+		unix_socks[i]=sv[0];
+	}
+	pids[bench_readers]=fork();
+	if (pids[bench_readers]==0){
+		bench_main(ls, unix_socks);
+		exit(0);
+	}
+	close(ls);
+	t=bench_run(n);
+	bench_stop(pids, bench_readers+1);
+	for (i=0; i<bench_readers; i++)
+		close(unix_socks[i]);
+	free(unix_socks);
+	free(pids);
+	return t;
+}
+
+static double bench_owned(int n)
+{
+	pid_t* pids;
+	int* ls;
+	int i;
+	double t;
+
+	bench_addr.sin_port=0;
+	ls=calloc(bench_readers, sizeof(int));
+	for (i=0; i<bench_readers; i++)
+		ls[i]=bench_listen(1);
+	pids=calloc(bench_readers, sizeof(pid_t));
+	fflush(stdout);
+	for (i=0; i<bench_readers; i++){
+		pids[i]=fork();
+		if (pids[i]==0){
+			tcp_reactor_idx=i;
+			bench_reader_own(ls[i]);
+			exit(0);
+		}
+	}
+	for (i=0; i<bench_readers; i++)
+		close(ls[i]);
+	t=bench_run(n);
+	bench_stop(pids, bench_readers);
+	free(ls);
+	free(pids);
+	return t;
+}
+
+int main(int argc, char** argv)
+{
+	int n, c;
+	double t[2];
+
+	n=20000;
+	bench_readers=4;
+	bench_clients=8;
+	while((c=getopt(argc, argv, "n:r:c:"))!=-1){
+		switch(c){
+			case 'n':
+				n=atoi(optarg);
+				break;
+			case 'r':
+				bench_readers=atoi(optarg);
+				break;
+			case 'c':
+				bench_clients=atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-n connections] [-r readers]"
+						" [-c clients]\n", argv[0]);
+				return 1;
+		}
+	}
+	if (n<1 || bench_readers<1 || bench_clients<1){
+		fprintf(stderr, "bad parameters\n");
+		return 1;
+	}
+	bench_shm_size=bench_readers*sizeof(struct tcp_reactor)+4096;
+	bench_shm=mmap(0, bench_shm_size, PROT_READ|PROT_WRITE,
+					MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if (bench_shm==MAP_FAILED){
+		perror("mmap");
+		return 1;
+	}
+	if (tcp_reactors_init(bench_readers)<0){
+		fprintf(stderr, "cannot init the reader stats\n");
+		return 1;
+	}
+	memset(&bench_addr, 0, sizeof(bench_addr));
+	bench_addr.sin_family=AF_INET;
+	bench_addr.sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+
+	printf("%d connections, %d readers, %d clients\n", n, bench_readers,
+			bench_clients);
+	t[0]=bench_passed(n);
+	bench_report("accept + send_fd", t[0], n);
+#ifdef SO_REUSEPORT
+	t[1]=bench_owned(n);
+	bench_report("accept in the reader", t[1], n);
+	printf("speedup: %.2fx\n", t[0]/t[1]);
+#else
+	printf("SO_REUSEPORT not supported, accept in the reader skipped\n");
+#endif
+	tcp_reactors_destroy();
+	return 0;
+}
@@ -0,0 +1,310 @@
+/*
+ * tcp reader handoff benchmark: compares how a SIP worker sends on a tcp
+ * connection kept by a reader, as it was before (the worker asks tcp_main
+ * for the fd with CONN_GET_FD, gets it with send_fd()/receive_fd(), writes
+ * and closes it) with tcp_reuse_port (the worker queues the data in the
+ * connection write buffer and hands the connection to the owner reader with
+ * tcp_reactor_push(), the reader writes it).
+ *
+ * The shm allocator is mapped to a shared mapping. The "tcp connections"
+ * are pipes to a drain process, each message is written once in both
+ * cases.
+ *
+ * Run: ./tcp_reactor_bench [-n messages] [-c connections] [-s size]
+ *  -n  number of messages (default 200000)
+ *  -c  number of connections (default 100)
+ *  -s  message size (default 500)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include "bench.h"
+
+/* shared mapping in place of the shm pool */
+#define shm_mem_h
+#define mem_h
+static char* bench_shm;
+static size_t bench_shm_used, bench_shm_size;
+static void* bench_shm_malloc(size_t s)
+{
+	void* p;
+
+	s=(s+15)&~15;
+	if (bench_shm_used+s>bench_shm_size)
+		return 0;
+	p=bench_shm+bench_shm_used;
+	bench_shm_used+=s;
+	return p;
+}
+#define shm_malloc(s) bench_shm_malloc(s)
+#define shm_free(p)
+#define pkg_malloc(s) malloc(s)
+#define pkg_free(p) free(p)
+#define PKG_MEM_ERROR
+#define SHM_MEM_ERROR
+
+#include "../tcp_reactor.c"
+#include "../pass_fd.c"
+
+
+#define BENCH_MAX_MSG 65536
+
+/* a connection with its write buffer */
+struct bench_conn{
+	struct tcp_connection c;
+	int fd;
+	int len;
+	char buf[BENCH_MAX_MSG];
+};
+
+static struct bench_conn* bench_conns;
+static int bench_conns_no;
+static int bench_size;
+static char bench_msg[BENCH_MAX_MSG];
+
+/* reads everything written on the connections */
+static int bench_drain(int* rfd, int n)
+{
+	struct pollfd* pf;
+	char buf[65536];
+	int i, active;
+
+	pf=calloc(n, sizeof(struct pollfd));
+	for (i=0; i<n; i++){
+		pf[i].fd=rfd[i];
+		pf[i].events=POLLIN;
+	}
+	active=n;
+	while(active){
+		if (poll(pf, n, -1)<0)
+			continue;
+		for (i=0; i<n; i++)
+			if (pf[i].revents){
+				if (read(pf[i].fd, buf, sizeof(buf))<=0){
+					pf[i].fd=-1;
+					active--;
+				}
+			}
+	}
+	return 0;
+}
+
+/* tcp_main answering CONN_GET_FD */
+static void bench_main(int unix_sock)
+{
+	long cmd[2];
+	struct bench_conn* bc;
+
+	while(read(unix_sock, cmd, sizeof(cmd))==sizeof(cmd)){
+		bc=&bench_conns[cmd[0]];
+		if (send_fd(unix_sock, &bc, sizeof(bc), bc->fd)<=0)
+			break;
+	}
+}
+
+/* the owner reader, writing the connections handed to it */
+static void bench_reader(int msgs)
+{
+	struct pollfd pf;
+	struct tcp_connection* c;
+	struct bench_conn* bc;
+	int cmds, done, wakeups;
+
+	done=0;
+	wakeups=0;
+	pf.fd=tcp_reactors[tcp_reactor_idx].rd_fd;
+	pf.events=POLLIN;
+	while(done<msgs){
+		if (poll(&pf, 1, -1)<0)
+			continue;
+		wakeups++;
+		tcp_reactor_wakeup_clear();
+		while((c=tcp_reactor_pop(&cmds))){
+			bc=(struct bench_conn*)c;
+			lock_get(&c->write_lock);
+				if (bc->len){
+					if (write(bc->fd, bc->buf, bc->len)!=bc->len)
+						perror("write");
+					done+=bc->len/bench_size;
+					bc->len=0;
+				}
+			lock_release(&c->write_lock);
+			atomic_dec(&c->refcnt);
+		}
+	}
+	printf("  reader: %d wake ups\n", wakeups);
+}
+
+static double bench_classic(int msgs)
+{
+	int sv[2];
+	pid_t pid;
+	long cmd[2];
+	struct bench_conn* bc;
+	double t0, t;
+	int i, fd;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv)<0){
+		perror("socketpair");
+		exit(1);
+	}
+	fflush(stdout);
+	pid=fork();
+	if (pid==0){
+		close(sv[0]);
+		bench_main(sv[1]);
+		exit(0);
+	}
+	close(sv[1]);
+	t0=bench_now_us();
+	for (i=0; i<msgs; i++){
+		cmd[0]=i%bench_conns_no;
+		cmd[1]=0;
+		if (write(sv[0], cmd, sizeof(cmd))!=sizeof(cmd) ||
+				receive_fd(sv[0], &bc, sizeof(bc), &fd, MSG_WAITALL)<=0){
+			fprintf(stderr, "CONN_GET_FD failed\n");
+			exit(1);
+		}
+		if (write(fd, bench_msg, bench_size)!=bench_size)
+			perror("write");
+		close(fd);
+	}
+	t=bench_now_us()-t0;
+	close(sv[0]);
+	waitpid(pid, 0, 0);
+	return t;
+}
+
+static double bench_handoff(int msgs)
+{
+	struct bench_conn* bc;
+	pid_t pid;
+	double t0, t;
+	int i, queued;
+
+	tcp_reactor_idx=0;
+	fflush(stdout);
+	pid=fork();
+	if (pid==0){
+		bench_reader(msgs);
+		exit(0);
+	}
+	tcp_reactor_idx=-1;
+	t0=bench_now_us();
+	for (i=0; i<msgs; i++){
+		bc=&bench_conns[i%bench_conns_no];
+		for(;;){
+			lock_get(&bc->c.write_lock);
+				queued=(bc->len+bench_size<=BENCH_MAX_MSG);
+				if (queued){
+					memcpy(bc->buf+bc->len, bench_msg, bench_size);
+					bc->len+=bench_size;
+				}
+			lock_release(&bc->c.write_lock);
+			if (queued)
+				break;
+			/* write buffer full, let the reader catch up */
+			sched_yield();
+		}
+		tcp_reactor_push(&bc->c, TCP_HO_WRITE);
+	}
+	waitpid(pid, 0, 0);
+	t=bench_now_us()-t0;
+	return t;
+}
+
+int main(int argc, char** argv)
+{
+	int msgs, c, i;
+	int p[2];
+	int* rfd;
+	pid_t drain;
+	double t[2];
+
+	msgs=200000;
+	bench_conns_no=100;
+	bench_size=500;
+	while((c=getopt(argc, argv, "n:c:s:"))!=-1){
+		switch(c){
+			case 'n':
+				msgs=atoi(optarg);
+				break;
+			case 'c':
+				bench_conns_no=atoi(optarg);
+				break;
+			case 's':
+				bench_size=atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-n messages] [-c connections]"
+						" [-s size]\n", argv[0]);
+				return 1;
+		}
+	}
+	if (bench_conns_no<1) bench_conns_no=1;
+	if (bench_size<1 || bench_size>BENCH_MAX_MSG) bench_size=500;
+	memset(bench_msg, 'x', bench_size);
+
+	bench_shm_size=bench_conns_no*sizeof(struct bench_conn)+
+						sizeof(struct tcp_reactor)+4096;
+	bench_shm=mmap(0, bench_shm_size, PROT_READ|PROT_WRITE,
+					MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if (bench_shm==MAP_FAILED){
+		perror("mmap");
+		return 1;
+	}
+	if (tcp_reactors_init(1)<0){
+		fprintf(stderr, "cannot init the handoff queue\n");
+		return 1;
+	}
+	bench_conns=shm_malloc(bench_conns_no*sizeof(struct bench_conn));
+	rfd=calloc(bench_conns_no, sizeof(int));
+	for (i=0; i<bench_conns_no; i++){
+		if (pipe(p)<0){
+			perror("pipe");
+			return 1;
+		}
+		rfd[i]=p[0];
+		bench_conns[i].fd=p[1];
+		bench_conns[i].c.owner=0;
+		atomic_set(&bench_conns[i].c.refcnt, 1);
+		lock_init(&bench_conns[i].c.write_lock);
+	}
+	drain=fork();
+	if (drain==0){
+		for (i=0; i<bench_conns_no; i++)
+			close(bench_conns[i].fd);
+		bench_drain(rfd, bench_conns_no);
+		exit(0);
+	}
+	for (i=0; i<bench_conns_no; i++)
+		close(rfd[i]);
+
+	printf("%d messages of %d bytes on %d connections\n", msgs, bench_size,
+			bench_conns_no);
+	t[0]=bench_classic(msgs);
+	printf("CONN_GET_FD + write   : %10.0f us  %7.3f us/msg\n", t[0],
+			t[0]/msgs);
+	t[1]=bench_handoff(msgs);
+	printf("handoff to the owner  : %10.0f us  %7.3f us/msg"
+			"  (%lu handoffs)\n", t[1], t[1]/msgs, tcp_reactors[0].handoffs);
+	printf("speedup: %.2fx\n", t[0]/t[1]);
+
+	for (i=0; i<bench_conns_no; i++){
+		if (atomic_get(&bench_conns[i].c.refcnt)!=1)
+			printf("BUG: connection %d refcnt %d\n", i,
+					atomic_get(&bench_conns[i].c.refcnt));
+		close(bench_conns[i].fd);
+	}
+	waitpid(drain, 0, 0);
+	tcp_reactors_destroy();
+	return 0;
+}
@@ -0,0 +1,226 @@
+/*
+ * core timer benchmark: SIP workers adding and deleting timers (like tm
+ * does for the retransmission and wait timers of each transaction) while
+ * the timer process runs the expired ones, with one timer shard (one lock,
+ * as before timer_shards) and with more shards.
+ *
+ * The timers are added 0 - 2 s ahead and deleted right after, so some of
+ * them expire before: their handler spins for a while, like a
+ * retransmission does. The timer process ticks faster than real time, so
+ * that it runs often during the benchmark. The shm pool is a shared
+ * mapping, the workers and the timer process are forked.
+ *
+ * Run: ./timer_bench [-p workers] [-n timers] [-r rounds] [-s shards]
+ *                    [-t tick_us] [-w handler_ns]
+ *  -p  number of worker processes (default 4)
+ *  -n  timers of each worker (default 10000)
+ *  -r  rounds of add and delete of all the timers (default 20)
+ *  -s  number of shards compared with one shard (default 8)
+ *  -t  real time between two ticks of the timer process, in usec
+ *      (default 1000, 62500 is real time)
+ *  -w  time spent by the handler of an expired timer, in nsec
+ *      (default 2000)
+ */
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "bench.h"
+
+/* shared mapping in place of the shm pool, reset for each run */
+#define shm_mem_h
+#define mem_h
+static char* bench_shm;
+static size_t bench_shm_size;
+static volatile size_t* bench_shm_used;
+static void* bench_shm_malloc(size_t s)
+{
+	size_t u;
+
+	s=(s+15)&~15;
+	u=__sync_fetch_and_add(bench_shm_used, s);
+	if (u+s>bench_shm_size)
+		return 0;
+	return bench_shm+u;
+}
+#define shm_malloc(s) bench_shm_malloc(s)
+#define shm_free(p)
+#define pkg_malloc(s) malloc(s)
+#define pkg_free(p) free(p)
+#define PKG_MEM_ERROR
+#define SHM_MEM_ERROR
+
+/* no cfg framework, the handlers do not use it */
+#include "../dprint.h"
+#include "../cfg/cfg_struct.h"
+#undef cfg_update
+#undef cfg_reset_all
+#define cfg_update()
+#define cfg_reset_all()
+#define cfg_child_init() 0
+
+#include "../timer.c"
+
+/* stubs for the core */
+int timer_shards=1;
+int slow_timer_pid=0;
+
+static volatile int* bench_done;
+static int bench_handler_ns;
+
+static ticks_t bench_handler(ticks_t t, struct timer_ln* tl, void* p)
+{
+	double t0;
+
+	t0=bench_now_us();
+	while((bench_now_us()-t0)*1000<bench_handler_ns);
+	(*(volatile unsigned long*)p)++;
+	return 0; /* one shot */
+}
+
+/* the timer process: ticks and runs the expired timers */
+static void bench_timer(int tick_us)
+{
+	in_timer=1;
+	while(!*bench_done){
+		(*ticks)++;
+		timer_handler();
+		usleep(tick_us);
+	}
+}
+
+static void bench_worker(int n, int rounds, unsigned long* expired)
+{
+	struct timer_ln* tls;
+	unsigned int seed;
+	int i, r;
+
+	tls=shm_malloc(n*sizeof(*tls));
+	if (tls==0){
+		fprintf(stderr, "out of shm\n");
+		exit(1);
+	}
+	seed=getpid();
+	for (i=0; i<n; i++)
+		timer_init(&tls[i], bench_handler, expired, F_TIMER_FAST);
+	for (r=0; r<rounds; r++){
+		for (i=0; i<n; i++){
+			timer_reinit(&tls[i]);
+			if (timer_add(&tls[i], 1+rand_r(&seed)%(2*TIMER_TICKS_HZ))<0){
+				fprintf(stderr, "timer_add failed\n");
+				exit(1);
+			}
+		}
+		for (i=0; i<n; i++)
+			timer_del(&tls[i]); /* -1 if already expired */
+	}
+}
+
+static double bench_run(int shards, int procs, int n, int rounds,
+		int tick_us, unsigned long* expired)
+{
+	pid_t tpid;
+	double t0, t;
+	int i, st;
+
+	*bench_shm_used=64;
+	timer_shards=shards;
+	if (init_timer()<0){
+		fprintf(stderr, "cannot init the timer\n");
+		exit(1);
+	}
+	*expired=0;
+	*bench_done=0;
+	fflush(stdout);
+	tpid=fork();
+	if (tpid==0){
+		bench_timer(tick_us);
+		exit(0);
+	}
+	t0=bench_now_us();
+	for (i=0; i<procs; i++){
+		if (fork()==0){
+			process_no=i+1;
+			bench_worker(n, rounds, expired);
+			exit(0);
+		}
+	}
+	for (i=0; i<procs; i++)
+		if (wait(&st)<0 || !WIFEXITED(st) || WEXITSTATUS(st)!=0){
+			fprintf(stderr, "worker failed\n");
+			exit(1);
+		}
+	t=bench_now_us()-t0;
+	*bench_done=1;
+	waitpid(tpid, 0, 0);
+	return t;
+}
+
+int main(int argc, char** argv)
+{
+	int procs, n, rounds, shards, tick_us;
+	unsigned long* expired;
+	double t[2];
+	int c, k;
+
+	procs=4;
+	n=10000;
+	rounds=20;
+	shards=8;
+	tick_us=1000;
+	bench_handler_ns=2000;
+	while((c=getopt(argc, argv, "p:n:r:s:t:w:"))!=-1){
+		switch(c){
+			case 'p':
+				procs=atoi(optarg);
+				break;
+			case 'n':
+				n=atoi(optarg);
+				break;
+			case 'r':
+				rounds=atoi(optarg);
+				break;
+			case 's':
+				shards=atoi(optarg);
+				break;
+			case 't':
+				tick_us=atoi(optarg);
+				break;
+			case 'w':
+				bench_handler_ns=atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-p workers] [-n timers]"
+						" [-r rounds] [-s shards] [-t tick_us]"
+						" [-w handler_ns]\n", argv[0]);
+				return 1;
+		}
+	}
+	if (procs<1) procs=1;
+	if (n<1) n=1;
+	if (rounds<1) rounds=1;
+	if (shards<1 || shards>TIMER_SHARDS_MAX) shards=8;
+
+	bench_shm_size=(size_t)procs*n*sizeof(struct timer_ln)+
+		TIMER_SHARDS_MAX*sizeof(struct timer_lists)+(1<<20);
+	bench_shm=mmap(0, bench_shm_size, PROT_READ|PROT_WRITE,
+					MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if (bench_shm==MAP_FAILED){
+		perror("mmap");
+		return 1;
+	}
+	/* the first bytes keep the state shared with the forked processes */
+	bench_shm_used=(volatile size_t*)bench_shm;
+	bench_done=(volatile int*)(bench_shm+sizeof(size_t));
+	expired=(unsigned long*)(bench_shm+2*sizeof(size_t));
+
+	printf("%d workers x %d timers x %d rounds, tick every %d us,"
+			" handler %d ns\n", procs, n, rounds, tick_us, bench_handler_ns);
+	printf("shards   total (ms)   add+del (ns)   expired\n");
+	for (k=0; k<2; k++){
+		t[k]=bench_run(k?shards:1, procs, n, rounds, tick_us, expired);
+		printf("%6d %12.1f %14.1f %9lu\n", timer_shards_no, t[k]/1000,
+				t[k]*1000/((double)procs*n*rounds), *expired);
+	}
+	printf("speedup: %.2fx\n", t[0]/t[1]);
+	return 0;
+}
@@ -0,0 +1,241 @@
+/*
+ * usrloc bulk write check: queues contacts for the write-back bulk write
+ * with a fake database module and checks that:
+ *  - the queued rows are copies, written as they were when queued;
+ *  - the queue is written with statements of at most db_bulk_size rows;
+ *  - when a statement fails, its contacts are written one by one (insert
+ *    for the new ones, update by ruid for the others) and the ones that
+ *    still fail get back their old state;
+ *  - the row of a contact removed while the queue was written is deleted
+ *    again;
+ *  - without bulk insert-update in the database module, the contacts are
+ *    not queued and take the usual one by one way.
+ *
+ * Run: ./usrloc_bulk_check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#define BENCH_MALLOC
+#include "bench.h"
+
+#include "../modules/usrloc/ucontact.c"
+
+/* stubs for the core and the module */
+char ut_buf_int2str[INT2STR_MAX_LEN];
+unsigned int _ul_max_partition = 0;
+int db_mode = WRITE_BACK;
+int desc_time_order = 0;
+int matching_mode = CONTACT_ONLY;
+unsigned int nat_bflag = (unsigned int)-1;
+int ul_db_bulk_size = 2;
+int ul_db_check_update = 0;
+int ul_db_insert_null = 0;
+int ul_db_ops_ruid = 1;
+int ul_db_update_as_insert = 0;
+int ul_expires_type = 0;
+int use_domain = 0;
+str ul_xavp_contact_name = {0, 0};
+struct ulcb_head_list* ulcb_list = 0;
+db1_con_t* ul_dbh = 0;
+db_func_t ul_dbf;
+str user_col = str_init("username");
+str domain_col = str_init("domain");
+str contact_col = str_init("contact");
+str expires_col = str_init("expires");
+str q_col = str_init("q");
+str callid_col = str_init("callid");
+str cseq_col = str_init("cseq");
+str flags_col = str_init("flags");
+str cflags_col = str_init("cflags");
+str user_agent_col = str_init("user_agent");
+str received_col = str_init("received");
+str path_col = str_init("path");
+str sock_col = str_init("socket");
+str methods_col = str_init("methods");
+str instance_col = str_init("instance");
+str reg_id_col = str_init("reg_id");
+str srv_id_col = str_init("server_id");
+str con_id_col = str_init("connection_id");
+str keepalive_col = str_init("keepalive");
+str partition_col = str_init("partition");
+str last_mod_col = str_init("last_modified");
+str ruid_col = str_init("ruid");
+str ulattrs_user_col = str_init("username");
+str ulattrs_domain_col = str_init("domain");
+str ulattrs_ruid_col = str_init("ruid");
+str ulattrs_aname_col = str_init("aname");
+str ulattrs_atype_col = str_init("atype");
+str ulattrs_avalue_col = str_init("avalue");
+str ulattrs_last_mod_col = str_init("last_modified");
+
+unsigned int ul_get_aorhash(str *_aor)
+{
+	return _aor->len;
+}
+sr_xavp_t *xavp_get(str *name, sr_xavp_t *start) { return 0; }
+sr_xavp_t *xavp_clone_level_nodata(sr_xavp_t *xold) { return 0; }
+void xavp_destroy_list(sr_xavp_t **head) { }
+
+/* fake database module */
+static int fail_bulk = 0;
+static char *fail_ruid = 0;
+static int bulk_calls, bulk_rows, inserts, updates, deletes;
+static char written_callid[64];
+
+static int fake_use_table(db1_con_t* _h, const str* _t) { return 0; }
+
+static int fake_insert_update_bulk(const db1_con_t* _h, const db_key_t* _k,
+		const db_val_t* _v, const int _n, const int _nr,
+		const db_key_t* _uk, const int _un)
+{
+	int i;
+
+	bulk_calls++;
+	if (fail_bulk)
+		return -1;
+	bulk_rows += _nr;
+	for (i = 0; i < _n; i++)
+		if (_k[i] == &callid_col)
+			snprintf(written_callid, sizeof(written_callid), "%.*s",
+					_v[i].val.str_val.len, _v[i].val.str_val.s);
+	return 0;
+}
+
+static int fake_insert(const db1_con_t* _h, const db_key_t* _k,
+		const db_val_t* _v, const int _n)
+{
+	inserts++;
+	return 0;
+}
+
+static int fake_update(const db1_con_t* _h, const db_key_t* _k,
+		const db_op_t* _o, const db_val_t* _v, const db_key_t* _uk,
+		const db_val_t* _uv, const int _n, const int _un)
+{
+	int i;
+
+	if (_n != 1 || _k[0] != &ruid_col)
+		return -1;
+	for (i = 0; i < _un; i++)
+		if (_uk[i] == &ruid_col || _uk[i] == &partition_col)
+			return -1;
+	updates++;
+	if (fail_ruid && _v[0].val.str_val.len == strlen(fail_ruid)
+			&& !memcmp(_v[0].val.str_val.s, fail_ruid, strlen(fail_ruid)))
+		return -1;
+	return 0;
+}
+
+static int fake_delete(const db1_con_t* _h, const db_key_t* _k,
+		const db_op_t* _o, const db_val_t* _v, const int _n)
+{
+	deletes++;
+	return 0;
+}
+
+static str dom = str_init("location");
+static str aor = str_init("alice@example.com");
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			printf("FAILED at line %d: %s\n", __LINE__, #cond); \
+			return 1; \
+		} \
+	} while(0)
+
+static void mk_contact(ucontact_t* c, char* ruid, char* callid)
+{
+	memset(c, 0, sizeof(*c));
+	c->domain = &dom;
+	c->aor = &aor;
+	c->c.s = "sip:alice@192.0.2.1";
+	c->c.len = strlen(c->c.s);
+	c->ruid.s = ruid;
+	c->ruid.len = strlen(ruid);
+	c->callid.s = callid;
+	c->callid.len = strlen(callid);
+	c->methods = 0xFFFFFFFF;
+	c->state = CS_SYNC;
+}
+
+int main(int argc, char** argv)
+{
+	urecord_t r;
+	hslot_t s;
+	ucontact_t c[3];
+	char callid[3][16];
+	int i;
+
+	memset(&ul_dbf, 0, sizeof(ul_dbf));
+	ul_dbf.cap = DB_CAP_INSERT_UPDATE_BULK;
+	ul_dbf.use_table = fake_use_table;
+	ul_dbf.insert_update_bulk = fake_insert_update_bulk;
+	ul_dbf.insert = fake_insert;
+	ul_dbf.update = fake_update;
+	ul_dbf.delete = fake_delete;
+
+	memset(&r, 0, sizeof(r));
+	memset(&s, 0, sizeof(s));
+	r.aorhash = ul_get_aorhash(&aor);
+	r.contacts = &c[0];
+	s.first = &r;
+	s.n = 1;
+	for (i = 0; i < 3; i++)
+		snprintf(callid[i], sizeof(callid[i]), "callid-%d", i);
+	mk_contact(&c[0], "ruid-0", callid[0]);
+	mk_contact(&c[1], "ruid-1", callid[1]);
+	mk_contact(&c[2], "ruid-2", callid[2]);
+	c[0].next = &c[1];
+	c[1].next = &c[2];
+
+	/* bulk write of copies, in statements of db_bulk_size rows */
+	CHECK(db_bulk_add_ucontact(&c[0], CS_NEW, 1) == 0);
+	CHECK(db_bulk_add_ucontact(&c[1], CS_DIRTY, 2) == 0);
+	CHECK(db_bulk_add_ucontact(&c[2], CS_DIRTY, 2) == 0);
+	CHECK(db_bulk_nr_ucontacts() == 3);
+	/* changed after the slot is unlocked */
+	strcpy(callid[2], "changed");
+	CHECK(db_bulk_flush_ucontacts() == 0);
+	CHECK(bulk_calls == 2 && bulk_rows == 3);
+	CHECK(strcmp(written_callid, "callid-2") == 0);
+	db_bulk_check_ucontacts(&s);
+	CHECK(db_bulk_nr_ucontacts() == 0);
+	CHECK(deletes == 0 && inserts == 0 && updates == 0);
+	printf("ok: bulk write of the queued copies\n");
+
+	/* failed statements: one by one, the failed contact gets its state */
+	fail_bulk = 1;
+	fail_ruid = "ruid-2";
+	bulk_calls = 0;
+	CHECK(db_bulk_add_ucontact(&c[0], CS_NEW, 1) == 0);
+	CHECK(db_bulk_add_ucontact(&c[1], CS_DIRTY, 2) == 0);
+	CHECK(db_bulk_add_ucontact(&c[2], CS_DIRTY, 2) == 0);
+	CHECK(db_bulk_flush_ucontacts() == 1);
+	CHECK(bulk_calls == 2 && inserts == 1 && updates == 2);
+	db_bulk_check_ucontacts(&s);
+	CHECK(c[0].state == CS_SYNC && c[1].state == CS_SYNC);
+	CHECK(c[2].state == CS_DIRTY);
+	printf("ok: one by one write after a failed statement\n");
+
+	/* contact removed while the queue was written */
+	fail_bulk = 0;
+	fail_ruid = 0;
+	c[2].state = CS_SYNC;
+	CHECK(db_bulk_add_ucontact(&c[2], CS_DIRTY, 2) == 0);
+	CHECK(db_bulk_flush_ucontacts() == 0);
+	c[1].next = 0;
+	db_bulk_check_ucontacts(&s);
+	CHECK(deletes == 1);
+	printf("ok: removed contact deleted again\n");
+
+	/* database module without bulk insert-update */
+	ul_dbf.cap = 0;
+	CHECK(db_bulk_add_ucontact(&c[0], CS_DIRTY, 2) == -1);
+	CHECK(db_bulk_nr_ucontacts() == 0);
+	printf("ok: not queued without bulk insert-update\n");
+	return 0;
+}
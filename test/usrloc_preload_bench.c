@@ -0,0 +1,349 @@
+/*
+ * usrloc preload benchmark: loads the location table with the real
+ * preload code (preload_all_udomains(), the parts of the table taken by
+ * preload_procs processes) from a fake database module and reports the
+ * load time for each number of processes.
+ *
+ * The fake database generates the rows on the fly. Each fetch of
+ * fetch_rows rows and the query of the highest id wait for the given
+ * times, in place of the network round trip and of the database work, so
+ * the processes overlap them as they would with a real server. With more
+ * than one table, a process waiting for the highest id of a table does not
+ * keep the others from taking the parts of the tables already known.
+ *
+ * The shm allocator is mapped to a shared memory arena, so that the
+ * processes load the same hash table, with the same locks, like the SIP
+ * workers. The freed memory is not reused by the arena.
+ *
+ * Run: ./usrloc_preload_bench [-n contacts] [-t tables] [-p max_procs]
+ *          [-f fetch_rows] [-d fetch_us] [-m max_id_us]
+ *  -n  number of contacts in each table (default 200000)
+ *  -t  number of location tables (default 1)
+ *  -p  loads with 1, 2, 4, ... up to this number of processes (default 4)
+ *  -f  rows per fetch (default 2000, the module default)
+ *  -d  time of a fetch, in us (default 2000)
+ *  -m  time of the highest id query, in us (default 20000)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "bench.h"
+
+/* shared memory arena in place of the shm pool */
+#define shm_mem_h
+#define mem_h
+static char *bench_arena = NULL;
+static unsigned long bench_arena_size = 0;
+static volatile unsigned long *bench_arena_used = NULL;
+static void *bench_shm_malloc(unsigned long size)
+{
+	unsigned long off;
+
+	size = (size + 15) & ~15UL;
+	off = __sync_fetch_and_add(bench_arena_used, size);
+	if (off + size > bench_arena_size)
+		return NULL;
+	return bench_arena + off;
+}
+#define shm_malloc(s) bench_shm_malloc(s)
+#define shm_free(p) do { } while(0)
+#define pkg_malloc(s) malloc(s)
+#define pkg_free(p) free(p)
+#define PKG_MEM_ERROR
+#define SHM_MEM_ERROR
+
+#include "../modules/usrloc/dlist.c"
+#include "../modules/usrloc/udomain.c"
+#include "../modules/usrloc/urecord.c"
+#include "../modules/usrloc/ucontact.c"
+#include "../modules/usrloc/hslot.c"
+
+/* stubs for the core and the module */
+char ut_buf_int2str[INT2STR_MAX_LEN];
+int db_mode = NO_DB;
+int desc_time_order = 0;
+unsigned int nat_bflag = (unsigned int)-1;
+int close_expired_tcp = 0;
+int handle_lost_tcp = 0;
+int ul_db_bulk_size = 0;
+int ul_db_check_update = 0;
+int ul_db_insert_null = 0;
+int ul_db_ops_ruid = 0;
+int ul_db_update_as_insert = 0;
+unsigned int ul_db_srvid = 0;
+int ul_expires_type = 0;
+int ul_fetch_rows = 2000;
+int ul_hash_size = 1<<16; /* the size, as set by mod_init() */
+int ul_keepalive_timeout = 0;
+int use_domain = 0;
+int server_id = 0;
+int unix_tcp_sock = -1;
+time_t act_time;
+str db_url = str_init("fake://");
+str ul_xavp_contact_name = {0, 0};
+struct ulcb_head_list* ulcb_list = 0;
+db1_con_t* ul_dbh = 0;
+db_func_t ul_dbf;
+str id_col = str_init("id");
+str user_col = str_init("username");
+str domain_col = str_init("domain");
+str contact_col = str_init("contact");
+str expires_col = str_init("expires");
+str q_col = str_init("q");
+str callid_col = str_init("callid");
+str cseq_col = str_init("cseq");
+str flags_col = str_init("flags");
+str cflags_col = str_init("cflags");
+str user_agent_col = str_init("user_agent");
+str received_col = str_init("received");
+str path_col = str_init("path");
+str sock_col = str_init("socket");
+str methods_col = str_init("methods");
+str instance_col = str_init("instance");
+str reg_id_col = str_init("reg_id");
+str srv_id_col = str_init("server_id");
+str con_id_col = str_init("connection_id");
+str keepalive_col = str_init("keepalive");
+str partition_col = str_init("partition");
+str last_mod_col = str_init("last_modified");
+str ruid_col = str_init("ruid");
+str ulattrs_user_col = str_init("username");
+str ulattrs_domain_col = str_init("domain");
+str ulattrs_ruid_col = str_init("ruid");
+str ulattrs_aname_col = str_init("aname");
+str ulattrs_atype_col = str_init("atype");
+str ulattrs_avalue_col = str_init("avalue");
+str ulattrs_last_mod_col = str_init("last_modified");
+
+void get_act_time(void) { act_time = time(0); }
+int db_time2str(time_t _v, char* _s, int* _l) { return -1; }
+int db_check_table_version(db_func_t* dbf, db1_con_t* dbh, const str* table,
+		const unsigned int version) { return 0; }
+struct socket_info* grep_sock_info(str* host, unsigned short port,
+		unsigned short proto) { return 0; }
+int parse_phostport(char* s, char** host, int* hlen, int* port, int* proto)
+{ return -1; }
+int send_all(int socket, void* data, int len) { return -1; }
+struct tcp_connection* tcpconn_get(int id, struct ip_addr* ip, int port,
+		union sockaddr_union* local_addr, ticks_t timeout) { return 0; }
+sr_xavp_t *xavp_get(str *name, sr_xavp_t *start) { return 0; }
+sr_xavp_t *xavp_clone_level_nodata(sr_xavp_t *xold) { return 0; }
+void xavp_destroy_list(sr_xavp_t **head) { }
+sr_xavp_t *xavp_add_value(str *name, sr_xval_t *val, sr_xavp_t **list)
+{ return 0; }
+sr_xavp_t *xavp_add_xavp_value(str *rname, str *name, sr_xval_t *val,
+		sr_xavp_t **list) { return 0; }
+
+/* fake database module, the rows of a query are generated by the fetches */
+#define BENCH_COLS 21
+static int bench_rows = 200000;
+static int bench_tables = 1;
+static int bench_fetch_us = 2000;
+static int bench_maxid_us = 20000;
+static long long q_next, q_end; /* ids left of the current query */
+static int q_maxid;
+
+static int fake_use_table(db1_con_t* _h, const str* _t) { return 0; }
+
+static int fake_query(const db1_con_t* _h, const db_key_t* _k,
+		const db_op_t* _op, const db_val_t* _v, const db_key_t* _c,
+		const int _n, const int _nc, const db_key_t _o, db1_res_t** _r)
+{
+	int i;
+
+	q_maxid = (_nc==1 && _c[0]==&id_col);
+	q_next = 1;
+	q_end = bench_rows + 1;
+	for (i = 0; i < _n; i++) {
+		if (_k[i]!=&id_col)
+			continue;
+		if (_op[i]==OP_GEQ && _v[i].val.ll_val > q_next)
+			q_next = _v[i].val.ll_val;
+		if (_op[i]==OP_LT && _v[i].val.ll_val < q_end)
+			q_end = _v[i].val.ll_val;
+	}
+	return 0;
+}
+
+/* a row of the table, with its strings in buf */
+static void bench_row(db_val_t* v, char (*buf)[64], long long id)
+{
+	int i;
+
+	memset(v, 0, BENCH_COLS*sizeof(db_val_t));
+	for (i = 0; i < BENCH_COLS; i++)
+		v[i].nul = 1;
+	snprintf(buf[0], 64, "user%lld", id);
+	snprintf(buf[1], 64, "sip:user%lld@10.%d.%d.%d:5060", id,
+			(int)(id>>16)&255, (int)(id>>8)&255, (int)id&255);
+	snprintf(buf[2], 64, "%016llx@pc33.example.com", id*2654435761ULL);
+	snprintf(buf[3], 64, "uloc-5a1f7b2c-%lld", id);
+	v[0].type = DB1_STRING; v[0].nul = 0; v[0].val.string_val = buf[0];
+	v[1].type = DB1_STRING; v[1].nul = 0; v[1].val.string_val = buf[1];
+	v[2].type = DB1_DATETIME; v[2].nul = 0;
+	v[2].val.time_val = time(0) + 3600;
+	v[3].type = DB1_DOUBLE; v[3].nul = 0; v[3].val.double_val = 1.0;
+	v[4].type = DB1_STRING; v[4].nul = 0; v[4].val.string_val = buf[2];
+	v[5].type = DB1_INT; v[5].nul = 0; v[5].val.int_val = 1;
+	v[6].type = DB1_INT; v[6].nul = 0;
+	v[7].type = DB1_INT; v[7].nul = 0;
+	v[14].type = DB1_STRING; v[14].nul = 0; v[14].val.string_val = buf[3];
+}
+
+static int fake_fetch_result(const db1_con_t* _h, db1_res_t** _r,
+		const int _n)
+{
+	static db1_res_t res;
+	static db_row_t* rows = 0;
+	static db_val_t* vals = 0;
+	static char (*strs)[64] = 0;
+	int i;
+
+	if (rows==0) {
+		rows = malloc(ul_fetch_rows*sizeof(db_row_t));
+		vals = malloc(ul_fetch_rows*BENCH_COLS*sizeof(db_val_t));
+		strs = malloc(ul_fetch_rows*4*64);
+		if (rows==0 || vals==0 || strs==0)
+			return -1;
+	}
+	memset(&res, 0, sizeof(res));
+	RES_ROWS(&res) = rows;
+	*_r = &res;
+	if (q_maxid) {
+		/* highest id, one row */
+		usleep(bench_maxid_us);
+		q_maxid = 0;
+		memset(&vals[0], 0, sizeof(db_val_t));
+		vals[0].type = DB1_BIGINT;
+		vals[0].val.ll_val = bench_rows;
+		ROW_VALUES(&rows[0]) = &vals[0];
+		RES_ROW_N(&res) = 1;
+		q_next = q_end;
+		return 0;
+	}
+	if (q_next>=q_end)
+		return 0;
+	usleep(bench_fetch_us);
+	for (i = 0; i < _n && q_next < q_end; i++, q_next++) {
+		bench_row(&vals[i*BENCH_COLS], &strs[i*4], q_next);
+		ROW_VALUES(&rows[i]) = &vals[i*BENCH_COLS];
+		ROW_N(&rows[i]) = BENCH_COLS;
+	}
+	RES_ROW_N(&res) = i;
+	return 0;
+}
+
+static int fake_free_result(db1_con_t* _h, db1_res_t* _r) { return 0; }
+
+static double bench_load(int procs)
+{
+	udomain_t* d;
+	char name[32];
+	int i;
+	unsigned long n;
+
+	*bench_arena_used = 0;
+	root = 0;
+	_ul_preload = NULL;
+	if (ul_init_locks() < 0) {
+		fprintf(stderr, "cannot create the locks\n");
+		exit(1);
+	}
+	for (i = 0; i < bench_tables; i++) {
+		snprintf(name, sizeof(name), "location%d", i);
+		if (register_udomain(name, &d) < 0) {
+			fprintf(stderr, "cannot create the domain\n");
+			exit(1);
+		}
+	}
+	if (ul_init_preload() < 0) {
+		fprintf(stderr, "cannot init the preload\n");
+		exit(1);
+	}
+	db_mode = WRITE_BACK;
+	fflush(stdout);
+	for (i = 0; i < procs; i++) {
+		if (fork()==0) {
+			if (preload_all_udomains(0, procs) < 0)
+				exit(1);
+			exit(0);
+		}
+	}
+	for (i = 0; i < procs; i++)
+		wait(0);
+	db_mode = NO_DB;
+	n = (unsigned long)bench_rows * bench_tables;
+	if (ul_get_preload_contacts()!=n)
+		fprintf(stderr, "loaded %lu contacts of %lu\n",
+				ul_get_preload_contacts(), n);
+	return ul_get_preload_time();
+}
+
+int main(int argc, char** argv)
+{
+	int procs, max_procs;
+	int c;
+
+	max_procs = 4;
+	while((c = getopt(argc, argv, "n:t:p:f:d:m:")) != -1) {
+		switch(c) {
+			case 'n':
+				bench_rows = atoi(optarg);
+				break;
+			case 't':
+				bench_tables = atoi(optarg);
+				break;
+			case 'p':
+				max_procs = atoi(optarg);
+				break;
+			case 'f':
+				ul_fetch_rows = atoi(optarg);
+				break;
+			case 'd':
+				bench_fetch_us = atoi(optarg);
+				break;
+			case 'm':
+				bench_maxid_us = atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-n contacts] [-t tables]"
+						" [-p max_procs] [-f fetch_rows] [-d fetch_us]"
+						" [-m max_id_us]\n", argv[0]);
+				return 1;
+		}
+	}
+	if (bench_rows<1 || bench_tables<1 || max_procs<1 || ul_fetch_rows<1) {
+		fprintf(stderr, "bad parameters\n");
+		return 1;
+	}
+	bench_arena_size = (unsigned long)bench_rows * bench_tables * 1024
+		+ 64*1024*1024;
+	bench_arena = mmap(0, bench_arena_size + 64, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (bench_arena==MAP_FAILED) {
+		fprintf(stderr, "cannot map the arena\n");
+		return 1;
+	}
+	bench_arena_used = (volatile unsigned long*)(bench_arena
+			+ bench_arena_size);
+
+	memset(&ul_dbf, 0, sizeof(ul_dbf));
+	ul_dbf.cap = DB_CAP_QUERY | DB_CAP_FETCH;
+	ul_dbf.use_table = fake_use_table;
+	ul_dbf.query = fake_query;
+	ul_dbf.fetch_result = fake_fetch_result;
+	ul_dbf.free_result = fake_free_result;
+
+	printf("%d tables of %d contacts, %d rows per fetch of %d us,"
+			" highest id query %d us\n", bench_tables, bench_rows,
+			ul_fetch_rows, bench_fetch_us, bench_maxid_us);
+	for (procs = 1; procs <= max_procs; procs *= 2)
+		printf("preload_procs %2d: %8.0f ms\n", procs, bench_load(procs));
+	return 0;
+}
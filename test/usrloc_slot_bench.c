@@ -0,0 +1,203 @@
+/*
+ * usrloc slot lock benchmark: reader processes take shared access to the
+ * hash slots (slot_rlock(), as the registrar lookups) while writer
+ * processes take exclusive access (slot_wlock(), as the saves and the
+ * timer), and reports the operations per second of each side and how long
+ * the writers waited for the slot.
+ *
+ * With -o the writers wait for the readers while holding the slot lock,
+ * as before slot_wlock() released it while waiting.
+ *
+ * Run: ./usrloc_slot_bench [-r readers] [-w writers] [-s slots] [-l ops]
+ *          [-R read_ns] [-W write_ns] [-o]
+ *  -r  number of reader processes (default 4)
+ *  -w  number of writer processes (default 2)
+ *  -s  number of slots the processes pick from (default 1, all on one)
+ *  -l  operations per process (default 200000)
+ *  -R  time spent holding the shared access, in ns (default 200)
+ *  -W  time spent holding the exclusive access, in ns (default 500)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "bench.h"
+
+#include "../modules/usrloc/hslot.h"
+
+struct bench_res {
+	double us;        /* time for all the operations */
+	double wait_us;   /* writers: total time waiting for the slot */
+	double max_wait_us;
+};
+
+static hslot_t *slots;
+static gen_lock_t *locks;
+static int old_wlock = 0;
+
+/* the writer waits for the readers holding the slot lock */
+static void bench_wlock_held(hslot_t *s)
+{
+	int i;
+
+	lock_get(s->lock);
+	s->writer = 1;
+	membar();
+	for(i = 0; atomic_get(&s->readers); i++) {
+		if(i >= UL_SLOT_SPINS)
+			sched_yield();
+	}
+	membar();
+}
+
+static void spin_ns(int ns)
+{
+	double t0;
+
+	if(ns <= 0)
+		return;
+	t0 = bench_now_us();
+	while((bench_now_us() - t0) * 1000.0 < ns)
+		;
+}
+
+static void reader(int l, int nslots, int hold, struct bench_res *r)
+{
+	double t0;
+	int i;
+
+	srandom(getpid());
+	t0 = bench_now_us();
+	for(i = 0; i < l; i++) {
+		hslot_t *s = &slots[random() % nslots];
+		slot_rlock(s);
+		spin_ns(hold);
+		slot_runlock(s);
+	}
+	r->us = bench_now_us() - t0;
+}
+
+static void writer(int l, int nslots, int hold, struct bench_res *r)
+{
+	double t0, t1, w;
+	int i;
+
+	srandom(getpid());
+	t0 = bench_now_us();
+	for(i = 0; i < l; i++) {
+		hslot_t *s = &slots[random() % nslots];
+		t1 = bench_now_us();
+		if(old_wlock)
+			bench_wlock_held(s);
+		else
+			slot_wlock(s);
+		w = bench_now_us() - t1;
+		r->wait_us += w;
+		if(w > r->max_wait_us)
+			r->max_wait_us = w;
+		s->n++;
+		spin_ns(hold);
+		slot_wunlock(s);
+	}
+	r->us = bench_now_us() - t0;
+}
+
+int main(int argc, char **argv)
+{
+	struct bench_res *res;
+	double rops, wops, wait_us, max_wait;
+	int readers, writers, nslots, l, rhold, whold;
+	int c, i;
+
+	readers = 4;
+	writers = 2;
+	nslots = 1;
+	l = 200000;
+	rhold = 200;
+	whold = 500;
+	while((c = getopt(argc, argv, "r:w:s:l:R:W:o")) != -1) {
+		switch(c) {
+			case 'r':
+				readers = atoi(optarg);
+				break;
+			case 'w':
+				writers = atoi(optarg);
+				break;
+			case 's':
+				nslots = atoi(optarg);
+				break;
+			case 'l':
+				l = atoi(optarg);
+				break;
+			case 'R':
+				rhold = atoi(optarg);
+				break;
+			case 'W':
+				whold = atoi(optarg);
+				break;
+			case 'o':
+				old_wlock = 1;
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-r readers] [-w writers]"
+						" [-s slots] [-l ops] [-R read_ns] [-W write_ns]"
+						" [-o]\n", argv[0]);
+				return 1;
+		}
+	}
+	if(nslots < 1 || readers < 0 || writers < 0) {
+		fprintf(stderr, "bad parameters\n");
+		return 1;
+	}
+	slots = mmap(0, nslots * sizeof(hslot_t) + nslots * sizeof(gen_lock_t)
+			+ (readers + writers) * sizeof(struct bench_res),
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(slots == MAP_FAILED) {
+		fprintf(stderr, "cannot map the slots\n");
+		return 1;
+	}
+	locks = (gen_lock_t *)(slots + nslots);
+	res = (struct bench_res *)(locks + nslots);
+	for(i = 0; i < nslots; i++) {
+		lock_init(&locks[i]);
+		slots[i].lock = &locks[i];
+		slots[i].writer = 0;
+		atomic_set(&slots[i].readers, 0);
+	}
+
+	for(i = 0; i < readers + writers; i++) {
+		if(fork() == 0) {
+			if(i < readers)
+				reader(l, nslots, rhold, &res[i]);
+			else
+				writer(l, nslots, whold, &res[i]);
+			exit(0);
+		}
+	}
+	for(i = 0; i < readers + writers; i++)
+		wait(0);
+
+	rops = wops = wait_us = max_wait = 0;
+	for(i = 0; i < readers + writers; i++) {
+		if(i < readers) {
+			rops += l / (res[i].us / 1000000.0);
+		} else {
+			wops += l / (res[i].us / 1000000.0);
+			wait_us += res[i].wait_us;
+			if(res[i].max_wait_us > max_wait)
+				max_wait = res[i].max_wait_us;
+		}
+	}
+	printf("%s, %d readers, %d writers, %d slots, %d ops each\n",
+			old_wlock ? "slot lock held while waiting for the readers"
+					  : "slot lock released while waiting for the readers",
+			readers, writers, nslots, l);
+	printf("reads:  %10.0f ops/s\n", rops);
+	printf("writes: %10.0f ops/s, wait %.2f us avg, %.0f us max\n", wops,
+			writers ? wait_us / ((double)writers * l) : 0.0, max_wait);
+	return 0;
+}
@@ -71,17 +71,18 @@ static struct timeval start_time; /* for debugging */
 static volatile int run_timer=0;
 static int timer_id=0;
 
-static gen_lock_t* timer_lock=0;
+static gen_lock_set_t* timer_locks=0; /* one lock per timer shard */
 static struct timer_ln* volatile* running_timer=0;/* running timer handler */
 static int in_timer=0;
 
 #define IS_IN_TIMER() (in_timer)
 
-#define LOCK_TIMER_LIST()		lock_get(timer_lock)
-#define UNLOCK_TIMER_LIST()		lock_release(timer_lock)
+#define LOCK_TIMER_LIST(s)		lock_set_get(timer_locks, (s))
+#define UNLOCK_TIMER_LIST(s)	lock_set_release(timer_locks, (s))
 
 /* we can get away without atomic_set/atomic_cmp and write barriers because we
- * always call SET_RUNNING and IS_RUNNING while holding the timer lock
+ * always call SET_RUNNING and IS_RUNNING while holding the timer lock of the
+ * timer shard (only one timer handler runs at a given time)
  * => it's implicitly atomic and the lock acts as write barrier */
 #define SET_RUNNING(t)		(*running_timer=(t))
 #define IS_RUNNING(t)		(*running_timer==(t))
@@ -100,6 +101,8 @@ static int in_timer=0;
 
 
 static gen_lock_t*  slow_timer_lock; /* slow timer lock */
+/* SLOW_LISTS_NO lists for each timer shard, a shard adds only to its own
+ * lists (under its lock) */
 static struct timer_head* slow_timer_lists; 
 static volatile unsigned short* t_idx; /* "main" timer index in slow_lists[] */
 static volatile unsigned short* s_idx; /* "slow" timer index in slow_lists[] */
@@ -121,7 +124,12 @@ static int in_slow_timer=0;
 #endif
 
 
-struct timer_lists* timer_lst=0;
+struct timer_lists* timer_lst=0; /* timer_shards_no timer lists */
+unsigned int timer_shards_no=1;
+
+#ifdef USE_SLOW_TIMER
+#define SLOW_LIST(s, i)	(&slow_timer_lists[(s)*SLOW_LISTS_NO+(i)])
+#endif
 
 void sig_timer(int signo)
 {
@@ -142,10 +150,10 @@ void destroy_timer()
 	memset(&it, 0, sizeof(it));
 	setitimer(ITIMER_REAL, &it, 0); 
 	set_sig_h(SIGALRM, SIG_IGN);
-	if (timer_lock){
-		lock_destroy(timer_lock);
-		lock_dealloc(timer_lock);
-		timer_lock=0;
+	if (timer_locks){
+		lock_set_destroy(timer_locks);
+		lock_set_dealloc(timer_locks);
+		timer_locks=0;
 	}
 	if (ticks){
 #ifdef SHM_MEM
@@ -198,31 +206,42 @@ void destroy_timer()
 int init_timer()
 {
 	int r;
+	int s;
 	int ret;
 	
 	ret=-1;
 	
+	if (timer_shards<1 || timer_shards>TIMER_SHARDS_MAX){
+		LM_ERR("invalid timer_shards value %d (1 - %d)\n",
+				timer_shards, TIMER_SHARDS_MAX);
+		goto error;
+	}
+	/* power of 2, for a fast shard selection */
+	for (timer_shards_no=1; (timer_shards_no<<1)<=timer_shards;
+			timer_shards_no<<=1);
+	if (timer_shards_no!=timer_shards)
+		LM_WARN("timer_shards not a power of 2, using %u\n", timer_shards_no);
 	/* init the locks */
-	timer_lock=lock_alloc();
-	if (timer_lock==0){
+	timer_locks=lock_set_alloc(timer_shards_no);
+	if (timer_locks==0){
 		ret=E_OUT_OF_MEM;
 		goto error;
 	}
-	if (lock_init(timer_lock)==0){
-		lock_dealloc(timer_lock);
-		timer_lock=0;
+	if (lock_set_init(timer_locks)==0){
+		lock_set_dealloc(timer_locks);
+		timer_locks=0;
 		ret=-1;
 		goto error;
 	}
 	/* init the shared structs */
 #ifdef SHM_MEM
 	ticks=shm_malloc(sizeof(ticks_t));
-	timer_lst=shm_malloc(sizeof(struct timer_lists));
+	timer_lst=shm_malloc(timer_shards_no*sizeof(struct timer_lists));
 #else
 	/* in this case get_ticks won't work! */
 	LM_WARN("no shared memory support compiled in get_ticks won't work\n");
 	ticks=pkg_malloc(sizeof(ticks_t));
-	timer_lst=pkg_malloc(sizeof(struct timer_lists));
+	timer_lst=pkg_malloc(timer_shards_no*sizeof(struct timer_lists));
 #endif
 	if (ticks==0){
 		LM_CRIT("out of shared memory (ticks)\n");
@@ -242,7 +261,7 @@ int init_timer()
 	}
 
 	/* initial values */
-	memset(timer_lst, 0, sizeof(struct timer_lists));
+	memset(timer_lst, 0, timer_shards_no*sizeof(struct timer_lists));
 	*ticks=random(); /* random value for start, for debugging */
 	prev_ticks=last_ticks=last_adj_check=*ticks;
 	*running_timer=0;
@@ -255,13 +274,15 @@ int init_timer()
 	LM_DBG("starting with *ticks=%u\n", (unsigned) *ticks);
 	
 	/* init timer structures */
-	for (r=0; r<H0_ENTRIES; r++)
-		_timer_init_list(&timer_lst->h0[r]);
-	for (r=0; r<H1_ENTRIES; r++)
-		_timer_init_list(&timer_lst->h1[r]);
-	for (r=0; r<H2_ENTRIES; r++)
-		_timer_init_list(&timer_lst->h2[r]);
-	_timer_init_list(&timer_lst->expired);
+	for (s=0; s<timer_shards_no; s++){
+		for (r=0; r<H0_ENTRIES; r++)
+			_timer_init_list(&timer_lst[s].h0[r]);
+		for (r=0; r<H1_ENTRIES; r++)
+			_timer_init_list(&timer_lst[s].h1[r]);
+		for (r=0; r<H2_ENTRIES; r++)
+			_timer_init_list(&timer_lst[s].h2[r]);
+		_timer_init_list(&timer_lst[s].expired);
+	}
 	
 #ifdef USE_SLOW_TIMER
 	
@@ -279,7 +300,8 @@ int init_timer()
 	}
 	t_idx=shm_malloc(sizeof(*t_idx));
 	s_idx=shm_malloc(sizeof(*s_idx));
-	slow_timer_lists=shm_malloc(sizeof(struct timer_head)*SLOW_LISTS_NO);
+	slow_timer_lists=shm_malloc(sizeof(struct timer_head)*SLOW_LISTS_NO*
+									timer_shards_no);
 	running_timer2=shm_malloc(sizeof(struct timer_ln*));
 	if ((t_idx==0)||(s_idx==0) || (slow_timer_lists==0) ||(running_timer2==0)){
 		LM_ERR("out of shared memory (slow)\n");
@@ -288,13 +310,14 @@ int init_timer()
 	}
 	*t_idx=*s_idx=0;
 	*running_timer2=0;
-	for (r=0; r<SLOW_LISTS_NO; r++)
+	for (r=0; r<SLOW_LISTS_NO*timer_shards_no; r++)
 		_timer_init_list(&slow_timer_lists[r]);
 	
 #endif
 	
-	LM_DBG("timer_list between %p and %p\n",
-			&timer_lst->h0[0], &timer_lst->h2[H2_ENTRIES]);
+	LM_DBG("timer_list between %p and %p (%u shards)\n",
+			&timer_lst[0].h0[0], &timer_lst[timer_shards_no-1].h2[H2_ENTRIES],
+			timer_shards_no);
 	return 0;
 error:
 	destroy_timer();
@@ -520,7 +543,8 @@ void timer_free(struct timer_ln* t)
 }
 
 
-/* unsafe (no lock ) timer add function
+/* unsafe (no lock ) timer add function, the lock of the timer shard
+ * (timer_shard(tl)) must be held
  * t = current ticks
  * tl must be filled (the intial_timeout and flags must be set)
  * returns -1 on error, 0 on success */
@@ -534,7 +558,7 @@ static inline int _timer_add(ticks_t t, struct timer_ln* tl)
 #endif
 	delta=tl->initial_timeout;
 	tl->expire=t+delta;
-	return _timer_dist_tl(tl, delta);
+	return _timer_dist_tl(&timer_lst[timer_shard(tl)], tl, delta);
 }
 
 
@@ -555,8 +579,10 @@ int timer_add_safe(struct timer_ln* tl, ticks_t delta)
 #endif
 {
 	int ret;
+	unsigned int s;
 	
-	LOCK_TIMER_LIST();
+	s=timer_shard(tl);
+	LOCK_TIMER_LIST(s);
 	if (tl->flags & F_TIMER_ACTIVE){
 #ifdef TIMER_DEBUG
 		LOG(timerlog, "timer_add called on an active timer %p (%p, %p),"
@@ -592,7 +618,7 @@ int timer_add_safe(struct timer_ln* tl, ticks_t delta)
 #endif
 	ret=_timer_add(*ticks, tl);
 error:
-	UNLOCK_TIMER_LIST();
+	UNLOCK_TIMER_LIST(s);
 	return ret;
 }
 
@@ -611,8 +637,10 @@ int timer_del_safe(struct timer_ln* tl)
 #endif
 {
 	int ret;
+	unsigned int s;
 	
 	ret=-1;
+	s=timer_shard(tl);
 again:
 	/* quick exit if timer inactive */
 	if ( !(tl->flags & F_TIMER_ACTIVE)){
@@ -705,15 +733,15 @@ again:
 			UNLOCK_SLOW_TIMER_LIST();
 		}else{
 #endif
-			LOCK_TIMER_LIST();
+			LOCK_TIMER_LIST(s);
 #ifdef USE_SLOW_TIMER
 			if (IS_ON_SLOW_LIST(tl) && (tl->slow_idx!=*t_idx)){
-				UNLOCK_TIMER_LIST();
+				UNLOCK_TIMER_LIST(s);
 				goto again;
 			}
 #endif
 			if (IS_RUNNING(tl)){
-				UNLOCK_TIMER_LIST();
+				UNLOCK_TIMER_LIST(s);
 				if (IS_IN_TIMER()){
 					/* if somebody tries to shoot himself in the foot,
 					 * warn him and ignore the delete */
@@ -772,7 +800,7 @@ again:
 #endif
 				ret=-1;
 			}
-			UNLOCK_TIMER_LIST();
+			UNLOCK_TIMER_LIST(s);
 #ifdef USE_SLOW_TIMER
 		}
 #endif
@@ -808,11 +836,13 @@ void timer_allow_del(void)
 }
 
 
-/* called from timer_handle, must be called with the timer lock held
+/* called from timer_handle, must be called with the lock of the timer
+ * shard s held
  * WARNING: expired one shot timers are _not_ automatically reinit
  *          (because they could have been already freed from the timer
  *           handler so a reinit would not be safe!) */
-inline static void timer_list_expire(ticks_t t, struct timer_head* h
+inline static void timer_list_expire(unsigned int s, ticks_t t,
+										struct timer_head* h
 #ifdef USE_SLOW_TIMER
 										, struct timer_head* slow_l,
 										slow_idx_t slow_mark
@@ -869,16 +899,16 @@ inline static void timer_list_expire(ticks_t t, struct timer_head* h
 #ifdef TIMER_DEBUG
 			tl->expires_no++;
 #endif
-			UNLOCK_TIMER_LIST(); /* acts also as write barrier */ 
+			UNLOCK_TIMER_LIST(s); /* acts also as write barrier */ 
 				ret=tl->f(t, tl, tl->data);
 				/* reset the configuration group handles */
 				cfg_reset_all();
 				if (ret==0){
 					UNSET_RUNNING();
-					LOCK_TIMER_LIST();
+					LOCK_TIMER_LIST(s);
 				}else{
 					/* not one-shot, re-add it */
-					LOCK_TIMER_LIST();
+					LOCK_TIMER_LIST(s);
 					if (ret!=(ticks_t)-1) /* ! periodic */
 						tl->initial_timeout=ret;
 					_timer_add(t, tl);
@@ -906,6 +936,9 @@ inline static void timer_list_expire(ticks_t t, struct timer_head* h
 static void timer_handler(void)
 {
 	ticks_t saved_ticks;
+	ticks_t start_ticks;
+	ticks_t t;
+	unsigned int s;
 #ifdef USE_SLOW_TIMER
 	int run_slow_timer;
 	int i;
@@ -919,33 +952,43 @@ static void timer_handler(void)
 	*/
 	run_timer=0; /* reset run_timer */
 	adjust_ticks();
-	LOCK_TIMER_LIST();
-	do{
-		saved_ticks=*ticks; /* protect against time running backwards */
-		if (prev_ticks>=saved_ticks){
-			LM_CRIT("backwards or still time\n");
-			/* try to continue */
-			prev_ticks=saved_ticks-1;
-			break;
-		}
+	saved_ticks=*ticks; /* protect against time running backwards */
+	if (prev_ticks>=saved_ticks){
+		LM_CRIT("backwards or still time\n");
+		/* try to continue */
+		prev_ticks=saved_ticks-1;
+	}
+	start_ticks=prev_ticks+1;
+	prev_ticks=saved_ticks;
+	/* the shards are run one after the other, holding only the lock of
+	 * the current one, so that timer_add/timer_del on the other shards
+	 * are not blocked; if *ticks changes meanwhile, run_timer is set again
+	 * and the next timer_handler call will catch up */
+	for (s=0; s<timer_shards_no; s++){
+		LOCK_TIMER_LIST(s);
 		/* go through all the "missed" ticks, taking a possible overflow
 		 * into account */
-		for (prev_ticks=prev_ticks+1; prev_ticks!=saved_ticks; prev_ticks++) 
-			timer_run(prev_ticks);
-		timer_run(prev_ticks); /* do it for saved_ticks too */
-	}while(saved_ticks!=*ticks); /* in case *ticks changed */
+		for (t=start_ticks; t!=saved_ticks; t++)
+			timer_run(&timer_lst[s], t);
+		timer_run(&timer_lst[s], t); /* do it for saved_ticks too */
 #ifdef USE_SLOW_TIMER
-	timer_list_expire(*ticks, &timer_lst->expired, &slow_timer_lists[i],
-						*t_idx);
+		timer_list_expire(s, *ticks, &timer_lst[s].expired, SLOW_LIST(s, i),
+							*t_idx);
+		if (SLOW_LIST(s, i)->next!=(struct timer_ln*)SLOW_LIST(s, i))
+			run_slow_timer=1;
 #else
-	timer_list_expire(*ticks, &timer_lst->expired);
+		timer_list_expire(s, *ticks, &timer_lst[s].expired);
 #endif
-	/* WARNING: add_timer(...,0) must go directly to expired list, since
-	 * otherwise there is a race between timer running and adding it
-	 * (it could expire it H0_ENTRIES ticks later instead of 'now')*/
+		/* WARNING: add_timer(...,0) must go directly to expired list, since
+		 * otherwise there is a race between timer running and adding it
+		 * (it could expire it H0_ENTRIES ticks later instead of 'now')*/
+		UNLOCK_TIMER_LIST(s);
+	}
 #ifdef USE_SLOW_TIMER
-	if (slow_timer_lists[i].next!=(struct timer_ln*)&slow_timer_lists[i]){
-		run_slow_timer=1;
+	if (run_slow_timer){
+		/* timer_del checks *t_idx under the lock of the timer shard */
+		for (s=0; s<timer_shards_no; s++)
+			LOCK_TIMER_LIST(s);
 		if ((slow_idx_t)(*t_idx-*s_idx) < (SLOW_LISTS_NO-1U))
 			(*t_idx)++;
 		else{
@@ -953,13 +996,11 @@ static void timer_handler(void)
 					*t_idx, *s_idx, *t_idx-*s_idx);
 			/* trying to continue */
 		}
-	}
-#endif
-	UNLOCK_TIMER_LIST();
-#ifdef USE_SLOW_TIMER
-	/* wake up the "slow" timer */
-	if (run_slow_timer)
+		for (s=0; s<timer_shards_no; s++)
+			UNLOCK_TIMER_LIST(s);
+		/* wake up the "slow" timer */
 		kill(slow_timer_pid, SLOW_TIMER_SIG);
+	}
 #endif
 }
 
@@ -1079,7 +1120,10 @@ void slow_timer_main()
 	int n;
 	ticks_t ret;
 	struct timer_ln* tl;
+	struct timer_head* h;
 	unsigned short i;
+	unsigned int s;
+	unsigned int ts;
 #ifdef USE_SIGWAIT
 	int sig;
 #endif
@@ -1117,34 +1161,37 @@ void slow_timer_main()
 		LOCK_SLOW_TIMER_LIST();
 		while(*s_idx!=*t_idx){
 			i= *s_idx%SLOW_LISTS_NO;
-			while(slow_timer_lists[i].next!=
-					(struct timer_ln*)&slow_timer_lists[i]){
-				tl=slow_timer_lists[i].next;
-				_timer_rm_list(tl);
-				tl->next=tl->prev=0;
+			for (s=0; s<timer_shards_no; s++){
+				h=SLOW_LIST(s, i);
+				while(h->next!=(struct timer_ln*)h){
+					tl=h->next;
+					_timer_rm_list(tl);
+					tl->next=tl->prev=0;
 #ifdef TIMER_DEBUG
-				tl->expires_no++;
+					tl->expires_no++;
 #endif
-				SET_RUNNING_SLOW(tl);
-				UNLOCK_SLOW_TIMER_LIST();
-					ret=tl->f(*ticks, tl, tl->data);
-					/* reset the configuration group handles */
-					cfg_reset_all();
-					if (ret==0){
-						/* one shot */
-						UNSET_RUNNING_SLOW();
-						LOCK_SLOW_TIMER_LIST();
-					}else{
-						/* not one shot, re-add it */
-						LOCK_TIMER_LIST(); /* add it to the "main"  list */
-							RESET_SLOW_LIST(tl);
-							if (ret!=(ticks_t)-1) /* != periodic */
-								tl->initial_timeout=ret;
-							_timer_add(*ticks, tl);
-						UNLOCK_TIMER_LIST();
-						LOCK_SLOW_TIMER_LIST();
-						UNSET_RUNNING_SLOW();
-					}
+					SET_RUNNING_SLOW(tl);
+					UNLOCK_SLOW_TIMER_LIST();
+						ret=tl->f(*ticks, tl, tl->data);
+						/* reset the configuration group handles */
+						cfg_reset_all();
+						if (ret==0){
+							/* one shot */
+							UNSET_RUNNING_SLOW();
+							LOCK_SLOW_TIMER_LIST();
+						}else{
+							/* not one shot, re-add it to the "main" list */
+							ts=timer_shard(tl);
+							LOCK_TIMER_LIST(ts);
+								RESET_SLOW_LIST(tl);
+								if (ret!=(ticks_t)-1) /* != periodic */
+									tl->initial_timeout=ret;
+								_timer_add(*ticks, tl);
+							UNLOCK_TIMER_LIST(ts);
+							LOCK_SLOW_TIMER_LIST();
+							UNSET_RUNNING_SLOW();
+						}
+				}
 			}
 			(*s_idx)++;
 		}
@@ -79,7 +79,16 @@ struct timer_lists{
 	struct timer_head  expired; /* list of expired entries */
 };
 
+/* timer shards: timer_lst[timer_shards_no], each protected by its own lock;
+ * a timer always goes in the same shard, selected by its address */
 extern struct timer_lists* timer_lst;
+extern unsigned int timer_shards_no;
+
+#define TIMER_SHARDS_MAX 64
+
+#define timer_shard(tl) \
+	((unsigned int)((((unsigned long)(tl))>>4) ^ \
+					(((unsigned long)(tl))>>12)) & (timer_shards_no-1))
 
 
 #define _timer_init_list(head)	clist_init((head), next, prev)
@@ -104,29 +113,30 @@ extern struct timer_lists* timer_lst;
  * from current time to the timer desired expire (should be tl->expire-*tick)
  * If you don't know delta, you probably want to call _timer_add instead.
  */
-static inline int _timer_dist_tl(struct timer_ln* tl, ticks_t delta)
+static inline int _timer_dist_tl(struct timer_lists* tls,
+									struct timer_ln* tl, ticks_t delta)
 {
 	if (delta<H0_ENTRIES){
 		if (delta==0){
 			LM_WARN("0 expire timer added\n");
-			_timer_add_list(&timer_lst->expired, tl);
+			_timer_add_list(&tls->expired, tl);
 		}else{
-			_timer_add_list( &timer_lst->h0[tl->expire & H0_MASK], tl);
+			_timer_add_list( &tls->h0[tl->expire & H0_MASK], tl);
 		}
 	}else if (delta<(H0_ENTRIES*H1_ENTRIES)){
-		_timer_add_list(&timer_lst->h1[(tl->expire & H1_H0_MASK)>>H0_BITS],tl);
+		_timer_add_list(&tls->h1[(tl->expire & H1_H0_MASK)>>H0_BITS],tl);
 	}else{
-		_timer_add_list(&timer_lst->h2[tl->expire>>(H1_BITS+H0_BITS)], tl);
+		_timer_add_list(&tls->h2[tl->expire>>(H1_BITS+H0_BITS)], tl);
 	}
 	return 0;
 }
 
 
 
-#define _timer_mv_expire(h) \
+#define _timer_mv_expire(tls, h) \
 	do{ \
 		if ((h)->next!=(struct timer_ln*)(h)){ \
-			clist_append_sublist(&timer_lst->expired, (h)->next, \
+			clist_append_sublist(&(tls)->expired, (h)->next, \
 									(h)->prev, next, prev); \
 			_timer_init_list(h); \
 		} \
@@ -135,35 +145,36 @@ static inline int _timer_dist_tl(struct timer_ln* tl, ticks_t delta)
 
 #if 1
 
-static inline void timer_redist(ticks_t t, struct timer_head *h)
+static inline void timer_redist(struct timer_lists* tls, ticks_t t,
+									struct timer_head *h)
 {
 	struct timer_ln* tl;
 	struct timer_ln* tmp;
 	
 	timer_foreach_safe(tl, tmp, h){
-		_timer_dist_tl(tl, tl->expire-t);
+		_timer_dist_tl(tls, tl, tl->expire-t);
 	}
 	/* clear the current list */
 	_timer_init_list(h);
 }
 
-static inline void timer_run(ticks_t t)
+static inline void timer_run(struct timer_lists* tls, ticks_t t)
 {
 	struct timer_head *thp;
 
 	/* trust the compiler for optimizing */
 	if ((t & H0_MASK)==0){              /*r1*/
 		if ((t & H1_H0_MASK)==0){        /*r2*/
-			timer_redist(t, &timer_lst->h2[t>>(H0_BITS+H1_BITS)]);
+			timer_redist(tls, t, &tls->h2[t>>(H0_BITS+H1_BITS)]);
 		}
 		
-		timer_redist(t, &timer_lst->h1[(t & H1_H0_MASK)>>H0_BITS]);/*r2 >> H0*/
+		timer_redist(tls, t, &tls->h1[(t & H1_H0_MASK)>>H0_BITS]);/*r2 >> H0*/
 	}
 	/*
 	DBG("timer_run: ticks %u, expire h0[%u]\n",
 						(unsigned ) t, (unsigned)(t & H0_MASK));*/
-	thp = &timer_lst->h0[t & H0_MASK];
-	_timer_mv_expire(thp);  /*r1*/
+	thp = &tls->h0[t & H0_MASK];
+	_timer_mv_expire(tls, thp);  /*r1*/
 }
 #else
 
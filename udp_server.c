@@ -26,6 +26,12 @@
  * Module: @ref core
  */
 
+#if defined(HAVE_RECVMMSG) || defined(HAVE_SENDMMSG) || defined(__OS_linux)
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* for recvmmsg()/sendmmsg() and the cpu affinity macros */
+#endif
+#endif
+
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
@@ -38,6 +44,9 @@
 #ifdef __linux__
 	#include <linux/types.h>
 	#include <linux/errqueue.h>
+	#include <linux/filter.h>
+	#include <sched.h>
+	#include <unistd.h>
 #endif
 
 
@@ -283,6 +292,18 @@ int udp_init(struct socket_info* sock_info)
 		LM_ERR("setsockopt: %s\n", strerror(errno));
 		goto error;
 	}
+#ifdef SO_REUSEPORT
+	/* allow one socket per worker on the same address (multicast
+	 * receivers are never sharded) */
+	if (udp_reuse_port && !(sock_info->flags & SI_IS_MCAST)){
+		optval=1;
+		if (setsockopt(sock_info->socket, SOL_SOCKET, SO_REUSEPORT,
+						(void*)&optval, sizeof(optval)) ==-1){
+			LM_ERR("setsockopt SO_REUSEPORT: %s\n", strerror(errno));
+			goto error;
+		}
+	}
+#endif
 	/* tos */
 	optval = tos;
 	if (addr->s.sa_family==AF_INET){
@@ -380,6 +401,417 @@ error:
 
 
 
+#if defined(SO_REUSEPORT) && defined(SO_ATTACH_REUSEPORT_CBPF)
+/* attaches to the reuse port group of sock_info a classic bpf program
+ * steering each datagram to the socket with the index of the cpu that
+ * handled it (cpu % group size)
+ * returns 0 on success, -1 on error */
+static int udp_reuse_port_steering(struct socket_info* sock_info)
+{
+	struct sock_filter code[] = {
+		/* A = current cpu */
+		{ BPF_LD | BPF_W | BPF_ABS, 0, 0, SKF_AD_OFF + SKF_AD_CPU },
+		/* A = A % rp_socket_no */
+		{ BPF_ALU | BPF_MOD | BPF_K, 0, 0, sock_info->rp_socket_no },
+		/* return A - index of the socket in the group */
+		{ BPF_RET | BPF_A, 0, 0, 0 },
+	};
+	struct sock_fprog prog;
+
+	prog.len=sizeof(code)/sizeof(code[0]);
+	prog.filter=code;
+	if (setsockopt(sock_info->rp_socket[0], SOL_SOCKET,
+				SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog))==-1){
+		LM_ERR("setsockopt SO_ATTACH_REUSEPORT_CBPF on %.*s: %s\n",
+				sock_info->sock_str.len, sock_info->sock_str.s,
+				strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+#endif
+
+
+
+/* opens the extra SO_REUSEPORT sockets for an udp listener served by n
+ * workers - the worker with index k will receive on rp_socket[k]
+ * (rp_socket[0] is the socket opened by udp_init())
+ * returns 0 on success, -1 on error */
+int udp_init_reuse_port(struct socket_info* sock_info, int n)
+{
+#ifdef SO_REUSEPORT
+	int sock;
+	int i;
+#if defined(__OS_linux) && defined(SO_ATTACH_REUSEPORT_CBPF)
+	long ncpus;
+#endif
+
+	if (n<=1 || (sock_info->flags & SI_IS_MCAST))
+		return 0;
+	sock_info->rp_socket=(int*)pkg_malloc(n*sizeof(int));
+	if (sock_info->rp_socket==0){
+		LM_ERR("out of pkg memory\n");
+		return -1;
+	}
+	sock=sock_info->socket;
+	sock_info->rp_socket[0]=sock;
+	sock_info->rp_socket_no=1;
+	for (i=1; i<n; i++){
+		/* udp_init() opens, sets up and binds a new socket in ->socket */
+		if (udp_init(sock_info)==-1){
+			sock_info->socket=sock;
+			return -1;
+		}
+		sock_info->rp_socket[i]=sock_info->socket;
+		sock_info->rp_socket_no++;
+	}
+	sock_info->socket=sock;
+	LM_DBG("%d SO_REUSEPORT sockets opened for %.*s\n", n,
+			sock_info->sock_str.len, sock_info->sock_str.s);
+	if (udp_reuse_port>1){
+#if defined(__OS_linux) && defined(SO_ATTACH_REUSEPORT_CBPF)
+		ncpus=sysconf(_SC_NPROCESSORS_ONLN);
+		if (ncpus>0 && n>ncpus){
+			/* the extra workers would never get anything */
+			LM_WARN("more workers (%d) than cpus (%ld) for %.*s -"
+					" cpu steering disabled\n", n, ncpus,
+					sock_info->sock_str.len, sock_info->sock_str.s);
+		} else if (udp_reuse_port_steering(sock_info)<0){
+			return -1;
+		}
+#else
+		LM_WARN("cpu steering for SO_REUSEPORT sockets not supported\n");
+#endif
+	}
+	return 0;
+#else
+	LM_WARN("SO_REUSEPORT not supported, udp_reuse_port ignored\n");
+	return 0;
+#endif /* SO_REUSEPORT */
+}
+
+
+
+/* called in the udp worker with index idx after fork: the worker receives
+ * and sends by default on its own socket; with cpu steering it is also
+ * pinned on the cpus whose datagrams are steered to that socket (cpu % group
+ * size == idx), out of the cpus the process is allowed to run on (taskset,
+ * cgroups). If none of them is allowed, it is pinned on one allowed cpu,
+ * picked by idx. */
+void udp_reuse_port_child_init(struct socket_info* sock_info, int idx)
+{
+#if defined(__OS_linux) && defined(SO_ATTACH_REUSEPORT_CBPF)
+	cpu_set_t allowed;
+	cpu_set_t cpus;
+	int nallowed;
+	int cpu;
+	int k;
+#endif
+
+	if (idx<0 || idx>=sock_info->rp_socket_no)
+		return;
+	sock_info->socket=sock_info->rp_socket[idx];
+#if defined(__OS_linux) && defined(SO_ATTACH_REUSEPORT_CBPF)
+	if (udp_reuse_port>1 && sock_info->rp_socket_no
+			<=sysconf(_SC_NPROCESSORS_ONLN)){
+		if (sched_getaffinity(0, sizeof(allowed), &allowed)==-1){
+			LM_WARN("could not get the cpu affinity of worker %d: %s\n",
+					idx, strerror(errno));
+			return;
+		}
+		nallowed=CPU_COUNT(&allowed);
+		if (nallowed<=0)
+			return;
+		CPU_ZERO(&cpus);
+		for (cpu=idx; cpu<CPU_SETSIZE; cpu+=sock_info->rp_socket_no)
+			if (CPU_ISSET(cpu, &allowed))
+				CPU_SET(cpu, &cpus);
+		if (CPU_COUNT(&cpus)==0){
+			/* the steered cpus are not allowed, use the idx-th allowed one */
+			k=idx%nallowed;
+			for (cpu=0; cpu<CPU_SETSIZE; cpu++)
+				if (CPU_ISSET(cpu, &allowed) && k--==0)
+					break;
+			CPU_SET(cpu, &cpus);
+			LM_WARN("no allowed cpu steered to worker %d, pinned on cpu %d\n",
+					idx, cpu);
+		}
+		if (sched_setaffinity(0, sizeof(cpus), &cpus)==-1)
+			LM_WARN("could not bind worker %d to its cpus: %s\n", idx,
+					strerror(errno));
+	}
+#endif
+}
+
+
+
+/* process one datagram received on bind_address
+ * - buf must have room for the terminating 0 (buf[len]) and ri->src_su
+ *   must be already set
+ * - the datagram is consumed (passed to receive_msg() or to the stun code)
+ *   or dropped
+ * returns 0 if the datagram was processed, -1 if it was dropped */
+static int udp_rcv_dgram(char* buf, unsigned len, struct receive_info* ri)
+{
+	char *tmp;
+
+	/* we must 0-term the messages, receive_msg expects it */
+	buf[len]=0; /* no need to save the previous char */
+
+	su2ip_addr(&ri->src_ip, &ri->src_su);
+	ri->src_port=su_getport(&ri->src_su);
+
+	if(unlikely(sr_event_enabled(SREV_NET_DGRAM_IN)))
+	{
+		void *sredp[3];
+		sredp[0] = (void*)buf;
+		sredp[1] = (void*)(&len);
+		sredp[2] = (void*)ri;
+		if(sr_event_exec(SREV_NET_DGRAM_IN, (void*)sredp)<0) {
+			/* data handled by callback - continue to next packet */
+			return -1;
+		}
+	}
+#ifndef NO_ZERO_CHECKS
+	if (!unlikely(sr_event_enabled(SREV_STUN_IN)) || (unsigned char)*buf != 0x00) {
+		if (len<MIN_UDP_PACKET) {
+			tmp=ip_addr2a(&ri->src_ip);
+			LM_DBG("probing packet received from %s %d\n", tmp, htons(ri->src_port));
+			return -1;
+		}
+	}
+/* historically, zero-terminated packets indicated a bug in clients
+ * that calculated wrongly packet length and included string-terminating
+ * zero; today clients exist with legitimate binary payloads and we
+ * shall not check for zero-terminated payloads
+ */
+#ifdef TRASH_ZEROTERMINATED_PACKETS
+	if (buf[len-1]==0) {
+		tmp=ip_addr2a(&ri->src_ip);
+		LM_WARN("upstream bug - 0-terminated packet from %s %d\n",
+				tmp, htons(ri->src_port));
+		len--;
+	}
+#endif
+#endif
+#ifdef DBG_MSG_QA
+	if (!dbg_msg_qa(buf, len)) {
+		LM_WARN("an incoming message didn't pass test,"
+					"  drop it: %.*s\n", len, buf );
+		return -1;
+	}
+#endif
+	if (ri->src_port==0){
+		tmp=ip_addr2a(&ri->src_ip);
+		LM_INFO("dropping 0 port packet from %s\n", tmp);
+		return -1;
+	}
+
+	/* update the local config */
+	cfg_update();
+	if (unlikely(sr_event_enabled(SREV_STUN_IN)) && (unsigned char)*buf == 0x00) {
+		/* stun_process_msg releases buf memory if necessary */
+		if ((stun_process_msg(buf, len, ri)) != 0) {
+			return -1; /* some error occurred */
+		}
+	} else {
+		/* receive_msg must free buf too!*/
+		receive_msg(buf, len, ri);
+	}
+	return 0;
+}
+
+
+
+#ifdef HAVE_SENDMMSG
+/* queue of udp datagrams waiting to be sent with sendmmsg()
+ * - it is active (udp_snd_q!=0) only in an udp receiver that runs with
+ *   udp_snd_batch and only while it processes a received batch, so that
+ *   the replies and the forwarded requests generated by it leave in a
+ *   few syscalls */
+struct udp_snd_queue {
+	int n;       /* queued datagrams */
+	int max;     /* queue size */
+	int* socks;  /* socket for each datagram */
+	char** bufs; /* private (pkg) copies of the datagrams */
+	union sockaddr_union* to;
+	struct iovec* iov;
+	struct mmsghdr* msgs;
+};
+
+static struct udp_snd_queue udp_snd_batch_q;
+static struct udp_snd_queue* udp_snd_q = 0;
+
+
+
+static int udp_snd_queue_init(struct udp_snd_queue* q, int max)
+{
+	memset(q, 0, sizeof(*q));
+	q->socks=pkg_malloc(max*sizeof(*q->socks));
+	q->bufs=pkg_malloc(max*sizeof(*q->bufs));
+	q->to=pkg_malloc(max*sizeof(*q->to));
+	q->iov=pkg_malloc(max*sizeof(*q->iov));
+	q->msgs=pkg_malloc(max*sizeof(*q->msgs));
+	if (q->socks==0 || q->bufs==0 || q->to==0 || q->iov==0 || q->msgs==0){
+		LM_ERR("out of pkg memory\n");
+		return -1;
+	}
+	q->max=max;
+	return 0;
+}
+
+
+
+/* sends all the queued datagrams
+ * - sendmmsg() works on a single socket, so consecutive datagrams
+ *   on the same socket are grouped in one call */
+static void udp_snd_queue_flush(struct udp_snd_queue* q)
+{
+	int i, j, k, n;
+	struct ip_addr ip; /* used only on error, for debugging */
+
+	for (i=0; i<q->n; i=j){
+		for (j=i+1; j<q->n && q->socks[j]==q->socks[i]; j++);
+		k=i;
+		while (k<j){
+			n=sendmmsg(q->socks[i], &q->msgs[k], j-k, 0);
+			if (unlikely(n==-1)){
+				if (errno==EINTR) continue;
+				su2ip_addr(&ip, &q->to[k]);
+				LM_ERR("sendmmsg(sock,%p,%u,0,%s:%d): %s(%d)\n",
+						q->bufs[k], (unsigned)q->iov[k].iov_len,
+						ip_addr2a(&ip), su_getport(&q->to[k]),
+						strerror(errno), errno);
+				k++; /* drop the failed datagram and go on with the rest */
+				continue;
+			}
+			k+=n;
+		}
+	}
+	for (i=0; i<q->n; i++)
+		pkg_free(q->bufs[i]);
+	q->n=0;
+}
+
+
+
+/* queues a copy of the iovcnt chunks in iov (len bytes in total) as one
+ * datagram for sending over dst->send_sock
+ * returns len on success, -1 on error */
+static int udp_snd_queue_add(struct udp_snd_queue* q, struct dest_info* dst,
+								struct iovec* iov, int iovcnt, unsigned len)
+{
+	char* b;
+	char* p;
+	int i;
+
+	if (unlikely(q->n==q->max))
+		udp_snd_queue_flush(q);
+	b=pkg_malloc(len);
+	if (unlikely(b==0)){
+		LM_ERR("out of pkg memory\n");
+		return -1;
+	}
+	for (i=0, p=b; i<iovcnt; p+=iov[i].iov_len, i++)
+		memcpy(p, iov[i].iov_base, iov[i].iov_len);
+	q->socks[q->n]=dst->send_sock->socket;
+	q->bufs[q->n]=b;
+	q->to[q->n]=dst->to;
+	q->iov[q->n].iov_base=b;
+	q->iov[q->n].iov_len=len;
+	memset(&q->msgs[q->n], 0, sizeof(q->msgs[q->n]));
+	q->msgs[q->n].msg_hdr.msg_name=&q->to[q->n];
+	q->msgs[q->n].msg_hdr.msg_namelen=sockaddru_len(dst->to);
+	q->msgs[q->n].msg_hdr.msg_iov=&q->iov[q->n];
+	q->msgs[q->n].msg_hdr.msg_iovlen=1;
+	q->n++;
+	return len;
+}
+#endif /* HAVE_SENDMMSG */
+
+
+
+#ifdef HAVE_RECVMMSG
+/* udp receive loop reading up to udp_rcv_batch datagrams with one
+ * recvmmsg() call into a per process ring of buffers
+ * - the buffers are allocated from system memory, not to eat from PKG
+ *   (same as the static buffer from PKG pov)
+ * - never returns on success */
+static int udp_rcv_batch_loop(struct receive_info* ri)
+{
+	int n;
+	int i;
+	int cnt;
+	char* bufs;
+	union sockaddr_union* from;
+	struct iovec* iov;
+	struct mmsghdr* msgs;
+
+	n=udp_rcv_batch;
+	if (n>UDP_RCV_BATCH_MAX) n=UDP_RCV_BATCH_MAX;
+	bufs=malloc(n*(BUF_SIZE+1));
+	from=malloc(n*sizeof(*from));
+	iov=malloc(n*sizeof(*iov));
+	msgs=malloc(n*sizeof(*msgs));
+	if (bufs==0 || from==0 || iov==0 || msgs==0){
+		LM_ERR("could not allocate the receive buffers\n");
+		goto error;
+	}
+#ifdef HAVE_SENDMMSG
+	if (udp_snd_batch && udp_snd_queue_init(&udp_snd_batch_q, 2*n)<0)
+		goto error;
+#endif
+	LM_DBG("receiving up to %d datagrams per call on %.*s\n", n,
+			bind_address->sock_str.len, bind_address->sock_str.s);
+
+	for(;;){
+		for (i=0; i<n; i++){
+			iov[i].iov_base=bufs+i*(BUF_SIZE+1);
+			iov[i].iov_len=BUF_SIZE;
+			memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+			msgs[i].msg_hdr.msg_name=&from[i];
+			msgs[i].msg_hdr.msg_namelen=sockaddru_len(bind_address->su);
+			msgs[i].msg_hdr.msg_iov=&iov[i];
+			msgs[i].msg_hdr.msg_iovlen=1;
+		}
+		/* block only until the first datagram is available */
+		cnt=recvmmsg(bind_address->socket, msgs, n, MSG_WAITFORONE, 0);
+		if (cnt==-1){
+			if (errno==EAGAIN){
+				LM_DBG("packet with bad checksum received\n");
+				continue;
+			}
+			LM_ERR("recvmmsg:[%d] %s\n", errno, strerror(errno));
+			if ((errno==EINTR)||(errno==EWOULDBLOCK)|| (errno==ECONNREFUSED))
+				continue;
+			else goto error;
+		}
+#ifdef HAVE_SENDMMSG
+		if (udp_snd_batch) udp_snd_q=&udp_snd_batch_q;
+#endif
+		for (i=0; i<cnt; i++){
+			ri->src_su=from[i];
+			udp_rcv_dgram(iov[i].iov_base, msgs[i].msg_len, ri);
+		}
+#ifdef HAVE_SENDMMSG
+		if (udp_snd_q){
+			udp_snd_q=0;
+			udp_snd_queue_flush(&udp_snd_batch_q);
+		}
+#endif
+	}
+
+error:
+	if (bufs) free(bufs);
+	if (from) free(from);
+	if (iov) free(iov);
+	if (msgs) free(msgs);
+	return -1;
+}
+#endif /* HAVE_RECVMMSG */
+
+
+
 int udp_rcv_loop()
 {
 	unsigned len;
@@ -388,7 +820,6 @@ int udp_rcv_loop()
 #else
 	static char buf [BUF_SIZE+1];
 #endif
-	char *tmp;
 	union sockaddr_union* from;
 	unsigned int fromlen;
 	struct receive_info ri;
@@ -409,6 +840,18 @@ int udp_rcv_loop()
 	/* initialize the config framework */
 	if (cfg_child_init()) goto error;
 
+#ifdef HAVE_RECVMMSG
+#ifndef DYN_BUF
+	if (udp_rcv_batch>1){
+		pkg_free(from);
+		return udp_rcv_batch_loop(&ri);
+	}
+#else
+	if (udp_rcv_batch>1)
+		LM_WARN("udp_receive_batch ignored (DYN_BUF compile option)\n");
+#endif /* DYN_BUF */
+#endif /* HAVE_RECVMMSG */
+
 	for(;;){
 #ifdef DYN_BUF
 		buf=pkg_malloc(BUF_SIZE+1);
@@ -430,79 +873,18 @@ int udp_rcv_loop()
 				continue; /* goto skip;*/
 			else goto error;
 		}
-		/* we must 0-term the messages, receive_msg expects it */
-		buf[len]=0; /* no need to save the previous char */
 
 		ri.src_su=*from;
-		su2ip_addr(&ri.src_ip, from);
-		ri.src_port=su_getport(from);
+		udp_rcv_dgram(buf, len, &ri);
 
-		if(unlikely(sr_event_enabled(SREV_NET_DGRAM_IN)))
-		{
-			void *sredp[3];
-			sredp[0] = (void*)buf;
-			sredp[1] = (void*)(&len);
-			sredp[2] = (void*)(&ri);
-			if(sr_event_exec(SREV_NET_DGRAM_IN, (void*)sredp)<0) {
-				/* data handled by callback - continue to next packet */
-				continue;
-			}
-		}
-#ifndef NO_ZERO_CHECKS
-		if (!unlikely(sr_event_enabled(SREV_STUN_IN)) || (unsigned char)*buf != 0x00) {
-			if (len<MIN_UDP_PACKET) {
-				tmp=ip_addr2a(&ri.src_ip);
-				LM_DBG("probing packet received from %s %d\n", tmp, htons(ri.src_port));
-				continue;
-			}
-		}
-/* historically, zero-terminated packets indicated a bug in clients
- * that calculated wrongly packet length and included string-terminating
- * zero; today clients exist with legitimate binary payloads and we
- * shall not check for zero-terminated payloads
- */
-#ifdef TRASH_ZEROTERMINATED_PACKETS
-		if (buf[len-1]==0) {
-			tmp=ip_addr2a(&ri.src_ip);
-			LM_WARN("upstream bug - 0-terminated packet from %s %d\n",
-					tmp, htons(ri.src_port));
-			len--;
-		}
-#endif
-#endif
-#ifdef DBG_MSG_QA
-		if (!dbg_msg_qa(buf, len)) {
-			LM_WARN("an incoming message didn't pass test,"
-						"  drop it: %.*s\n", len, buf );
-			continue;
-		}
-#endif
-		if (ri.src_port==0){
-			tmp=ip_addr2a(&ri.src_ip);
-			LM_INFO("dropping 0 port packet from %s\n", tmp);
-			continue;
-		}
-		
-		/* update the local config */
-		cfg_update();
-		if (unlikely(sr_event_enabled(SREV_STUN_IN)) && (unsigned char)*buf == 0x00) {
-			/* stun_process_msg releases buf memory if necessary */
-			if ((stun_process_msg(buf, len, &ri)) != 0) {
-				continue; /* some error occurred */
-			}
-		} else {
-			/* receive_msg must free buf too!*/
-			receive_msg(buf, len, &ri);
-		}
-		
 	/* skip: do other stuff */
-		
+
 	}
 	/*
 	if (from) pkg_free(from);
 	return 0;
 	*/
-	
+
 error:
 	if (from) pkg_free(from);
 	return -1;
@@ -523,6 +905,9 @@ int udp_send(struct dest_info* dst, char *buf, unsigned len)
 #ifdef USE_RAW_SOCKS
 	int mtu;
 #endif /* USE_RAW_SOCKS */
+#ifdef HAVE_SENDMMSG
+	struct iovec v;
+#endif /* HAVE_SENDMMSG */
 
 #ifdef DBG_MSG_QA
 	/* aborts on error, does nothing otherwise */
@@ -537,6 +922,13 @@ int udp_send(struct dest_info* dst, char *buf, unsigned len)
 					dst->send_sock->address.af == AF_INET) )) {
 #endif /* USE_RAW_SOCKS */
 		/* normal send over udp socket */
+#ifdef HAVE_SENDMMSG
+		if (unlikely(udp_snd_q)){
+			v.iov_base=buf;
+			v.iov_len=len;
+			return udp_snd_queue_add(udp_snd_q, dst, &v, 1, len);
+		}
+#endif
 		tolen=sockaddru_len(dst->to);
 again:
 		n=sendto(dst->send_sock->socket, buf, len, 0, &dst->to.s, tolen);
@@ -575,3 +967,65 @@ raw_again:
 #endif /* USE_RAW_SOCKS */
 	return n;
 }
+
+
+
+/* send the iovcnt chunks in iov (len bytes in total) as one udp datagram
+ * to dst, with sendmsg(), without copying them first
+ * (uses only the to and send_sock dst members)
+ * returns the numbers of bytes sent on success (>=0) and -1 on error
+ */
+int udp_send_iov(struct dest_info* dst, struct iovec* iov, int iovcnt,
+					unsigned len)
+{
+	struct msghdr mh;
+	struct ip_addr ip; /* used only on error, for debugging */
+	char* buf;
+	char* p;
+	int flat;
+	int i;
+	int n;
+
+	flat=0;
+#ifdef DBG_MSG_QA
+	/* the message checks need the datagram in one buffer */
+	flat=1;
+#endif
+#ifdef USE_RAW_SOCKS
+	/* and the raw sockets too */
+	flat|=(raw_udp4_send_sock >= 0 &&
+			cfg_get(core, core_cfg, udp4_raw) &&
+			dst->send_sock->address.af == AF_INET);
+#endif /* USE_RAW_SOCKS */
+	if (unlikely(flat)){
+		buf=pkg_malloc(len);
+		if (unlikely(buf==0)){
+			LM_ERR("out of pkg memory\n");
+			return -1;
+		}
+		for (i=0, p=buf; i<iovcnt; p+=iov[i].iov_len, i++)
+			memcpy(p, iov[i].iov_base, iov[i].iov_len);
+		n=udp_send(dst, buf, len);
+		pkg_free(buf);
+		return n;
+	}
+#ifdef HAVE_SENDMMSG
+	if (unlikely(udp_snd_q))
+		return udp_snd_queue_add(udp_snd_q, dst, iov, iovcnt, len);
+#endif
+	memset(&mh, 0, sizeof(mh));
+	mh.msg_name=&dst->to.s;
+	mh.msg_namelen=sockaddru_len(dst->to);
+	mh.msg_iov=iov;
+	mh.msg_iovlen=iovcnt;
+again:
+	n=sendmsg(dst->send_sock->socket, &mh, 0);
+	if (unlikely(n==-1)){
+		su2ip_addr(&ip, &dst->to);
+		LM_ERR("sendmsg(sock,%d chunks,%u,0,%s:%d): %s(%d)\n",
+				iovcnt, len, ip_addr2a(&ip), su_getport(&dst->to),
+				strerror(errno), errno);
+		if (errno==EINTR) goto again;
+	}
+	return n;
+}
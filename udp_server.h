@@ -29,14 +29,20 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include "ip_addr.h"
 
 #define MAX_RECV_BUFFER_SIZE	256*1024
 #define BUFFER_INCREMENT	2048
+#define UDP_RCV_BATCH_MAX	64  /* max datagrams read with one recvmmsg() */
 
 
 int udp_init(struct socket_info* si);
+int udp_init_reuse_port(struct socket_info* si, int n);
+void udp_reuse_port_child_init(struct socket_info* si, int idx);
 int udp_send(struct dest_info* dst, char *buf, unsigned len);
+int udp_send_iov(struct dest_info* dst, struct iovec* iov, int iovcnt,
+					unsigned len);
 int udp_rcv_loop(void);
 
 